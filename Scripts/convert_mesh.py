@@ -0,0 +1,270 @@
+#
+#   This file is a part of Jiayin's Graphics Samples.
+#   Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+#
+
+# This script converts OBJ and glTF meshes to the binary mesh files of the samples, see 'common/mesh.h'.
+# It is supposed to be called this way
+#   convert_mesh.py [input.obj|input.gltf|input.glb] [output_filename] [--keep-positions]
+#
+# The samples have no camera, positions are fitted into clip space unless '--keep-positions' is specified. Vertices without a
+# color get one from their position so that the shape is still visible. Each object of an OBJ file and each primitive of a
+# glTF file is a submesh, all of them share the same vertex stream. Meshes are written without meshlets, they are built by
+# the mesh optimizer of the samples, '-optimize-mesh input output', or when the mesh is loaded.
+
+import sys
+import os
+import json
+import base64
+import struct
+
+MESH_FILE_MAGIC = 0x4853454d
+MESH_FILE_VERSION = 3
+MESH_FILE_ALIGNMENT = 64
+
+# Layout of 'Vertex' in common/common.h, float3 position and a 32 bits color. The hash has to match
+# 'get_vertex_layout_hash<Vertex>()', it is FNV-1a of the stride, then the semantic, format and offset of each attribute.
+VERTEX_STRIDE = 16
+VERTEX_ATTRIBUTES = [
+    # semantic, format, offset
+    (0, 1, 0),      # Position, Float3
+    (1, 3, 12),     # Color, UNorm8x4
+]
+
+HEADER_FORMAT = "<8I6f4Q4I4Q"
+STREAM_FORMAT = "<Q2I2Q"
+SUBMESH_FORMAT = "<4I"
+
+def fnv1a(hash, value, byte_cnt):
+    for i in range(byte_cnt):
+        hash ^= (value >> (i * 8)) & 0xff
+        hash = (hash * 1099511628211) & 0xffffffffffffffff
+    return hash
+
+def vertex_layout_hash():
+    hash = fnv1a(14695981039346656037, VERTEX_STRIDE, 4)
+    for semantic, format, offset in VERTEX_ATTRIBUTES:
+        hash = fnv1a(hash, semantic, 1)
+        hash = fnv1a(hash, format, 1)
+        hash = fnv1a(hash, offset, 4)
+    return hash
+
+def align(offset):
+    return (offset + MESH_FILE_ALIGNMENT - 1) & ~(MESH_FILE_ALIGNMENT - 1)
+
+def pack_color(r, g, b, a = 1.0):
+    def to_byte(v):
+        return max(0, min(255, int(round(v * 255.0))))
+    return to_byte(r) | (to_byte(g) << 8) | (to_byte(b) << 16) | (to_byte(a) << 24)
+
+class MeshBuilder:
+    def __init__(self):
+        self.positions = []
+        self.colors = []            # None for vertices without a color
+        self.indices = []
+        self.submeshes = []
+
+    # a submesh covers all indices added since the last one
+    def end_submesh(self, first_index):
+        index_cnt = len(self.indices) - first_index
+        if index_cnt == 0:
+            return
+        used = self.indices[first_index:]
+        first_vertex = min(used)
+        self.submeshes.append((first_index, index_cnt, first_vertex, max(used) + 1 - first_vertex))
+
+def load_obj(filename):
+    mesh = MeshBuilder()
+    first_index = 0
+    with open(filename, "r") as file:
+        for line in file:
+            tokens = line.split()
+            if not tokens:
+                continue
+            if tokens[0] == "v":
+                mesh.positions.append((float(tokens[1]), float(tokens[2]), float(tokens[3])))
+                # vertex colors are a common extension, 'v x y z r g b'
+                mesh.colors.append(tuple(float(t) for t in tokens[4:7]) if len(tokens) >= 7 else None)
+            elif tokens[0] == "f":
+                # only positions matter, 'v/vt/vn' is reduced to 'v', negative indices are relative to the end
+                corners = []
+                for token in tokens[1:]:
+                    index = int(token.split("/")[0])
+                    corners.append(index - 1 if index > 0 else len(mesh.positions) + index)
+                # polygons are triangulated as fans
+                for i in range(1, len(corners) - 1):
+                    mesh.indices += [corners[0], corners[i], corners[i + 1]]
+            elif tokens[0] in ("o", "g"):
+                mesh.end_submesh(first_index)
+                first_index = len(mesh.indices)
+    mesh.end_submesh(first_index)
+    return mesh
+
+COMPONENT_FORMATS = { 5120: "b", 5121: "B", 5122: "h", 5123: "H", 5125: "I", 5126: "f" }
+COMPONENT_MAX = { 5120: 127.0, 5121: 255.0, 5122: 32767.0, 5123: 65535.0 }
+TYPE_COMPONENTS = { "SCALAR": 1, "VEC2": 2, "VEC3": 3, "VEC4": 4 }
+
+def load_gltf_buffers(filename, gltf, glb_chunk):
+    buffers = []
+    for buffer in gltf.get("buffers", []):
+        uri = buffer.get("uri")
+        if uri is None:
+            buffers.append(glb_chunk)
+        elif uri.startswith("data:"):
+            buffers.append(base64.b64decode(uri.split(",", 1)[1]))
+        else:
+            with open(os.path.join(os.path.dirname(filename), uri), "rb") as file:
+                buffers.append(file.read())
+    return buffers
+
+def read_accessor(gltf, buffers, index):
+    accessor = gltf["accessors"][index]
+    view = gltf["bufferViews"][accessor["bufferView"]]
+    data = buffers[view["buffer"]]
+    component = COMPONENT_FORMATS[accessor["componentType"]]
+    component_cnt = TYPE_COMPONENTS[accessor["type"]]
+    element = struct.Struct("<" + component * component_cnt)
+    stride = view.get("byteStride", element.size)
+    offset = view.get("byteOffset", 0) + accessor.get("byteOffset", 0)
+
+    values = [element.unpack_from(data, offset + i * stride) for i in range(accessor["count"])]
+    if accessor.get("normalized", False):
+        scale = COMPONENT_MAX.get(accessor["componentType"], 1.0)
+        values = [tuple(max(v / scale, -1.0) for v in value) for value in values]
+    return values
+
+def multiply(a, b):
+    # column major 4x4 matrices, as glTF stores them
+    return [sum(a[k * 4 + r] * b[c * 4 + k] for k in range(4)) for c in range(4) for r in range(4)]
+
+def node_matrix(node):
+    if "matrix" in node:
+        return node["matrix"]
+    tx, ty, tz = node.get("translation", [0.0, 0.0, 0.0])
+    qx, qy, qz, qw = node.get("rotation", [0.0, 0.0, 0.0, 1.0])
+    sx, sy, sz = node.get("scale", [1.0, 1.0, 1.0])
+    return [
+        (1 - 2 * (qy * qy + qz * qz)) * sx, (2 * (qx * qy + qz * qw)) * sx, (2 * (qx * qz - qy * qw)) * sx, 0.0,
+        (2 * (qx * qy - qz * qw)) * sy, (1 - 2 * (qx * qx + qz * qz)) * sy, (2 * (qy * qz + qx * qw)) * sy, 0.0,
+        (2 * (qx * qz + qy * qw)) * sz, (2 * (qy * qz - qx * qw)) * sz, (1 - 2 * (qx * qx + qy * qy)) * sz, 0.0,
+        tx, ty, tz, 1.0 ]
+
+def load_gltf(filename):
+    glb_chunk = None
+    with open(filename, "rb") as file:
+        data = file.read()
+    if data[:4] == b"glTF":
+        # a binary glTF is a JSON chunk followed by an optional binary chunk
+        json_length, = struct.unpack_from("<I", data, 12)
+        gltf = json.loads(data[20:20 + json_length].decode("utf-8"))
+        bin_offset = 20 + json_length
+        if bin_offset + 8 <= len(data):
+            bin_length, = struct.unpack_from("<I", data, bin_offset)
+            glb_chunk = data[bin_offset + 8:bin_offset + 8 + bin_length]
+    else:
+        gltf = json.loads(data.decode("utf-8"))
+    buffers = load_gltf_buffers(filename, gltf, glb_chunk)
+
+    mesh = MeshBuilder()
+    def add_mesh(index, matrix):
+        for primitive in gltf["meshes"][index]["primitives"]:
+            if primitive.get("mode", 4) != 4:
+                print("Skipping a primitive that is not a triangle list.", file=sys.stderr)
+                continue
+            attributes = primitive["attributes"]
+            positions = read_accessor(gltf, buffers, attributes["POSITION"])
+            colors = read_accessor(gltf, buffers, attributes["COLOR_0"]) if "COLOR_0" in attributes else [None] * len(positions)
+            indices = [i[0] for i in read_accessor(gltf, buffers, primitive["indices"])] if "indices" in primitive else list(range(len(positions)))
+
+            base = len(mesh.positions)
+            first_index = len(mesh.indices)
+            for x, y, z in positions:
+                mesh.positions.append(tuple(matrix[r] * x + matrix[4 + r] * y + matrix[8 + r] * z + matrix[12 + r] for r in range(3)))
+            mesh.colors += [c[:3] if c else None for c in colors]
+            mesh.indices += [base + i for i in indices]
+            mesh.end_submesh(first_index)
+
+    def visit(index, parent):
+        node = gltf["nodes"][index]
+        matrix = multiply(parent, node_matrix(node))
+        if "mesh" in node:
+            add_mesh(node["mesh"], matrix)
+        for child in node.get("children", []):
+            visit(child, matrix)
+
+    identity = [1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0, 0.0, 0.0, 0.0, 0.0, 1.0]
+    scenes = gltf.get("scenes")
+    if scenes:
+        for node in scenes[gltf.get("scene", 0)].get("nodes", []):
+            visit(node, identity)
+    else:
+        for index in range(len(gltf.get("meshes", []))):
+            add_mesh(index, identity)
+    return mesh
+
+def get_bounds(positions):
+    if not positions:
+        return [0.0] * 3, [0.0] * 3
+    return [min(p[k] for p in positions) for k in range(3)], [max(p[k] for p in positions) for k in range(3)]
+
+# x and y are scaled uniformly into [-0.9, 0.9], z into [0, 1]
+def fit_into_clip_space(mesh):
+    lower, upper = get_bounds(mesh.positions)
+    center = [(lower[k] + upper[k]) * 0.5 for k in range(3)]
+    extent = max(upper[0] - lower[0], upper[1] - lower[1]) * 0.5
+    scale = 0.9 / extent if extent > 0.0 else 1.0
+    depth = upper[2] - lower[2]
+    mesh.positions = [((p[0] - center[0]) * scale, (p[1] - center[1]) * scale, (p[2] - lower[2]) / depth if depth > 0.0 else 0.0) for p in mesh.positions]
+
+def write_mesh(filename, mesh):
+    lower, upper = get_bounds(mesh.positions)
+    vertex_cnt = len(mesh.positions)
+    index_cnt = len(mesh.indices)
+    index_size = 2 if vertex_cnt <= 0x10000 else 4
+
+    stream_table_offset = align(struct.calcsize(HEADER_FORMAT))
+    submesh_table_offset = align(stream_table_offset + struct.calcsize(STREAM_FORMAT))
+    vertex_offset = align(submesh_table_offset + len(mesh.submeshes) * struct.calcsize(SUBMESH_FORMAT))
+    index_offset = align(vertex_offset + vertex_cnt * VERTEX_STRIDE)
+    file_size = index_offset + index_cnt * index_size
+
+    image = bytearray(file_size)
+    struct.pack_into(HEADER_FORMAT, image, 0, MESH_FILE_MAGIC, MESH_FILE_VERSION, struct.calcsize(HEADER_FORMAT), 1,
+                     len(mesh.submeshes), vertex_cnt, index_cnt, index_size, *lower, *upper,
+                     stream_table_offset, submesh_table_offset, index_offset, file_size, 0, 0, 0, 0, 0, 0, 0, 0)
+    struct.pack_into(STREAM_FORMAT, image, stream_table_offset, vertex_layout_hash(), VERTEX_STRIDE, 0, vertex_offset, vertex_cnt * VERTEX_STRIDE)
+    for i, submesh in enumerate(mesh.submeshes):
+        struct.pack_into(SUBMESH_FORMAT, image, submesh_table_offset + i * struct.calcsize(SUBMESH_FORMAT), *submesh)
+
+    vertex = struct.Struct("<3fI")
+    for i, (position, color) in enumerate(zip(mesh.positions, mesh.colors)):
+        if color is None:
+            # a color from the position within the bounding box
+            color = [(position[k] - lower[k]) / (upper[k] - lower[k]) if upper[k] > lower[k] else 1.0 for k in range(3)]
+        vertex.pack_into(image, vertex_offset + i * VERTEX_STRIDE, *position, pack_color(*color))
+    struct.pack_into("<%d%s" % (index_cnt, "H" if index_size == 2 else "I"), image, index_offset, *mesh.indices)
+
+    with open(filename, "wb") as file:
+        file.write(image)
+
+if __name__ == "__main__":
+    args = [arg for arg in sys.argv[1:] if not arg.startswith("--")]
+    if len(args) != 2:
+        print("Usage: convert_mesh.py [input.obj|input.gltf|input.glb] [output_filename] [--keep-positions]", file=sys.stderr)
+        exit(1)
+
+    in_filename, out_filename = args
+    extension = os.path.splitext(in_filename)[1].lower()
+    if extension == ".obj":
+        mesh = load_obj(in_filename)
+    elif extension in (".gltf", ".glb"):
+        mesh = load_gltf(in_filename)
+    else:
+        print("Unknown mesh format %s." % extension, file=sys.stderr)
+        exit(1)
+
+    if "--keep-positions" not in sys.argv:
+        fit_into_clip_space(mesh)
+
+    write_mesh(out_filename, mesh)
+    print("%s: %d vertices, %d triangles, %d submeshes" % (out_filename, len(mesh.positions), len(mesh.indices) // 3, len(mesh.submeshes)))
@@ -5,7 +5,8 @@
 
 # This script offers an interface to convert glsl code to spirv headers, which will be used during compiling.
 # It is supposed to be called this way
-#   generate_shader.py [shader_source_code] [output_filename] [glslangValidator.exe]
+#   generate_shader.py [shader_source_code] [output_filename] [glslangValidator.exe] [extra arguments of glslangValidator]
+# Extra arguments are passed to glslangValidator as they are, e.g. '--target-env spirv1.4' for mesh shaders.
 
 import os
 import sys
@@ -20,6 +21,7 @@ INDENT = 4
 in_filename     = sys.argv[1]
 out_filename    = sys.argv[2]
 executable      = sys.argv[3]
+extra_args      = sys.argv[4:]
 
 def identifierize(s):
     # translate invalid chars
@@ -32,7 +34,7 @@ def compile(filename, tmpfile):
     # invoke glslangValidator
     try:
         # spawn a process to generate shader binaries
-        args = [executable, "-V", "-H", "-o", tmpfile, filename]
+        args = [executable, "-V", "-H"] + extra_args + ["-o", tmpfile, filename]
         output = subprocess.check_output(args, universal_newlines=True)
     except subprocess.CalledProcessError as e:
         print(e.output, file=sys.stderr)
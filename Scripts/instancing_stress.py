@@ -0,0 +1,53 @@
+#
+#   This file is a part of Jiayin's Graphics Samples.
+#   Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+#
+
+# This script runs the benchmark of the single triangle sample with 1 to 1000000 instances, once with a draw call per instance
+# and once with a single instanced draw call, and prints the p50 of the frame time, the time of recording commands and the
+# GPU time of each run.
+# It is supposed to be called this way
+#   instancing_stress.py [benchmark executable] [extra arguments of the benchmark]
+# Extra arguments are passed to the benchmark as they are, e.g. '-backend vulkan -offscreen'.
+
+import os
+import sys
+import json
+import subprocess
+
+INSTANCE_COUNTS = [1, 10, 100, 1000, 10000, 100000, 1000000]
+FRAME_COUNT = 200
+
+executable  = sys.argv[1]
+extra_args  = sys.argv[2:]
+
+# run the benchmark once, returns the metrics of its json report
+def run(instance_cnt, instanced):
+    tmpfile = "instancing_stress.json.tmp"
+    args = [executable] + extra_args + ["-draws", str(instance_cnt), "-frames", str(FRAME_COUNT), "-json", tmpfile]
+    if instanced:
+        args.append("-instanced")
+
+    try:
+        subprocess.check_output(args, universal_newlines=True)
+    except subprocess.CalledProcessError as e:
+        print(e.output, file=sys.stderr)
+        return None
+
+    with open(tmpfile, "r") as f:
+        report = json.load(f)
+    os.remove(tmpfile)
+
+    return report["metrics"]
+
+def p50(metrics, name):
+    if metrics is None or name not in metrics or metrics[name]["count"] == 0:
+        return "-"
+    return "%.3f" % metrics[name]["p50"]
+
+print("%10s %10s %12s %12s %12s" % ("instances", "instanced", "frame_ms", "record_ms", "gpu_ms"))
+for instance_cnt in INSTANCE_COUNTS:
+    for instanced in [False, True]:
+        metrics = run(instance_cnt, instanced)
+        print("%10d %10s %12s %12s %12s" % (instance_cnt, "yes" if instanced else "no",
+            p50(metrics, "frame_ms"), p50(metrics, "record_ms"), p50(metrics, "gpu_ms")))
@@ -0,0 +1,586 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+/*
+    This is a benchmark of the sample, instead of rendering on demand, it renders a fixed number of frames as fast as possible.
+    The first few frames are for warming up and not measured, the following frames are measured and summarized as percentiles
+    of the time of each frame, along with the CPU time of recording commands, the time of waiting for fences and the GPU time.
+    It also reports the startup timeline, every step of initialization and the time it takes to get the first frame out. The
+    first frame is always rendered on its own for it, it counts as a warm up frame. Pipelines are compiled in the background,
+    warming up goes on until all of them are ready so that the measured frames draw everything.
+
+    Usage
+        bench [-backend d3d12|vulkan|software] [-offscreen] [-headless] [-present fifo|mailbox|immediate] [-low-latency] [-warmup N] [-frames N] [-width N] [-height N]
+              [-threads N] [-draws N] [-frames-in-flight N] [-instanced] [-gpu-culling] [-mesh filename] [-optimize] [-quantize] [-meshlets] [-json filename] [-csv filename] [-trace filename]
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <vector>
+#include <algorithm>
+#if PLATFORM_WIN
+#include <windows.h>
+#include "d3d12/d3d12_impl.h"
+#endif
+#include "vulkan/vulkan_impl.h"
+#include "software/software_impl.h"
+
+/*
+ * Everything measured in a frame, in milliseconds. Negative values mean the backend didn't report it.
+ */
+struct FrameRecord {
+    double  frame_ms = -1.0;            // time of 'render_frame' on CPU
+    double  record_ms = -1.0;           // time of recording commands
+    double  fence_wait_ms = -1.0;       // time of waiting for the GPU to catch up
+    double  gpu_ms = -1.0;              // time of the frame on GPU
+    double  pacing_ms = -1.0;           // time the frame is delayed to wait for the swap chain or for low latency pacing
+    double  latency_ms = -1.0;          // time from the beginning of the frame, once it is paced, to the end of it on GPU
+
+    // When the frame begins once it is paced and when it is done on GPU, latency is measured from them.
+    long long   input_ns = -1;
+    long long   gpu_end_ns = -1;
+};
+
+/*
+ * Summary of a metric over all measured frames.
+ */
+struct MetricSummary {
+    const char*     name = nullptr;
+    unsigned int    count = 0;
+    double          mean = 0.0;
+    double          p50 = 0.0;
+    double          p95 = 0.0;
+    double          p99 = 0.0;
+    double          max = 0.0;
+};
+
+// Usage of the transient memory, it is only valid if the backend has any transient memory.
+static TransientMemoryStats g_transient_stats;
+static bool         g_has_transient_stats = false;
+// Usage of GPU memory, it is only valid if the backend manages GPU memory itself.
+static GpuMemoryStats g_gpu_memory_stats;
+static bool         g_has_gpu_memory_stats = false;
+// Size of the vertices before and after encoding, it is only valid if the backend encodes vertices.
+static VertexEncodingStats g_vertex_encoding_stats;
+static bool         g_has_vertex_encoding_stats = false;
+// Cache efficiency of the mesh before and after optimization, it is only valid if the mesh is optimized.
+static MeshOptimizationStats g_mesh_optimization_stats;
+static bool         g_has_mesh_optimization_stats = false;
+// Meshes in the geometry pool and how much of it they use, it is only valid if the backend has a geometry pool.
+static GeometryPoolStats g_geometry_pool_stats;
+static bool         g_has_geometry_pool_stats = false;
+// Meshlet culling of the last frame read back, it is only valid if the backend draws meshlets.
+static MeshletStats g_meshlet_stats;
+static bool         g_has_meshlet_stats = false;
+// How frames are presented, it is only valid if the backend presents at all.
+static PresentStats g_present_stats;
+static bool         g_has_present_stats = false;
+// Instances drawn in each frame, it is only valid if the backend draws instances.
+static InstancingStats g_instancing_stats;
+static bool         g_has_instancing_stats = false;
+// GPU culling of the last frame read back, it is only valid if the backend culls objects on GPU.
+static GpuCullingStats g_gpu_culling_stats;
+static bool         g_has_gpu_culling_stats = false;
+
+// Render graph of the last frame, it is only valid if the backend records frames with a render graph.
+static RenderGraphStats g_render_graph_stats;
+static bool         g_has_render_graph_stats = false;
+
+// Startup timeline, in nanoseconds since the sample is created. Negative values mean it is unknown.
+static long long    g_initialized_ns = -1;
+static long long    g_first_frame_ns = -1;
+static long long    g_first_frame_gpu_ns = -1;
+// Zones recorded during initialization, from the earliest to the latest.
+static std::vector<ProfileEvent> g_startup_events;
+// Number of frames rendered while pipelines were still compiling, their draws were skipped or drawn with a fallback pipeline.
+static unsigned int g_pipeline_pending_frames = 0;
+
+// Options of the benchmark.
+static const char*  g_backend = "vulkan";
+static bool         g_offscreen = false;
+static unsigned int g_warmup_cnt = 100;
+static unsigned int g_frame_cnt = 1000;
+static unsigned int g_width = 1280;
+static unsigned int g_height = 720;
+static unsigned int g_thread_cnt = 0;
+static unsigned int g_draw_cnt = 1;
+static unsigned int g_frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+static bool         g_headless = false;
+static PresentMode  g_present_mode = PresentMode::Fifo;
+static bool         g_low_latency = false;
+static bool         g_instanced = false;
+static bool         g_gpu_culling = false;
+static const char*  g_mesh_filename = nullptr;
+static bool         g_optimize = false;
+static bool         g_quantize = false;
+static bool         g_meshlets = false;
+static const char*  g_json_filename = nullptr;
+static const char*  g_csv_filename = nullptr;
+static const char*  g_trace_filename = nullptr;
+
+
+/*
+ * Summarize one metric of the frames, frames that don't report the metric are ignored.
+ */
+static MetricSummary summarize(const char* name, const std::vector<FrameRecord>& records, double FrameRecord::* metric) {
+    std::vector<double> values;
+    values.reserve(records.size());
+    for (const auto& record : records) {
+        if (record.*metric >= 0.0)
+            values.push_back(record.*metric);
+    }
+
+    MetricSummary summary;
+    summary.name = name;
+    summary.count = (unsigned int)values.size();
+    if (values.empty())
+        return summary;
+
+    std::sort(values.begin(), values.end());
+
+    // nearest rank percentile
+    auto percentile = [&](const double p) {
+        const auto rank = (size_t)(p / 100.0 * values.size() + 0.5);
+        return values[std::min(values.size() - 1, rank > 0 ? rank - 1 : 0)];
+    };
+
+    for (const auto value : values)
+        summary.mean += value;
+    summary.mean /= values.size();
+    summary.p50 = percentile(50.0);
+    summary.p95 = percentile(95.0);
+    summary.p99 = percentile(99.0);
+    summary.max = values.back();
+
+    return summary;
+}
+
+
+/*
+ * Write the summary as a JSON file.
+ */
+static bool write_json(const char* filename, const std::vector<MetricSummary>& summaries) {
+    auto file = fopen(filename, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "{\n");
+    fprintf(file, "  \"sample\": \"2 - SingleTriangle\",\n");
+    fprintf(file, "  \"backend\": \"%s\",\n", g_backend);
+    fprintf(file, "  \"offscreen\": %s,\n", g_offscreen && !g_has_present_stats ? "true" : "false");
+    fprintf(file, "  \"headless\": %s,\n", g_headless ? "true" : "false");
+    fprintf(file, "  \"width\": %u,\n", g_width);
+    fprintf(file, "  \"height\": %u,\n", g_height);
+    fprintf(file, "  \"threads\": %u,\n", g_thread_cnt);
+    fprintf(file, "  \"draws\": %u,\n", g_draw_cnt);
+    fprintf(file, "  \"frames_in_flight\": %u,\n", g_frames_in_flight);
+    fprintf(file, "  \"warmup_frames\": %u,\n", g_warmup_cnt);
+    fprintf(file, "  \"frames\": %u,\n", g_frame_cnt);
+    if (g_has_present_stats)
+        fprintf(file, "  \"present\": { \"mode\": \"%s\", \"low_latency\": %s, \"waitable\": %s },\n", get_present_mode_name(g_present_stats.mode),
+            g_present_stats.low_latency ? "true" : "false", g_present_stats.waitable ? "true" : "false");
+    if (g_has_transient_stats)
+        fprintf(file, "  \"transient_memory\": { \"capacity\": %zu, \"high_water_mark\": %zu, \"failed\": %llu },\n",
+            g_transient_stats.capacity, g_transient_stats.high_water_mark, g_transient_stats.failed_cnt);
+    fprintf(file, "  \"startup\": { \"initialized_ms\": %.4f, \"first_frame_ms\": %.4f", g_initialized_ns / 1000000.0, g_first_frame_ns / 1000000.0);
+    if (g_first_frame_gpu_ns >= 0)
+        fprintf(file, ", \"first_frame_gpu_ms\": %.4f", g_first_frame_gpu_ns / 1000000.0);
+    fprintf(file, ", \"pipeline_pending_frames\": %u", g_pipeline_pending_frames);
+    fprintf(file, ", \"tasks\": [");
+    for (size_t i = 0; i < g_startup_events.size(); ++i) {
+        const auto& event = g_startup_events[i];
+        fprintf(file, "%s\n    { \"name\": \"%s\", \"thread\": %u, \"begin_ms\": %.4f, \"end_ms\": %.4f }", i ? "," : "", event.name,
+            event.thread, event.begin_ns / 1000000.0, event.end_ns / 1000000.0);
+    }
+    fprintf(file, "\n  ] },\n");
+    if (g_has_gpu_memory_stats)
+        fprintf(file, "  \"gpu_memory\": { \"blocks\": %u, \"reserved\": %llu, \"allocations\": %u, \"used\": %llu, \"free_ranges\": %u, \"largest_free_range\": %llu, \"fragmentation\": %.4f },\n",
+            g_gpu_memory_stats.block_cnt, g_gpu_memory_stats.reserved, g_gpu_memory_stats.allocation_cnt, g_gpu_memory_stats.used,
+            g_gpu_memory_stats.free_range_cnt, g_gpu_memory_stats.largest_free_range, g_gpu_memory_stats.fragmentation);
+    if (g_has_vertex_encoding_stats)
+        fprintf(file, "  \"vertices\": { \"encoding\": \"%s\", \"count\": %u, \"original_size\": %llu, \"encoded_size\": %llu, \"saved\": %llu },\n",
+            get_vertex_encoding_name(g_vertex_encoding_stats.encoding), g_vertex_encoding_stats.vertex_cnt, g_vertex_encoding_stats.original_size,
+            g_vertex_encoding_stats.encoded_size, g_vertex_encoding_stats.original_size - g_vertex_encoding_stats.encoded_size);
+    if (g_has_geometry_pool_stats)
+        fprintf(file, "  \"geometry_pool\": { \"meshes\": %u, \"vertices\": %llu, \"vertex_capacity\": %llu, \"indices\": %llu, \"index_capacity\": %llu, \"free_ranges\": %u },\n",
+            g_geometry_pool_stats.mesh_cnt, g_geometry_pool_stats.vertex_used, g_geometry_pool_stats.vertex_capacity, g_geometry_pool_stats.index_used,
+            g_geometry_pool_stats.index_capacity, g_geometry_pool_stats.free_range_cnt);
+    if (g_has_mesh_optimization_stats)
+        fprintf(file, "  \"mesh\": { \"triangles\": %u, \"original\": { \"vertices\": %u, \"index_size\": %u, \"acmr\": %.4f, \"atvr\": %.4f }, \"optimized\": { \"vertices\": %u, \"index_size\": %u, \"acmr\": %.4f, \"atvr\": %.4f } },\n",
+            g_mesh_optimization_stats.triangle_cnt, g_mesh_optimization_stats.original_vertex_cnt, g_mesh_optimization_stats.original_index_size,
+            g_mesh_optimization_stats.original_cache.acmr, g_mesh_optimization_stats.original_cache.atvr, g_mesh_optimization_stats.optimized_vertex_cnt,
+            g_mesh_optimization_stats.optimized_index_size, g_mesh_optimization_stats.optimized_cache.acmr, g_mesh_optimization_stats.optimized_cache.atvr);
+    if (g_has_instancing_stats)
+        fprintf(file, "  \"instancing\": { \"instances\": %u, \"draw_calls\": %u, \"data_size\": %llu },\n",
+            g_instancing_stats.instance_cnt, g_instancing_stats.draw_call_cnt, g_instancing_stats.instance_data_size);
+    if (g_has_gpu_culling_stats)
+        fprintf(file, "  \"gpu_culling\": { \"path\": \"%s\", \"objects\": %u, \"visible\": %llu },\n",
+            get_gpu_culling_path_name(g_gpu_culling_stats.path), g_gpu_culling_stats.object_cnt, g_gpu_culling_stats.visible);
+    if (g_has_meshlet_stats)
+        fprintf(file, "  \"meshlets\": { \"path\": \"%s\", \"count\": %u, \"tested\": %llu, \"visible\": %llu },\n",
+            get_meshlet_path_name(g_meshlet_stats.path), g_meshlet_stats.meshlet_cnt, g_meshlet_stats.tested, g_meshlet_stats.visible);
+    if (g_has_render_graph_stats)
+        fprintf(file, "  \"render_graph\": { \"passes\": %u, \"culled_passes\": %u, \"barrier_batches\": %u, \"barriers\": %u, \"dropped_barriers\": %u, \"transients\": %u, \"transient_size\": %llu, \"aliased_size\": %llu },\n",
+            g_render_graph_stats.pass_cnt, g_render_graph_stats.culled_pass_cnt, g_render_graph_stats.barrier_batch_cnt, g_render_graph_stats.barrier_cnt,
+            g_render_graph_stats.dropped_barrier_cnt, g_render_graph_stats.transient_cnt, g_render_graph_stats.transient_size, g_render_graph_stats.aliased_size);
+    fprintf(file, "  \"metrics\": {");
+    bool first = true;
+    for (const auto& summary : summaries) {
+        if (summary.count == 0)
+            continue;
+        fprintf(file, "%s\n    \"%s\": { \"count\": %u, \"mean\": %.4f, \"p50\": %.4f, \"p95\": %.4f, \"p99\": %.4f, \"max\": %.4f }",
+            first ? "" : ",", summary.name, summary.count, summary.mean, summary.p50, summary.p95, summary.p99, summary.max);
+        first = false;
+    }
+    fprintf(file, "\n  }\n}\n");
+
+    fclose(file);
+    return true;
+}
+
+
+/*
+ * Write the summary as a CSV file, one row for each metric.
+ */
+static bool write_csv(const char* filename, const std::vector<MetricSummary>& summaries) {
+    auto file = fopen(filename, "w");
+    if (!file)
+        return false;
+
+    fprintf(file, "backend,metric,count,mean,p50,p95,p99,max\n");
+    for (const auto& summary : summaries) {
+        if (summary.count == 0)
+            continue;
+        fprintf(file, "%s,%s,%u,%.4f,%.4f,%.4f,%.4f,%.4f\n", g_backend, summary.name, summary.count, summary.mean, summary.p50,
+            summary.p95, summary.p99, summary.max);
+    }
+
+    fclose(file);
+    return true;
+}
+
+
+#if PLATFORM_WIN
+// D3D12 can't render without a window, the benchmark renders into a window that is never shown.
+static HWND create_hidden_window() {
+    static constexpr wchar_t CLASS_NAME[] = L"Jiayin's Graphics Samples Benchmark";
+
+    WNDCLASSEXW wcex;
+    memset(&wcex, 0, sizeof(wcex));
+    wcex.cbSize = sizeof(WNDCLASSEX);
+    wcex.lpfnWndProc = DefWindowProcW;
+    wcex.hInstance = GetModuleHandle(nullptr);
+    wcex.lpszClassName = CLASS_NAME;
+    RegisterClassExW(&wcex);
+
+    return CreateWindowW(CLASS_NAME, L"2 - SingleTriangle (Benchmark)", WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU, CW_USEDEFAULT, 0,
+        g_width, g_height, nullptr, nullptr, wcex.hInstance, nullptr);
+}
+#endif
+
+
+/*
+ * Create and initialize the sample with the requested backend.
+ */
+static std::unique_ptr<GraphicsSample> create_sample() {
+    std::unique_ptr<GraphicsSample> sample = nullptr;
+    if (strcmp(g_backend, "vulkan") == 0)
+        sample = std::make_unique<VulkanGraphicsSample>(g_thread_cnt);
+    else if (strcmp(g_backend, "software") == 0)
+        sample = std::make_unique<SoftwareGraphicsSample>(g_thread_cnt);
+#if PLATFORM_WIN
+    else if (strcmp(g_backend, "d3d12") == 0)
+        sample = std::make_unique<D3D12GraphicsSample>();
+#endif
+    if (!sample) {
+        fprintf(stderr, "Unknown backend %s.\n", g_backend);
+        return nullptr;
+    }
+    sample->set_draw_count(g_draw_cnt);
+    sample->set_frames_in_flight(g_frames_in_flight);
+    sample->set_present_mode(g_present_mode);
+    sample->set_low_latency(g_low_latency);
+    sample->set_headless_surface(g_headless);
+    sample->set_instancing(g_instanced);
+    sample->set_gpu_culling(g_gpu_culling);
+    sample->set_mesh(g_mesh_filename);
+    sample->set_mesh_optimization(g_optimize);
+    sample->set_vertex_encoding(g_quantize ? VertexEncoding::Quantized : VertexEncoding::Full);
+    sample->set_meshlets(g_meshlets);
+
+#if PLATFORM_WIN
+    if (!g_offscreen) {
+        const auto hwnd = create_hidden_window();
+        if (!hwnd || !sample->initialize(GetModuleHandle(nullptr), hwnd))
+            return nullptr;
+        return sample;
+    }
+#endif
+
+    if (!sample->initialize(g_width, g_height))
+        return nullptr;
+    return sample;
+}
+
+
+int main(int argc, char** argv) {
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-backend") == 0 && i + 1 < argc)
+            g_backend = argv[++i];
+        else if (strcmp(argv[i], "-offscreen") == 0)
+            g_offscreen = true;
+        else if (strcmp(argv[i], "-headless") == 0)
+            g_offscreen = g_headless = true;
+        else if (strcmp(argv[i], "-present") == 0 && i + 1 < argc) {
+            ++i;
+            g_present_mode = strcmp(argv[i], "mailbox") == 0 ? PresentMode::Mailbox :
+                             strcmp(argv[i], "immediate") == 0 ? PresentMode::Immediate : PresentMode::Fifo;
+        }
+        else if (strcmp(argv[i], "-low-latency") == 0)
+            g_low_latency = true;
+        else if (strcmp(argv[i], "-warmup") == 0 && i + 1 < argc)
+            g_warmup_cnt = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+            g_frame_cnt = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-width") == 0 && i + 1 < argc)
+            g_width = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-height") == 0 && i + 1 < argc)
+            g_height = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            g_thread_cnt = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-draws") == 0 && i + 1 < argc)
+            g_draw_cnt = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-frames-in-flight") == 0 && i + 1 < argc)
+            g_frames_in_flight = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-instanced") == 0)
+            g_instanced = true;
+        else if (strcmp(argv[i], "-gpu-culling") == 0)
+            g_gpu_culling = true;
+        else if (strcmp(argv[i], "-mesh") == 0 && i + 1 < argc)
+            g_mesh_filename = argv[++i];
+        else if (strcmp(argv[i], "-optimize") == 0)
+            g_optimize = true;
+        else if (strcmp(argv[i], "-quantize") == 0)
+            g_quantize = true;
+        else if (strcmp(argv[i], "-meshlets") == 0)
+            g_meshlets = true;
+        else if (strcmp(argv[i], "-json") == 0 && i + 1 < argc)
+            g_json_filename = argv[++i];
+        else if (strcmp(argv[i], "-csv") == 0 && i + 1 < argc)
+            g_csv_filename = argv[++i];
+        else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+            g_trace_filename = argv[++i];
+    }
+
+#if !PLATFORM_WIN
+    // there is no window system to render to
+    g_offscreen = true;
+#endif
+
+    auto sample = create_sample();
+    if (!sample) {
+        fprintf(stderr, "Failed to initialize the %s backend.\n", g_backend);
+        return -1;
+    }
+
+    auto& profiler = sample->get_profiler();
+    std::vector<ProfileEvent> events;
+    unsigned long long cursor = 0;
+
+    // frames rendered before all pipelines are ready don't draw everything
+    auto render_warmup_frame = [&]() {
+        if (sample->get_pending_pipeline_count())
+            ++g_pipeline_pending_frames;
+        sample->render_frame();
+    };
+
+    // Everything recorded before the first frame belongs to initialization.
+    g_initialized_ns = profiler.now();
+    render_warmup_frame();
+    g_first_frame_ns = profiler.now();
+    profiler.poll_events(events, cursor);
+    for (const auto& event : events) {
+        if (event.frame == 0)
+            g_startup_events.push_back(event);
+    }
+    std::sort(g_startup_events.begin(), g_startup_events.end(), [](const ProfileEvent& a, const ProfileEvent& b) { return a.begin_ns < b.begin_ns; });
+    events.clear();
+
+    // Frames are not measured until warming up is done, GPU timestamps of the last warm up frames are read back a few frames
+    // later, they are simply ignored since they don't belong to any measured frame. The GPU time of the first frame is among them.
+    for (unsigned int i = 1; i < g_warmup_cnt; ++i)
+        render_warmup_frame();
+    while (sample->get_pending_pipeline_count())
+        render_warmup_frame();
+    profiler.poll_events(events, cursor);
+    for (const auto& event : events) {
+        if (event.thread == FrameProfiler::GPU_THREAD && event.frame == 1)
+            g_first_frame_gpu_ns = event.end_ns;
+    }
+    events.clear();
+
+    const auto first_frame = profiler.frame() + 1;
+    std::vector<FrameRecord> records(g_frame_cnt);
+
+    auto accumulate = [&](double& value, const ProfileEvent& event) {
+        value = std::max(value, 0.0) + (event.end_ns - event.begin_ns) / 1000000.0;
+    };
+
+    for (unsigned int i = 0; i < g_frame_cnt; ++i) {
+        const auto begin = std::chrono::steady_clock::now();
+        sample->render_frame();
+        records[i].frame_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - begin).count();
+
+#if PLATFORM_WIN
+        // keep the hidden window responsive
+        MSG msg;
+        while (PeekMessage(&msg, NULL, 0, 0, PM_REMOVE)) {
+            TranslateMessage(&msg);
+            DispatchMessage(&msg);
+        }
+#endif
+
+        // Events are polled every frame so that the ring buffer never overflows no matter how many frames are measured.
+        profiler.poll_events(events, cursor);
+        for (const auto& event : events) {
+            if (event.frame < first_frame || event.frame >= first_frame + g_frame_cnt)
+                continue;
+
+            auto& record = records[event.frame - first_frame];
+            if (event.thread == FrameProfiler::GPU_THREAD) {
+                accumulate(record.gpu_ms, event);
+                record.gpu_end_ns = std::max(record.gpu_end_ns, event.end_ns);
+            }
+            else if (strcmp(event.name, "pacing") == 0 || strcmp(event.name, "latency wait") == 0) {
+                accumulate(record.pacing_ms, event);
+                record.input_ns = std::max(record.input_ns, event.end_ns);
+            }
+            else if (strcmp(event.name, "record") == 0)
+                accumulate(record.record_ms, event);
+            else if (strcmp(event.name, "fence wait") == 0)
+                accumulate(record.fence_wait_ms, event);
+        }
+        events.clear();
+    }
+
+    // GPU time is aligned with the CPU clock by the submission of the first frame, so the latency leaves out how long that
+    // frame waited in the queue, and the time the display takes after GPU is done.
+    for (auto& record : records) {
+        if (record.input_ns >= 0 && record.gpu_end_ns >= 0)
+            record.latency_ms = (record.gpu_end_ns - record.input_ns) / 1000000.0;
+    }
+
+    g_has_present_stats = sample->get_present_stats(g_present_stats);
+    g_has_transient_stats = sample->get_transient_memory_stats(g_transient_stats);
+    g_has_gpu_memory_stats = sample->get_gpu_memory_stats(g_gpu_memory_stats);
+    g_has_vertex_encoding_stats = sample->get_vertex_encoding_stats(g_vertex_encoding_stats);
+    g_has_mesh_optimization_stats = sample->get_mesh_optimization_stats(g_mesh_optimization_stats);
+    g_has_geometry_pool_stats = sample->get_geometry_pool_stats(g_geometry_pool_stats);
+    g_has_meshlet_stats = sample->get_meshlet_stats(g_meshlet_stats);
+    g_has_instancing_stats = sample->get_instancing_stats(g_instancing_stats);
+    g_has_gpu_culling_stats = sample->get_gpu_culling_stats(g_gpu_culling_stats);
+    g_has_render_graph_stats = sample->get_render_graph_stats(g_render_graph_stats);
+
+    // shutdown waits for all frames on GPU, the timestamps of the last few frames are gone with it
+    sample->shutdown();
+
+    const std::vector<MetricSummary> summaries = {
+        summarize("frame_ms", records, &FrameRecord::frame_ms),
+        summarize("record_ms", records, &FrameRecord::record_ms),
+        summarize("fence_wait_ms", records, &FrameRecord::fence_wait_ms),
+        summarize("gpu_ms", records, &FrameRecord::gpu_ms),
+        summarize("pacing_ms", records, &FrameRecord::pacing_ms),
+        summarize("latency_ms", records, &FrameRecord::latency_ms),
+    };
+
+    printf("2 - SingleTriangle (%s%s), %ux%u, %u draws, %u frames in flight, %u warm up frames, %u measured frames\n", g_backend,
+        g_has_present_stats ? (g_headless ? ", headless" : "") : g_offscreen ? ", offscreen" : "", g_width, g_height, g_draw_cnt, g_frames_in_flight, g_warmup_cnt, g_frame_cnt);
+    printf("%-16s %8s %10s %10s %10s %10s %10s\n", "metric", "count", "mean", "p50", "p95", "p99", "max");
+    for (const auto& summary : summaries) {
+        if (summary.count == 0)
+            continue;
+        printf("%-16s %8u %10.4f %10.4f %10.4f %10.4f %10.4f\n", summary.name, summary.count, summary.mean, summary.p50,
+            summary.p95, summary.p99, summary.max);
+    }
+
+    printf("startup: initialized at %.3f ms, first frame submitted at %.3f ms", g_initialized_ns / 1000000.0, g_first_frame_ns / 1000000.0);
+    if (g_first_frame_gpu_ns >= 0)
+        printf(", done on GPU at %.3f ms", g_first_frame_gpu_ns / 1000000.0);
+    printf(", %u frames rendered before all pipelines were ready\n", g_pipeline_pending_frames);
+    for (const auto& event : g_startup_events) {
+        printf("  %-20s thread %-3u %10.3f ms - %10.3f ms\n", event.name, event.thread, event.begin_ns / 1000000.0,
+            event.end_ns / 1000000.0);
+    }
+
+    if (g_has_present_stats) {
+        printf("present: %s%s%s\n", get_present_mode_name(g_present_stats.mode), g_present_stats.low_latency ? ", low latency" : "",
+            g_present_stats.waitable ? ", waitable swap chain" : "");
+    }
+
+    if (g_has_transient_stats) {
+        printf("transient memory: %zu bytes per frame, high water mark %zu bytes, %llu failed allocations\n", g_transient_stats.capacity,
+            g_transient_stats.high_water_mark, g_transient_stats.failed_cnt);
+    }
+
+    if (g_has_gpu_memory_stats) {
+        printf("gpu memory: %u blocks, %llu of %llu bytes used by %u allocations, %u free ranges, fragmentation %.3f\n", g_gpu_memory_stats.block_cnt,
+            g_gpu_memory_stats.used, g_gpu_memory_stats.reserved, g_gpu_memory_stats.allocation_cnt, g_gpu_memory_stats.free_range_cnt,
+            g_gpu_memory_stats.fragmentation);
+    }
+
+    if (g_has_vertex_encoding_stats) {
+        printf("vertices: %u %s vertices, %llu bytes encoded as %llu bytes, %llu bytes saved\n", g_vertex_encoding_stats.vertex_cnt,
+            get_vertex_encoding_name(g_vertex_encoding_stats.encoding), g_vertex_encoding_stats.original_size, g_vertex_encoding_stats.encoded_size,
+            g_vertex_encoding_stats.original_size - g_vertex_encoding_stats.encoded_size);
+    }
+
+    if (g_has_mesh_optimization_stats) {
+        printf("mesh: %u triangles, %u vertices with %u bytes indices optimized into %u vertices with %u bytes indices\n",
+            g_mesh_optimization_stats.triangle_cnt, g_mesh_optimization_stats.original_vertex_cnt, g_mesh_optimization_stats.original_index_size,
+            g_mesh_optimization_stats.optimized_vertex_cnt, g_mesh_optimization_stats.optimized_index_size);
+        printf("  ACMR %.3f -> %.3f, ATVR %.3f -> %.3f with a %u entries FIFO cache\n", g_mesh_optimization_stats.original_cache.acmr,
+            g_mesh_optimization_stats.optimized_cache.acmr, g_mesh_optimization_stats.original_cache.atvr, g_mesh_optimization_stats.optimized_cache.atvr,
+            MESH_CACHE_SIZE);
+    }
+
+    if (g_has_geometry_pool_stats) {
+        printf("geometry pool: %u mesh(es), %llu of %llu vertices and %llu of %llu indices used, %u free ranges\n", g_geometry_pool_stats.mesh_cnt,
+            g_geometry_pool_stats.vertex_used, g_geometry_pool_stats.vertex_capacity, g_geometry_pool_stats.index_used, g_geometry_pool_stats.index_capacity,
+            g_geometry_pool_stats.free_range_cnt);
+    }
+
+    if (g_has_meshlet_stats) {
+        printf("meshlets: %u meshlets, %s, %llu of %llu tested in the last frame read back are visible\n", g_meshlet_stats.meshlet_cnt,
+            get_meshlet_path_name(g_meshlet_stats.path), g_meshlet_stats.visible, g_meshlet_stats.tested);
+    }
+
+    if (g_has_instancing_stats) {
+        printf("instancing: %u instances in %u draw call(s), %llu bytes of instance data per frame\n", g_instancing_stats.instance_cnt,
+            g_instancing_stats.draw_call_cnt, g_instancing_stats.instance_data_size);
+    }
+
+    if (g_has_gpu_culling_stats) {
+        printf("gpu culling: %u objects culled through %s, %llu visible in the last frame read back\n", g_gpu_culling_stats.object_cnt,
+            get_gpu_culling_path_name(g_gpu_culling_stats.path), g_gpu_culling_stats.visible);
+    }
+
+    if (g_has_render_graph_stats) {
+        printf("render graph: %u passes, %u culled, %u barriers in %u batch(es), %u redundant barriers dropped, %u transient resources in %llu of %llu bytes\n",
+            g_render_graph_stats.pass_cnt, g_render_graph_stats.culled_pass_cnt, g_render_graph_stats.barrier_cnt, g_render_graph_stats.barrier_batch_cnt,
+            g_render_graph_stats.dropped_barrier_cnt, g_render_graph_stats.transient_cnt, g_render_graph_stats.aliased_size, g_render_graph_stats.transient_size);
+    }
+
+    if (g_json_filename && !write_json(g_json_filename, summaries))
+        fprintf(stderr, "Failed to write %s.\n", g_json_filename);
+    if (g_csv_filename && !write_csv(g_csv_filename, summaries))
+        fprintf(stderr, "Failed to write %s.\n", g_csv_filename);
+    if (g_trace_filename && !profiler.dump_chrome_trace(g_trace_filename))
+        fprintf(stderr, "Failed to write %s.\n", g_trace_filename);
+
+    return 0;
+}
@@ -6,6 +6,14 @@
 #pragma once
 
 #include <stdlib.h>
+#include <math.h>
+#include "vertex_layout.h"
+#include "vertex_encoding.h"
+
+// _countof is only available with MSVC
+#ifndef _countof
+#define _countof(arr)   (sizeof(arr) / sizeof(arr[0]))
+#endif
 
 struct float3 {
     float x, y, z;
@@ -21,24 +29,79 @@ struct Vertex {
 };
 
 /*
- * There are only three vertices, it is a triangle in the middle of the screen.
+ * The only place the layout of a vertex is described, input layouts of both backends are generated from it. The shaders
+ * declare the same inputs, location and semantic name follow the semantic of each attribute.
+ */
+template<>
+struct VertexLayout<Vertex> {
+    static constexpr VertexAttribute attributes[] = {
+        VERTEX_ATTRIBUTE(Vertex, position, Position, Float3),
+        VERTEX_ATTRIBUTE(Vertex, color, Color, UNorm8x4),
+    };
+};
+
+/*
+ * Constants of each draw call. When the triangle is drawn more than once, each draw is scaled and moved into its own cell of a
+ * grid so that all of them are visible. A single draw is exactly the original triangle. The vertex shader computes the position
+ * as 'position * scale + offset', which decodes quantized positions along the way.
  */
-static Vertex g_vertices[] = {
-    { {-0.35f, -0.5f, 0.0f}, 0xff0000 },
-    { { 0.35f, -0.5f, 0.0f}, 0x00ff00 },
-    { { 0.0f,  0.5f,  0.0f}, 0x0000ff },
+struct DrawConstants {
+    float scale[3];             // scale of the position
+    float padding0;             // a float3 can't cross 16 bytes in constant buffers
+    float offset[3];            // offset in clip space
+    float padding1;             // constant buffers are always 16 bytes aligned
 };
 
+inline DrawConstants get_draw_constants(const unsigned int draw, const unsigned int draw_cnt, const PositionDecode& decode = PositionDecode()) {
+    auto grid = (unsigned int)ceil(sqrt((double)draw_cnt));
+    grid = grid ? grid : 1;
+
+    const auto cell = 2.0f / grid;
+    const float offset[2] = { -1.0f + cell * (draw % grid + 0.5f), 1.0f - cell * (draw / grid + 0.5f) };
+    const auto scale = 1.0f / grid;
+
+    DrawConstants constants;
+    constants.scale[0] = decode.extent[0] * scale;
+    constants.scale[1] = decode.extent[1] * scale;
+    constants.scale[2] = decode.extent[2];
+    constants.padding0 = 0.0f;
+    constants.offset[0] = decode.center[0] * scale + offset[0];
+    constants.offset[1] = decode.center[1] * scale + offset[1];
+    constants.offset[2] = decode.center[2];
+    constants.padding1 = 0.0f;
+    return constants;
+}
+
 /*
- * Indices data of the vertex buffer.
+ * Data of an instance of the instanced path. Instead of a draw call for each cell of the grid, a single instanced draw fetches
+ * the scale and offset of each instance from a second vertex stream, along with a color multiplied with the vertex colors.
  */
-static unsigned int g_indices[] = { 0, 1, 2 };
+struct InstanceData {
+    float scale[3];
+    float offset[3];
+    unsigned int color;
+};
+
+template<>
+struct VertexLayout<InstanceData> {
+    static constexpr VertexAttribute attributes[] = {
+        VERTEX_ATTRIBUTE(InstanceData, scale, InstanceScale, Float3),
+        VERTEX_ATTRIBUTE(InstanceData, offset, InstanceOffset, Float3),
+        VERTEX_ATTRIBUTE(InstanceData, color, InstanceColor, UNorm8x4),
+    };
+};
+
+inline InstanceData get_instance_data(const unsigned int instance, const unsigned int instance_cnt, const PositionDecode& decode = PositionDecode()) {
+    const auto constants = get_draw_constants(instance, instance_cnt, decode);
 
-constexpr unsigned int g_indices_cnt = _countof(g_indices);
-constexpr unsigned int g_vertices_cnt = _countof(g_vertices);
+    InstanceData data;
+    for (int i = 0; i < 3; ++i) {
+        data.scale[i] = constants.scale[i];
+        data.offset[i] = constants.offset[i];
+    }
 
-// vertex size
-constexpr unsigned int g_vertex_size = sizeof(Vertex);
-constexpr unsigned int g_total_vertices_size = g_vertex_size * g_vertices_cnt;
-constexpr unsigned int g_index_size = sizeof(unsigned int);
-constexpr unsigned int g_total_indices_size = g_index_size * g_indices_cnt;
\ No newline at end of file
+    // neighboring instances get different tints from a multiplicative hash, never darker than half so the mesh stays visible
+    const auto hash = instance * 2654435761u;
+    data.color = 0xff808080u | ((hash >> 9) & 0x7f) | ((hash >> 17) & 0x7f) << 8 | ((hash >> 25) & 0x7f) << 16;
+    return data;
+}
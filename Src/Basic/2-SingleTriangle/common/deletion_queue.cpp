@@ -0,0 +1,49 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <vector>
+#include "deletion_queue.h"
+
+void DeletionQueue::push(const unsigned long long serial, std::function<void()> deleter) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_entries.push_back(Entry{ serial, std::move(deleter) });
+}
+
+void DeletionQueue::collect(const unsigned long long completed_serial) {
+    // Deleters are executed out of the lock since they could push more things into the queue. Serials are mostly pushed in
+    // order, but with multiple threads pushing, it is not guaranteed, so the whole queue is checked.
+    std::vector<std::function<void()>> ready;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto it = m_entries.begin(); it != m_entries.end();) {
+            if (it->serial <= completed_serial) {
+                ready.push_back(std::move(it->deleter));
+                it = m_entries.erase(it);
+            }
+            else {
+                ++it;
+            }
+        }
+    }
+
+    for (auto& deleter : ready)
+        deleter();
+}
+
+void DeletionQueue::flush() {
+    std::deque<Entry> entries;
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        entries.swap(m_entries);
+    }
+
+    for (auto& entry : entries)
+        entry.deleter();
+}
+
+size_t DeletionQueue::pending_count() const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    return m_entries.size();
+}
@@ -0,0 +1,48 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <functional>
+
+/*
+ * Deferred destruction of GPU resources.
+ * A resource can't be destroyed while GPU may still be using it. Instead of waiting for GPU to be idle, the destruction is
+ * pushed in the queue along with a serial, which is usually the fence value or the index of the last frame that may use
+ * the resource. Once GPU reaches the serial, which is checked every frame anyway, the resource is destroyed.
+ */
+class DeletionQueue {
+public:
+    /*
+     * Destroy something once GPU reaches the serial, it is safe to push on any thread.
+     */
+    void push(const unsigned long long serial, std::function<void()> deleter);
+
+    /*
+     * Destroy everything whose serial is already reached by GPU.
+     */
+    void collect(const unsigned long long completed_serial);
+
+    /*
+     * Destroy everything no matter what, this is only safe when GPU is idle.
+     */
+    void flush();
+
+    /*
+     * Number of resources waiting to be destroyed.
+     */
+    size_t pending_count() const;
+
+private:
+    struct Entry {
+        unsigned long long      serial;
+        std::function<void()>   deleter;
+    };
+
+    std::deque<Entry>           m_entries;
+    mutable std::mutex          m_mutex;
+};
@@ -0,0 +1,55 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include "frame_pacing.h"
+#include "profiler.h"
+
+// A frame is started this much earlier than predicted, a late frame leaves GPU idle, which costs more than a little latency.
+static constexpr long long PACING_MARGIN_NS = 500000;
+
+// Sleeping is not precise, the last part of the wait spins.
+static constexpr long long SPIN_NS = 1000000;
+
+// Weight of the latest frame in the moving averages, in 1/8.
+static constexpr long long AVERAGE_WEIGHT = 1;
+
+static long long update_average(const long long average, const long long value) {
+    return average < 0 ? value : average + (value - average) * AVERAGE_WEIGHT / 8;
+}
+
+void FramePacer::wait(const FrameProfiler& profiler) {
+    auto now = profiler.now();
+    if (m_low_latency && m_cpu_ns >= 0 && m_gpu_ns > 0) {
+        const auto begin = m_gpu_idle_ns - m_cpu_ns - PACING_MARGIN_NS;
+        if (begin - now > SPIN_NS)
+            std::this_thread::sleep_for(std::chrono::nanoseconds(begin - now - SPIN_NS));
+        while ((now = profiler.now()) < begin)
+            std::this_thread::yield();
+    }
+    m_frame_begin_ns = now;
+}
+
+void FramePacer::submitted(const long long now_ns) {
+    if (m_frame_begin_ns >= 0)
+        m_cpu_ns = update_average(m_cpu_ns, now_ns - m_frame_begin_ns);
+    m_frame_begin_ns = -1;
+
+    // GPU starts the frame once it is done with the previous ones, or right away if it is idle
+    m_gpu_idle_ns = std::max(m_gpu_idle_ns, now_ns) + std::max(m_gpu_ns, 0ll);
+}
+
+void FramePacer::gpu_frame_done(const long long gpu_ns) {
+    m_gpu_ns = update_average(m_gpu_ns, gpu_ns);
+}
+
+void FramePacer::reset() {
+    m_cpu_ns = -1;
+    m_gpu_ns = -1;
+    m_frame_begin_ns = -1;
+    m_gpu_idle_ns = 0;
+}
@@ -0,0 +1,79 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+class FrameProfiler;
+
+/*
+ * How frames are handed to the display.
+ */
+enum class PresentMode {
+    Fifo,           // wait for vertical blank, frames queue up behind it, there is no tearing
+    Mailbox,        // wait for vertical blank, a newer frame replaces the queued one, so CPU and GPU are never blocked by the display
+    Immediate,      // no waiting at all, frames may tear, it is DXGI tearing on D3D12
+};
+
+inline const char* get_present_mode_name(const PresentMode mode) {
+    return mode == PresentMode::Mailbox ? "mailbox" : mode == PresentMode::Immediate ? "immediate" : "fifo";
+}
+
+/*
+ * How presentation is set up, the mode may not be the one asked for if the surface doesn't support it.
+ */
+struct PresentStats {
+    PresentMode     mode = PresentMode::Fifo;
+    bool            low_latency = false;
+    bool            waitable = false;           // whether frames wait for a latency object of the swap chain before they start
+};
+
+/*
+ * Low latency frame pacing.
+ * Waiting for the frames in flight only keeps CPU from running too far ahead, a frame still starts as soon as a frame index is
+ * free and its commands sit in the queue until GPU is done with everything before. Anything the frame samples at its beginning,
+ * like input, is as old as the whole queue once it is on screen. The pacer predicts when GPU runs out of work and delays the
+ * beginning of the frame so that its commands are submitted just before that, the queue stays about one frame deep.
+ *
+ * The prediction is the GPU time of recent frames, from timestamp queries, added up from the submission of each frame, and the
+ * CPU time of recent frames from their beginning to their submission. Without GPU timestamps nothing is ever delayed.
+ */
+class FramePacer {
+public:
+    /*
+     * Frames are never delayed if low latency is off, which is the default, it is for throughput.
+     */
+    void set_low_latency(const bool low_latency) { m_low_latency = low_latency; }
+    bool is_low_latency() const { return m_low_latency; }
+
+    /*
+     * Sleep until CPU needs to start the frame to have it submitted by the time GPU runs out of work, the frame begins when it
+     * returns. It returns right away if low latency is off.
+     */
+    void wait(const FrameProfiler& profiler);
+
+    /*
+     * The frame is submitted, GPU starts it once it is done with everything submitted before.
+     */
+    void submitted(const long long now_ns);
+
+    /*
+     * GPU time of a frame done on GPU.
+     */
+    void gpu_frame_done(const long long gpu_ns);
+
+    /*
+     * Forget about all frames, this is for a new device.
+     */
+    void reset();
+
+private:
+    // Moving averages of the recent frames in nanoseconds, negative until the first frame is measured.
+    long long   m_cpu_ns = -1;
+    long long   m_gpu_ns = -1;
+    // When the frame being recorded began, and when GPU is predicted to be done with all frames submitted so far.
+    long long   m_frame_begin_ns = -1;
+    long long   m_gpu_idle_ns = 0;
+    bool        m_low_latency = false;
+};
@@ -0,0 +1,130 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include "geometry_pool.h"
+#include "mesh.h"
+
+void RangeAllocator::initialize(const uint32_t capacity) {
+    m_free_ranges.clear();
+    if (capacity)
+        m_free_ranges[0] = capacity;
+    m_capacity = capacity;
+    m_used = 0;
+}
+
+bool RangeAllocator::allocate(const uint32_t cnt, uint32_t& first) {
+    if (cnt == 0) {
+        first = 0;
+        return true;
+    }
+
+    for (auto it = m_free_ranges.begin(); it != m_free_ranges.end(); ++it) {
+        if (it->second < cnt)
+            continue;
+
+        // the front of the free range is taken, what is left stays free
+        first = it->first;
+        const auto left = it->second - cnt;
+        m_free_ranges.erase(it);
+        if (left)
+            m_free_ranges[first + cnt] = left;
+        m_used += cnt;
+        return true;
+    }
+    return false;
+}
+
+void RangeAllocator::free(const uint32_t first, const uint32_t cnt) {
+    if (cnt == 0)
+        return;
+
+    auto range_first = first;
+    auto range_cnt = cnt;
+
+    // merge with the free range right after it
+    auto next = m_free_ranges.find(first + cnt);
+    if (next != m_free_ranges.end()) {
+        range_cnt += next->second;
+        m_free_ranges.erase(next);
+    }
+
+    // and the one right before it
+    auto prev = m_free_ranges.lower_bound(first);
+    if (prev != m_free_ranges.begin()) {
+        --prev;
+        if (prev->first + prev->second == first) {
+            range_first = prev->first;
+            range_cnt += prev->second;
+            m_free_ranges.erase(prev);
+        }
+    }
+
+    m_free_ranges[range_first] = range_cnt;
+    m_used -= cnt;
+}
+
+void GeometryPool::initialize(const uint32_t vertex_capacity, const uint32_t vertex_stride, const uint32_t index_capacity, const uint32_t index_size) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_vertices.initialize(vertex_capacity);
+    m_indices.initialize(index_capacity);
+    m_vertex_stride = vertex_stride;
+    m_index_size = index_size;
+    m_range_cnt = 0;
+}
+
+bool GeometryPool::allocate(const uint32_t vertex_cnt, const uint32_t index_cnt, GeometryRange& range) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_vertices.allocate(vertex_cnt, range.base_vertex))
+        return false;
+    if (!m_indices.allocate(index_cnt, range.first_index)) {
+        m_vertices.free(range.base_vertex, vertex_cnt);
+        return false;
+    }
+    range.vertex_cnt = vertex_cnt;
+    range.index_cnt = index_cnt;
+    ++m_range_cnt;
+    return true;
+}
+
+void GeometryPool::free(const GeometryRange& range) {
+    if (!range.vertex_cnt && !range.index_cnt)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    m_vertices.free(range.base_vertex, range.vertex_cnt);
+    m_indices.free(range.first_index, range.index_cnt);
+    --m_range_cnt;
+}
+
+void GeometryPool::get_stats(GeometryPoolStats& stats) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    stats.mesh_cnt = m_range_cnt;
+    stats.vertex_capacity = m_vertices.get_capacity();
+    stats.vertex_used = m_vertices.get_used();
+    stats.index_capacity = m_indices.get_capacity();
+    stats.index_used = m_indices.get_used();
+    stats.free_range_cnt = m_vertices.get_free_range_count() + m_indices.get_free_range_count();
+}
+
+uint32_t get_geometry_pool_index_size(const Mesh& mesh) {
+    return mesh.get_vertex_count() > 65536 ? 4 : 2;
+}
+
+const void* get_geometry_pool_indices(const Mesh& mesh, const uint32_t index_size, std::vector<uint8_t>& converted) {
+    if (mesh.get_index_size() == index_size)
+        return mesh.get_indices();
+    if (index_size == 2 && mesh.get_vertex_count() > 65536)
+        return nullptr;
+
+    const auto index_cnt = mesh.get_index_count();
+    converted.resize((size_t)index_cnt * index_size);
+    for (uint32_t i = 0; i < index_cnt; ++i) {
+        if (index_size == 2)
+            ((uint16_t*)converted.data())[i] = (uint16_t)mesh.get_index(i);
+        else
+            ((uint32_t*)converted.data())[i] = mesh.get_index(i);
+    }
+    return converted.data();
+}
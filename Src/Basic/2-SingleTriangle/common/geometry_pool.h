@@ -0,0 +1,109 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <map>
+#include <mutex>
+#include <vector>
+
+class Mesh;
+
+/*
+ * Where a mesh lives in the geometry pool. Its indices are relative to its own vertices, they are drawn with the base vertex
+ * and the first index of the range, so that all meshes share the same vertex and index buffer binding.
+ */
+struct GeometryRange {
+    uint32_t    base_vertex = 0;
+    uint32_t    vertex_cnt = 0;
+    uint32_t    first_index = 0;
+    uint32_t    index_cnt = 0;
+};
+
+/*
+ * Usage of the geometry pool.
+ */
+struct GeometryPoolStats {
+    unsigned int        mesh_cnt = 0;               // ranges allocated
+    unsigned long long  vertex_capacity = 0;
+    unsigned long long  vertex_used = 0;
+    unsigned long long  index_capacity = 0;
+    unsigned long long  index_used = 0;
+    unsigned int        free_range_cnt = 0;         // free ranges of both vertices and indices
+};
+
+/*
+ * Ranges of elements handed out from a fixed capacity. Free ranges are kept sorted by their first element, allocation takes
+ * the first one large enough, freeing merges the range with its free neighbors.
+ */
+class RangeAllocator {
+public:
+    void initialize(const uint32_t capacity);
+
+    /*
+     * False if no free range is large enough.
+     */
+    bool allocate(const uint32_t cnt, uint32_t& first);
+    void free(const uint32_t first, const uint32_t cnt);
+
+    uint32_t get_capacity() const { return m_capacity; }
+    uint32_t get_used() const { return m_used; }
+    uint32_t get_free_range_count() const { return (uint32_t)m_free_ranges.size(); }
+
+private:
+    std::map<uint32_t, uint32_t>    m_free_ranges;  // first element to number of elements
+    uint32_t                        m_capacity = 0;
+    uint32_t                        m_used = 0;
+};
+
+/*
+ * Book keeping of a geometry pool, one large vertex buffer and one large index buffer that all meshes are sub-allocated from.
+ * The buffers themselves belong to the backends, the pool only decides where each mesh goes. Vertices of all meshes have the
+ * same stride and indices the same size. Indices are relative to the base vertex of their mesh, so 16 bits indices are good
+ * for any mesh of up to 65536 vertices, no matter how large the pool is. It is thread safe, meshes can be loaded by tasks.
+ */
+class GeometryPool {
+public:
+    // Smallest capacity of a pool, a pool is never smaller than what its first mesh needs either.
+    static constexpr uint32_t DEFAULT_VERTEX_CAPACITY = 256 * 1024;
+    static constexpr uint32_t DEFAULT_INDEX_CAPACITY = 1024 * 1024;
+
+    void initialize(const uint32_t vertex_capacity, const uint32_t vertex_stride, const uint32_t index_capacity, const uint32_t index_size);
+
+    /*
+     * Reserve the vertices and indices of a mesh. False if the pool is out of room, nothing is reserved then.
+     */
+    bool allocate(const uint32_t vertex_cnt, const uint32_t index_cnt, GeometryRange& range);
+    void free(const GeometryRange& range);
+
+    uint32_t get_vertex_stride() const { return m_vertex_stride; }
+    uint32_t get_index_size() const { return m_index_size; }
+    uint64_t get_vertex_buffer_size() const { return (uint64_t)m_vertices.get_capacity() * m_vertex_stride; }
+    uint64_t get_index_buffer_size() const { return (uint64_t)m_indices.get_capacity() * m_index_size; }
+    uint64_t get_vertex_offset(const GeometryRange& range) const { return (uint64_t)range.base_vertex * m_vertex_stride; }
+    uint64_t get_index_offset(const GeometryRange& range) const { return (uint64_t)range.first_index * m_index_size; }
+
+    void get_stats(GeometryPoolStats& stats) const;
+
+private:
+    mutable std::mutex  m_mutex;
+    RangeAllocator      m_vertices;
+    RangeAllocator      m_indices;
+    uint32_t            m_vertex_stride = 0;
+    uint32_t            m_index_size = 4;
+    unsigned int        m_range_cnt = 0;
+};
+
+/*
+ * Index size of a pool holding the mesh, 16 bits unless the mesh has more vertices than 16 bits indices can address.
+ */
+uint32_t get_geometry_pool_index_size(const Mesh& mesh);
+
+/*
+ * Indices of the mesh in the index size of the pool. The indices of the mesh are returned as they are if the sizes match,
+ * otherwise they are converted into 'converted'. Nullptr if they don't fit in the index size.
+ */
+const void* get_geometry_pool_indices(const Mesh& mesh, const uint32_t index_size, std::vector<uint8_t>& converted);
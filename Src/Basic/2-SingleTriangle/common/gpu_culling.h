@@ -0,0 +1,70 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <math.h>
+#include "vertex_encoding.h"
+
+/*
+ * GPU driven drawing. Each draw of the scene is an object, the data of all objects stays in GPU memory for the lifetime of the
+ * scene. Every frame a compute shader culls the bounds of all objects against the frustum and writes an indexed indirect draw
+ * for each visible one, the frame is then a single indirect draw no matter how many objects there are. Objects are drawn with
+ * the instanced vertex shader, the first instance of each indirect draw is the object, so its data is fetched as an instance.
+ */
+
+/*
+ * How a backend draws the indirect draws written by culling.
+ */
+enum class GpuCullingPath {
+    None,               // objects are drawn one by one on CPU
+    IndirectCount,      // visible objects are compacted, the number of draws comes from a count buffer written by culling
+    DrawIndirect,       // each object has its own indirect draw, culled objects draw no instance, for devices without an indirect count
+};
+
+inline const char* get_gpu_culling_path_name(const GpuCullingPath path) {
+    return path == GpuCullingPath::IndirectCount ? "indirect count" : path == GpuCullingPath::DrawIndirect ? "draw indirect" : "none";
+}
+
+/*
+ * GPU culling of the last frame read back.
+ */
+struct GpuCullingStats {
+    GpuCullingPath      path = GpuCullingPath::None;
+    unsigned int        object_cnt = 0;             // objects tested each frame
+    unsigned long long  visible = 0;                // objects inside the frustum
+};
+
+/*
+ * Constants of the culling compute shader, the layout matches the shaders of both backends.
+ */
+struct GpuCullingConstants {
+    float       sphere[4];          // bounding sphere of the mesh, center and radius, in the space of the fetched positions
+    uint32_t    first;              // first object of the dispatch
+    uint32_t    object_cnt;
+    uint32_t    index_cnt;          // indices of the mesh, every draw draws all of them
+    uint32_t    first_index;        // where the mesh is in the geometry pool
+    uint32_t    base_vertex;
+    uint32_t    compact;            // whether visible draws are compacted at the front, or each object writes its own draw
+    uint32_t    counter;            // the counter of visible objects, in 4 bytes
+};
+
+static_assert(sizeof(GpuCullingConstants) == 44, "Culling constants are read by shaders as they are.");
+
+/*
+ * Bounding sphere of the mesh in the space of the positions fetched by the vertex shader, which is the space of the quantized
+ * positions if they are quantized. Objects scale and move it the same way they do to the mesh.
+ */
+inline void get_gpu_culling_sphere(const float* bounds_min, const float* bounds_max, const PositionDecode& decode, float sphere[4]) {
+    float radius_sq = 0.0f;
+    for (int i = 0; i < 3; ++i) {
+        const auto extent = decode.extent[i] > 0.0f ? decode.extent[i] : 1.0f;
+        const auto half = (bounds_max[i] - bounds_min[i]) * 0.5f / extent;
+        sphere[i] = ((bounds_min[i] + bounds_max[i]) * 0.5f - decode.center[i]) / extent;
+        radius_sq += half * half;
+    }
+    sphere[3] = sqrtf(radius_sq);
+}
@@ -0,0 +1,43 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <algorithm>
+#include "linear_allocator.h"
+
+void LinearAllocator::initialize(void* base, const size_t capacity, const size_t alignment) {
+    m_base = (unsigned char*)base;
+    m_capacity = capacity;
+    m_alignment = std::max(alignment, (size_t)1);
+    m_offset = 0;
+    m_high_water_mark = 0;
+    m_failed_cnt = 0;
+}
+
+void* LinearAllocator::allocate(const size_t size, size_t& offset) {
+    // the offset is always aligned since every allocation is rounded up to the alignment
+    const auto aligned_size = (size + m_alignment - 1) & ~(m_alignment - 1);
+    offset = m_offset.fetch_add(aligned_size, std::memory_order_relaxed);
+    if (offset + aligned_size > m_capacity) {
+        ++m_failed_cnt;
+        return nullptr;
+    }
+    return m_base + offset;
+}
+
+// A failed allocation still moves the offset past the capacity, the memory used never does.
+static size_t get_used_size(const size_t offset, const size_t capacity) {
+    return std::min(offset, capacity);
+}
+
+void LinearAllocator::reset() {
+    m_high_water_mark = std::max(m_high_water_mark, get_used_size(m_offset.load(std::memory_order_relaxed), m_capacity));
+    m_offset = 0;
+}
+
+void LinearAllocator::get_stats(TransientMemoryStats& stats) const {
+    stats.capacity = std::max(stats.capacity, m_capacity);
+    stats.high_water_mark = std::max(stats.high_water_mark, std::max(m_high_water_mark, get_used_size(m_offset.load(std::memory_order_relaxed), m_capacity)));
+    stats.failed_cnt += m_failed_cnt;
+}
@@ -0,0 +1,59 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <atomic>
+
+/*
+ * Usage of the per-frame memory for transient data, like per-draw constants.
+ */
+struct TransientMemoryStats {
+    size_t              capacity = 0;           // bytes available to each frame
+    size_t              high_water_mark = 0;    // most bytes used in a single frame, never more than the capacity
+    unsigned long long  failed_cnt = 0;         // number of allocations that didn't fit
+};
+
+/*
+ * A linear allocator on top of persistently mapped memory.
+ * Allocating is nothing but bumping an offset, which is lock-free so that multiple recording threads can share the same
+ * allocator. Nothing is freed individually, the whole allocator is reset once GPU is done with the frame owning it.
+ */
+class LinearAllocator {
+public:
+    LinearAllocator() : m_offset(0) {}
+
+    /*
+     * Start allocating from the mapped memory, the alignment has to be a power of two.
+     */
+    void initialize(void* base, const size_t capacity, const size_t alignment);
+
+    /*
+     * Allocate memory that stays valid until the next reset, the offset is relative to the beginning of the mapped memory.
+     * Nullptr is returned if there is not enough memory left.
+     */
+    void* allocate(const size_t size, size_t& offset);
+
+    /*
+     * Recycle all allocations, this can only be done when GPU is not reading any of them anymore.
+     */
+    void reset();
+
+    /*
+     * Merge the usage of this allocator into the stats, which are usually shared by the allocators of all frames.
+     */
+    void get_stats(TransientMemoryStats& stats) const;
+
+private:
+    unsigned char*                  m_base = nullptr;
+    size_t                          m_capacity = 0;
+    size_t                          m_alignment = 1;
+    // Offset of the next allocation. It keeps growing even if an allocation doesn't fit, so that the high water mark tells
+    // how much memory the frame really needs.
+    std::atomic<size_t>             m_offset;
+    size_t                          m_high_water_mark = 0;
+    std::atomic<unsigned long long> m_failed_cnt{ 0 };
+};
@@ -0,0 +1,89 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#if PLATFORM_WIN
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+#include "mapped_file.h"
+
+#if PLATFORM_WIN
+bool MappedFile::open(const char* filename) {
+    close();
+
+    m_file = CreateFileA(filename, GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (m_file == INVALID_HANDLE_VALUE) {
+        m_file = nullptr;
+        return false;
+    }
+
+    LARGE_INTEGER size;
+    if (!GetFileSizeEx(m_file, &size) || size.QuadPart <= 0) {
+        close();
+        return false;
+    }
+
+    m_mapping = CreateFileMappingA(m_file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+    m_data = m_mapping ? (const uint8_t*)MapViewOfFile(m_mapping, FILE_MAP_READ, 0, 0, 0) : nullptr;
+    if (!m_data) {
+        close();
+        return false;
+    }
+    m_size = (size_t)size.QuadPart;
+
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_data)
+        UnmapViewOfFile(m_data);
+    if (m_mapping)
+        CloseHandle(m_mapping);
+    if (m_file)
+        CloseHandle(m_file);
+    m_data = nullptr;
+    m_size = 0;
+    m_mapping = nullptr;
+    m_file = nullptr;
+}
+#else
+bool MappedFile::open(const char* filename) {
+    close();
+
+    const auto fd = ::open(filename, O_RDONLY);
+    if (fd < 0)
+        return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size <= 0) {
+        ::close(fd);
+        return false;
+    }
+
+    // the mapping keeps the file alive, the descriptor is not needed anymore
+    auto data = mmap(nullptr, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    ::close(fd);
+    if (data == MAP_FAILED)
+        return false;
+
+    // the file is read from the beginning to the end exactly once, read ahead as much as possible
+    madvise(data, (size_t)info.st_size, MADV_SEQUENTIAL);
+
+    m_data = (const uint8_t*)data;
+    m_size = (size_t)info.st_size;
+    return true;
+}
+
+void MappedFile::close() {
+    if (m_data)
+        munmap((void*)m_data, m_size);
+    m_data = nullptr;
+    m_size = 0;
+}
+#endif
@@ -0,0 +1,41 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * A file mapped into memory for reading. Nothing is read until it is touched, pages come in from the file cache on demand.
+ */
+class MappedFile {
+public:
+    MappedFile() = default;
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+    ~MappedFile() { close(); }
+
+    /*
+     * Map the whole file, empty files can't be mapped.
+     */
+    bool open(const char* filename);
+
+    /*
+     * Unmap the file, everything pointing into it is invalid afterward.
+     */
+    void close();
+
+    const uint8_t*  data() const { return m_data; }
+    size_t          size() const { return m_size; }
+
+private:
+    const uint8_t*  m_data = nullptr;
+    size_t          m_size = 0;
+#if PLATFORM_WIN
+    void*           m_file = nullptr;
+    void*           m_mapping = nullptr;
+#endif
+};
@@ -0,0 +1,247 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <float.h>
+#include <algorithm>
+#include "mesh.h"
+#include "meshlet.h"
+#include "common.h"
+
+/*
+ * There are only three vertices, it is a triangle in the middle of the screen.
+ */
+static const Vertex g_triangle_vertices[] = {
+    { {-0.35f, -0.5f, 0.0f}, 0xff0000 },
+    { { 0.35f, -0.5f, 0.0f}, 0x00ff00 },
+    { { 0.0f,  0.5f,  0.0f}, 0x0000ff },
+};
+
+static const uint32_t g_triangle_indices[] = { 0, 1, 2 };
+
+static inline uint64_t align_offset(const uint64_t offset) {
+    return (offset + MESH_FILE_ALIGNMENT - 1) & ~(uint64_t)(MESH_FILE_ALIGNMENT - 1);
+}
+
+// whether a section lies inside the file and starts at an aligned offset
+static inline bool is_valid_section(const uint64_t offset, const uint64_t size, const uint64_t file_size) {
+    return offset % MESH_FILE_ALIGNMENT == 0 && offset <= file_size && size <= file_size - offset;
+}
+
+// whether all indices are below the limit, it is what everything indexed by them relies on
+template<class T>
+static bool are_indices_in_range(const T* indices, const uint64_t cnt, const uint32_t limit) {
+    for (uint64_t i = 0; i < cnt; ++i) {
+        if (indices[i] >= limit)
+            return false;
+    }
+    return true;
+}
+
+bool Mesh::load(const char* filename) {
+    release();
+
+    if (!m_file.open(filename))
+        return false;
+    if (!validate(m_file.data(), m_file.size())) {
+        release();
+        return false;
+    }
+    return true;
+}
+
+void Mesh::create_triangle() {
+    const MeshSubmesh submesh = { 0, _countof(g_triangle_indices), 0, _countof(g_triangle_vertices) };
+    create(g_triangle_vertices, _countof(g_triangle_vertices), g_triangle_indices, _countof(g_triangle_indices), &submesh, 1);
+}
+
+bool Mesh::create(const Vertex* vertices, const uint32_t vertex_cnt, const uint32_t* indices, const uint32_t index_cnt,
+                  const MeshSubmesh* submeshes, const uint32_t submesh_cnt, const MeshletData* meshlets) {
+    release();
+
+    MeshFileHeader header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MESH_FILE_MAGIC;
+    header.version = MESH_FILE_VERSION;
+    header.header_size = sizeof(MeshFileHeader);
+    header.stream_cnt = 1;
+    header.submesh_cnt = submesh_cnt;
+    header.vertex_cnt = vertex_cnt;
+    header.index_cnt = index_cnt;
+    header.index_size = vertex_cnt <= 0x10000 ? 2 : 4;
+    for (int k = 0; k < 3; ++k) {
+        header.bounds_min[k] = vertex_cnt ? FLT_MAX : 0.0f;
+        header.bounds_max[k] = vertex_cnt ? -FLT_MAX : 0.0f;
+    }
+    for (uint32_t i = 0; i < vertex_cnt; ++i) {
+        const float position[3] = { vertices[i].position.x, vertices[i].position.y, vertices[i].position.z };
+        for (int k = 0; k < 3; ++k) {
+            header.bounds_min[k] = std::min(header.bounds_min[k], position[k]);
+            header.bounds_max[k] = std::max(header.bounds_max[k], position[k]);
+        }
+    }
+
+    MeshFileStream stream;
+    memset(&stream, 0, sizeof(stream));
+    stream.layout_hash = get_vertex_layout_hash<Vertex>();
+    stream.stride = get_vertex_stride<Vertex>();
+    stream.size = (uint64_t)vertex_cnt * stream.stride;
+
+    header.stream_table_offset = align_offset(sizeof(MeshFileHeader));
+    header.submesh_table_offset = align_offset(header.stream_table_offset + sizeof(MeshFileStream));
+    stream.offset = align_offset(header.submesh_table_offset + (uint64_t)submesh_cnt * sizeof(MeshSubmesh));
+    header.index_offset = align_offset(stream.offset + stream.size);
+    header.file_size = header.index_offset + (uint64_t)index_cnt * header.index_size;
+    if (meshlets && !meshlets->meshlets.empty()) {
+        header.meshlet_cnt = (uint32_t)meshlets->meshlets.size();
+        header.meshlet_vertex_cnt = (uint32_t)meshlets->vertices.size();
+        header.meshlet_triangles_size = (uint32_t)meshlets->triangles.size();
+        header.meshlet_table_offset = align_offset(header.file_size);
+        header.meshlet_bounds_offset = align_offset(header.meshlet_table_offset + (uint64_t)header.meshlet_cnt * sizeof(Meshlet));
+        header.meshlet_vertex_offset = align_offset(header.meshlet_bounds_offset + (uint64_t)header.meshlet_cnt * sizeof(MeshletBounds));
+        header.meshlet_triangle_offset = align_offset(header.meshlet_vertex_offset + (uint64_t)header.meshlet_vertex_cnt * sizeof(uint32_t));
+        header.file_size = header.meshlet_triangle_offset + header.meshlet_triangles_size;
+    }
+
+    m_memory.assign((size_t)header.file_size, 0);
+    memcpy(m_memory.data(), &header, sizeof(header));
+    memcpy(m_memory.data() + header.stream_table_offset, &stream, sizeof(stream));
+    if (submesh_cnt)
+        memcpy(m_memory.data() + header.submesh_table_offset, submeshes, (size_t)submesh_cnt * sizeof(MeshSubmesh));
+    if (vertex_cnt)
+        memcpy(m_memory.data() + stream.offset, vertices, (size_t)stream.size);
+    if (header.index_size == 2) {
+        auto dst = (uint16_t*)(m_memory.data() + header.index_offset);
+        for (uint32_t i = 0; i < index_cnt; ++i)
+            dst[i] = (uint16_t)indices[i];
+    } else if (index_cnt) {
+        memcpy(m_memory.data() + header.index_offset, indices, (size_t)index_cnt * sizeof(uint32_t));
+    }
+    if (header.meshlet_cnt) {
+        memcpy(m_memory.data() + header.meshlet_table_offset, meshlets->meshlets.data(), (size_t)header.meshlet_cnt * sizeof(Meshlet));
+        memcpy(m_memory.data() + header.meshlet_bounds_offset, meshlets->bounds.data(), (size_t)header.meshlet_cnt * sizeof(MeshletBounds));
+        memcpy(m_memory.data() + header.meshlet_vertex_offset, meshlets->vertices.data(), (size_t)header.meshlet_vertex_cnt * sizeof(uint32_t));
+        memcpy(m_memory.data() + header.meshlet_triangle_offset, meshlets->triangles.data(), header.meshlet_triangles_size);
+    }
+
+    if (!validate(m_memory.data(), m_memory.size())) {
+        release();
+        return false;
+    }
+    return true;
+}
+
+bool Mesh::save(const char* filename) const {
+    if (!m_data)
+        return false;
+
+    auto file = fopen(filename, "wb");
+    if (!file)
+        return false;
+    const auto written = fwrite(m_data, 1, m_size, file) == m_size;
+    return fclose(file) == 0 && written;
+}
+
+void Mesh::release() {
+    m_file.close();
+    m_memory.clear();
+    m_memory.shrink_to_fit();
+    m_data = nullptr;
+    m_size = 0;
+    m_header = nullptr;
+    m_vertices = nullptr;
+    m_indices = nullptr;
+    m_submeshes = nullptr;
+    m_meshlets = nullptr;
+    m_meshlet_bounds = nullptr;
+    m_meshlet_vertices = nullptr;
+    m_meshlet_triangles = nullptr;
+}
+
+uint64_t Mesh::get_vertices_size() const {
+    return (uint64_t)get_vertex_count() * get_vertex_stride<Vertex>();
+}
+
+/*
+ * The structure is checked, offsets, sizes and counts, along with every index, which is a single pass over the indices when
+ * the mesh is loaded. Indices refer to the whole vertex stream, meshlet vertices too, triangles of a meshlet refer to its own
+ * vertices. Nothing reading them has to check them again, neither GPU nor the meshlet paths.
+ */
+bool Mesh::validate(const uint8_t* data, const size_t size) {
+    // sections are aligned relative to the image, vertices are loaded with SIMD, the image itself has to be 16 bytes aligned
+    if (size < sizeof(MeshFileHeader) || (uintptr_t)data % 16)
+        return false;
+
+    const auto header = (const MeshFileHeader*)data;
+    if (header->magic != MESH_FILE_MAGIC || header->version != MESH_FILE_VERSION || header->header_size != sizeof(MeshFileHeader))
+        return false;
+    if (header->file_size != size || header->stream_cnt == 0 || header->index_cnt % 3 || (header->index_size != 2 && header->index_size != 4))
+        return false;
+
+    if (!is_valid_section(header->stream_table_offset, (uint64_t)header->stream_cnt * sizeof(MeshFileStream), size) ||
+        !is_valid_section(header->submesh_table_offset, (uint64_t)header->submesh_cnt * sizeof(MeshSubmesh), size) ||
+        !is_valid_section(header->index_offset, (uint64_t)header->index_cnt * header->index_size, size))
+        return false;
+
+    // the first stream is all the sample reads, it has to be exactly 'Vertex'
+    const auto stream = (const MeshFileStream*)(data + header->stream_table_offset);
+    if (stream->layout_hash != get_vertex_layout_hash<Vertex>() || stream->stride != get_vertex_stride<Vertex>() ||
+        stream->size != (uint64_t)header->vertex_cnt * stream->stride || !is_valid_section(stream->offset, stream->size, size))
+        return false;
+
+    const auto submeshes = (const MeshSubmesh*)(data + header->submesh_table_offset);
+    for (uint32_t i = 0; i < header->submesh_cnt; ++i) {
+        const auto& submesh = submeshes[i];
+        if ((uint64_t)submesh.first_index + submesh.index_cnt > header->index_cnt ||
+            (uint64_t)submesh.first_vertex + submesh.vertex_cnt > header->vertex_cnt)
+            return false;
+    }
+
+    const auto indices = data + header->index_offset;
+    if (header->index_size == 2 ? !are_indices_in_range((const uint16_t*)indices, header->index_cnt, header->vertex_cnt) :
+                                  !are_indices_in_range((const uint32_t*)indices, header->index_cnt, header->vertex_cnt))
+        return false;
+
+    // meshlets only refer to their own vertices and triangles, the range of each of them is checked
+    if (header->meshlet_cnt) {
+        if (!is_valid_section(header->meshlet_table_offset, (uint64_t)header->meshlet_cnt * sizeof(Meshlet), size) ||
+            !is_valid_section(header->meshlet_bounds_offset, (uint64_t)header->meshlet_cnt * sizeof(MeshletBounds), size) ||
+            !is_valid_section(header->meshlet_vertex_offset, (uint64_t)header->meshlet_vertex_cnt * sizeof(uint32_t), size) ||
+            !is_valid_section(header->meshlet_triangle_offset, header->meshlet_triangles_size, size))
+            return false;
+
+        const auto meshlets = (const Meshlet*)(data + header->meshlet_table_offset);
+        for (uint32_t i = 0; i < header->meshlet_cnt; ++i) {
+            const auto& meshlet = meshlets[i];
+            if (meshlet.vertex_cnt > MESHLET_MAX_VERTICES || meshlet.triangle_cnt > MESHLET_MAX_TRIANGLES ||
+                (uint64_t)meshlet.vertex_offset + meshlet.vertex_cnt > header->meshlet_vertex_cnt ||
+                (uint64_t)meshlet.triangle_offset + meshlet.triangle_cnt * 3 > header->meshlet_triangles_size)
+                return false;
+
+            const auto triangles = data + header->meshlet_triangle_offset + meshlet.triangle_offset;
+            if (!are_indices_in_range(triangles, (uint64_t)meshlet.triangle_cnt * 3, meshlet.vertex_cnt))
+                return false;
+        }
+
+        const auto meshlet_vertices = (const uint32_t*)(data + header->meshlet_vertex_offset);
+        if (!are_indices_in_range(meshlet_vertices, header->meshlet_vertex_cnt, header->vertex_cnt))
+            return false;
+    }
+
+    m_data = data;
+    m_size = size;
+    m_header = header;
+    m_vertices = (const Vertex*)(data + stream->offset);
+    m_indices = indices;
+    m_submeshes = submeshes;
+    if (header->meshlet_cnt) {
+        m_meshlets = (const Meshlet*)(data + header->meshlet_table_offset);
+        m_meshlet_bounds = (const MeshletBounds*)(data + header->meshlet_bounds_offset);
+        m_meshlet_vertices = (const uint32_t*)(data + header->meshlet_vertex_offset);
+        m_meshlet_triangles = data + header->meshlet_triangle_offset;
+    }
+    return true;
+}
@@ -0,0 +1,157 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "mapped_file.h"
+
+struct Vertex;
+struct Meshlet;
+struct MeshletBounds;
+struct MeshletData;
+
+/*
+ * Binary mesh files, written offline by 'Scripts/convert_mesh.py'.
+ * A file is an image of what is uploaded to GPU, it is mapped and read in place, there is no parsing at all. Everything is
+ * little endian and every section starts at a multiple of 'MESH_FILE_ALIGNMENT' bytes from the beginning of the file.
+ *
+ *   MeshFileHeader
+ *   MeshFileStream[stream_cnt]
+ *   MeshSubmesh[submesh_cnt]
+ *   vertices of each stream
+ *   16 bits or 32 bits indices
+ *   Meshlet[meshlet_cnt]
+ *   MeshletBounds[meshlet_cnt]
+ *   32 bits meshlet vertices
+ *   8 bits meshlet triangles
+ *
+ * Indices of all submeshes refer to the whole vertex stream, the mesh can be drawn with a single draw call. Indices are 16 bits
+ * whenever the number of vertices allows it. Meshlets are optional, they are built offline by the mesh optimizer, see
+ * 'common/meshlet.h'. The version goes up whenever the layout of the file changes, files of other versions are rejected.
+ */
+static constexpr uint32_t MESH_FILE_MAGIC = 0x4853454d;     // 'MESH'
+static constexpr uint32_t MESH_FILE_VERSION = 3;
+static constexpr uint32_t MESH_FILE_ALIGNMENT = 64;
+
+struct MeshFileHeader {
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    header_size;            // size of this header, sections are located by their offsets anyway
+    uint32_t    stream_cnt;
+    uint32_t    submesh_cnt;
+    uint32_t    vertex_cnt;
+    uint32_t    index_cnt;
+    uint32_t    index_size;             // 2 or 4 bytes
+    float       bounds_min[3];          // bounding box of all positions
+    float       bounds_max[3];
+    uint64_t    stream_table_offset;
+    uint64_t    submesh_table_offset;
+    uint64_t    index_offset;
+    uint64_t    file_size;
+    uint32_t    meshlet_cnt;            // no meshlets at all if it is 0
+    uint32_t    meshlet_vertex_cnt;
+    uint32_t    meshlet_triangles_size; // in bytes, three of them for each triangle
+    uint32_t    padding;
+    uint64_t    meshlet_table_offset;
+    uint64_t    meshlet_bounds_offset;
+    uint64_t    meshlet_vertex_offset;
+    uint64_t    meshlet_triangle_offset;
+};
+
+struct MeshFileStream {
+    uint64_t    layout_hash;            // 'get_vertex_layout_hash' of the vertex in the stream
+    uint32_t    stride;
+    uint32_t    padding;
+    uint64_t    offset;
+    uint64_t    size;
+};
+
+struct MeshSubmesh {
+    uint32_t    first_index;
+    uint32_t    index_cnt;
+    uint32_t    first_vertex;           // range of vertices the indices of the submesh refer to
+    uint32_t    vertex_cnt;
+};
+
+static_assert(sizeof(MeshFileHeader) == 136, "The mesh file header is part of the file format.");
+static_assert(sizeof(MeshFileStream) == 32, "The mesh stream is part of the file format.");
+static_assert(sizeof(MeshSubmesh) == 16, "The submesh is part of the file format.");
+
+/*
+ * A mesh of a single vertex stream of 'Vertex', either mapped from a mesh file or built in memory.
+ * Everything returned points into the file, they are only valid until the mesh is released.
+ */
+class Mesh {
+public:
+    /*
+     * Map a mesh file, the structure of the file and all indices are validated, the rest of the content is trusted.
+     */
+    bool load(const char* filename);
+
+    /*
+     * The triangle in the middle of the screen, it is what the sample draws without a mesh file.
+     */
+    void create_triangle();
+
+    /*
+     * Build a mesh in memory, the image is exactly what would be written to a mesh file. Indices are stored in 16 bits if
+     * the number of vertices allows it. Meshlets are optional.
+     */
+    bool create(const Vertex* vertices, const uint32_t vertex_cnt, const uint32_t* indices, const uint32_t index_cnt,
+                const MeshSubmesh* submeshes, const uint32_t submesh_cnt, const MeshletData* meshlets = nullptr);
+
+    /*
+     * Write the image of the mesh to a mesh file.
+     */
+    bool save(const char* filename) const;
+
+    void release();
+
+    const Vertex*       get_vertices() const { return m_vertices; }
+    uint32_t            get_vertex_count() const { return m_header ? m_header->vertex_cnt : 0; }
+    uint64_t            get_vertices_size() const;
+    const void*         get_indices() const { return m_indices; }
+    uint32_t            get_index_count() const { return m_header ? m_header->index_cnt : 0; }
+    uint32_t            get_index_size() const { return m_header ? m_header->index_size : 4; }
+    uint64_t            get_indices_size() const { return (uint64_t)get_index_count() * get_index_size(); }
+    uint32_t            get_index(const uint32_t i) const { return get_index_size() == 2 ? ((const uint16_t*)m_indices)[i] : ((const uint32_t*)m_indices)[i]; }
+    const MeshSubmesh*  get_submeshes() const { return m_submeshes; }
+    uint32_t            get_submesh_count() const { return m_header ? m_header->submesh_cnt : 0; }
+    const float*        get_bounds_min() const { return m_header ? m_header->bounds_min : nullptr; }
+    const float*        get_bounds_max() const { return m_header ? m_header->bounds_max : nullptr; }
+    const Meshlet*      get_meshlets() const { return m_meshlets; }
+    const MeshletBounds* get_meshlet_bounds() const { return m_meshlet_bounds; }
+    uint32_t            get_meshlet_count() const { return m_header ? m_header->meshlet_cnt : 0; }
+    const uint32_t*     get_meshlet_vertices() const { return m_meshlet_vertices; }
+    uint32_t            get_meshlet_vertex_count() const { return m_header ? m_header->meshlet_vertex_cnt : 0; }
+    const uint8_t*      get_meshlet_triangles() const { return m_meshlet_triangles; }
+    uint32_t            get_meshlet_triangles_size() const { return m_header ? m_header->meshlet_triangles_size : 0; }
+
+    /*
+     * The whole image of the mesh, in the layout of mesh files.
+     */
+    const uint8_t*      get_image() const { return m_data; }
+    size_t              get_image_size() const { return m_size; }
+
+private:
+    bool validate(const uint8_t* data, const size_t size);
+
+    MappedFile              m_file;
+    // image of meshes built in memory
+    std::vector<uint8_t>    m_memory;
+
+    const uint8_t*          m_data = nullptr;
+    size_t                  m_size = 0;
+    const MeshFileHeader*   m_header = nullptr;
+    const Vertex*           m_vertices = nullptr;
+    const void*             m_indices = nullptr;
+    const MeshSubmesh*      m_submeshes = nullptr;
+    const Meshlet*          m_meshlets = nullptr;
+    const MeshletBounds*    m_meshlet_bounds = nullptr;
+    const uint32_t*         m_meshlet_vertices = nullptr;
+    const uint8_t*          m_meshlet_triangles = nullptr;
+};
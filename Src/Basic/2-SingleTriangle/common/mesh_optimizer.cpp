@@ -0,0 +1,445 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <math.h>
+#include <string.h>
+#include <algorithm>
+#include <unordered_map>
+#include <vector>
+#include "mesh_optimizer.h"
+#include "mesh.h"
+#include "meshlet.h"
+#include "common.h"
+
+static constexpr uint32_t INVALID_INDEX = ~0u;
+
+// size of the LRU cache modeled by the cache optimization, it is larger than the FIFO the result is measured with on purpose
+static constexpr int FORSYTH_CACHE_SIZE = 32;
+
+/*
+ * Score of a vertex in Tom Forsyth's algorithm. Vertices of the last triangle get a fixed score so that strips are not
+ * favored, other cached vertices score higher the more recently they were used. Vertices with few triangles left get a
+ * boost to avoid leaving lonely triangles behind.
+ */
+static float get_vertex_score(const int cache_position, const uint32_t remaining_valence) {
+    if (remaining_valence == 0)
+        return -1.0f;
+
+    auto score = 0.0f;
+    if (cache_position >= 0) {
+        if (cache_position < 3)
+            score = 0.75f;
+        else
+            score = powf(1.0f - (float)(cache_position - 3) / (FORSYTH_CACHE_SIZE - 3), 1.5f);
+    }
+    return score + 2.0f / sqrtf((float)remaining_valence);
+}
+
+MeshCacheStats analyze_vertex_cache(const uint32_t* indices, const uint32_t index_cnt, const uint32_t vertex_cnt,
+                                    const unsigned int cache_size) {
+    MeshCacheStats stats;
+    if (index_cnt < 3 || cache_size == 0)
+        return stats;
+
+    // the cache is a ring of the last 'cache_size' vertices, it is small enough to be searched linearly
+    std::vector<uint32_t> cache(cache_size, INVALID_INDEX);
+    std::vector<bool> used(vertex_cnt, false);
+    unsigned int head = 0, misses = 0, used_cnt = 0;
+    for (uint32_t i = 0; i < index_cnt; ++i) {
+        const auto index = indices[i];
+        if (std::find(cache.begin(), cache.end(), index) != cache.end())
+            continue;
+
+        cache[head] = index;
+        head = (head + 1) % cache_size;
+        ++misses;
+        if (!used[index]) {
+            used[index] = true;
+            ++used_cnt;
+        }
+    }
+
+    stats.acmr = (float)misses / (index_cnt / 3);
+    stats.atvr = (float)misses / used_cnt;
+    return stats;
+}
+
+uint32_t remove_duplicate_vertices(Vertex* vertices, const uint32_t vertex_cnt, uint32_t* indices, const uint32_t index_cnt) {
+    struct VertexHash {
+        // FNV-1a over the bytes of the vertex, padding would break it but there is none in 'Vertex'
+        size_t operator()(const Vertex& vertex) const {
+            const auto bytes = (const uint8_t*)&vertex;
+            uint64_t hash = 14695981039346656037ull;
+            for (size_t i = 0; i < sizeof(Vertex); ++i)
+                hash = (hash ^ bytes[i]) * 1099511628211ull;
+            return (size_t)hash;
+        }
+    };
+    struct VertexEqual {
+        bool operator()(const Vertex& a, const Vertex& b) const {
+            return memcmp(&a, &b, sizeof(Vertex)) == 0;
+        }
+    };
+    static_assert(sizeof(Vertex) == sizeof(float3) + sizeof(unsigned int), "Vertices are compared as bytes, there can't be padding.");
+
+    std::unordered_map<Vertex, uint32_t, VertexHash, VertexEqual> unique;
+    unique.reserve(vertex_cnt);
+
+    std::vector<uint32_t> remap(vertex_cnt);
+    uint32_t unique_cnt = 0;
+    for (uint32_t i = 0; i < vertex_cnt; ++i) {
+        const auto it = unique.emplace(vertices[i], unique_cnt);
+        if (it.second)
+            vertices[unique_cnt++] = vertices[i];
+        remap[i] = it.first->second;
+    }
+
+    for (uint32_t i = 0; i < index_cnt; ++i)
+        indices[i] = remap[indices[i]];
+    return unique_cnt;
+}
+
+/*
+ * Triangles are emitted one at a time, the next one is the best scoring triangle using a vertex in the cache. When none of
+ * them is left, the first triangle not emitted yet is taken. Only vertices in the cache change score, each step is constant
+ * time and the whole optimization is linear.
+ */
+void optimize_vertex_cache(uint32_t* indices, const uint32_t index_cnt, const uint32_t vertex_cnt) {
+    const auto triangle_cnt = index_cnt / 3;
+    if (triangle_cnt == 0)
+        return;
+
+    // triangles of each vertex, the first 'valence' of them are not emitted yet
+    std::vector<uint32_t> valence(vertex_cnt, 0), offsets(vertex_cnt + 1, 0);
+    for (uint32_t i = 0; i < index_cnt; ++i)
+        ++valence[indices[i]];
+    for (uint32_t i = 0; i < vertex_cnt; ++i)
+        offsets[i + 1] = offsets[i] + valence[i];
+    std::vector<uint32_t> adjacency(index_cnt);
+    {
+        std::vector<uint32_t> cursor(offsets.begin(), offsets.end() - 1);
+        for (uint32_t i = 0; i < index_cnt; ++i)
+            adjacency[cursor[indices[i]]++] = i / 3;
+    }
+
+    std::vector<int> cache_position(vertex_cnt, -1);
+    std::vector<float> vertex_score(vertex_cnt);
+    for (uint32_t i = 0; i < vertex_cnt; ++i)
+        vertex_score[i] = get_vertex_score(-1, valence[i]);
+
+    std::vector<float> triangle_score(triangle_cnt);
+    std::vector<bool> emitted(triangle_cnt, false);
+    for (uint32_t i = 0; i < triangle_cnt; ++i)
+        triangle_score[i] = vertex_score[indices[i * 3]] + vertex_score[indices[i * 3 + 1]] + vertex_score[indices[i * 3 + 2]];
+
+    std::vector<uint32_t> output;
+    output.reserve(index_cnt);
+
+    uint32_t cache[FORSYTH_CACHE_SIZE + 3];
+    int cache_cnt = 0;
+    uint32_t next_unemitted = 0;
+    auto best = (int64_t)(std::max_element(triangle_score.begin(), triangle_score.end()) - triangle_score.begin());
+    while (best >= 0) {
+        const auto triangle = &indices[best * 3];
+        emitted[best] = true;
+        output.insert(output.end(), triangle, triangle + 3);
+
+        // the triangle is not adjacent to its vertices anymore
+        for (int k = 0; k < 3; ++k) {
+            const auto v = triangle[k];
+            const auto begin = adjacency.begin() + offsets[v];
+            const auto it = std::find(begin, begin + valence[v], (uint32_t)best);
+            std::swap(*it, *(begin + valence[v] - 1));
+            --valence[v];
+        }
+
+        // vertices of the triangle move to the front of the cache, the ones pushed beyond its size are evicted
+        uint32_t new_cache[FORSYTH_CACHE_SIZE + 3];
+        int new_cache_cnt = 0;
+        for (int k = 0; k < 3; ++k) {
+            if (std::find(new_cache, new_cache + new_cache_cnt, triangle[k]) == new_cache + new_cache_cnt)
+                new_cache[new_cache_cnt++] = triangle[k];
+        }
+        for (int k = 0; k < cache_cnt; ++k) {
+            if (std::find(new_cache, new_cache + new_cache_cnt, cache[k]) == new_cache + new_cache_cnt)
+                new_cache[new_cache_cnt++] = cache[k];
+        }
+
+        for (int k = 0; k < new_cache_cnt; ++k) {
+            const auto v = new_cache[k];
+            cache_position[v] = k < FORSYTH_CACHE_SIZE ? k : -1;
+            vertex_score[v] = get_vertex_score(cache_position[v], valence[v]);
+        }
+        for (int k = 0; k < new_cache_cnt; ++k) {
+            const auto v = new_cache[k];
+            for (uint32_t j = offsets[v]; j < offsets[v] + valence[v]; ++j) {
+                const auto t = adjacency[j];
+                triangle_score[t] = vertex_score[indices[t * 3]] + vertex_score[indices[t * 3 + 1]] + vertex_score[indices[t * 3 + 2]];
+            }
+        }
+        cache_cnt = std::min(new_cache_cnt, FORSYTH_CACHE_SIZE);
+        memcpy(cache, new_cache, sizeof(uint32_t) * cache_cnt);
+
+        best = -1;
+        auto best_score = -1.0f;
+        for (int k = 0; k < cache_cnt; ++k) {
+            const auto v = cache[k];
+            for (uint32_t j = offsets[v]; j < offsets[v] + valence[v]; ++j) {
+                const auto t = adjacency[j];
+                if (triangle_score[t] > best_score) {
+                    best_score = triangle_score[t];
+                    best = t;
+                }
+            }
+        }
+
+        if (best < 0) {
+            while (next_unemitted < triangle_cnt && emitted[next_unemitted])
+                ++next_unemitted;
+            best = next_unemitted < triangle_cnt ? (int64_t)next_unemitted : -1;
+        }
+    }
+
+    memcpy(indices, output.data(), sizeof(uint32_t) * triangle_cnt * 3);
+}
+
+/*
+ * It follows 'Fast Triangle Reordering for Vertex Locality and Reduced Overdraw' by Sander et al. A cluster starts at each
+ * triangle missing the cache on all of its vertices. Clusters facing away from the center of the mesh are more likely to
+ * occlude the others, they are drawn first.
+ */
+void optimize_overdraw(uint32_t* indices, const uint32_t index_cnt, const Vertex* vertices, const unsigned int cache_size) {
+    const auto triangle_cnt = index_cnt / 3;
+    if (triangle_cnt < 2 || cache_size == 0)
+        return;
+
+    std::vector<uint32_t> clusters;
+    {
+        std::vector<uint32_t> cache(cache_size, INVALID_INDEX);
+        unsigned int head = 0;
+        for (uint32_t i = 0; i < triangle_cnt; ++i) {
+            int misses = 0;
+            for (int k = 0; k < 3; ++k) {
+                const auto index = indices[i * 3 + k];
+                if (std::find(cache.begin(), cache.end(), index) == cache.end()) {
+                    cache[head] = index;
+                    head = (head + 1) % cache_size;
+                    ++misses;
+                }
+            }
+            if (i == 0 || misses == 3)
+                clusters.push_back(i);
+        }
+    }
+    if (clusters.size() < 2)
+        return;
+    clusters.push_back(triangle_cnt);
+
+    const auto get_position = [&](const uint32_t index) {
+        const auto& p = vertices[index].position;
+        return float3{ p.x, p.y, p.z };
+    };
+
+    struct Cluster {
+        float       centroid[3];
+        float       normal[3];
+        float       area;
+        float       sort_key;
+    };
+    // centroids are weighted by the area of each triangle
+    std::vector<Cluster> cluster_data(clusters.size() - 1);
+    float mesh_centroid[3] = { 0.0f, 0.0f, 0.0f };
+    auto mesh_area = 0.0f;
+    for (size_t c = 0; c + 1 < clusters.size(); ++c) {
+        auto& cluster = cluster_data[c];
+        memset(&cluster, 0, sizeof(cluster));
+        for (auto i = clusters[c]; i < clusters[c + 1]; ++i) {
+            const auto p0 = get_position(indices[i * 3]);
+            const auto p1 = get_position(indices[i * 3 + 1]);
+            const auto p2 = get_position(indices[i * 3 + 2]);
+            const float e0[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+            const float e1[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+            // the cross product is the normal scaled by twice the area
+            const float n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+            const auto area = sqrtf(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) * 0.5f;
+            cluster.centroid[0] += (p0.x + p1.x + p2.x) * area / 3.0f;
+            cluster.centroid[1] += (p0.y + p1.y + p2.y) * area / 3.0f;
+            cluster.centroid[2] += (p0.z + p1.z + p2.z) * area / 3.0f;
+            for (int k = 0; k < 3; ++k)
+                cluster.normal[k] += n[k];
+            cluster.area += area;
+        }
+        for (int k = 0; k < 3; ++k)
+            mesh_centroid[k] += cluster.centroid[k];
+        mesh_area += cluster.area;
+        if (cluster.area > 0.0f) {
+            for (int k = 0; k < 3; ++k)
+                cluster.centroid[k] /= cluster.area;
+        }
+    }
+    if (mesh_area > 0.0f) {
+        for (int k = 0; k < 3; ++k)
+            mesh_centroid[k] /= mesh_area;
+    }
+
+    for (auto& cluster : cluster_data) {
+        const auto length = sqrtf(cluster.normal[0] * cluster.normal[0] + cluster.normal[1] * cluster.normal[1] + cluster.normal[2] * cluster.normal[2]);
+        cluster.sort_key = 0.0f;
+        if (length > 0.0f) {
+            for (int k = 0; k < 3; ++k)
+                cluster.sort_key += (cluster.centroid[k] - mesh_centroid[k]) * cluster.normal[k] / length;
+        }
+    }
+
+    std::vector<uint32_t> order(cluster_data.size());
+    for (uint32_t i = 0; i < order.size(); ++i)
+        order[i] = i;
+    std::stable_sort(order.begin(), order.end(), [&](const uint32_t a, const uint32_t b) {
+        return cluster_data[a].sort_key > cluster_data[b].sort_key;
+    });
+
+    std::vector<uint32_t> output;
+    output.reserve(index_cnt);
+    for (const auto c : order)
+        output.insert(output.end(), indices + clusters[c] * 3, indices + clusters[c + 1] * 3);
+    memcpy(indices, output.data(), sizeof(uint32_t) * output.size());
+}
+
+uint32_t optimize_vertex_fetch(Vertex* vertices, const uint32_t vertex_cnt, uint32_t* indices, const uint32_t index_cnt) {
+    std::vector<uint32_t> remap(vertex_cnt, INVALID_INDEX);
+    uint32_t next = 0;
+    for (uint32_t i = 0; i < index_cnt; ++i) {
+        auto& index = remap[indices[i]];
+        if (index == INVALID_INDEX)
+            index = next++;
+        indices[i] = index;
+    }
+
+    const std::vector<Vertex> original(vertices, vertices + vertex_cnt);
+    for (uint32_t i = 0; i < vertex_cnt; ++i) {
+        if (remap[i] != INVALID_INDEX)
+            vertices[remap[i]] = original[i];
+    }
+    return next;
+}
+
+bool optimize_mesh(const Mesh& input, Mesh& output, MeshOptimizationStats& stats) {
+    const auto index_cnt = input.get_index_count();
+    auto vertex_cnt = input.get_vertex_count();
+
+    std::vector<Vertex> vertices(input.get_vertices(), input.get_vertices() + vertex_cnt);
+    std::vector<uint32_t> indices(index_cnt);
+    for (uint32_t i = 0; i < index_cnt; ++i) {
+        indices[i] = input.get_index(i);
+        if (indices[i] >= vertex_cnt)
+            return false;
+    }
+
+    // a mesh without submeshes is drawn as a whole
+    std::vector<MeshSubmesh> submeshes(input.get_submeshes(), input.get_submeshes() + input.get_submesh_count());
+    if (submeshes.empty())
+        submeshes.push_back(MeshSubmesh{ 0, index_cnt, 0, vertex_cnt });
+
+    stats = MeshOptimizationStats();
+    stats.triangle_cnt = index_cnt / 3;
+    stats.original_vertex_cnt = vertex_cnt;
+    stats.original_index_size = input.get_index_size();
+    stats.original_cache = analyze_vertex_cache(indices.data(), index_cnt, vertex_cnt);
+
+    vertex_cnt = remove_duplicate_vertices(vertices.data(), vertex_cnt, indices.data(), index_cnt);
+
+    // submeshes are optimized one by one with local vertex indices, so that the cost doesn't scale with the whole mesh
+    std::vector<uint32_t> local(vertex_cnt, INVALID_INDEX);
+    std::vector<uint32_t> global;
+    std::vector<uint32_t> submesh_indices;
+    for (const auto& submesh : submeshes) {
+        const auto first = indices.data() + submesh.first_index;
+        submesh_indices.resize(submesh.index_cnt);
+        global.clear();
+        for (uint32_t i = 0; i < submesh.index_cnt; ++i) {
+            auto& index = local[first[i]];
+            if (index == INVALID_INDEX) {
+                index = (uint32_t)global.size();
+                global.push_back(first[i]);
+            }
+            submesh_indices[i] = index;
+        }
+
+        optimize_vertex_cache(submesh_indices.data(), submesh.index_cnt, (uint32_t)global.size());
+        for (uint32_t i = 0; i < submesh.index_cnt; ++i)
+            first[i] = global[submesh_indices[i]];
+        optimize_overdraw(first, submesh.index_cnt, vertices.data());
+
+        for (const auto v : global)
+            local[v] = INVALID_INDEX;
+    }
+
+    vertex_cnt = optimize_vertex_fetch(vertices.data(), vertex_cnt, indices.data(), index_cnt);
+
+    // vertices are in the order of first use, each submesh refers to a range of them again
+    for (auto& submesh : submeshes) {
+        auto lower = INVALID_INDEX, upper = 0u;
+        for (uint32_t i = submesh.first_index; i < submesh.first_index + submesh.index_cnt; ++i) {
+            lower = std::min(lower, indices[i]);
+            upper = std::max(upper, indices[i]);
+        }
+        submesh.first_vertex = submesh.index_cnt ? lower : 0;
+        submesh.vertex_cnt = submesh.index_cnt ? upper + 1 - lower : 0;
+    }
+
+    stats.optimized_vertex_cnt = vertex_cnt;
+    stats.optimized_cache = analyze_vertex_cache(indices.data(), index_cnt, vertex_cnt);
+
+    // the index stream is already in cache order, meshlets are built from it as it is
+    MeshletData meshlets;
+    for (const auto& submesh : submeshes)
+        build_meshlets(indices.data() + submesh.first_index, submesh.index_cnt, vertices.data(), vertex_cnt, meshlets);
+    stats.meshlet_cnt = (unsigned int)meshlets.meshlets.size();
+
+    if (!output.create(vertices.data(), vertex_cnt, indices.data(), index_cnt, submeshes.data(), (uint32_t)submeshes.size(), &meshlets))
+        return false;
+    stats.optimized_index_size = output.get_index_size();
+    return true;
+}
+
+bool add_mesh_meshlets(const Mesh& input, Mesh& output) {
+    MeshletData meshlets;
+    if (!build_mesh_meshlets(input, meshlets))
+        return false;
+
+    std::vector<uint32_t> indices(input.get_index_count());
+    for (uint32_t i = 0; i < input.get_index_count(); ++i)
+        indices[i] = input.get_index(i);
+    return output.create(input.get_vertices(), input.get_vertex_count(), indices.data(), input.get_index_count(),
+                         input.get_submeshes(), input.get_submesh_count(), &meshlets);
+}
+
+bool load_sample_mesh(Mesh& mesh, const char* filename, const bool optimize, const bool meshlets, MeshOptimizationStats& stats) {
+    stats = MeshOptimizationStats();
+
+    const auto load = [&](Mesh& target) {
+        if (!filename || !*filename) {
+            target.create_triangle();
+            return true;
+        }
+        return target.load(filename);
+    };
+    if (optimize) {
+        Mesh original;
+        return load(original) && optimize_mesh(original, mesh, stats);
+    }
+
+    if (!meshlets)
+        return load(mesh);
+
+    // meshlets are usually in the file already, they are only built here for files converted without them
+    if (!load(mesh))
+        return false;
+    if (mesh.get_meshlet_count() || mesh.get_index_count() == 0)
+        return true;
+    // mapped files can't move, the file is simply mapped a second time
+    Mesh original;
+    return load(original) && add_mesh_meshlets(original, mesh);
+}
@@ -0,0 +1,89 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+
+struct Vertex;
+class Mesh;
+
+/*
+ * Size of the FIFO post-transform cache the statistics are measured with, it is roughly what recent GPUs behave like.
+ */
+static constexpr unsigned int MESH_CACHE_SIZE = 16;
+
+/*
+ * Efficiency of the post-transform cache for an index stream.
+ *   ACMR, average cache miss ratio, vertex shader invocations per triangle, between 0.5 and 3, lower is better.
+ *   ATVR, average transformed vertex ratio, vertex shader invocations per vertex, 1 is the best possible.
+ */
+struct MeshCacheStats {
+    float   acmr = 0.0f;
+    float   atvr = 0.0f;
+};
+
+/*
+ * A mesh before and after it is optimized.
+ */
+struct MeshOptimizationStats {
+    unsigned int        triangle_cnt = 0;
+    unsigned int        original_vertex_cnt = 0;
+    unsigned int        optimized_vertex_cnt = 0;
+    unsigned int        original_index_size = 0;
+    unsigned int        optimized_index_size = 0;
+    MeshCacheStats      original_cache;
+    MeshCacheStats      optimized_cache;
+    unsigned int        meshlet_cnt = 0;
+};
+
+/*
+ * Simulate a FIFO post-transform cache of 'cache_size' entries over an index stream.
+ */
+MeshCacheStats analyze_vertex_cache(const uint32_t* indices, const uint32_t index_cnt, const uint32_t vertex_cnt,
+                                    const unsigned int cache_size = MESH_CACHE_SIZE);
+
+/*
+ * Merge vertices that are identical to the bit, indices are remapped to the first of them. Returns the number of vertices
+ * left, they are compacted at the beginning of 'vertices'.
+ */
+uint32_t remove_duplicate_vertices(Vertex* vertices, const uint32_t vertex_cnt, uint32_t* indices, const uint32_t index_cnt);
+
+/*
+ * Reorder triangles for the post-transform cache, it is Tom Forsyth's linear-speed vertex cache optimization. Indices have
+ * to be less than 'vertex_cnt'.
+ */
+void optimize_vertex_cache(uint32_t* indices, const uint32_t index_cnt, const uint32_t vertex_cnt);
+
+/*
+ * Reorder clusters of triangles from the outside in to reduce overdraw, the order of triangles within a cluster is kept.
+ * Clusters are split where the cache is cold anyway, so the cache efficiency of a cache optimized stream barely changes.
+ */
+void optimize_overdraw(uint32_t* indices, const uint32_t index_cnt, const Vertex* vertices,
+                       const unsigned int cache_size = MESH_CACHE_SIZE);
+
+/*
+ * Reorder vertices in the order indices first refer to them, vertices that are never referred to are dropped. Returns the
+ * number of vertices left.
+ */
+uint32_t optimize_vertex_fetch(Vertex* vertices, const uint32_t vertex_cnt, uint32_t* indices, const uint32_t index_cnt);
+
+/*
+ * The whole pipeline, redundant vertices are removed, each submesh is optimized for the vertex cache and overdraw, then the
+ * vertices are reordered for fetching. Triangles never move between submeshes. Meshlets are built last, see
+ * 'common/meshlet.h'.
+ */
+bool optimize_mesh(const Mesh& input, Mesh& output, MeshOptimizationStats& stats);
+
+/*
+ * Copy a mesh with its meshlets built, the order of its triangles is kept.
+ */
+bool add_mesh_meshlets(const Mesh& input, Mesh& output);
+
+/*
+ * Load the mesh drawn by the sample, the triangle if there is no mesh file. Mesh files are mapped and drawn as they are, unless
+ * they are optimized in memory first, or they have no meshlets while 'meshlets' asks for them.
+ */
+bool load_sample_mesh(Mesh& mesh, const char* filename, const bool optimize, const bool meshlets, MeshOptimizationStats& stats);
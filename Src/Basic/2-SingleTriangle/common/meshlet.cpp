@@ -0,0 +1,163 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <math.h>
+#include <float.h>
+#include <algorithm>
+#include "meshlet.h"
+#include "mesh.h"
+#include "mesh_optimizer.h"
+#include "common.h"
+
+static constexpr uint32_t INVALID_INDEX = ~0u;
+
+// the cutoff of a cone that never culls anything, it is larger than any sine
+static constexpr float NO_CONE_CUTOFF = 2.0f;
+
+void build_meshlets(const uint32_t* indices, const uint32_t index_cnt, const Vertex* vertices, const uint32_t vertex_cnt, MeshletData& meshlets) {
+    // slot of each vertex in the current meshlet, they are reset whenever a meshlet is closed
+    std::vector<uint32_t> slot(vertex_cnt, INVALID_INDEX);
+
+    Meshlet current = { (uint32_t)meshlets.vertices.size(), (uint32_t)meshlets.triangles.size(), 0, 0 };
+    const auto close = [&]() {
+        if (current.triangle_cnt == 0)
+            return;
+        for (uint32_t i = 0; i < current.vertex_cnt; ++i)
+            slot[meshlets.vertices[current.vertex_offset + i]] = INVALID_INDEX;
+        meshlets.meshlets.push_back(current);
+        meshlets.bounds.push_back(compute_meshlet_bounds(meshlets, current, vertices));
+        current = { (uint32_t)meshlets.vertices.size(), (uint32_t)meshlets.triangles.size(), 0, 0 };
+    };
+
+    for (uint32_t i = 0; i + 2 < index_cnt; i += 3) {
+        const auto a = indices[i], b = indices[i + 1], c = indices[i + 2];
+        // degenerate triangles may refer to the same vertex more than once, it only takes one slot
+        const auto new_cnt = (slot[a] == INVALID_INDEX) + (slot[b] == INVALID_INDEX && b != a) +
+                             (slot[c] == INVALID_INDEX && c != a && c != b);
+        if (current.vertex_cnt + new_cnt > MESHLET_MAX_VERTICES || current.triangle_cnt + 1 > MESHLET_MAX_TRIANGLES)
+            close();
+
+        for (const auto v : { a, b, c }) {
+            if (slot[v] == INVALID_INDEX) {
+                slot[v] = current.vertex_cnt++;
+                meshlets.vertices.push_back(v);
+            }
+            meshlets.triangles.push_back((uint8_t)slot[v]);
+        }
+        ++current.triangle_cnt;
+    }
+    close();
+}
+
+/*
+ * The sphere is centered at the center of the bounding box, it is not the smallest one but close enough for culling. The cone
+ * axis is the average of the normals of all triangles, the cone is just wide enough to contain all of them.
+ */
+MeshletBounds compute_meshlet_bounds(const MeshletData& meshlets, const Meshlet& meshlet, const Vertex* vertices) {
+    const auto get_position = [&](const uint32_t slot) {
+        return vertices[meshlets.vertices[meshlet.vertex_offset + slot]].position;
+    };
+
+    MeshletBounds bounds;
+    float lower[3] = { FLT_MAX, FLT_MAX, FLT_MAX }, upper[3] = { -FLT_MAX, -FLT_MAX, -FLT_MAX };
+    for (uint32_t i = 0; i < meshlet.vertex_cnt; ++i) {
+        const auto p = get_position(i);
+        const float position[3] = { p.x, p.y, p.z };
+        for (int k = 0; k < 3; ++k) {
+            lower[k] = std::min(lower[k], position[k]);
+            upper[k] = std::max(upper[k], position[k]);
+        }
+    }
+    for (int k = 0; k < 3; ++k)
+        bounds.center[k] = meshlet.vertex_cnt ? (lower[k] + upper[k]) * 0.5f : 0.0f;
+
+    auto radius_sq = 0.0f;
+    for (uint32_t i = 0; i < meshlet.vertex_cnt; ++i) {
+        const auto p = get_position(i);
+        const float d[3] = { p.x - bounds.center[0], p.y - bounds.center[1], p.z - bounds.center[2] };
+        radius_sq = std::max(radius_sq, d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+    }
+    bounds.radius = sqrtf(radius_sq);
+
+    // unit normals of triangles, degenerate ones have no facing and don't affect the cone
+    std::vector<float3> normals;
+    normals.reserve(meshlet.triangle_cnt);
+    const auto triangles = meshlets.triangles.data() + meshlet.triangle_offset;
+    for (uint32_t i = 0; i < meshlet.triangle_cnt; ++i) {
+        const auto p0 = get_position(triangles[i * 3]);
+        const auto p1 = get_position(triangles[i * 3 + 1]);
+        const auto p2 = get_position(triangles[i * 3 + 2]);
+        const float e0[3] = { p1.x - p0.x, p1.y - p0.y, p1.z - p0.z };
+        const float e1[3] = { p2.x - p0.x, p2.y - p0.y, p2.z - p0.z };
+        const float3 n = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+        const auto length = sqrtf(n.x * n.x + n.y * n.y + n.z * n.z);
+        if (length > 0.0f)
+            normals.push_back(float3{ n.x / length, n.y / length, n.z / length });
+    }
+
+    float3 axis = { 0.0f, 0.0f, 0.0f };
+    for (const auto& n : normals) {
+        axis.x += n.x;
+        axis.y += n.y;
+        axis.z += n.z;
+    }
+    const auto axis_length = sqrtf(axis.x * axis.x + axis.y * axis.y + axis.z * axis.z);
+    if (axis_length > 0.0f) {
+        axis = float3{ axis.x / axis_length, axis.y / axis_length, axis.z / axis_length };
+
+        // the cosine of the widest angle between the axis and a normal, the cone is useless once it reaches a half sphere
+        auto min_dot = 1.0f;
+        for (const auto& n : normals)
+            min_dot = std::min(min_dot, n.x * axis.x + n.y * axis.y + n.z * axis.z);
+        bounds.cone_cutoff = min_dot > 0.0f ? sqrtf(1.0f - min_dot * min_dot) : NO_CONE_CUTOFF;
+    } else {
+        bounds.cone_cutoff = NO_CONE_CUTOFF;
+    }
+    bounds.cone_axis[0] = axis.x;
+    bounds.cone_axis[1] = axis.y;
+    bounds.cone_axis[2] = axis.z;
+    return bounds;
+}
+
+bool build_mesh_meshlets(const Mesh& mesh, MeshletData& meshlets) {
+    meshlets = MeshletData();
+
+    const auto index_cnt = mesh.get_index_count();
+    const auto vertex_cnt = mesh.get_vertex_count();
+
+    // a mesh without submeshes is a single one
+    std::vector<MeshSubmesh> submeshes(mesh.get_submeshes(), mesh.get_submeshes() + mesh.get_submesh_count());
+    if (submeshes.empty())
+        submeshes.push_back(MeshSubmesh{ 0, index_cnt, 0, vertex_cnt });
+
+    // like the optimizer, each submesh is reordered with local vertex indices
+    std::vector<uint32_t> local(vertex_cnt, INVALID_INDEX);
+    std::vector<uint32_t> global;
+    std::vector<uint32_t> submesh_indices;
+    for (const auto& submesh : submeshes) {
+        submesh_indices.resize(submesh.index_cnt);
+        global.clear();
+        for (uint32_t i = 0; i < submesh.index_cnt; ++i) {
+            const auto vertex = mesh.get_index(submesh.first_index + i);
+            if (vertex >= vertex_cnt)
+                return false;
+            auto& index = local[vertex];
+            if (index == INVALID_INDEX) {
+                index = (uint32_t)global.size();
+                global.push_back(vertex);
+            }
+            submesh_indices[i] = index;
+        }
+
+        optimize_vertex_cache(submesh_indices.data(), submesh.index_cnt, (uint32_t)global.size());
+        for (auto& index : submesh_indices)
+            index = global[index];
+        build_meshlets(submesh_indices.data(), submesh.index_cnt, mesh.get_vertices(), vertex_cnt, meshlets);
+
+        for (const auto v : global)
+            local[v] = INVALID_INDEX;
+    }
+    return true;
+}
@@ -0,0 +1,101 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+
+struct Vertex;
+class Mesh;
+
+/*
+ * Limits of a meshlet, they fit the output limits every mesh shader implementation guarantees. 124 triangles leave room for
+ * the primitive count to stay below 128 with some implementations packing 4 bytes per primitive.
+ */
+static constexpr uint32_t MESHLET_MAX_VERTICES = 64;
+static constexpr uint32_t MESHLET_MAX_TRIANGLES = 124;
+
+/*
+ * A small cluster of triangles, drawn by a single mesh shader workgroup. Its vertices are indices into the vertex stream of
+ * the mesh, its triangles are three bytes each, indices into the vertices of the meshlet. Triangles of all meshlets are
+ * packed without any padding, so 'triangle_offset' is also where the triangles of the meshlet start once they are expanded
+ * into an index buffer.
+ */
+struct Meshlet {
+    uint32_t    vertex_offset;          // first vertex in the meshlet vertices
+    uint32_t    triangle_offset;        // first byte in the meshlet triangles
+    uint32_t    vertex_cnt;
+    uint32_t    triangle_cnt;
+};
+
+/*
+ * Bounds of a meshlet for culling. All normals of the meshlet are within the cone around 'cone_axis', the cutoff is the sine
+ * of the half angle of the cone, larger than one if the cone is too wide to cull anything.
+ *
+ * There is no camera, the view direction is +z everywhere and positions are only scaled and moved by each draw. A meshlet
+ * faces away from the viewer, as in all of its triangles are back faces, if 'cone_axis.z <= -cone_cutoff'. Front faces are
+ * counter-clockwise on screen.
+ */
+struct MeshletBounds {
+    float       center[3];
+    float       radius;
+    float       cone_axis[3];
+    float       cone_cutoff;
+};
+
+static_assert(sizeof(Meshlet) == 16, "Meshlets are part of the mesh file format and read by shaders as they are.");
+static_assert(sizeof(MeshletBounds) == 32, "Meshlet bounds are part of the mesh file format and read by shaders as they are.");
+
+/*
+ * Meshlets of a whole mesh.
+ */
+struct MeshletData {
+    std::vector<Meshlet>        meshlets;
+    std::vector<MeshletBounds>  bounds;
+    std::vector<uint32_t>       vertices;
+    std::vector<uint8_t>        triangles;
+};
+
+/*
+ * How a backend culls and draws meshlets.
+ */
+enum class MeshletPath {
+    None,               // the mesh is drawn as a whole, without any culling
+    MeshShader,         // task shaders cull meshlets, mesh shaders draw the visible ones
+    ComputeCulled,      // a compute shader culls meshlets into indexed indirect draws, for devices without mesh shaders
+};
+
+inline const char* get_meshlet_path_name(const MeshletPath path) {
+    return path == MeshletPath::MeshShader ? "mesh shader" : path == MeshletPath::ComputeCulled ? "compute culled" : "none";
+}
+
+/*
+ * Meshlet culling of the last frame read back.
+ */
+struct MeshletStats {
+    MeshletPath         path = MeshletPath::None;
+    unsigned int        meshlet_cnt = 0;            // meshlets of the mesh
+    unsigned long long  tested = 0;                 // each meshlet is tested once for each draw
+    unsigned long long  visible = 0;                // meshlets surviving frustum and cone culling
+};
+
+/*
+ * Partition triangles into meshlets, in the order they are listed. A meshlet is closed as soon as the next triangle doesn't
+ * fit into it, so the index stream is expected to be optimized for the vertex cache, which keeps neighboring triangles
+ * together. Meshlets are appended to 'meshlets'.
+ */
+void build_meshlets(const uint32_t* indices, const uint32_t index_cnt, const Vertex* vertices, const uint32_t vertex_cnt, MeshletData& meshlets);
+
+/*
+ * Bounding sphere and normal cone of the triangles of a meshlet.
+ */
+MeshletBounds compute_meshlet_bounds(const MeshletData& meshlets, const Meshlet& meshlet, const Vertex* vertices);
+
+/*
+ * Build the meshlets of each submesh of a mesh, a meshlet never crosses submeshes. The vertex cache optimization is done on
+ * a copy of the indices before partitioning, the mesh itself is not changed. It fails on indices out of range.
+ */
+bool build_mesh_meshlets(const Mesh& mesh, MeshletData& meshlets);
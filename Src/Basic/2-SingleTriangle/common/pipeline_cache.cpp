@@ -0,0 +1,93 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <stdio.h>
+#include <string.h>
+#include <string>
+#include "pipeline_cache.h"
+
+#if PLATFORM_WIN
+#include <windows.h>
+#endif
+
+// 'PCHE' and the version of the file format, a file of a different version is ignored.
+static constexpr uint32_t PIPELINE_CACHE_MAGIC = 0x45484350;
+static constexpr uint32_t PIPELINE_CACHE_VERSION = 1;
+
+// The header of the file, the blob follows it right away.
+struct PipelineCacheHeader {
+    uint32_t            magic;
+    uint32_t            version;
+    PipelineCacheKey    key;
+    uint64_t            size;
+    uint64_t            checksum;
+};
+
+// FNV-1a, it is only for detecting truncated or corrupted files.
+static uint64_t checksum(const uint8_t* data, const size_t size) {
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < size; ++i) {
+        hash ^= data[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+static bool same_key(const PipelineCacheKey& a, const PipelineCacheKey& b) {
+    return a.vendor_id == b.vendor_id && a.device_id == b.device_id && a.driver_version == b.driver_version &&
+           memcmp(a.uuid, b.uuid, sizeof(a.uuid)) == 0;
+}
+
+bool load_pipeline_cache(const char* filename, const PipelineCacheKey& key, std::vector<uint8_t>& blob) {
+    blob.clear();
+
+    auto file = fopen(filename, "rb");
+    if (!file)
+        return false;
+
+    PipelineCacheHeader header;
+    auto ret = fread(&header, sizeof(header), 1, file) == 1 && header.magic == PIPELINE_CACHE_MAGIC &&
+               header.version == PIPELINE_CACHE_VERSION && same_key(header.key, key);
+    if (ret) {
+        blob.resize((size_t)header.size);
+        ret = fread(blob.data(), 1, blob.size(), file) == blob.size() && checksum(blob.data(), blob.size()) == header.checksum;
+    }
+    fclose(file);
+
+    if (!ret)
+        blob.clear();
+    return ret;
+}
+
+bool save_pipeline_cache(const char* filename, const PipelineCacheKey& key, const void* data, const size_t size) {
+    PipelineCacheHeader header = {};
+    header.magic = PIPELINE_CACHE_MAGIC;
+    header.version = PIPELINE_CACHE_VERSION;
+    header.key = key;
+    header.size = size;
+    header.checksum = checksum((const uint8_t*)data, size);
+
+    const auto temp_filename = std::string(filename) + ".tmp";
+    auto file = fopen(temp_filename.c_str(), "wb");
+    if (!file)
+        return false;
+
+    auto ret = fwrite(&header, sizeof(header), 1, file) == 1 && fwrite(data, 1, size, file) == size;
+    ret = (fclose(file) == 0) && ret;
+    if (!ret) {
+        remove(temp_filename.c_str());
+        return false;
+    }
+
+    // rename is atomic, the file is either the old one or the new one
+#if PLATFORM_WIN
+    ret = MoveFileExA(temp_filename.c_str(), filename, MOVEFILE_REPLACE_EXISTING | MOVEFILE_WRITE_THROUGH) != 0;
+#else
+    ret = rename(temp_filename.c_str(), filename) == 0;
+#endif
+    if (!ret)
+        remove(temp_filename.c_str());
+    return ret;
+}
@@ -0,0 +1,34 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <vector>
+
+/*
+ * What a pipeline cache blob is only valid for. A blob from a different GPU or driver is useless at best and could crash the
+ * driver at worst, it is simply ignored.
+ */
+struct PipelineCacheKey {
+    uint32_t    vendor_id = 0;
+    uint32_t    device_id = 0;
+    uint64_t    driver_version = 0;
+    uint8_t     uuid[16] = {};          // pipeline cache uuid on Vulkan, zero if the API doesn't have one
+};
+
+/*
+ * Load a pipeline cache blob saved by 'save_pipeline_cache'.
+ * The file header has to match the key and the checksum of the blob, otherwise nothing is loaded.
+ */
+bool load_pipeline_cache(const char* filename, const PipelineCacheKey& key, std::vector<uint8_t>& blob);
+
+/*
+ * Save a pipeline cache blob along with its key.
+ * The blob is written to a temporary file first, which then replaces the old file, a crash in the middle never leaves a
+ * broken cache behind.
+ */
+bool save_pipeline_cache(const char* filename, const PipelineCacheKey& key, const void* data, const size_t size);
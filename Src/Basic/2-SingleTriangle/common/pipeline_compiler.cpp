@@ -0,0 +1,41 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include "pipeline_compiler.h"
+
+const AsyncPipeline* AsyncPipeline::resolve() const {
+    for (auto pipeline = this; pipeline; pipeline = pipeline->m_fallback.get()) {
+        if (pipeline->is_ready())
+            return pipeline;
+    }
+    return nullptr;
+}
+
+PipelineCompiler::PipelineCompiler(FrameProfiler& profiler, const unsigned int thread_cnt)
+    : m_profiler(profiler), m_pool(thread_cnt ? thread_cnt : 1) {
+}
+
+PipelineCompiler::~PipelineCompiler() {
+    wait_idle();
+}
+
+void PipelineCompiler::compile(std::shared_ptr<AsyncPipeline> pipeline, std::function<bool()> task) {
+    ++m_pending_cnt;
+    m_pool.submit([this, pipeline, task]() {
+        bool succeeded;
+        {
+            PROFILE_ZONE(m_profiler, pipeline->name());
+            succeeded = task();
+        }
+
+        // the pipeline object is written by the task, publishing the status makes it visible to the threads recording draws
+        pipeline->m_status.store(succeeded ? AsyncPipeline::Status::Ready : AsyncPipeline::Status::Failed, std::memory_order_release);
+        --m_pending_cnt;
+    });
+}
+
+void PipelineCompiler::wait_idle() {
+    m_pool.wait_idle();
+}
@@ -0,0 +1,93 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <functional>
+#include "thread_pool.h"
+#include "profiler.h"
+
+/*
+ * A pipeline compiled in the background.
+ * Backends derive from it to keep the actual pipeline object, which is only safe to touch once the pipeline is ready. A draw
+ * never waits for a pipeline, it uses whatever 'resolve' returns and is skipped if there is nothing ready at all.
+ */
+class AsyncPipeline {
+public:
+    enum class Status {
+        Pending,
+        Ready,
+        Failed,
+    };
+
+    /*
+     * The name has to be a string literal, it is what the profiler zone of the compilation is called.
+     */
+    explicit AsyncPipeline(const char* name) : m_name(name) {}
+    virtual ~AsyncPipeline() {}
+
+    const char* name() const { return m_name; }
+    Status status() const { return m_status.load(std::memory_order_acquire); }
+    bool is_ready() const { return status() == Status::Ready; }
+
+    /*
+     * The pipeline to use until this one is ready, it is usually a cheaper pipeline that is compiled already. It can only be set
+     * before the pipeline is handed to the compiler.
+     */
+    void set_fallback(std::shared_ptr<AsyncPipeline> fallback) { m_fallback = std::move(fallback); }
+
+    /*
+     * This pipeline if it is ready, otherwise the first ready one along its fallbacks. nullptr means the draw has to be skipped.
+     */
+    const AsyncPipeline* resolve() const;
+
+private:
+    friend class PipelineCompiler;
+
+    const char*                     m_name;
+    std::atomic<Status>             m_status{ Status::Pending };
+    std::shared_ptr<AsyncPipeline>  m_fallback;
+};
+
+/*
+ * Pipelines are compiled on background threads, so that a new pipeline never stalls the frame recording it.
+ * The compiler has its own threads, a compilation can take way longer than a frame and it shouldn't hold up the threads
+ * recording commands.
+ */
+class PipelineCompiler {
+public:
+    /*
+     * There is always at least one background thread, even if 0 is passed in.
+     */
+    PipelineCompiler(FrameProfiler& profiler, const unsigned int thread_cnt);
+
+    /*
+     * Wait for all pending compilations.
+     */
+    ~PipelineCompiler();
+
+    /*
+     * Compile the pipeline in the background, the task creates the pipeline object and returns whether it succeeds. The
+     * pipeline is marked as ready or failed once the task is done, nothing else should touch the pipeline object until then.
+     */
+    void compile(std::shared_ptr<AsyncPipeline> pipeline, std::function<bool()> task);
+
+    /*
+     * Wait until all pipelines handed to the compiler are done, it is for loading screens and shutdown.
+     */
+    void wait_idle();
+
+    /*
+     * Number of pipelines not done yet.
+     */
+    unsigned int pending_count() const { return m_pending_cnt.load(std::memory_order_relaxed); }
+
+private:
+    FrameProfiler&              m_profiler;
+    std::atomic<unsigned int>   m_pending_cnt{ 0 };
+    ThreadPool                  m_pool;
+};
@@ -0,0 +1,126 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <stdio.h>
+#include <chrono>
+#include <algorithm>
+#include "profiler.h"
+
+// Each thread gets a small id the first time it records anything, which is a lot more readable than the native thread id.
+static std::atomic<unsigned int>    g_thread_cnt(0);
+static thread_local unsigned int    t_thread_id = 0xffffffff;
+
+static unsigned int current_thread_id() {
+    if (t_thread_id == 0xffffffff)
+        t_thread_id = g_thread_cnt++;
+    return t_thread_id;
+}
+
+static long long steady_now() {
+    return (long long)std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+FrameProfiler::FrameProfiler(const unsigned int capacity) : m_write_index(0), m_frame(0) {
+    m_capacity = 1;
+    while (m_capacity < capacity)
+        m_capacity <<= 1;
+
+    m_slots = std::make_unique<Slot[]>(m_capacity);
+    for (unsigned int i = 0; i < m_capacity; ++i)
+        m_slots[i].sequence.store(0, std::memory_order_relaxed);
+
+    m_epoch = steady_now();
+}
+
+long long FrameProfiler::now() const {
+    return steady_now() - m_epoch;
+}
+
+void FrameProfiler::record(const char* name, const long long begin_ns, const long long end_ns) {
+    ProfileEvent event;
+    event.name = name;
+    event.frame = m_frame.load(std::memory_order_relaxed);
+    event.begin_ns = begin_ns;
+    event.end_ns = end_ns;
+    event.thread = current_thread_id();
+    push(event);
+}
+
+void FrameProfiler::record_gpu(const char* name, const unsigned long long frame, const long long begin_ns, const long long end_ns) {
+    ProfileEvent event;
+    event.name = name;
+    event.frame = frame;
+    event.begin_ns = begin_ns;
+    event.end_ns = end_ns;
+    event.thread = GPU_THREAD;
+    push(event);
+}
+
+void FrameProfiler::push(const ProfileEvent& event) {
+    // Each writer owns a unique index, the sequence number of the slot is odd while it is being written and becomes
+    // '2 * (index + 1)' once the event is completely written.
+    const auto index = m_write_index.fetch_add(1, std::memory_order_relaxed);
+    auto& slot = m_slots[index & (m_capacity - 1)];
+
+    slot.sequence.store(2 * index + 1, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_release);
+    slot.event = event;
+    slot.sequence.store(2 * (index + 1), std::memory_order_release);
+}
+
+void FrameProfiler::get_events(std::vector<ProfileEvent>& events) const {
+    events.clear();
+
+    unsigned long long cursor = 0;
+    poll_events(events, cursor);
+}
+
+void FrameProfiler::poll_events(std::vector<ProfileEvent>& events, unsigned long long& cursor) const {
+    const auto write_index = m_write_index.load(std::memory_order_acquire);
+    cursor = std::max(cursor, write_index > m_capacity ? write_index - m_capacity : 0);
+
+    for (; cursor < write_index; ++cursor) {
+        const auto& slot = m_slots[cursor & (m_capacity - 1)];
+        const auto published = 2 * (cursor + 1);
+
+        // An event still being written stops the poll, the next one picks it up from here. Events already overwritten by newer
+        // ones are lost, they are skipped.
+        const auto sequence = slot.sequence.load(std::memory_order_acquire);
+        if (sequence < published)
+            break;
+        if (sequence > published)
+            continue;
+
+        const auto event = slot.event;
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (slot.sequence.load(std::memory_order_relaxed) != sequence)
+            continue;
+
+        events.push_back(event);
+    }
+}
+
+bool FrameProfiler::dump_chrome_trace(const char* filename) const {
+    auto file = fopen(filename, "w");
+    if (!file)
+        return false;
+
+    std::vector<ProfileEvent> events;
+    get_events(events);
+
+    // GPU events go to their own track, whose name is set through a meta data event.
+    fprintf(file, "{\"traceEvents\":[\n");
+    fprintf(file, "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":0,\"tid\":%u,\"args\":{\"name\":\"GPU\"}}", GPU_THREAD);
+    for (const auto& event : events) {
+        // chrome trace is in microseconds
+        fprintf(file, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":0,\"tid\":%u,\"ts\":%.3f,\"dur\":%.3f,\"args\":{\"frame\":%llu}}",
+            event.name, event.thread == GPU_THREAD ? "gpu" : "cpu", event.thread, event.begin_ns / 1000.0,
+            (event.end_ns - event.begin_ns) / 1000.0, event.frame);
+    }
+    fprintf(file, "\n]}\n");
+
+    fclose(file);
+    return true;
+}
@@ -0,0 +1,112 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <vector>
+
+/*
+ * A timed event, it is either a CPU zone or a range of GPU work.
+ */
+struct ProfileEvent {
+    const char*         name = nullptr;     // name of the event, it has to be a string literal since only the pointer is kept
+    unsigned long long  frame = 0;          // the frame this event belongs to
+    long long           begin_ns = 0;       // begin time in nanoseconds since the profiler is created
+    long long           end_ns = 0;         // end time in nanoseconds since the profiler is created
+    unsigned int        thread = 0;         // the thread recording the event, GPU events all go to 'GPU_THREAD'
+};
+
+/*
+ * Per-frame instrumentation.
+ * Events are pushed into a ring buffer, the oldest events are overwritten once it is full. Pushing is lock-free and safe on
+ * any thread, so that worker threads can record their own zones too.
+ */
+class FrameProfiler {
+public:
+    // Thread id of all GPU events.
+    static constexpr unsigned int GPU_THREAD = 0xffffffff;
+
+    /*
+     * The capacity is rounded up to a power of two.
+     */
+    explicit FrameProfiler(const unsigned int capacity = 65536);
+
+    /*
+     * Current time in nanoseconds since the profiler is created.
+     */
+    long long now() const;
+
+    /*
+     * Start a new frame, all events recorded after this belong to the new frame.
+     */
+    void begin_frame() { ++m_frame; }
+
+    /*
+     * Index of the current frame, the first frame is 1, 0 means no frame has started yet.
+     */
+    unsigned long long frame() const { return m_frame; }
+
+    /*
+     * Record a CPU event on the calling thread.
+     */
+    void record(const char* name, const long long begin_ns, const long long end_ns);
+
+    /*
+     * Record a GPU event of the given frame. The time needs to be converted to the CPU timeline already.
+     */
+    void record_gpu(const char* name, const unsigned long long frame, const long long begin_ns, const long long end_ns);
+
+    /*
+     * Copy all events still in the ring buffer, from the oldest to the latest.
+     */
+    void get_events(std::vector<ProfileEvent>& events) const;
+
+    /*
+     * Append the events recorded since the cursor and move the cursor past them, so that polling it every frame only returns
+     * new events. The cursor stops at the first event still being written, it is returned by the next poll. Events that are
+     * overwritten before they are polled are lost.
+     */
+    void poll_events(std::vector<ProfileEvent>& events, unsigned long long& cursor) const;
+
+    /*
+     * Dump all events still in the ring buffer as a Chrome trace, which can be viewed in chrome://tracing.
+     */
+    bool dump_chrome_trace(const char* filename) const;
+
+private:
+    // A slot in the ring buffer, the sequence number tells whether the event in it is completely written.
+    struct Slot {
+        std::atomic<unsigned long long> sequence;
+        ProfileEvent                    event;
+    };
+
+    void push(const ProfileEvent& event);
+
+    std::unique_ptr<Slot[]>             m_slots;
+    unsigned int                        m_capacity = 0;
+    std::atomic<unsigned long long>     m_write_index;
+    std::atomic<unsigned long long>     m_frame;
+    long long                           m_epoch = 0;
+};
+
+/*
+ * A scoped CPU zone, the event is recorded when it goes out of scope.
+ */
+class ProfileZone {
+public:
+    ProfileZone(FrameProfiler& profiler, const char* name) : m_profiler(profiler), m_name(name), m_begin(profiler.now()) {}
+    ~ProfileZone() { m_profiler.record(m_name, m_begin, m_profiler.now()); }
+
+private:
+    FrameProfiler&  m_profiler;
+    const char*     m_name;
+    long long       m_begin;
+};
+
+#define PROFILE_ZONE_CONCAT_INNER(a, b)     a##b
+#define PROFILE_ZONE_CONCAT(a, b)           PROFILE_ZONE_CONCAT_INNER(a, b)
+#define PROFILE_ZONE(profiler, name)        ProfileZone PROFILE_ZONE_CONCAT(profile_zone_, __LINE__)(profiler, name)
@@ -0,0 +1,283 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <assert.h>
+#include <algorithm>
+#include <numeric>
+#include "render_graph.h"
+
+static constexpr unsigned int INVALID_RESOURCE = ~0u;
+
+static size_t align_up(const size_t offset, const size_t alignment) {
+    return (offset + alignment - 1) / alignment * alignment;
+}
+
+void RenderGraph::reset() {
+    m_resources.clear();
+    m_passes.clear();
+    m_recorded_passes.clear();
+    m_final_barriers.clear();
+    m_transient_memory_size = 0;
+}
+
+RenderGraph::ResourceId RenderGraph::import_resource(const char* name, const ResourceUsage initial, const ResourceUsage final_usage) {
+    Resource resource;
+    resource.name = name;
+    resource.initial = initial;
+    resource.final_usage = final_usage;
+    m_resources.push_back(resource);
+    return (ResourceId)(m_resources.size() - 1);
+}
+
+RenderGraph::ResourceId RenderGraph::create_transient_resource(const char* name, const size_t size, const size_t alignment) {
+    assert(alignment > 0);
+
+    Resource resource;
+    resource.name = name;
+    resource.transient = true;
+    resource.size = size;
+    resource.alignment = alignment;
+    m_resources.push_back(resource);
+    return (ResourceId)(m_resources.size() - 1);
+}
+
+RenderGraph::PassId RenderGraph::add_pass(const char* name, std::function<void()> record, const bool attachment_transitions) {
+    Pass pass;
+    pass.name = name;
+    pass.record = std::move(record);
+    pass.attachment_transitions = attachment_transitions;
+    m_passes.push_back(std::move(pass));
+    return (PassId)(m_passes.size() - 1);
+}
+
+void RenderGraph::use(const PassId pass, const ResourceId resource, const ResourceUsage usage) {
+    assert(pass < m_passes.size() && resource < m_resources.size());
+
+    auto& accesses = m_passes[pass].accesses;
+    assert(std::none_of(accesses.begin(), accesses.end(), [&](const Access& access) { return access.resource == resource; }));
+
+    Access access;
+    access.resource = resource;
+    access.usage = usage;
+    accesses.push_back(access);
+}
+
+/*
+ * Passes are visited backwards, a pass is needed if it writes an imported resource or anything a later pass needs. Everything
+ * a needed pass uses is needed too, it may read what is already there even if it writes it. A pass writing nothing has effects
+ * the graph can't see, it is never culled.
+ */
+void RenderGraph::cull_passes() {
+    std::vector<bool> needed(m_resources.size());
+    for (size_t i = 0; i < m_resources.size(); ++i)
+        needed[i] = !m_resources[i].transient;
+
+    for (auto i = m_passes.size(); i-- > 0;) {
+        auto& pass = m_passes[i];
+
+        bool writes = false;
+        bool writes_needed = false;
+        for (const auto& access : pass.accesses) {
+            if (is_write_usage(access.usage)) {
+                writes = true;
+                writes_needed = writes_needed || needed[access.resource];
+            }
+        }
+
+        pass.culled = writes && !writes_needed;
+        if (!pass.culled) {
+            for (const auto& access : pass.accesses)
+                needed[access.resource] = true;
+        }
+    }
+}
+
+/*
+ * Larger resources are placed first, each at the lowest offset where it doesn't overlap any resource placed before that is
+ * alive at the same time. The size without aliasing is the one of the same resources placed one after another with the same
+ * alignment, aliasing never takes more than that.
+ */
+void RenderGraph::place_transient_resources() {
+    std::vector<ResourceId> transients;
+    for (ResourceId i = 0; i < (ResourceId)m_resources.size(); ++i) {
+        if (m_resources[i].transient && m_resources[i].used)
+            transients.push_back(i);
+    }
+    std::stable_sort(transients.begin(), transients.end(), [&](const ResourceId l, const ResourceId r) { return m_resources[l].size > m_resources[r].size; });
+
+    size_t unaliased_size = 0;
+    for (size_t i = 0; i < transients.size(); ++i) {
+        auto& resource = m_resources[transients[i]];
+        unaliased_size = align_up(unaliased_size, resource.alignment) + resource.size;
+
+        size_t offset = 0;
+        for (auto moved = true; moved;) {
+            moved = false;
+            for (size_t j = 0; j < i; ++j) {
+                const auto& placed = m_resources[transients[j]];
+                const auto alive = placed.first_pass <= resource.last_pass && resource.first_pass <= placed.last_pass;
+                const auto overlaps = placed.offset < offset + resource.size && offset < placed.offset + placed.size;
+                if (alive && overlaps) {
+                    offset = align_up(placed.offset + placed.size, resource.alignment);
+                    moved = true;
+                }
+            }
+        }
+
+        resource.offset = offset;
+        m_transient_memory_size = std::max(m_transient_memory_size, offset + resource.size);
+    }
+
+    m_stats.transient_cnt = (unsigned int)transients.size();
+    m_stats.transient_size = unaliased_size;
+    m_stats.aliased_size = m_transient_memory_size;
+}
+
+void RenderGraph::compile() {
+    m_stats = RenderGraphStats();
+    m_stats.pass_cnt = (unsigned int)m_passes.size();
+
+    cull_passes();
+    for (unsigned int i = 0; i < (unsigned int)m_passes.size(); ++i) {
+        if (!m_passes[i].culled)
+            m_recorded_passes.push_back(i);
+    }
+    m_stats.culled_pass_cnt = m_stats.pass_cnt - (unsigned int)m_recorded_passes.size();
+
+    // lifetimes of the resources, in passes left
+    const auto pass_cnt = (unsigned int)m_recorded_passes.size();
+    for (unsigned int i = 0; i < pass_cnt; ++i) {
+        for (const auto& access : m_passes[m_recorded_passes[i]].accesses) {
+            auto& resource = m_resources[access.resource];
+            if (!resource.used)
+                resource.first_pass = i;
+            resource.last_pass = i;
+            resource.used = true;
+        }
+    }
+
+    place_transient_resources();
+
+    // The memory of a transient resource was last used by the resource before it that ends last, its first barrier waits
+    // for that resource.
+    std::vector<ResourceId> aliased(m_resources.size(), INVALID_RESOURCE);
+    for (ResourceId i = 0; i < (ResourceId)m_resources.size(); ++i) {
+        const auto& resource = m_resources[i];
+        if (!resource.transient || !resource.used)
+            continue;
+
+        for (ResourceId j = 0; j < (ResourceId)m_resources.size(); ++j) {
+            const auto& other = m_resources[j];
+            if (!other.transient || !other.used || other.last_pass >= resource.first_pass)
+                continue;
+            if (other.offset < resource.offset + resource.size && resource.offset < other.offset + other.size &&
+                (aliased[i] == INVALID_RESOURCE || m_resources[aliased[i]].last_pass < other.last_pass))
+                aliased[i] = j;
+        }
+    }
+
+    // Walk through the passes with the usage of each resource, a barrier goes anywhere after the pass using the resource before.
+    std::vector<ResourceUsage> states(m_resources.size());
+    std::vector<unsigned int> earliest(m_resources.size(), 0);
+    std::vector<bool> settled(m_resources.size(), false);
+    for (size_t i = 0; i < m_resources.size(); ++i)
+        states[i] = m_resources[i].initial;
+
+    std::vector<PlacedBarrier> barriers;
+    for (unsigned int i = 0; i < pass_cnt; ++i) {
+        const auto& pass = m_passes[m_recorded_passes[i]];
+        for (const auto& access : pass.accesses) {
+            const auto id = access.resource;
+            const auto& resource = m_resources[id];
+
+            PlacedBarrier placed;
+            placed.barrier.resource = id;
+            placed.barrier.before = states[id];
+            placed.barrier.after = access.usage;
+            placed.earliest = earliest[id];
+            placed.latest = i;
+
+            if (pass.attachment_transitions && access.usage == ResourceUsage::ColorAttachment) {
+                // the pass leaves its attachments in their final usage, nothing can use them after it
+                assert(resource.last_pass == i);
+                settled[id] = true;
+                ++m_stats.dropped_barrier_cnt;
+            } else if (resource.transient && resource.first_pass == i) {
+                placed.barrier.discard = true;
+                if (aliased[id] != INVALID_RESOURCE) {
+                    placed.barrier.before = states[aliased[id]];
+                    placed.earliest = m_resources[aliased[id]].last_pass + 1;
+                }
+                barriers.push_back(placed);
+            } else if (states[id] == access.usage && !is_write_usage(access.usage)) {
+                ++m_stats.dropped_barrier_cnt;
+            } else {
+                barriers.push_back(placed);
+            }
+
+            states[id] = settled[id] ? resource.final_usage : access.usage;
+            earliest[id] = i + 1;
+        }
+    }
+
+    // Points to place the barriers at, each is the latest place of the barrier that has to be placed first among the ones not
+    // placed yet, it is the fewest points possible.
+    std::vector<unsigned int> order(barriers.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](const unsigned int l, const unsigned int r) { return barriers[l].latest < barriers[r].latest; });
+
+    std::vector<bool> points(pass_cnt, false);
+    auto last_point = -1;
+    for (const auto i : order) {
+        if (last_point < (int)barriers[i].earliest) {
+            last_point = (int)barriers[i].latest;
+            points[last_point] = true;
+        }
+    }
+
+    // each barrier goes to the latest point it can go, the barriers at a point are in the order the passes use the resources
+    m_batches.resize(pass_cnt);
+    for (auto& batch : m_batches)
+        batch.clear();
+    for (const auto& placed : barriers) {
+        auto point = placed.latest;
+        while (!points[point])
+            --point;
+        assert(point >= placed.earliest);
+        m_batches[point].push_back(placed.barrier);
+    }
+
+    // imported resources are left in their final usage for whatever uses them after the frame
+    for (ResourceId i = 0; i < (ResourceId)m_resources.size(); ++i) {
+        const auto& resource = m_resources[i];
+        if (resource.transient || settled[i] || resource.final_usage == ResourceUsage::None || states[i] == resource.final_usage)
+            continue;
+
+        RenderGraphBarrier barrier;
+        barrier.resource = i;
+        barrier.before = states[i];
+        barrier.after = resource.final_usage;
+        m_final_barriers.push_back(barrier);
+    }
+}
+
+void RenderGraph::execute(const std::function<unsigned int(const RenderGraphBarrier*, const unsigned int)>& record_barriers) {
+    auto record = [&](const std::vector<RenderGraphBarrier>& batch) {
+        if (batch.empty())
+            return;
+
+        const auto recorded = record_barriers(batch.data(), (unsigned int)batch.size());
+        assert(recorded <= batch.size());
+        m_stats.barrier_cnt += recorded;
+        m_stats.dropped_barrier_cnt += (unsigned int)batch.size() - recorded;
+        m_stats.barrier_batch_cnt += recorded ? 1 : 0;
+    };
+
+    for (size_t i = 0; i < m_recorded_passes.size(); ++i) {
+        record(m_batches[i]);
+        m_passes[m_recorded_passes[i]].record();
+    }
+    record(m_final_barriers);
+}
@@ -0,0 +1,172 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <vector>
+#include <functional>
+
+/*
+ * How a pass accesses a resource, backends translate it to pipeline stages, access masks and layouts on Vulkan and to resource
+ * states on D3D12.
+ */
+enum class ResourceUsage : unsigned char {
+    None,               // not accessed at all, the content is undefined, it is also the common state D3D12 buffers decay to
+    IndirectArgument,   // read as arguments of indirect draws
+    ComputeWrite,       // written, and maybe read, by compute shaders
+    TaskShaderWrite,    // written by task shaders, meshlet culling with mesh shaders
+    ColorAttachment,    // rendered into
+    CopySource,
+    CopyDest,
+    HostRead,           // read on CPU once the frame is done on GPU
+    Present,            // presented by the swap chain
+};
+
+inline bool is_write_usage(const ResourceUsage usage) {
+    return usage == ResourceUsage::ComputeWrite || usage == ResourceUsage::TaskShaderWrite || usage == ResourceUsage::ColorAttachment ||
+           usage == ResourceUsage::CopyDest;
+}
+
+/*
+ * A transition of a resource from one usage to another.
+ */
+struct RenderGraphBarrier {
+    unsigned int        resource = 0;
+    ResourceUsage       before = ResourceUsage::None;
+    ResourceUsage       after = ResourceUsage::None;
+    // The content is not needed, this is the first use of a transient resource. Before is the last usage of the resource that
+    // used its memory earlier in the frame, if there is any.
+    bool                discard = false;
+};
+
+/*
+ * What the render graph of the last frame did.
+ */
+struct RenderGraphStats {
+    unsigned int        pass_cnt = 0;               // passes added to the graph
+    unsigned int        culled_pass_cnt = 0;        // passes skipped since nothing uses what they write
+    unsigned int        barrier_batch_cnt = 0;      // barrier calls recorded, each has all barriers placed between two passes
+    unsigned int        barrier_cnt = 0;            // barriers recorded
+    unsigned int        dropped_barrier_cnt = 0;    // transitions found redundant, by the graph or by the backend
+    unsigned int        transient_cnt = 0;          // transient resources of the passes left
+    unsigned long long  transient_size = 0;         // memory they take placed one after another, with the same alignment
+    unsigned long long  aliased_size = 0;           // memory they take once the ones not alive at the same time share it
+};
+
+/*
+ * A graph of the passes of a frame, it is built again every frame.
+ * Passes declare how they use the resources of the frame, in the order they are recorded. Compiling the graph culls the passes
+ * nothing depends on, works out the barriers between the passes and places the transient resources in memory. Executing it
+ * records the passes with the barriers in between.
+ *
+ * A barrier is needed wherever a resource changes its usage or is written, reading a resource the same way again needs nothing.
+ * Each barrier can go anywhere between the pass accessing the resource before and the pass needing it, barriers are gathered
+ * into as few places as possible, which are as late as possible, so that backends record them in a handful of calls with the
+ * stages of both sides.
+ *
+ * Imported resources live beyond the frame, like the swap chain images and the buffers culling writes, they are what the frame
+ * produces, passes writing them are never culled. Transient resources only live through the passes using them, the ones that
+ * are never alive at the same time share memory.
+ */
+class RenderGraph {
+public:
+    typedef unsigned int ResourceId;
+    typedef unsigned int PassId;
+
+    /*
+     * Remove all passes and resources, the memory of the graph is kept for the next frame.
+     */
+    void reset();
+
+    /*
+     * A resource that lives beyond the frame. It is in the initial usage at the beginning of the frame and is transitioned to
+     * the final usage at the end, None means whatever it is left in.
+     */
+    ResourceId import_resource(const char* name, const ResourceUsage initial, const ResourceUsage final_usage);
+
+    /*
+     * A resource that only lives through the frame, its memory is placed by compiling the graph.
+     */
+    ResourceId create_transient_resource(const char* name, const size_t size, const size_t alignment);
+
+    /*
+     * Add a pass, it is recorded by execute in the order passes are added. A pass transitioning its own attachments, like a
+     * Vulkan render pass with an undefined initial layout, gets no barriers for them, they are left in their final usage.
+     */
+    PassId add_pass(const char* name, std::function<void()> record, const bool attachment_transitions = false);
+
+    /*
+     * Declare how a pass uses a resource, each resource is used at most once by a pass.
+     */
+    void use(const PassId pass, const ResourceId resource, const ResourceUsage usage);
+
+    /*
+     * Cull the passes, work out the barriers and place the transient resources.
+     */
+    void compile();
+
+    /*
+     * Where a transient resource is in the memory shared by all transient resources, and how large that memory is. It is only
+     * valid after compiling.
+     */
+    size_t get_transient_offset(const ResourceId resource) const { return m_resources[resource].offset; }
+    size_t get_transient_memory_size() const { return m_transient_memory_size; }
+
+    /*
+     * Record the passes left. The barriers between two passes are handed to the backend at once, it returns how many of them it
+     * records, the others turned out to be redundant for the graphics API.
+     */
+    void execute(const std::function<unsigned int(const RenderGraphBarrier*, const unsigned int)>& record_barriers);
+
+    const RenderGraphStats& get_stats() const { return m_stats; }
+
+private:
+    struct Resource {
+        const char*         name = nullptr;
+        ResourceUsage       initial = ResourceUsage::None;
+        ResourceUsage       final_usage = ResourceUsage::None;
+        bool                transient = false;
+        size_t              size = 0;
+        size_t              alignment = 1;
+        size_t              offset = 0;
+        // passes left using it first and last, in the order they are recorded
+        unsigned int        first_pass = 0;
+        unsigned int        last_pass = 0;
+        bool                used = false;
+    };
+
+    struct Access {
+        ResourceId          resource = 0;
+        ResourceUsage       usage = ResourceUsage::None;
+    };
+
+    struct Pass {
+        const char*             name = nullptr;
+        std::function<void()>   record;
+        std::vector<Access>     accesses;
+        bool                    attachment_transitions = false;
+        bool                    culled = false;
+    };
+
+    // A barrier along with where it can go, before the first pass left at earliest and before the last one at latest.
+    struct PlacedBarrier {
+        RenderGraphBarrier  barrier;
+        unsigned int        earliest = 0;
+        unsigned int        latest = 0;
+    };
+
+    void cull_passes();
+    void place_transient_resources();
+
+    std::vector<Resource>           m_resources;
+    std::vector<Pass>               m_passes;
+    // passes left in the order they are recorded, the barriers before each of them and the ones at the end of the frame
+    std::vector<unsigned int>       m_recorded_passes;
+    std::vector<std::vector<RenderGraphBarrier>> m_batches;
+    std::vector<RenderGraphBarrier> m_final_barriers;
+    size_t                          m_transient_memory_size = 0;
+    RenderGraphStats                m_stats;
+};
@@ -0,0 +1,24 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <string.h>
+#include "state_cache.h"
+
+StateKey& StateKey::add_bytes(const void* data, const size_t size) {
+    const auto bytes = (const uint8_t*)data;
+    m_bytes.insert(m_bytes.end(), bytes, bytes + size);
+
+    for (size_t i = 0; i < size; ++i) {
+        m_hash ^= bytes[i];
+        m_hash *= 1099511628211ull;
+    }
+    return *this;
+}
+
+StateKey& StateKey::add_string(const char* str) {
+    const auto length = (uint32_t)(str ? strlen(str) : 0);
+    add(length);
+    return add_bytes(str, length);
+}
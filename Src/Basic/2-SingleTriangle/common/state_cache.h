@@ -0,0 +1,216 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <atomic>
+#include <mutex>
+#include <memory>
+#include <vector>
+#include <type_traits>
+
+/*
+ * Canonical description of a piece of pipeline state.
+ * Fields are appended one by one instead of hashing API structs as they are, so padding bytes never end up in the key, and
+ * pointers are followed with what they point to appended instead. The same state always ends up with the same bytes, the
+ * hash is only for finding it quickly, two keys are only equal if all of their bytes are.
+ */
+class StateKey {
+public:
+    /*
+     * Append a scalar, structs can't be added as a whole since they may have padding in them.
+     */
+    template<class T>
+    StateKey& add(const T& value) {
+        static_assert(std::is_arithmetic<T>::value || std::is_enum<T>::value, "Only scalars can be added, structs may have padding.");
+        return add_bytes(&value, sizeof(value));
+    }
+
+    /*
+     * Append raw bytes, like shader byte code. Arrays of variable length need their size added before them, otherwise two
+     * different lists could end up with the same bytes.
+     */
+    StateKey& add_bytes(const void* data, const size_t size);
+
+    /*
+     * Append a string along with its length, nullptr is treated as an empty string.
+     */
+    StateKey& add_string(const char* str);
+
+    uint64_t hash() const { return m_hash; }
+    const std::vector<uint8_t>& bytes() const { return m_bytes; }
+
+    bool operator==(const StateKey& other) const { return m_hash == other.m_hash && m_bytes == other.m_bytes; }
+    bool operator!=(const StateKey& other) const { return !(*this == other); }
+
+private:
+    std::vector<uint8_t>    m_bytes;
+    // FNV-1a of all bytes so far
+    uint64_t                m_hash = 14695981039346656037ull;
+};
+
+/*
+ * Counters of a state cache.
+ */
+struct StateCacheStats {
+    unsigned int        entry_cnt = 0;      // number of unique states
+    unsigned long long  hit_cnt = 0;        // requests returning an existing state
+    unsigned long long  miss_cnt = 0;       // requests creating a new state
+};
+
+/*
+ * A read-mostly hash map from state descriptions to the objects created from them.
+ * Looking a state up is lock-free, the table is an array of atomic pointers to immutable entries with linear probing. New
+ * states are inserted with a lock held, which is rare once the states of a scene are created. When the table gets half full,
+ * a table twice as large is filled and published, the old one is kept around since readers may still be probing it.
+ *
+ * Entries are never removed until the cache is cleared, pointers to the values stay valid until then.
+ */
+template<class T>
+class StateCache {
+public:
+    explicit StateCache(const unsigned int capacity = 64) {
+        unsigned int size = 16;
+        while (size < capacity * 2)
+            size *= 2;
+        publish(std::make_unique<Table>(size));
+    }
+
+    /*
+     * Look the state up without any lock, nullptr means it is not created yet.
+     */
+    const T* find(const StateKey& key) const {
+        const auto entry = find_entry(*m_table.load(std::memory_order_acquire), key);
+        return entry ? &entry->value : nullptr;
+    }
+
+    /*
+     * Look the state up and create it if it is not there yet, 'create' is a callable of 'bool(T&)'. Creation is done with
+     * the lock held, so that two threads asking for the same new state never create it twice. Nothing is cached if it fails,
+     * nullptr is returned in this case.
+     */
+    template<class Create>
+    const T* get_or_create(const StateKey& key, Create&& create) {
+        if (auto value = find(key)) {
+            m_hit_cnt.fetch_add(1, std::memory_order_relaxed);
+            return value;
+        }
+
+        std::lock_guard<std::mutex> lock(m_mutex);
+
+        // somebody else may have created it while waiting for the lock
+        auto& table = *m_table.load(std::memory_order_relaxed);
+        if (auto entry = find_entry(table, key)) {
+            m_hit_cnt.fetch_add(1, std::memory_order_relaxed);
+            return &entry->value;
+        }
+
+        auto entry = std::make_unique<Entry>();
+        entry->key = key;
+        if (!create(entry->value))
+            return nullptr;
+        m_miss_cnt.fetch_add(1, std::memory_order_relaxed);
+
+        // keep the load factor below a half so that probing stays short
+        if ((m_entries.size() + 1) * 2 > table.size) {
+            auto larger = std::make_unique<Table>(table.size * 2);
+            for (const auto& existing : m_entries)
+                insert(*larger, existing.get());
+            insert(*larger, entry.get());
+            publish(std::move(larger));
+        }
+        else {
+            insert(table, entry.get());
+        }
+
+        m_entries.push_back(std::move(entry));
+        return &m_entries.back()->value;
+    }
+
+    /*
+     * Visit all values, it is for destroying them. It is not safe with other threads creating states at the same time.
+     */
+    template<class Func>
+    void for_each(Func&& func) {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        for (auto& entry : m_entries)
+            func(entry->value);
+    }
+
+    /*
+     * Remove everything, nobody can be looking anything up at the same time.
+     */
+    void clear() {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        const auto size = m_table.load(std::memory_order_relaxed)->size;
+        m_tables.clear();
+        m_entries.clear();
+        publish(std::make_unique<Table>(size));
+    }
+
+    StateCacheStats get_stats() const {
+        StateCacheStats stats;
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            stats.entry_cnt = (unsigned int)m_entries.size();
+        }
+        stats.hit_cnt = m_hit_cnt.load(std::memory_order_relaxed);
+        stats.miss_cnt = m_miss_cnt.load(std::memory_order_relaxed);
+        return stats;
+    }
+
+private:
+    // An entry never changes after it is published.
+    struct Entry {
+        StateKey    key;
+        T           value;
+    };
+
+    struct Table {
+        explicit Table(const unsigned int size) : size(size), slots(new std::atomic<Entry*>[size]) {
+            for (unsigned int i = 0; i < size; ++i)
+                slots[i].store(nullptr, std::memory_order_relaxed);
+        }
+
+        const unsigned int                      size;       // always a power of two
+        std::unique_ptr<std::atomic<Entry*>[]>  slots;
+    };
+
+    static const Entry* find_entry(const Table& table, const StateKey& key) {
+        const auto mask = table.size - 1;
+        for (auto i = (unsigned int)key.hash() & mask; ; i = (i + 1) & mask) {
+            const auto entry = table.slots[i].load(std::memory_order_acquire);
+            if (!entry)
+                return nullptr;
+            if (entry->key == key)
+                return entry;
+        }
+    }
+
+    static void insert(Table& table, Entry* entry) {
+        const auto mask = table.size - 1;
+        auto i = (unsigned int)entry->key.hash() & mask;
+        while (table.slots[i].load(std::memory_order_relaxed))
+            i = (i + 1) & mask;
+
+        // the entry is completely written before it is visible to readers
+        table.slots[i].store(entry, std::memory_order_release);
+    }
+
+    void publish(std::unique_ptr<Table> table) {
+        m_table.store(table.get(), std::memory_order_release);
+        m_tables.push_back(std::move(table));
+    }
+
+    std::atomic<Table*>                     m_table{ nullptr };
+    // all tables ever published, readers may still be probing the older ones
+    std::vector<std::unique_ptr<Table>>     m_tables;
+    std::vector<std::unique_ptr<Entry>>     m_entries;
+    mutable std::mutex                      m_mutex;
+    std::atomic<unsigned long long>         m_hit_cnt{ 0 };
+    std::atomic<unsigned long long>         m_miss_cnt{ 0 };
+};
@@ -0,0 +1,101 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <assert.h>
+#include <atomic>
+#include "task_graph.h"
+
+TaskGraph::TaskId TaskGraph::add(const char* name, std::function<bool()> task, const std::vector<TaskId>& dependencies, const bool calling_thread) {
+    const auto id = (TaskId)m_tasks.size();
+
+    Task entry;
+    entry.name = name;
+    entry.task = std::move(task);
+    entry.dependency_cnt = (unsigned int)dependencies.size();
+    entry.calling_thread = calling_thread;
+    m_tasks.push_back(std::move(entry));
+
+    for (const auto dependency : dependencies) {
+        assert(dependency < id);
+        m_tasks[dependency].dependents.push_back(id);
+    }
+
+    return id;
+}
+
+bool TaskGraph::run(ThreadPool& pool, FrameProfiler& profiler) {
+    const auto task_cnt = (unsigned int)m_tasks.size();
+
+    std::mutex                  mutex;
+    std::condition_variable     cv;
+    std::vector<unsigned int>   remaining(task_cnt);
+    std::deque<TaskId>          calling_thread_tasks;
+    unsigned int                finished_cnt = 0;
+    std::atomic<bool>           failed(false);
+
+    for (unsigned int i = 0; i < task_cnt; ++i)
+        remaining[i] = m_tasks[i].dependency_cnt;
+
+    std::function<void(TaskId)> dispatch;
+    auto execute = [&](const TaskId id) {
+        const auto& task = m_tasks[id];
+
+        if (!failed) {
+            PROFILE_ZONE(profiler, task.name);
+            if (!task.task())
+                failed = true;
+        }
+
+        // Dependents are dispatched outside the lock, a pool without worker threads runs them right away on this thread.
+        std::vector<TaskId> ready;
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            for (const auto dependent : task.dependents) {
+                if (--remaining[dependent] == 0)
+                    ready.push_back(dependent);
+            }
+            ++finished_cnt;
+
+            // notifying with the lock held, the waiting thread may destroy the condition variable as soon as it wakes up
+            cv.notify_one();
+        }
+
+        for (const auto dependent : ready)
+            dispatch(dependent);
+    };
+
+    dispatch = [&](const TaskId id) {
+        if (m_tasks[id].calling_thread) {
+            std::lock_guard<std::mutex> lock(mutex);
+            calling_thread_tasks.push_back(id);
+            cv.notify_one();
+            return;
+        }
+        pool.submit([&execute, id]() { execute(id); });
+    };
+
+    for (unsigned int i = 0; i < task_cnt; ++i) {
+        if (m_tasks[i].dependency_cnt == 0)
+            dispatch(i);
+    }
+
+    // the calling thread runs its own tasks until everything is done
+    std::unique_lock<std::mutex> lock(mutex);
+    while (finished_cnt < task_cnt) {
+        if (calling_thread_tasks.empty()) {
+            cv.wait(lock);
+            continue;
+        }
+
+        const auto id = calling_thread_tasks.front();
+        calling_thread_tasks.pop_front();
+
+        lock.unlock();
+        execute(id);
+        lock.lock();
+    }
+
+    return !failed;
+}
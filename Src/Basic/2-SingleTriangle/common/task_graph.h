@@ -0,0 +1,48 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <functional>
+#include "thread_pool.h"
+#include "profiler.h"
+
+/*
+ * A graph of tasks with dependencies between them, it is for running initialization on multiple threads.
+ * A task starts as soon as all of its dependencies are done, tasks that don't depend on each other run in parallel on the
+ * worker threads. Tasks touching the window, like creating a swapchain, can be pinned to the thread calling 'run', which is
+ * usually the thread owning the window.
+ *
+ * Dependencies can only be tasks added earlier, so the graph never has a cycle. Once a task fails, tasks not started yet are
+ * skipped.
+ */
+class TaskGraph {
+public:
+    typedef unsigned int TaskId;
+
+    /*
+     * Add a task, it returns true if it succeeds. The name has to be a string literal, it is what the profiler zone of the
+     * task is called.
+     */
+    TaskId add(const char* name, std::function<bool()> task, const std::vector<TaskId>& dependencies = {}, const bool calling_thread = false);
+
+    /*
+     * Run all tasks and return after all of them are done or skipped, each task is recorded as a zone in the profiler.
+     * Returns false if any of the tasks failed.
+     */
+    bool run(ThreadPool& pool, FrameProfiler& profiler);
+
+private:
+    struct Task {
+        const char*             name = nullptr;
+        std::function<bool()>   task;
+        std::vector<TaskId>     dependents;
+        unsigned int            dependency_cnt = 0;
+        bool                    calling_thread = false;
+    };
+
+    std::vector<Task>   m_tasks;
+};
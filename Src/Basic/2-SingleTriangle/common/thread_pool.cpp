@@ -0,0 +1,111 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <atomic>
+#include <algorithm>
+#include "thread_pool.h"
+
+// The thread slot of the current thread, only worker threads have a valid slot.
+static thread_local unsigned int t_thread_slot = 0;
+
+ThreadPool::ThreadPool(const unsigned int worker_cnt) {
+    m_workers.reserve(worker_cnt);
+    for (unsigned int i = 0; i < worker_cnt; ++i)
+        m_workers.emplace_back(&ThreadPool::worker_loop, this, i);
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_quitting = true;
+    }
+    m_task_cv.notify_all();
+
+    for (auto& worker : m_workers)
+        worker.join();
+}
+
+void ThreadPool::submit(std::function<void()> task) {
+    // there is nobody else to run it
+    if (m_workers.empty()) {
+        task();
+        return;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(m_mutex);
+        m_tasks.push_back(std::move(task));
+    }
+    m_task_cv.notify_one();
+}
+
+void ThreadPool::wait_idle() {
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_idle_cv.wait(lock, [&]() { return m_tasks.empty() && m_busy_cnt == 0; });
+}
+
+void ThreadPool::parallel_for(const unsigned int cnt, const std::function<void(unsigned int, unsigned int)>& task) {
+    if (cnt == 0)
+        return;
+
+    // each participating thread keeps grabbing the next index until there is nothing left
+    std::atomic<unsigned int> next_index(0);
+    auto run = [&](const unsigned int slot) {
+        for (auto i = next_index++; i < cnt; i = next_index++)
+            task(i, slot);
+    };
+
+    // there is no point waking up more workers than the number of tasks
+    const auto helper_cnt = std::min(worker_count(), cnt - 1);
+
+    std::mutex              done_mutex;
+    std::condition_variable done_cv;
+    unsigned int            done_cnt = 0;
+    for (unsigned int i = 0; i < helper_cnt; ++i) {
+        submit([&]() {
+            run(t_thread_slot);
+
+            // notifying with the lock held, the waiting thread may destroy the condition variable as soon as it wakes up
+            std::lock_guard<std::mutex> lock(done_mutex);
+            ++done_cnt;
+            done_cv.notify_one();
+        });
+    }
+
+    // the calling thread takes the last slot
+    run(worker_count());
+
+    std::unique_lock<std::mutex> lock(done_mutex);
+    done_cv.wait(lock, [&]() { return done_cnt == helper_cnt; });
+}
+
+void ThreadPool::worker_loop(const unsigned int slot) {
+    t_thread_slot = slot;
+
+    while (true) {
+        std::function<void()> task;
+        {
+            std::unique_lock<std::mutex> lock(m_mutex);
+            m_task_cv.wait(lock, [&]() { return m_quitting || !m_tasks.empty(); });
+
+            // pending tasks are still executed before quitting
+            if (m_tasks.empty())
+                return;
+
+            task = std::move(m_tasks.front());
+            m_tasks.pop_front();
+            ++m_busy_cnt;
+        }
+
+        task();
+
+        {
+            std::lock_guard<std::mutex> lock(m_mutex);
+            --m_busy_cnt;
+            if (m_busy_cnt == 0 && m_tasks.empty())
+                m_idle_cv.notify_all();
+        }
+    }
+}
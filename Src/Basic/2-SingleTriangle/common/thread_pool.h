@@ -0,0 +1,72 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <deque>
+
+/*
+ * A very simple thread pool.
+ * Worker threads are created once and kept alive until the pool is destroyed so that there is no cost of spawning threads
+ * every frame. Apart from the worker threads, the calling thread also participates in 'parallel_for', which is why there
+ * are always one more thread slots than worker threads.
+ */
+class ThreadPool {
+public:
+    /*
+     * Create a pool with the given number of worker threads, 0 means no worker thread at all, everything will run on the
+     * calling thread.
+     */
+    explicit ThreadPool(const unsigned int worker_cnt);
+
+    /*
+     * Wait for all pending tasks and join all worker threads.
+     */
+    ~ThreadPool();
+
+    /*
+     * Push a task in the queue, it will be picked up by one of the worker threads. Tasks are executed on the calling thread
+     * if there is no worker at all.
+     */
+    void submit(std::function<void()> task);
+
+    /*
+     * Wait until all submitted tasks are done.
+     */
+    void wait_idle();
+
+    /*
+     * Execute the task for each index in [0, cnt) and return after all of them are done. The second parameter of the task is
+     * the thread slot executing it, which is always less than 'slot_count', it is useful for accessing per-thread data.
+     */
+    void parallel_for(const unsigned int cnt, const std::function<void(unsigned int, unsigned int)>& task);
+
+    /*
+     * Number of worker threads.
+     */
+    unsigned int worker_count() const { return (unsigned int)m_workers.size(); }
+
+    /*
+     * Number of threads that could possibly execute a task of 'parallel_for', this includes the calling thread.
+     */
+    unsigned int slot_count() const { return worker_count() + 1; }
+
+private:
+    // the loop of each worker thread
+    void worker_loop(const unsigned int slot);
+
+    std::vector<std::thread>            m_workers;
+    std::deque<std::function<void()>>   m_tasks;
+    std::mutex                          m_mutex;
+    std::condition_variable             m_task_cv;
+    std::condition_variable             m_idle_cv;
+    unsigned int                        m_busy_cnt = 0;
+    bool                                m_quitting = false;
+};
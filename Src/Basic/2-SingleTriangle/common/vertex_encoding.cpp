@@ -0,0 +1,161 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <string.h>
+#include <math.h>
+#include <algorithm>
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#include "vertex_encoding.h"
+#include "common.h"
+
+static_assert(sizeof(QuantizedVertex) == 12, "A quantized vertex is supposed to be 12 bytes.");
+
+static inline int16_t to_snorm16(const float value) {
+    return (int16_t)lrintf(std::min(std::max(value, -1.0f), 1.0f) * 32767.0f);
+}
+
+/*
+ * Round to the nearest even, values too large for a half become infinity.
+ */
+static inline uint16_t float_to_half(const float value) {
+    constexpr uint32_t FLOAT_INFINITY = 255u << 23;
+    constexpr uint32_t HALF_OVERFLOW = (127u + 16u) << 23;
+    // adding it moves the mantissa of a half denormal to the lowest bits of the float
+    constexpr uint32_t DENORMAL_MAGIC = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    const uint32_t sign = bits & 0x80000000u;
+    bits ^= sign;
+
+    uint32_t half;
+    if (bits >= HALF_OVERFLOW) {
+        half = bits > FLOAT_INFINITY ? 0x7e00 : 0x7c00;
+    } else if (bits < (113u << 23)) {
+        float magic, denormal;
+        memcpy(&magic, &DENORMAL_MAGIC, sizeof(magic));
+        memcpy(&denormal, &bits, sizeof(denormal));
+        denormal += magic;
+        memcpy(&bits, &denormal, sizeof(bits));
+        half = bits - DENORMAL_MAGIC;
+    } else {
+        const uint32_t odd = (bits >> 13) & 1;
+        bits += ((uint32_t)(15 - 127) << 23) + 0xfff + odd;
+        half = bits >> 13;
+    }
+    return (uint16_t)(half | (sign >> 16));
+}
+
+PositionDecode get_position_decode(const Vertex* vertices, const unsigned int vertex_cnt) {
+    PositionDecode decode;
+    if (!vertex_cnt)
+        return decode;
+
+    float lower[3] = { vertices[0].position.x, vertices[0].position.y, vertices[0].position.z };
+    float upper[3] = { lower[0], lower[1], lower[2] };
+    for (unsigned int i = 1; i < vertex_cnt; ++i) {
+        const float position[3] = { vertices[i].position.x, vertices[i].position.y, vertices[i].position.z };
+        for (int k = 0; k < 3; ++k) {
+            lower[k] = std::min(lower[k], position[k]);
+            upper[k] = std::max(upper[k], position[k]);
+        }
+    }
+
+    for (int k = 0; k < 3; ++k) {
+        decode.center[k] = (lower[k] + upper[k]) * 0.5f;
+        decode.extent[k] = (upper[k] - lower[k]) * 0.5f;
+    }
+    return decode;
+}
+
+void quantize_vertices(const Vertex* vertices, const unsigned int vertex_cnt, const PositionDecode& decode, QuantizedVertex* output) {
+    // a flat axis of the bounding box has nothing to encode, all of its positions are the center
+    float scale[3];
+    for (int k = 0; k < 3; ++k)
+        scale[k] = decode.extent[k] > 0.0f ? 1.0f / decode.extent[k] : 0.0f;
+
+    unsigned int i = 0;
+#if defined(__SSE2__) || defined(_M_X64)
+    static_assert(sizeof(Vertex) == 16, "A vertex is loaded as four floats, the fourth one is its color.");
+
+    // Two vertices at a time, each position is a single register with the color masked out. Converting rounds to the nearest
+    // and packing saturates to 16 bits, both of them are what SNORM expects.
+    const auto center = _mm_setr_ps(decode.center[0], decode.center[1], decode.center[2], 0.0f);
+    const auto factor = _mm_setr_ps(scale[0] * 32767.0f, scale[1] * 32767.0f, scale[2] * 32767.0f, 0.0f);
+    const auto mask = _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0));
+    for (; i + 2 <= vertex_cnt; i += 2) {
+        const auto p0 = _mm_and_ps(_mm_loadu_ps(&vertices[i].position.x), mask);
+        const auto p1 = _mm_and_ps(_mm_loadu_ps(&vertices[i + 1].position.x), mask);
+        const auto q0 = _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(p0, center), factor));
+        const auto q1 = _mm_cvtps_epi32(_mm_mul_ps(_mm_sub_ps(p1, center), factor));
+        const auto packed = _mm_packs_epi32(q0, q1);
+        _mm_storel_epi64((__m128i*)output[i].position, packed);
+        _mm_storel_epi64((__m128i*)output[i + 1].position, _mm_unpackhi_epi64(packed, packed));
+        output[i].color = vertices[i].color;
+        output[i + 1].color = vertices[i + 1].color;
+    }
+#endif
+
+    for (; i < vertex_cnt; ++i) {
+        const auto& position = vertices[i].position;
+        output[i].position[0] = to_snorm16((position.x - decode.center[0]) * scale[0]);
+        output[i].position[1] = to_snorm16((position.y - decode.center[1]) * scale[1]);
+        output[i].position[2] = to_snorm16((position.z - decode.center[2]) * scale[2]);
+        output[i].position[3] = 0;
+        output[i].color = vertices[i].color;
+    }
+}
+
+uint32_t encode_octahedral_normal(const float normal[3]) {
+    const auto length = fabsf(normal[0]) + fabsf(normal[1]) + fabsf(normal[2]);
+    if (length <= 0.0f)
+        return 0;
+
+    auto x = normal[0] / length;
+    auto y = normal[1] / length;
+    // the lower half of the octahedron is folded over the upper half
+    if (normal[2] < 0.0f) {
+        const auto folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+        const auto folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+        x = folded_x;
+        y = folded_y;
+    }
+    return (uint32_t)(uint16_t)to_snorm16(x) | ((uint32_t)(uint16_t)to_snorm16(y) << 16);
+}
+
+void encode_half(const float* input, const unsigned int count, uint16_t* output) {
+    unsigned int i = 0;
+#if defined(__F16C__) || (defined(_MSC_VER) && defined(__AVX2__))
+    for (; i + 4 <= count; i += 4)
+        _mm_storel_epi64((__m128i*)(output + i), _mm_cvtps_ph(_mm_loadu_ps(input + i), _MM_FROUND_TO_NEAREST_INT));
+#endif
+    for (; i < count; ++i)
+        output[i] = float_to_half(input[i]);
+}
+
+VertexEncodingStats encode_vertices(const Vertex* vertices, const unsigned int vertex_cnt, const VertexEncoding encoding,
+                                    std::vector<uint8_t>& output, PositionDecode& decode) {
+    VertexEncodingStats stats;
+    stats.encoding = encoding;
+    stats.vertex_cnt = vertex_cnt;
+    stats.original_size = (unsigned long long)vertex_cnt * sizeof(Vertex);
+
+    // vertices of full precision are uploaded as they are, there is nothing to copy
+    decode = PositionDecode();
+    output.clear();
+    stats.encoded_size = stats.original_size;
+    if (encoding != VertexEncoding::Quantized)
+        return stats;
+
+    decode = get_position_decode(vertices, vertex_cnt);
+    output.resize((size_t)vertex_cnt * sizeof(QuantizedVertex));
+    quantize_vertices(vertices, vertex_cnt, decode, (QuantizedVertex*)output.data());
+    stats.encoded_size = output.size();
+    return stats;
+}
@@ -0,0 +1,88 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stdint.h>
+#include <vector>
+#include "vertex_layout.h"
+
+struct Vertex;
+
+/*
+ * How vertices are stored in GPU memory. Vertex fetch of large meshes is bound by bandwidth, quantized vertices take less of it.
+ */
+enum class VertexEncoding : uint8_t {
+    Full = 0,       // 32 bits float positions, 16 bytes per vertex
+    Quantized,      // 16 bits SNORM positions inside the bounding box of the mesh, 12 bytes per vertex
+};
+
+inline const char* get_vertex_encoding_name(const VertexEncoding encoding) {
+    return encoding == VertexEncoding::Quantized ? "quantized" : "full";
+}
+
+/*
+ * A quantized vertex, its position is relative to the bounding box of the mesh. The fourth component of the position is
+ * always zero, there is no three component 16 bits format in DXGI.
+ */
+struct QuantizedVertex {
+    int16_t         position[4];
+    unsigned int    color;
+};
+
+template<>
+struct VertexLayout<QuantizedVertex> {
+    static constexpr VertexAttribute attributes[] = {
+        VERTEX_ATTRIBUTE(QuantizedVertex, position, Position, SNorm16x4),
+        VERTEX_ATTRIBUTE(QuantizedVertex, color, Color, UNorm8x4),
+    };
+};
+
+/*
+ * The vertex shader decodes positions as 'position * extent + center'. Positions of full precision are not encoded, their
+ * decode is the identity.
+ */
+struct PositionDecode {
+    float   center[3] = { 0.0f, 0.0f, 0.0f };
+    float   extent[3] = { 1.0f, 1.0f, 1.0f };      // half of the size of the bounding box
+};
+
+/*
+ * Size of a mesh before and after encoding, in bytes.
+ */
+struct VertexEncodingStats {
+    VertexEncoding      encoding = VertexEncoding::Full;
+    unsigned int        vertex_cnt = 0;
+    unsigned long long  original_size = 0;
+    unsigned long long  encoded_size = 0;
+};
+
+/*
+ * Encode vertices of a mesh into 'output', in the layout of 'QuantizedVertex'. Vertices of full precision need no encoding,
+ * 'output' is left empty and the vertices are uploaded as they are.
+ */
+VertexEncodingStats encode_vertices(const Vertex* vertices, const unsigned int vertex_cnt, const VertexEncoding encoding,
+                                    std::vector<uint8_t>& output, PositionDecode& decode);
+
+/*
+ * The bounding box of the positions of a mesh, as the decode of its quantized positions.
+ */
+PositionDecode get_position_decode(const Vertex* vertices, const unsigned int vertex_cnt);
+
+/*
+ * Quantize positions into the bounding box, with SIMD when it is available.
+ */
+void quantize_vertices(const Vertex* vertices, const unsigned int vertex_cnt, const PositionDecode& decode, QuantizedVertex* output);
+
+/*
+ * Octahedral encoding of a unit normal as two 16 bits SNORM, the first one in the lower bits. It is fetched as 'SNorm16x2',
+ * the vertex shader unfolds the octahedron to get the normal back.
+ */
+uint32_t encode_octahedral_normal(const float normal[3]);
+
+/*
+ * Convert floats to half floats, rounding to the nearest. Texture coordinates fetched as 'Half2' or 'Half4' need no decode.
+ */
+void encode_half(const float* input, const unsigned int count, uint16_t* output);
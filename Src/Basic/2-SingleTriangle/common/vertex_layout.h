@@ -0,0 +1,204 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+#include <array>
+#include <utility>
+#include <type_traits>
+
+/*
+ * Formats of vertex attributes, each backend maps them to its own format.
+ */
+enum class VertexFormat : uint8_t {
+    Float2,
+    Float3,
+    Float4,
+    UNorm8x4,
+    SNorm8x4,
+    UNorm16x2,
+    SNorm16x2,
+    UNorm16x4,
+    SNorm16x4,
+    Half2,
+    Half4,
+};
+
+constexpr uint32_t get_vertex_format_size(const VertexFormat format) {
+    switch (format) {
+    case VertexFormat::Float2:      return 8;
+    case VertexFormat::Float3:      return 12;
+    case VertexFormat::Float4:      return 16;
+    case VertexFormat::UNorm8x4:    return 4;
+    case VertexFormat::SNorm8x4:    return 4;
+    case VertexFormat::UNorm16x2:   return 4;
+    case VertexFormat::SNorm16x2:   return 4;
+    case VertexFormat::UNorm16x4:   return 8;
+    case VertexFormat::SNorm16x4:   return 8;
+    case VertexFormat::Half2:       return 4;
+    case VertexFormat::Half4:       return 8;
+    }
+    return 0;
+}
+
+/*
+ * What an attribute means to the vertex shader. The location of an attribute in GLSL is the value of its semantic, the name
+ * of the semantic is what HLSL calls it, both shaders have to declare their inputs the same way.
+ */
+enum class VertexSemantic : uint8_t {
+    Position = 0,
+    Color,
+    Normal,
+    TexCoord,
+    // per-instance attributes of instanced draws
+    InstanceScale,
+    InstanceOffset,
+    InstanceColor,
+};
+
+constexpr uint32_t get_vertex_location(const VertexSemantic semantic) {
+    return (uint32_t)semantic;
+}
+
+constexpr const char* get_vertex_semantic_name(const VertexSemantic semantic) {
+    switch (semantic) {
+    case VertexSemantic::Position:          return "POSITION";
+    case VertexSemantic::Color:             return "COLOR";
+    case VertexSemantic::Normal:            return "NORMAL";
+    case VertexSemantic::TexCoord:          return "TEXCOORD";
+    case VertexSemantic::InstanceScale:     return "INSTANCE_SCALE";
+    case VertexSemantic::InstanceOffset:    return "INSTANCE_OFFSET";
+    case VertexSemantic::InstanceColor:     return "INSTANCE_COLOR";
+    }
+    return "";
+}
+
+/*
+ * A single attribute of a vertex, 'size' is the size of the member it comes from.
+ */
+struct VertexAttribute {
+    VertexSemantic  semantic;
+    VertexFormat    format;
+    uint32_t        offset;
+    uint32_t        size;
+};
+
+/*
+ * Describe an attribute of a vertex by the member it is stored in, it can only be used inside a vertex layout.
+ */
+#define VERTEX_ATTRIBUTE(vertex, member, semantic, format) \
+    VertexAttribute{ VertexSemantic::semantic, VertexFormat::format, (uint32_t)offsetof(vertex, member), (uint32_t)sizeof(vertex::member) }
+
+/*
+ * A vertex declares its attributes once by specializing this template, each backend generates its input layout from it.
+ *
+ *   template<> struct VertexLayout<Vertex> {
+ *       static constexpr VertexAttribute attributes[] = {
+ *           VERTEX_ATTRIBUTE(Vertex, position, Position, Float3),
+ *       };
+ *   };
+ *
+ * Each vertex type is a stream of its own, split-stream formats are made of more than one vertex type.
+ */
+template<class V>
+struct VertexLayout;
+
+template<class V>
+constexpr uint32_t get_vertex_attribute_count() {
+    return (uint32_t)(sizeof(VertexLayout<V>::attributes) / sizeof(VertexLayout<V>::attributes[0]));
+}
+
+template<class V>
+constexpr uint32_t get_vertex_stride() {
+    return (uint32_t)sizeof(V);
+}
+
+namespace vertex_layout_detail {
+    template<class V>
+    constexpr bool formats_match_members() {
+        for (const auto& attribute : VertexLayout<V>::attributes) {
+            if (get_vertex_format_size(attribute.format) != attribute.size)
+                return false;
+        }
+        return true;
+    }
+
+    template<class V>
+    constexpr bool offsets_are_aligned() {
+        for (const auto& attribute : VertexLayout<V>::attributes) {
+            if (attribute.offset % 4)
+                return false;
+        }
+        return true;
+    }
+
+    template<class V>
+    constexpr bool attributes_are_disjoint() {
+        const auto& attributes = VertexLayout<V>::attributes;
+        for (uint32_t i = 0; i < get_vertex_attribute_count<V>(); ++i) {
+            for (uint32_t j = i + 1; j < get_vertex_attribute_count<V>(); ++j) {
+                const auto& a = attributes[i];
+                const auto& b = attributes[j];
+                if (a.semantic == b.semantic)
+                    return false;
+                if (a.offset < b.offset + b.size && b.offset < a.offset + a.size)
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    constexpr uint64_t hash_bytes(uint64_t hash, const uint32_t value, const int byte_cnt) {
+        for (int i = 0; i < byte_cnt; ++i) {
+            hash ^= (value >> (i * 8)) & 0xff;
+            hash *= 1099511628211ull;
+        }
+        return hash;
+    }
+
+    template<class V, class Element, class Make, size_t... I>
+    constexpr std::array<Element, sizeof...(I)> make_elements(const Make& make, std::index_sequence<I...>) {
+        return { { make(VertexLayout<V>::attributes[I])... } };
+    }
+}
+
+/*
+ * Everything a backend relies on when generating an input layout, checked at compile time.
+ */
+template<class V>
+constexpr bool check_vertex_layout() {
+    static_assert(std::is_standard_layout<V>::value && std::is_trivially_copyable<V>::value, "Vertices have to be plain data.");
+    static_assert(get_vertex_stride<V>() % 4 == 0, "The stride of a vertex has to be a multiple of four bytes.");
+    static_assert(vertex_layout_detail::formats_match_members<V>(), "The format of an attribute doesn't match the size of its member.");
+    static_assert(vertex_layout_detail::offsets_are_aligned<V>(), "Attributes have to be aligned to four bytes.");
+    static_assert(vertex_layout_detail::attributes_are_disjoint<V>(), "Attributes can't overlap or share a semantic.");
+    return true;
+}
+
+/*
+ * Generate an array of backend elements from the layout of a vertex, 'make' turns an attribute into an element.
+ */
+template<class V, class Element, class Make>
+constexpr std::array<Element, get_vertex_attribute_count<V>()> make_vertex_elements(const Make& make) {
+    static_assert(check_vertex_layout<V>(), "Invalid vertex layout.");
+    return vertex_layout_detail::make_elements<V, Element>(make, std::make_index_sequence<get_vertex_attribute_count<V>()>());
+}
+
+/*
+ * FNV-1a of the stride and the semantic, format and offset of each attribute, files storing vertices record it so that a
+ * vertex stream is never read with a different layout. Tools writing vertices have to hash them the same way.
+ */
+template<class V>
+constexpr uint64_t get_vertex_layout_hash() {
+    auto hash = vertex_layout_detail::hash_bytes(14695981039346656037ull, get_vertex_stride<V>(), 4);
+    for (const auto& attribute : VertexLayout<V>::attributes) {
+        hash = vertex_layout_detail::hash_bytes(hash, (uint32_t)attribute.semantic, 1);
+        hash = vertex_layout_detail::hash_bytes(hash, (uint32_t)attribute.format, 1);
+        hash = vertex_layout_detail::hash_bytes(hash, attribute.offset, 4);
+    }
+    return hash;
+}
@@ -8,10 +8,31 @@
 #include <d3d12.h>
 #include <math.h>
 #include <d3dcompiler.h>
+#include <array>
+#include <algorithm>
+#include <vector>
+#include <string>
+#include <thread>
+#include <mutex>
+#include <memory>
 #include "shaders/generated_ps.h"
 #include "shaders/generated_vs.h"
+#include "shaders/generated_vs_instanced.h"
+#include "shaders/generated_object_cull.h"
 #include "d3d12_impl.h"
 #include "../common/common.h"
+#include "../common/linear_allocator.h"
+#include "../common/deletion_queue.h"
+#include "../common/pipeline_cache.h"
+#include "../common/task_graph.h"
+#include "../common/pipeline_compiler.h"
+#include "../common/state_cache.h"
+#include "../common/mesh.h"
+#include "../common/mesh_optimizer.h"
+#include "../common/gpu_culling.h"
+#include "../common/geometry_pool.h"
+#include "../common/frame_pacing.h"
+#include "../common/render_graph.h"
 
 /*
     This tutorial demonstrate how to draw a single triangle on screen.
@@ -24,11 +45,25 @@
 
 using Microsoft::WRL::ComPtr;
 
+// A pipeline state object compiled in the background, it is only valid once the pipeline is ready.
+struct D3D12Pipeline : public AsyncPipeline {
+    explicit D3D12Pipeline(const char* name) : AsyncPipeline(name) {}
+
+    ComPtr<ID3D12PipelineState>     pso;
+};
+
 // Different from d3d11, which implicitly accumulate command buffers of three frames and stall CPU pipeline if it is
 // too fast ( faster than three frames on CPU ), d3d12 exposes the control to programmers.
-// The purpose of doing so is to avoid occasionally long CPU frame, which could result in GPU idle. The reason it is
-// only 3 but not any number larger is to avoid input lag, which is not exactly a problem in this tutorial.
-static constexpr unsigned NUM_FRAMES = 3;
+// The purpose of doing so is to avoid occasionally long CPU frame, which could result in GPU idle. How many frames CPU runs
+// ahead is a runtime setting, see 'set_frames_in_flight', per-frame resources are sized for 'MAX_FRAMES_IN_FLIGHT'. The
+// number of back buffers has nothing to do with it, a frame renders into whichever back buffer the swap chain gives it.
+static constexpr unsigned NUM_BACK_BUFFERS = 3;
+
+// Size of the transient memory of each frame, each draw takes 256 bytes of it since that is the alignment of constant buffers.
+static constexpr unsigned TRANSIENT_MEMORY_PER_FRAME = 8 * 1024 * 1024;
+
+// Compiled pipelines are kept in this file between launches.
+static constexpr const char* PIPELINE_LIBRARY_FILE = "2_single_triangle_d3d12.pipeline_cache";
 
 
 // Followings are d3d12 related data structures
@@ -39,12 +74,19 @@ static ComPtr<IDXGIAdapter>                 g_adapter = nullptr;
 static ComPtr<ID3D12Device2>                g_d3d12_device = nullptr;
 // Command queue is the software abstraction of GPU hardware command queue. There are three type of command queues on
 // modern graphics hardware, which is also true in d3d12, graphics queue, compute queue and copy queue.
-// Only graphics queue is used in this tutorial.
+// The graphics queue does the rendering, uploads go through the copy queue.
 static ComPtr<ID3D12CommandQueue>           g_command_queue = nullptr;
+// Copy queue is usually backed by the DMA engines, copies on it run in parallel with rendering.
+static ComPtr<ID3D12CommandQueue>           g_copy_queue = nullptr;
+// The command list and allocator for recording uploads, there is only one batch of uploads being recorded at a time.
+static ComPtr<ID3D12GraphicsCommandList>    g_copy_command_list = nullptr;
+static ComPtr<ID3D12CommandAllocator>       g_copy_command_allocator = nullptr;
+// The copy queue signals this fence when a batch of uploads is done.
+static ComPtr<ID3D12Fence>                  g_copy_fence = nullptr;
 // Swap chain is the abstraction of a set of back buffers.
 static ComPtr<IDXGISwapChain4>              g_swap_chain = nullptr;
 // The three back buffers acquired from the swap chain.
-static ComPtr<ID3D12Resource>               g_back_buffers[NUM_FRAMES] = { nullptr, nullptr, nullptr };
+static ComPtr<ID3D12Resource>               g_back_buffers[NUM_BACK_BUFFERS] = { nullptr, nullptr, nullptr };
 // Descriptor is a new concept in d3d12, descriptor is what we use to describe a resource and have them linked to graphics
 // pipeline. Unlike d3d11, the memory management is explicitly, no memory allocation under the hood of API. In order to
 // allocate a descriptor, we need a descriptor heap, which is responsible for keeping all descriptors memory alive.
@@ -56,30 +98,133 @@ static ComPtr<ID3D12DescriptorHeap>         g_descriptor_heap = nullptr;
 static ComPtr<ID3D12GraphicsCommandList>    g_command_list = nullptr;
 // A command list only translate the GPU command into commands of correct format. It doesn't keep the command buffer memory, 
 // the command allocator does.
-static ComPtr<ID3D12CommandAllocator>       g_command_list_allocators[NUM_FRAMES] = { nullptr, nullptr, nullptr };
-// Fence object is used to make sure CPU is never too fast. In this tutorial, if it is 3 frames ahead of GPU, it will be 
-// stalled.
+static ComPtr<ID3D12CommandAllocator>       g_command_list_allocators[MAX_FRAMES_IN_FLIGHT];
+// Fence object is used to make sure CPU is never too fast. Every frame signals an ever increasing value on it, if CPU is
+// more frames ahead of GPU than the frames in flight, it will be stalled.
 static ComPtr<ID3D12Fence>                  g_fence = nullptr;
 // The committed heap for geometry data, including vertex buffer and index buffer
+// The geometry pool, see 'common/geometry_pool.h'. Its vertices and its indices are two ranges of the same buffer, all
+// meshes are sub-allocated from them and drawn with their base vertex and first index, the buffer is bound once.
 static ComPtr<ID3D12Resource>               g_geometry_buffer = nullptr;
+static GeometryPool                         g_geometry_pool;
+// where the mesh is in the geometry pool
+static GeometryRange                        g_mesh_range;
 // The root signature
 static ComPtr<ID3D12RootSignature>          g_root_signature = nullptr;
-// Pipeline state object for the draw call
-static ComPtr<ID3D12PipelineState>          g_pipeline_state_object = nullptr;
+// Pipeline state object for the draw call, it is compiled in the background and the triangle is not drawn until it is ready.
+static std::shared_ptr<D3D12Pipeline>       g_pipeline = nullptr;
+// Background threads compiling pipeline state objects.
+static std::unique_ptr<PipelineCompiler>    g_pipeline_compiler = nullptr;
+// Root signatures and pipeline state objects are looked up by their state, identical states are only created once.
+static StateCache<ComPtr<ID3D12RootSignature>>      g_root_signatures;
+static StateCache<std::shared_ptr<D3D12Pipeline>>   g_pipelines;
+// Pipeline library keeps compiled pipeline state objects between launches, it is null if the driver doesn't support it.
+static ComPtr<ID3D12PipelineLibrary>        g_pipeline_library = nullptr;
+// Timestamp queries, two for each frame, one at the beginning and the other one at the end of its command list.
+static ComPtr<ID3D12QueryHeap>              g_timestamp_query_heap = nullptr;
+// Query results can't be read on CPU directly, they are resolved into this buffer first.
+static ComPtr<ID3D12Resource>               g_timestamp_readback_buffer = nullptr;
+// Transient memory for per-draw constants, it is an upload buffer that stays mapped all the time, each frame owns a region of it.
+static ComPtr<ID3D12Resource>               g_transient_buffer = nullptr;
+// Linear allocators of the transient memory, one for each frame in flight, they are reset once the fence of the frame is reached.
+static LinearAllocator                      g_frame_allocators[MAX_FRAMES_IN_FLIGHT];
+// Size of the region of each frame in the transient buffer, instance data takes more than the per-draw constants.
+static UINT64                               g_transient_frame_size = TRANSIENT_MEMORY_PER_FRAME;
 
 // Following are some generic data of this tutorial program.
 
-// Sometimes if CPU is 3 frames ahead of CPU, it will be stalled. This even is for notifying CPU when the command it is waiting 
-// is done.
+// Sometimes if CPU is too many frames ahead of GPU, it will be stalled. This even is for notifying CPU when the command it is
+// waiting is done.
 static HANDLE                               g_fence_event;
 // This keeps track of what is the current back buffer index to be rendered into.
 static unsigned int                         g_current_back_buffer_index = 0;
+// Frames CPU runs ahead of GPU, and the frame being recorded, which owns a command allocator, a region of the transient
+// memory and the timestamp queries.
+static unsigned int                         g_frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+static unsigned int                         g_frame_index = 0;
+// Present mode asked for and the one the swap chain really uses. Mailbox is a sync interval of 0 without tearing, the
+// compositor shows the latest frame, immediate is DXGI tearing, which falls back to mailbox if the display can't tear.
+static PresentMode                          g_requested_present_mode = PresentMode::Fifo;
+static PresentMode                          g_present_mode = PresentMode::Fifo;
+// The swap chain signals this object once it can queue another frame, frames wait for it before they begin instead of
+// blocking in Present with their commands already recorded.
+static HANDLE                               g_frame_latency_waitable = nullptr;
+// Flags the swap chain is created with, resizing the back buffers has to keep them.
+static UINT                                 g_swap_chain_flags = 0;
+// Size of the window the back buffers are resized to at the beginning of the next frame.
+static bool                                 g_resize_pending = false;
+static unsigned int                         g_resize_width = 0;
+static unsigned int                         g_resize_height = 0;
+// Low latency frame pacing, it is fed with the GPU time of the timestamp queries.
+static FramePacer                           g_frame_pacer;
+// Passes of the current frame, see 'common/render_graph.h', and the resources of the graph.
+struct GraphResource {
+    ID3D12Resource*     resource = nullptr;
+    bool                buffer = false;
+};
+static RenderGraph                          g_render_graph;
+static std::vector<GraphResource>           g_graph_resources;
+// The event for waiting for the copy fence, it is only needed when the copy allocator is still in use.
+static HANDLE                               g_copy_fence_event;
+// The value signaled by the last batch of uploads.
+static UINT64                               g_copy_fence_value = 0;
+// Whether the copy command list is open for recording uploads.
+static bool                                 g_copy_recording = false;
+// Upload buffers of the batch being recorded.
+static std::vector<ComPtr<ID3D12Resource>>  g_upload_buffers;
 // The size of render target descriptor, this is vendor specific.
 static unsigned int                         g_rtv_size = 0;
 // An ever increasing value, it keeps track what value to write to the fence when each frame rendering is done.
 static UINT64                               g_fence_value = 0;
-// The catched value of the three frames. It keeps track of what value we used to write to the fence in the past three frames.
-static UINT64                               g_frame_fence_values[NUM_FRAMES];
+// The catched value of the frames in flight. It keeps track of what value we used to write to the fence in the past frames.
+static UINT64                               g_frame_fence_values[MAX_FRAMES_IN_FLIGHT] = {};
+// Number of timestamp ticks per second.
+static UINT64                               g_timestamp_frequency = 0;
+// The profiler frame that last used the queries of each frame, 0 means there is nothing to read back yet.
+static unsigned long long                   g_timestamp_frames[MAX_FRAMES_IN_FLIGHT] = {};
+// CPU time of submitting each frame.
+static long long                            g_submit_time[MAX_FRAMES_IN_FLIGHT] = {};
+// GPU timestamps have nothing to do with the CPU clock. The beginning of the first GPU frame is aligned with the time it was
+// submitted on CPU, all later GPU frames are placed relative to it.
+static long long                            g_gpu_time_offset = 0;
+static bool                                 g_gpu_time_calibrated = false;
+// Number of times the triangle is drawn in each frame.
+static unsigned int                         g_draw_cnt = 1;
+// Whether all draws are a single instanced draw, the data of each instance is a second vertex stream in the transient memory.
+// Instancing asked for and whether draws really go through it, GPU culling turns it off.
+static bool                                 g_requested_instancing = false;
+static bool                                 g_instancing = false;
+// GPU culling, see 'common/gpu_culling.h'. The data of all objects stays in a default heap, a compute shader culls them every
+// frame into the draw arguments of the visible ones, followed by their count, and a single ExecuteIndirect draws them.
+static bool                                 g_gpu_culling = false;
+static GpuCullingStats                      g_gpu_culling_stats;
+static ComPtr<ID3D12Resource>               g_object_buffer = nullptr;
+static ComPtr<ID3D12Resource>               g_object_draw_buffer = nullptr;
+static UINT64                               g_object_count_offset = 0;
+// The count of each frame is copied here, it is read once the fence of the frame is reached.
+static ComPtr<ID3D12Resource>               g_object_count_readback_buffer = nullptr;
+static bool                                 g_object_count_pending[MAX_FRAMES_IN_FLIGHT] = {};
+static ComPtr<ID3D12RootSignature>          g_object_cull_root_signature = nullptr;
+static ComPtr<ID3D12PipelineState>          g_object_cull_pso = nullptr;
+static ComPtr<ID3D12CommandSignature>       g_object_draw_signature = nullptr;
+// Encoding of the vertex buffer, along with the decode of its positions and its size before and after encoding.
+static VertexEncoding                       g_vertex_encoding = VertexEncoding::Full;
+static PositionDecode                       g_position_decode;
+static VertexEncodingStats                  g_vertex_encoding_stats;
+// The mesh drawn by the sample, it is mapped from a mesh file or the built-in triangle if there is no file.
+static Mesh                                 g_mesh;
+static std::string                          g_mesh_filename;
+// Whether the mesh is optimized when it is loaded, along with its efficiency before and after.
+static bool                                 g_mesh_optimization = false;
+static MeshOptimizationStats                g_mesh_optimization_stats;
+// The pipeline library is created on top of this blob, it has to outlive the library.
+static std::vector<uint8_t>                 g_pipeline_library_blob;
+// Whether anything is stored in the pipeline library since it was loaded.
+static bool                                 g_pipeline_library_dirty = false;
+// Pipelines are compiled on multiple threads, the pipeline library is only touched with this locked since it may be started over.
+static std::mutex                           g_pipeline_library_mutex;
+// Resources waiting for GPU to be done with them, they are released once the fence reaches the value of the last frame using them.
+static DeletionQueue                        g_deletion_queue;
 // The vertex buffer view
 D3D12_VERTEX_BUFFER_VIEW                    g_vertex_buffer_view;
 D3D12_INDEX_BUFFER_VIEW                     g_index_buffer_view;
@@ -223,6 +368,32 @@ bool create_command_queue() {
     return true;
 }
 
+/*
+ * Create the copy queue along with everything needed for recording uploads.
+ */
+bool create_copy_queue() {
+    D3D12_COMMAND_QUEUE_DESC desc = {};
+    desc.Type = D3D12_COMMAND_LIST_TYPE_COPY;
+    desc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
+    desc.Flags = D3D12_COMMAND_QUEUE_FLAG_NONE;
+    desc.NodeMask = 0;
+    if (FAILED(g_d3d12_device->CreateCommandQueue(&desc, IID_PPV_ARGS(&g_copy_queue))))
+        return false;
+
+    if (FAILED(g_d3d12_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_COPY, IID_PPV_ARGS(&g_copy_command_allocator))))
+        return false;
+
+    if (FAILED(g_d3d12_device->CreateCommandList(0, D3D12_COMMAND_LIST_TYPE_COPY, g_copy_command_allocator.Get(), nullptr, IID_PPV_ARGS(&g_copy_command_list))))
+        return false;
+    g_copy_command_list->Close();
+
+    if (FAILED(g_d3d12_device->CreateFence(0, D3D12_FENCE_FLAG_NONE, IID_PPV_ARGS(&g_copy_fence))))
+        return false;
+    g_copy_fence_event = ::CreateEvent(NULL, FALSE, FALSE, NULL);
+
+    return true;
+}
+
 /*
  * Create a swap chain.
  */
@@ -237,7 +408,7 @@ bool create_swap_chain(HWND hwnd) {
 
     // get the client size of the window
     ::RECT rect;
-    ::GetWindowRect(hwnd, &rect);
+    ::GetClientRect(hwnd, &rect);
 
     auto ret = CreateDXGIFactory2(createFactoryFlags, IID_PPV_ARGS(&dxgiFactory4));
     if (FAILED(ret))
@@ -250,15 +421,29 @@ bool create_swap_chain(HWND hwnd) {
     swapChainDesc.Stereo = FALSE;
     swapChainDesc.SampleDesc = { 1, 0 };
     swapChainDesc.BufferUsage = DXGI_USAGE_RENDER_TARGET_OUTPUT;
-    swapChainDesc.BufferCount = NUM_FRAMES;
+    swapChainDesc.BufferCount = NUM_BACK_BUFFERS;
     swapChainDesc.Scaling = DXGI_SCALING_STRETCH;
     swapChainDesc.SwapEffect = DXGI_SWAP_EFFECT_FLIP_DISCARD;
     swapChainDesc.AlphaMode = DXGI_ALPHA_MODE_UNSPECIFIED;
-    swapChainDesc.Flags = 0;
+    swapChainDesc.Flags = DXGI_SWAP_CHAIN_FLAG_FRAME_LATENCY_WAITABLE_OBJECT;
+
+    // tearing needs both the flag on the swap chain and a display that supports it
+    g_present_mode = g_requested_present_mode;
+    if (g_present_mode == PresentMode::Immediate) {
+        BOOL allow_tearing = FALSE;
+        ComPtr<IDXGIFactory5> dxgiFactory5;
+        if (SUCCEEDED(dxgiFactory4.As(&dxgiFactory5)) &&
+            SUCCEEDED(dxgiFactory5->CheckFeatureSupport(DXGI_FEATURE_PRESENT_ALLOW_TEARING, &allow_tearing, sizeof(allow_tearing))) && allow_tearing)
+            swapChainDesc.Flags |= DXGI_SWAP_CHAIN_FLAG_ALLOW_TEARING;
+        else
+            g_present_mode = PresentMode::Mailbox;
+    }
 
     g_window_width = swapChainDesc.Width;
     g_window_height = swapChainDesc.Height;
 
+    g_swap_chain_flags = swapChainDesc.Flags;
+
     ComPtr<IDXGISwapChain1> swapChain1;
     ret = dxgiFactory4->CreateSwapChainForHwnd(g_command_queue.Get(), hwnd, &swapChainDesc, nullptr, nullptr, &swapChain1);
     if (FAILED(ret))
@@ -271,6 +456,11 @@ bool create_swap_chain(HWND hwnd) {
 
     swapChain1.As(&g_swap_chain);
 
+    // DXGI queues up to three frames by default no matter how many frames are in flight, a low latency frame is never
+    // queued behind another one.
+    g_swap_chain->SetMaximumFrameLatency(g_frame_pacer.is_low_latency() ? 1 : g_frames_in_flight);
+    g_frame_latency_waitable = g_swap_chain->GetFrameLatencyWaitableObject();
+
     // get the currnet frame back buffer index
     g_current_back_buffer_index = g_swap_chain->GetCurrentBackBufferIndex();
 
@@ -279,10 +469,10 @@ bool create_swap_chain(HWND hwnd) {
 
 
 /*
- * Create a command list and three command list allocators.
+ * Create a command list and a command list allocator for each frame in flight.
  */
 bool create_commands() {
-    for (auto i = 0; i < NUM_FRAMES; ++i) {
+    for (auto i = 0u; i < g_frames_in_flight; ++i) {
         // create command list allocator
         const auto ret = g_d3d12_device->CreateCommandAllocator(D3D12_COMMAND_LIST_TYPE_DIRECT, IID_PPV_ARGS(&g_command_list_allocators[i]));
         if (FAILED(ret))
@@ -299,13 +489,34 @@ bool create_commands() {
 }
 
 
+/*
+ * Get the back buffers of the swap chain and create their render target views, they change whenever the back buffers are resized.
+ */
+bool create_back_buffer_rtvs() {
+    // create the render target view for each buffer in the swap chain.
+    auto handle = g_descriptor_heap->GetCPUDescriptorHandleForHeapStart();
+    for (int i = 0; i < NUM_BACK_BUFFERS; ++i)
+    {
+        ComPtr<ID3D12Resource> backBuffer;
+        const auto ret = g_swap_chain->GetBuffer(i, IID_PPV_ARGS(&backBuffer));
+        if (FAILED(ret))
+            return false;
+
+        g_d3d12_device->CreateRenderTargetView(backBuffer.Get(), nullptr, handle);
+        g_back_buffers[i] = backBuffer;
+        handle.ptr = handle.ptr + g_rtv_size;
+    }
+
+    return true;
+}
+
 /*
  * Create render target views.
  */
 bool create_rtvs() {
     // create descriptor heap
     D3D12_DESCRIPTOR_HEAP_DESC heap_desc = {};
-    heap_desc.NumDescriptors = NUM_FRAMES;
+    heap_desc.NumDescriptors = NUM_BACK_BUFFERS;
     heap_desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_RTV;
     const auto ret = g_d3d12_device->CreateDescriptorHeap(&heap_desc, IID_PPV_ARGS(&g_descriptor_heap));
     if (FAILED(ret))
@@ -314,21 +525,34 @@ bool create_rtvs() {
     // descriptor size could be vendor dependent
     g_rtv_size = g_d3d12_device->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_RTV);
 
-    // create the render target view for each buffer in the swap chain.
-    auto handle = g_descriptor_heap->GetCPUDescriptorHandleForHeapStart();
-    for (int i = 0; i < NUM_FRAMES; ++i)
-    {
-        ComPtr<ID3D12Resource> backBuffer;
-        const auto ret = g_swap_chain->GetBuffer(i, IID_PPV_ARGS(&backBuffer));
-        if (FAILED(ret))
-            return false;
+    return create_back_buffer_rtvs();
+}
 
-        g_d3d12_device->CreateRenderTargetView(backBuffer.Get(), nullptr, handle);
-        g_back_buffers[i] = backBuffer;
-        handle.ptr = handle.ptr + g_rtv_size;
+/*
+ * Resize the back buffers of the swap chain.
+ * DXGI can't resize back buffers that are still in use, so GPU has to be done with the last frame rendering into them, which
+ * is the last frame submitted. Nothing else is flushed, uploads on the copy queue go on, the frame index and the transient
+ * memory stay as they are, and the swap chain keeps its flags and its latency waitable object.
+ */
+bool resize_swap_chain(const unsigned int width, const unsigned int height) {
+    if (g_fence->GetCompletedValue() < g_fence_value) {
+        g_fence->SetEventOnCompletion(g_fence_value, g_fence_event);
+        ::WaitForSingleObject(g_fence_event, INFINITE);
     }
 
-    return true;
+    // all references to the back buffers have to be gone
+    for (auto& back_buffer : g_back_buffers)
+        back_buffer = nullptr;
+
+    if (FAILED(g_swap_chain->ResizeBuffers(NUM_BACK_BUFFERS, width, height, DXGI_FORMAT_UNKNOWN, g_swap_chain_flags)))
+        return false;
+
+    g_window_width = width;
+    g_window_height = height;
+    g_current_back_buffer_index = g_swap_chain->GetCurrentBackBufferIndex();
+
+    // the descriptor heap stays, the views are simply written again
+    return create_back_buffer_rtvs();
 }
 
 /*
@@ -358,31 +582,282 @@ bool create_fence() {
 
 
 /*
- * A helper utility function to make resource transition a bit easier.
+ * Create the timestamp queries to measure GPU time of each frame.
+ */
+bool create_timestamp_queries() {
+    // GPU timing is simply disabled if the queue doesn't support it
+    if (FAILED(g_command_queue->GetTimestampFrequency(&g_timestamp_frequency)) || g_timestamp_frequency == 0)
+        return true;
+
+    D3D12_QUERY_HEAP_DESC heap_desc = {};
+    heap_desc.Type = D3D12_QUERY_HEAP_TYPE_TIMESTAMP;
+    heap_desc.Count = g_frames_in_flight * 2;
+    heap_desc.NodeMask = 0;
+    if (FAILED(g_d3d12_device->CreateQueryHeap(&heap_desc, IID_PPV_ARGS(&g_timestamp_query_heap))))
+        return false;
+
+    D3D12_RESOURCE_DESC buffer_desc = {};
+    buffer_desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    buffer_desc.Width = sizeof(UINT64) * g_frames_in_flight * 2;
+    buffer_desc.Height = 1;
+    buffer_desc.DepthOrArraySize = 1;
+    buffer_desc.MipLevels = 1;
+    buffer_desc.Format = DXGI_FORMAT_UNKNOWN;
+    buffer_desc.SampleDesc.Count = 1;
+    buffer_desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    buffer_desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    D3D12_HEAP_PROPERTIES readback_heap_prop = {};
+    readback_heap_prop.Type = D3D12_HEAP_TYPE_READBACK;
+    readback_heap_prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    readback_heap_prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    readback_heap_prop.CreationNodeMask = 1;
+    readback_heap_prop.VisibleNodeMask = 1;
+
+    return SUCCEEDED(g_d3d12_device->CreateCommittedResource(&readback_heap_prop, D3D12_HEAP_FLAG_NONE, &buffer_desc,
+        D3D12_RESOURCE_STATE_COPY_DEST, nullptr, IID_PPV_ARGS(&g_timestamp_readback_buffer)));
+}
+
+
+/*
+ * Read back the GPU time of the frame that used the current frame index last time, it is already done on GPU.
+ */
+void read_timestamps(FrameProfiler& profiler) {
+    const auto index = g_frame_index;
+    if (!g_timestamp_query_heap || g_timestamp_frames[index] == 0)
+        return;
+
+    const D3D12_RANGE read_range = { sizeof(UINT64) * index * 2, sizeof(UINT64) * (index * 2 + 2) };
+    const D3D12_RANGE write_range = { 0, 0 };
+    UINT64* ticks = nullptr;
+    if (FAILED(g_timestamp_readback_buffer->Map(0, &read_range, reinterpret_cast<void**>(&ticks))))
+        return;
+    const auto begin = (long long)(ticks[index * 2] * 1000000000.0 / g_timestamp_frequency);
+    const auto end = (long long)(ticks[index * 2 + 1] * 1000000000.0 / g_timestamp_frequency);
+    g_timestamp_readback_buffer->Unmap(0, &write_range);
+
+    if (!g_gpu_time_calibrated) {
+        g_gpu_time_offset = g_submit_time[index] - begin;
+        g_gpu_time_calibrated = true;
+    }
+
+    profiler.record_gpu("gpu frame", g_timestamp_frames[index], begin + g_gpu_time_offset, end + g_gpu_time_offset);
+    g_frame_pacer.gpu_frame_done(end - begin);
+    g_timestamp_frames[index] = 0;
+}
+
+
+/*
+ * Release a d3d12 object at runtime without flushing the command queue.
+ * The frame being recorded may use it, it is released once the fence reaches the value signaled at the end of the frame.
+ */
+void defer_release(ComPtr<ID3D12Object> object) {
+    g_deletion_queue.push(g_fence_value + 1, [object]() mutable {
+        object = nullptr;
+    });
+}
+
+
+/*
+ * Copy the data into an upload buffer and record the copy into the destination buffer on the copy command list.
+ * Nothing is executed until 'submit_uploads' is called.
+ */
+bool upload_buffer(ID3D12Resource* dst, const UINT64 offset, const void* data, const UINT64 size) {
+    D3D12_RESOURCE_DESC buffer_desc = {};
+    buffer_desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    buffer_desc.Width = size;
+    buffer_desc.Height = 1;
+    buffer_desc.DepthOrArraySize = 1;
+    buffer_desc.MipLevels = 1;
+    buffer_desc.Format = DXGI_FORMAT_UNKNOWN;
+    buffer_desc.SampleDesc.Count = 1;
+    buffer_desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    buffer_desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+
+    D3D12_HEAP_PROPERTIES upload_heap_prop = {};
+    upload_heap_prop.Type = D3D12_HEAP_TYPE_UPLOAD;
+    upload_heap_prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    upload_heap_prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    upload_heap_prop.CreationNodeMask = 1;
+    upload_heap_prop.VisibleNodeMask = 1;
+
+    ComPtr<ID3D12Resource> upload = nullptr;
+    if (FAILED(g_d3d12_device->CreateCommittedResource(&upload_heap_prop, D3D12_HEAP_FLAG_NONE, &buffer_desc,
+        D3D12_RESOURCE_STATE_GENERIC_READ, nullptr, IID_PPV_ARGS(&upload))))
+        return false;
+
+    UINT8* raw = nullptr;
+    if (FAILED(upload->Map(0, nullptr, reinterpret_cast<void**>(&raw))))
+        return false;
+    memcpy(raw, data, size);
+    upload->Unmap(0, nullptr);
+
+    if (!g_copy_recording) {
+        // The allocator can't be reset until the previous batch is done, this only stalls when uploading twice in a row.
+        if (g_copy_fence->GetCompletedValue() < g_copy_fence_value) {
+            g_copy_fence->SetEventOnCompletion(g_copy_fence_value, g_copy_fence_event);
+            WaitForSingleObject(g_copy_fence_event, INFINITE);
+        }
+
+        g_copy_command_allocator->Reset();
+        g_copy_command_list->Reset(g_copy_command_allocator.Get(), nullptr);
+        g_copy_recording = true;
+    }
+
+    // Buffers are always in common state when they are not used, the copy queue promotes the destination to copy dest
+    // implicitly and it decays back to common once the copy is done. No barrier is needed on either queue.
+    g_copy_command_list->CopyBufferRegion(dst, offset, upload.Get(), 0, size);
+    g_upload_buffers.push_back(upload);
+
+    return true;
+}
+
+
+/*
+ * Execute the recorded uploads on the copy queue, the graphics queue waits for them on GPU, CPU never does.
+ * The returned fence value can be checked against the copy fence to see whether the uploads are done.
  */
-template<D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after>
-void resource_transition(ID3D12GraphicsCommandList* command_list, ID3D12Resource* resource) {
-    D3D12_RESOURCE_BARRIER barrier;
-    barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-    barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-    barrier.Transition.pResource = resource;
-    barrier.Transition.StateBefore = before;
-    barrier.Transition.StateAfter = after;
-    barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-    command_list->ResourceBarrier(1, &barrier);
+UINT64 submit_uploads() {
+    if (!g_copy_recording)
+        return g_copy_fence_value;
+
+    g_copy_command_list->Close();
+    g_copy_recording = false;
+
+    ID3D12CommandList* const commandLists[] = {
+        g_copy_command_list.Get()
+    };
+    g_copy_queue->ExecuteCommandLists(1, commandLists);
+    g_copy_queue->Signal(g_copy_fence.Get(), ++g_copy_fence_value);
+
+    // Anything submitted to the graphics queue from now on comes after the uploads.
+    g_command_queue->Wait(g_copy_fence.Get(), g_copy_fence_value);
+
+    // Since the graphics queue waits for the uploads, the upload buffers are free once the graphics queue is done with the
+    // next frame.
+    for (auto& upload : g_upload_buffers)
+        defer_release(upload);
+    g_upload_buffers.clear();
+
+    return g_copy_fence_value;
 }
 
 
 /*
- * This function helps to create a geomtry buffer, vertex buffer view and index buffer view.
+ * Resource state of a usage of the render graph.
+ */
+D3D12_RESOURCE_STATES get_resource_state(const ResourceUsage usage) {
+    switch (usage) {
+    case ResourceUsage::IndirectArgument:
+        return D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT;
+    case ResourceUsage::ComputeWrite:
+    case ResourceUsage::TaskShaderWrite:
+        return D3D12_RESOURCE_STATE_UNORDERED_ACCESS;
+    case ResourceUsage::ColorAttachment:
+        return D3D12_RESOURCE_STATE_RENDER_TARGET;
+    case ResourceUsage::CopySource:
+        return D3D12_RESOURCE_STATE_COPY_SOURCE;
+    case ResourceUsage::CopyDest:
+        return D3D12_RESOURCE_STATE_COPY_DEST;
+    case ResourceUsage::Present:
+        return D3D12_RESOURCE_STATE_PRESENT;
+    default:
+        return D3D12_RESOURCE_STATE_COMMON;
+    }
+}
+
+/*
+ * A resource of the render graph of the current frame.
+ */
+RenderGraph::ResourceId import_graph_resource(const char* name, ID3D12Resource* resource, const bool buffer, const ResourceUsage initial, const ResourceUsage final_usage) {
+    GraphResource graph_resource;
+    graph_resource.resource = resource;
+    graph_resource.buffer = buffer;
+    g_graph_resources.push_back(graph_resource);
+    return g_render_graph.import_resource(name, initial, final_usage);
+}
+
+/*
+ * Record the barriers placed between two passes by the render graph with a single call. Buffers are promoted from the common
+ * state on their first use in a command list and decay back to it once the command list is done, there is no transition from
+ * it. Unordered access written again only needs a UAV barrier.
+ */
+unsigned int record_barriers(ID3D12GraphicsCommandList* command_list, const RenderGraphBarrier* barriers, const unsigned int barrier_cnt) {
+    std::vector<D3D12_RESOURCE_BARRIER> resource_barriers;
+    resource_barriers.reserve(barrier_cnt);
+
+    for (unsigned int i = 0; i < barrier_cnt; ++i) {
+        const auto& barrier = barriers[i];
+        const auto& resource = g_graph_resources[barrier.resource];
+        const auto before = get_resource_state(barrier.before);
+        const auto after = get_resource_state(barrier.after);
+
+        D3D12_RESOURCE_BARRIER resource_barrier = {};
+        resource_barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
+        if (barrier.discard) {
+            // placed resources are created in the state of their first usage, it only waits for what used the memory before
+            if (barrier.before == ResourceUsage::None)
+                continue;
+            resource_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_ALIASING;
+            resource_barrier.Aliasing.pResourceBefore = nullptr;
+            resource_barrier.Aliasing.pResourceAfter = resource.resource;
+        } else if (resource.buffer && barrier.before == ResourceUsage::None) {
+            continue;
+        } else if (before == after) {
+            if (before != D3D12_RESOURCE_STATE_UNORDERED_ACCESS)
+                continue;
+            resource_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV;
+            resource_barrier.UAV.pResource = resource.resource;
+        } else {
+            resource_barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
+            resource_barrier.Transition.pResource = resource.resource;
+            resource_barrier.Transition.StateBefore = before;
+            resource_barrier.Transition.StateAfter = after;
+            resource_barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
+        }
+        resource_barriers.push_back(resource_barrier);
+    }
+
+    if (!resource_barriers.empty())
+        command_list->ResourceBarrier((UINT)resource_barriers.size(), resource_barriers.data());
+    return (unsigned int)resource_barriers.size();
+}
+
+
+/*
+ * Map the mesh file, nothing is read from it until its content is uploaded unless it is optimized.
+ */
+bool load_mesh() {
+    return load_sample_mesh(g_mesh, g_mesh_filename.c_str(), g_mesh_optimization, false, g_mesh_optimization_stats);
+}
+
+/*
+ * This function helps to create the geomtry buffer of the geometry pool, its vertex buffer view and index buffer view, and
+ * sub-allocates the mesh from it. Vertices and indices are copied from the mesh into the upload buffers as they are, unless
+ * vertices are quantized. The pool is never smaller than the mesh, the rest of it is room for more meshes.
  */
 bool create_geomtry_data() {
-    constexpr size_t sizeofVertex = sizeof(Vertex);
-    constexpr size_t sizeofVertices = sizeofVertex * _countof(g_vertices);
-    constexpr size_t sizeofIndex = sizeof(unsigned int);
-    constexpr size_t sizeofIndices = sizeofIndex * _countof(g_indices);
-    constexpr size_t totalSize1 = sizeofVertices + sizeofIndices;
-    constexpr size_t totalSize = g_total_vertices_size + g_total_indices_size;
+    std::vector<uint8_t> encoded;
+    g_vertex_encoding_stats = encode_vertices(g_mesh.get_vertices(), g_mesh.get_vertex_count(), g_vertex_encoding, encoded, g_position_decode);
+
+    const void* vertices = encoded.empty() ? (const void*)g_mesh.get_vertices() : encoded.data();
+    const auto vertices_size = (UINT)g_vertex_encoding_stats.encoded_size;
+    const auto vertex_size = g_vertex_encoding == VertexEncoding::Quantized ? get_vertex_stride<QuantizedVertex>() : get_vertex_stride<Vertex>();
+    const auto index_size = get_geometry_pool_index_size(g_mesh);
+
+    std::vector<uint8_t> converted;
+    const auto indices = get_geometry_pool_indices(g_mesh, index_size, converted);
+    const auto indices_size = (UINT)(g_mesh.get_index_count() * index_size);
+
+    g_geometry_pool.initialize(std::max(g_mesh.get_vertex_count(), GeometryPool::DEFAULT_VERTEX_CAPACITY), vertex_size,
+                               std::max(g_mesh.get_index_count(), GeometryPool::DEFAULT_INDEX_CAPACITY), index_size);
+    if (!indices || !g_geometry_pool.allocate(g_mesh.get_vertex_count(), g_mesh.get_index_count(), g_mesh_range))
+        return false;
+
+    // indices start right after the vertices of the pool
+    const auto pool_vertices_size = g_geometry_pool.get_vertex_buffer_size();
+    const auto pool_indices_size = g_geometry_pool.get_index_buffer_size();
+    const auto totalSize = pool_vertices_size + pool_indices_size;
 
     D3D12_RESOURCE_DESC buffer_desc = {};
     buffer_desc.Alignment = 0;
@@ -397,24 +872,6 @@ bool create_geomtry_data() {
     buffer_desc.SampleDesc.Count = 1;
     buffer_desc.SampleDesc.Quality = 0;
 
-    ComPtr<ID3D12Resource> upload_buffer = nullptr;
-    D3D12_HEAP_PROPERTIES upload_heap_prop;
-    upload_heap_prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-    upload_heap_prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-    upload_heap_prop.Type = D3D12_HEAP_TYPE_UPLOAD;
-    upload_heap_prop.VisibleNodeMask = 1;
-    upload_heap_prop.CreationNodeMask = 1;
-
-    if (FAILED(g_d3d12_device->CreateCommittedResource(
-        &upload_heap_prop,
-        D3D12_HEAP_FLAG_NONE,
-        &buffer_desc,
-        D3D12_RESOURCE_STATE_GENERIC_READ,
-        nullptr,
-        IID_PPV_ARGS(&upload_buffer)
-    )))
-        return false;
-
     D3D12_HEAP_PROPERTIES heap_prop;
     heap_prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
     heap_prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
@@ -432,65 +889,339 @@ bool create_geomtry_data() {
     )))
         return false;
 
-    // copy the data to the uploading buffer
-    UINT8* pRaw = 0;
-    upload_buffer->Map(0, 0, reinterpret_cast<void**>(&pRaw));
-    memcpy(pRaw, g_vertices, g_total_vertices_size);
-    memcpy(pRaw + g_total_vertices_size, g_indices, g_total_indices_size);
-    upload_buffer->Unmap(0, 0);
+    // the geometry data is uploaded on the copy queue, the first frame waits for it on GPU
+    if (!upload_buffer(g_geometry_buffer.Get(), g_geometry_pool.get_vertex_offset(g_mesh_range), vertices, vertices_size) ||
+        !upload_buffer(g_geometry_buffer.Get(), pool_vertices_size + g_geometry_pool.get_index_offset(g_mesh_range), indices, indices_size))
+        return false;
+    submit_uploads();
 
-    g_command_list_allocators[0]->Reset();
-    g_command_list->Reset(g_command_list_allocators[0].Get(), 0);
+    // create the vertex buffer and index buffer view
+    g_vertex_buffer_view = D3D12_VERTEX_BUFFER_VIEW{ g_geometry_buffer->GetGPUVirtualAddress(), (UINT)pool_vertices_size, vertex_size };
+    g_index_buffer_view = D3D12_INDEX_BUFFER_VIEW{ g_geometry_buffer->GetGPUVirtualAddress() + pool_vertices_size, (UINT)pool_indices_size,
+                                                  index_size == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT };
 
-    resource_transition<D3D12_RESOURCE_STATE_COMMON, D3D12_RESOURCE_STATE_COPY_DEST>(g_command_list.Get(), g_geometry_buffer.Get());
-    g_command_list->CopyBufferRegion(g_geometry_buffer.Get(), 0, upload_buffer.Get(), 0, totalSize);
-    resource_transition<D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_VERTEX_AND_CONSTANT_BUFFER | D3D12_RESOURCE_STATE_INDEX_BUFFER>(g_command_list.Get(), g_geometry_buffer.Get());
+    return true;
+}
 
-    g_command_list->Close();
 
-    // execute the command list
-    ID3D12CommandList* const commandLists[] = {
-        g_command_list.Get()
-    };
-    g_command_queue->ExecuteCommandLists(1, commandLists);
+/*
+ * Create the transient buffer for per-draw constants, it is mapped once and never unmapped.
+ */
+bool create_transient_memory() {
+    // Instance data is fetched as a vertex stream, the memory of each frame grows by the data of all instances. Otherwise it
+    // grows by the constants of all draws, each takes an aligned slot, so that no draw is dropped for lack of room. Objects
+    // culled on GPU have no per-draw constants at all.
+    const UINT64 alignment = D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT;
+    g_transient_frame_size = TRANSIENT_MEMORY_PER_FRAME;
+    if (g_instancing)
+        g_transient_frame_size += ((UINT64)sizeof(InstanceData) * g_draw_cnt + alignment * 2 - 1) & ~(alignment - 1);
+    else if (!g_gpu_culling)
+        g_transient_frame_size += ((UINT64)sizeof(DrawConstants) + alignment - 1) / alignment * alignment * g_draw_cnt;
 
-    // flush the command queue
-    flush_command_queue();
+    D3D12_RESOURCE_DESC buffer_desc = {};
+    buffer_desc.Alignment = 0;
+    buffer_desc.DepthOrArraySize = 1;
+    buffer_desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    buffer_desc.Flags = D3D12_RESOURCE_FLAG_NONE;
+    buffer_desc.Format = DXGI_FORMAT_UNKNOWN;
+    buffer_desc.Height = 1;
+    buffer_desc.Width = g_transient_frame_size * g_frames_in_flight;
+    buffer_desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    buffer_desc.MipLevels = 1;
+    buffer_desc.SampleDesc.Count = 1;
+    buffer_desc.SampleDesc.Quality = 0;
 
-    // create the vertex buffer and index buffer view
-    g_vertex_buffer_view = D3D12_VERTEX_BUFFER_VIEW{ g_geometry_buffer->GetGPUVirtualAddress(), g_total_vertices_size, g_vertex_size};
-    g_index_buffer_view = D3D12_INDEX_BUFFER_VIEW{ g_geometry_buffer->GetGPUVirtualAddress() + g_total_vertices_size, g_total_indices_size, DXGI_FORMAT_R32_UINT };
+    D3D12_HEAP_PROPERTIES upload_heap_prop;
+    upload_heap_prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    upload_heap_prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    upload_heap_prop.Type = D3D12_HEAP_TYPE_UPLOAD;
+    upload_heap_prop.VisibleNodeMask = 1;
+    upload_heap_prop.CreationNodeMask = 1;
+
+    if (FAILED(g_d3d12_device->CreateCommittedResource(
+        &upload_heap_prop,
+        D3D12_HEAP_FLAG_NONE,
+        &buffer_desc,
+        D3D12_RESOURCE_STATE_GENERIC_READ,
+        nullptr,
+        IID_PPV_ARGS(&g_transient_buffer)
+    )))
+        return false;
+
+    // Upload heaps can stay mapped while GPU is reading them, CPU is only ever writing into regions GPU is done with.
+    UINT8* data = nullptr;
+    const D3D12_RANGE read_range = { 0, 0 };
+    if (FAILED(g_transient_buffer->Map(0, &read_range, reinterpret_cast<void**>(&data))))
+        return false;
+
+    for (auto i = 0u; i < g_frames_in_flight; ++i)
+        g_frame_allocators[i].initialize(data + (size_t)g_transient_frame_size * i, (size_t)g_transient_frame_size, D3D12_CONSTANT_BUFFER_DATA_PLACEMENT_ALIGNMENT);
 
     return true;
 }
 
 
+constexpr DXGI_FORMAT get_dxgi_vertex_format(const VertexFormat format) {
+    switch (format) {
+    case VertexFormat::Float2:      return DXGI_FORMAT_R32G32_FLOAT;
+    case VertexFormat::Float3:      return DXGI_FORMAT_R32G32B32_FLOAT;
+    case VertexFormat::Float4:      return DXGI_FORMAT_R32G32B32A32_FLOAT;
+    case VertexFormat::UNorm8x4:    return DXGI_FORMAT_R8G8B8A8_UNORM;
+    case VertexFormat::SNorm8x4:    return DXGI_FORMAT_R8G8B8A8_SNORM;
+    case VertexFormat::UNorm16x2:   return DXGI_FORMAT_R16G16_UNORM;
+    case VertexFormat::SNorm16x2:   return DXGI_FORMAT_R16G16_SNORM;
+    case VertexFormat::UNorm16x4:   return DXGI_FORMAT_R16G16B16A16_UNORM;
+    case VertexFormat::SNorm16x4:   return DXGI_FORMAT_R16G16B16A16_SNORM;
+    case VertexFormat::Half2:       return DXGI_FORMAT_R16G16_FLOAT;
+    case VertexFormat::Half4:       return DXGI_FORMAT_R16G16B16A16_FLOAT;
+    }
+    return DXGI_FORMAT_UNKNOWN;
+}
+
+/*
+ * Input elements of a vertex stream in the input slot, generated at compile time from the layout of the vertex. Per-instance
+ * streams step once per instance.
+ */
+template<class V>
+constexpr std::array<D3D12_INPUT_ELEMENT_DESC, get_vertex_attribute_count<V>()> get_input_elements(const UINT slot, const D3D12_INPUT_CLASSIFICATION classification = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA) {
+    return make_vertex_elements<V, D3D12_INPUT_ELEMENT_DESC>([slot, classification](const VertexAttribute& attribute) {
+        return D3D12_INPUT_ELEMENT_DESC{ get_vertex_semantic_name(attribute.semantic), 0, get_dxgi_vertex_format(attribute.format), slot,
+                                         attribute.offset, classification, classification == D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA ? 1u : 0u };
+    });
+}
+
+/*
+ * Input elements of more than one stream, the input layout is all of them.
+ */
+template<size_t N, size_t M>
+constexpr std::array<D3D12_INPUT_ELEMENT_DESC, N + M> concat_input_elements(const std::array<D3D12_INPUT_ELEMENT_DESC, N>& a, const std::array<D3D12_INPUT_ELEMENT_DESC, M>& b) {
+    std::array<D3D12_INPUT_ELEMENT_DESC, N + M> elements = {};
+    for (size_t i = 0; i < N; ++i)
+        elements[i] = a[i];
+    for (size_t i = 0; i < M; ++i)
+        elements[N + i] = b[i];
+    return elements;
+}
+
 /*
- * Create pipeline state objects
+ * Look a root signature up by its serialized blob, which is already a canonical description of it. Identical root signatures
+ * are only created once.
  */
-bool create_pso() {
-    // This tutorial is simple enough that no root-signature is needed
-    D3D12_ROOT_SIGNATURE_DESC rootSig = { 0, nullptr, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT };
+ID3D12RootSignature* get_root_signature(const D3D12_ROOT_SIGNATURE_DESC& desc) {
     ComPtr<ID3DBlob> blob_sig, blob_errors;
-    auto ret = D3D12SerializeRootSignature(&rootSig, D3D_ROOT_SIGNATURE_VERSION_1, &blob_sig, &blob_errors);
-    if (FAILED(ret))
+    if (FAILED(D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1, &blob_sig, &blob_errors)))
+        return nullptr;
+
+    StateKey key;
+    key.add_bytes(blob_sig->GetBufferPointer(), blob_sig->GetBufferSize());
+
+    auto found = g_root_signatures.get_or_create(key, [&](ComPtr<ID3D12RootSignature>& root_signature) {
+        return SUCCEEDED(g_d3d12_device->CreateRootSignature(0, blob_sig->GetBufferPointer(), blob_sig->GetBufferSize(), IID_PPV_ARGS(&root_signature)));
+    });
+    return found ? found->Get() : nullptr;
+}
+
+/*
+ * Create the root signature, it is shared by all pipeline state objects.
+ */
+bool create_root_signature() {
+    // The only root parameter is the root constant buffer view of per-draw constants, it takes a GPU address directly so that
+    // binding the constants of a draw is just setting an address in the transient buffer.
+    D3D12_ROOT_PARAMETER root_param;
+    root_param.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV;
+    root_param.Descriptor.ShaderRegister = 0;
+    root_param.Descriptor.RegisterSpace = 0;
+    root_param.ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
+    D3D12_ROOT_SIGNATURE_DESC rootSig = { 1, &root_param, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT };
+
+    g_root_signature = get_root_signature(rootSig);
+    if (!g_root_signature)
         return false;
-    ret = g_d3d12_device->CreateRootSignature(0, blob_sig->GetBufferPointer(), blob_sig->GetBufferSize(), __uuidof(ID3D12RootSignature), (void**)&g_root_signature);
-    if (FAILED(ret))
+
+    return true;
+}
+
+/*
+ * A pipeline state description along with everything it points to, so that it can be compiled on another thread after the
+ * description the caller filled is gone.
+ */
+struct D3D12PipelineStateCopy {
+    D3D12_GRAPHICS_PIPELINE_STATE_DESC      desc;
+    std::vector<uint8_t>                    shaders[5];
+    std::vector<D3D12_INPUT_ELEMENT_DESC>   input_elements;
+    std::vector<std::string>                semantic_names;
+    ComPtr<ID3D12RootSignature>             root_signature;
+    // name of the pipeline in the pipeline library
+    wchar_t                                 name[32];
+};
+
+static void copy_shader(D3D12_SHADER_BYTECODE& shader, std::vector<uint8_t>& storage) {
+    const auto code = (const uint8_t*)shader.pShaderBytecode;
+    storage.assign(code, code + (code ? shader.BytecodeLength : 0));
+    shader.pShaderBytecode = storage.empty() ? nullptr : storage.data();
+    shader.BytecodeLength = storage.size();
+}
+
+static void add_shader(StateKey& key, const D3D12_SHADER_BYTECODE& shader) {
+    const auto size = shader.pShaderBytecode ? (uint64_t)shader.BytecodeLength : 0ull;
+    key.add(size).add_bytes(shader.pShaderBytecode, (size_t)size);
+}
+
+static void add_stencil_op(StateKey& key, const D3D12_DEPTH_STENCILOP_DESC& op) {
+    key.add(op.StencilFailOp).add(op.StencilDepthFailOp).add(op.StencilPassOp).add(op.StencilFunc);
+}
+
+/*
+ * Canonical description of a pipeline state, states that have no effect, like blend factors without blending, are left out.
+ * Stream output and cached blobs are not supported.
+ */
+static StateKey get_pipeline_state_key(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc) {
+    StateKey key;
+
+    // root signatures come from 'get_root_signature', there is only one object for each of them
+    key.add((uint64_t)(uintptr_t)desc.pRootSignature);
+
+    add_shader(key, desc.VS);
+    add_shader(key, desc.PS);
+    add_shader(key, desc.DS);
+    add_shader(key, desc.HS);
+    add_shader(key, desc.GS);
+
+    // without independent blending, only the first render target matters
+    const auto& blend = desc.BlendState;
+    const auto blend_cnt = blend.IndependentBlendEnable ? desc.NumRenderTargets : (desc.NumRenderTargets ? 1u : 0u);
+    key.add(blend.AlphaToCoverageEnable).add(blend.IndependentBlendEnable).add(blend_cnt);
+    for (UINT i = 0; i < blend_cnt; ++i) {
+        const auto& target = blend.RenderTarget[i];
+        key.add(target.BlendEnable).add(target.LogicOpEnable);
+        if (target.BlendEnable) {
+            key.add(target.SrcBlend).add(target.DestBlend).add(target.BlendOp);
+            key.add(target.SrcBlendAlpha).add(target.DestBlendAlpha).add(target.BlendOpAlpha);
+        }
+        if (target.LogicOpEnable)
+            key.add(target.LogicOp);
+        key.add(target.RenderTargetWriteMask);
+    }
+    key.add(desc.SampleMask);
+
+    const auto& rasterizer = desc.RasterizerState;
+    key.add(rasterizer.FillMode).add(rasterizer.CullMode).add(rasterizer.FrontCounterClockwise);
+    key.add(rasterizer.DepthBias).add(rasterizer.DepthBiasClamp).add(rasterizer.SlopeScaledDepthBias);
+    key.add(rasterizer.DepthClipEnable).add(rasterizer.MultisampleEnable).add(rasterizer.AntialiasedLineEnable);
+    key.add(rasterizer.ForcedSampleCount).add(rasterizer.ConservativeRaster);
+
+    const auto& depth_stencil = desc.DepthStencilState;
+    key.add(depth_stencil.DepthEnable);
+    if (depth_stencil.DepthEnable)
+        key.add(depth_stencil.DepthWriteMask).add(depth_stencil.DepthFunc);
+    key.add(depth_stencil.StencilEnable);
+    if (depth_stencil.StencilEnable) {
+        key.add(depth_stencil.StencilReadMask).add(depth_stencil.StencilWriteMask);
+        add_stencil_op(key, depth_stencil.FrontFace);
+        add_stencil_op(key, depth_stencil.BackFace);
+    }
+
+    key.add(desc.InputLayout.NumElements);
+    for (UINT i = 0; i < desc.InputLayout.NumElements; ++i) {
+        const auto& element = desc.InputLayout.pInputElementDescs[i];
+        key.add_string(element.SemanticName).add(element.SemanticIndex).add(element.Format).add(element.InputSlot);
+        key.add(element.AlignedByteOffset).add(element.InputSlotClass).add(element.InstanceDataStepRate);
+    }
+
+    key.add(desc.IBStripCutValue).add(desc.PrimitiveTopologyType).add(desc.NumRenderTargets);
+    for (UINT i = 0; i < desc.NumRenderTargets; ++i)
+        key.add(desc.RTVFormats[i]);
+    key.add(desc.DSVFormat).add(desc.SampleDesc.Count).add(desc.SampleDesc.Quality).add(desc.NodeMask).add(desc.Flags);
+
+    return key;
+}
+
+/*
+ * Create pipeline state objects, it runs on the threads of the pipeline compiler.
+ */
+bool create_pso(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& psod, const wchar_t* name, ComPtr<ID3D12PipelineState>& pso) {
+    // look the pipeline up in the library first, a miss compiles it and stores it for the next launch
+    {
+        std::lock_guard<std::mutex> lock(g_pipeline_library_mutex);
+        if (g_pipeline_library && SUCCEEDED(g_pipeline_library->LoadGraphicsPipeline(name, &psod, IID_PPV_ARGS(&pso))))
+            return true;
+    }
+
+    // compiling doesn't need the lock, other pipelines can be loaded or compiled meanwhile
+    if (FAILED(g_d3d12_device->CreateGraphicsPipelineState(&psod, __uuidof(ID3D12PipelineState), (void**)&pso)))
         return false;
 
-    const D3D12_INPUT_ELEMENT_DESC input_layout[] = {
-        { "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-        { "COLOR",    0, DXGI_FORMAT_R8G8B8A8_UNORM, 0, D3D12_APPEND_ALIGNED_ELEMENT, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
-    };
-    const UINT numInputLayoutElements = _countof(input_layout);
+    // A pipeline of the same name with a different description, like one from older shaders, can't be replaced in the library.
+    // The library is started over with the new pipeline in it.
+    std::lock_guard<std::mutex> lock(g_pipeline_library_mutex);
+    if (g_pipeline_library && FAILED(g_pipeline_library->StorePipeline(name, pso.Get()))) {
+        g_pipeline_library = nullptr;
+        g_pipeline_library_blob.clear();
+        if (SUCCEEDED(g_d3d12_device->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&g_pipeline_library))) &&
+            FAILED(g_pipeline_library->StorePipeline(name, pso.Get())))
+            g_pipeline_library = nullptr;
+    }
+    g_pipeline_library_dirty = g_pipeline_library != nullptr;
+
+    return true;
+}
+
+/*
+ * Look a pipeline state object up by the canonical description of its state, identical states share the same object. A miss
+ * hands the pipeline to the pipeline compiler and returns right away, the pipeline is ready some time later. The name has to
+ * be a string literal, it is only used by the first request of the state.
+ */
+std::shared_ptr<D3D12Pipeline> get_pso(const D3D12_GRAPHICS_PIPELINE_STATE_DESC& desc, const char* name) {
+    const auto key = get_pipeline_state_key(desc);
+
+    auto found = g_pipelines.get_or_create(key, [&](std::shared_ptr<D3D12Pipeline>& pipeline) {
+        pipeline = std::make_shared<D3D12Pipeline>(name);
+
+        auto state = std::make_shared<D3D12PipelineStateCopy>();
+        state->desc = desc;
+        state->root_signature = desc.pRootSignature;
+        copy_shader(state->desc.VS, state->shaders[0]);
+        copy_shader(state->desc.PS, state->shaders[1]);
+        copy_shader(state->desc.DS, state->shaders[2]);
+        copy_shader(state->desc.HS, state->shaders[3]);
+        copy_shader(state->desc.GS, state->shaders[4]);
+        state->input_elements.assign(desc.InputLayout.pInputElementDescs, desc.InputLayout.pInputElementDescs + desc.InputLayout.NumElements);
+        for (const auto& element : state->input_elements)
+            state->semantic_names.push_back(element.SemanticName);
+        for (size_t i = 0; i < state->input_elements.size(); ++i)
+            state->input_elements[i].SemanticName = state->semantic_names[i].c_str();
+        state->desc.InputLayout = { state->input_elements.data(), (UINT)state->input_elements.size() };
+
+        // the hash of the state names the pipeline in the library, so that different states never replace each other
+        swprintf(state->name, _countof(state->name), L"pso_%016llx", (unsigned long long)key.hash());
+
+        auto target = pipeline.get();
+        g_pipeline_compiler->compile(pipeline, [state, target]() { return create_pso(state->desc, state->name, target->pso); });
+        return true;
+    });
+    return found ? *found : nullptr;
+}
+
+/*
+ * Request the pipeline state object, it returns right away. Frames skip the draws until it is ready.
+ */
+bool request_pso() {
+    // vertex format layout, it comes from the layout of the vertex of the encoding
+    static constexpr auto full_input_layout = get_input_elements<Vertex>(0);
+    static constexpr auto quantized_input_layout = get_input_elements<QuantizedVertex>(0);
+    // instances are the second stream
+    static constexpr auto instance_elements = get_input_elements<InstanceData>(1, D3D12_INPUT_CLASSIFICATION_PER_INSTANCE_DATA);
+    static constexpr auto full_instanced_input_layout = concat_input_elements(full_input_layout, instance_elements);
+    static constexpr auto quantized_instanced_input_layout = concat_input_elements(quantized_input_layout, instance_elements);
 
     // Create Pipeline State Object
     D3D12_GRAPHICS_PIPELINE_STATE_DESC psod;
     memset(&psod, 0, sizeof(psod));
     psod.pRootSignature = g_root_signature.Get();
-    psod.VS.BytecodeLength = sizeof(g_shader_vs);
-    psod.VS.pShaderBytecode = g_shader_vs;
+    // culled objects are drawn as instances of the object buffer
+    const auto instanced = g_instancing || g_gpu_culling;
+    psod.VS.BytecodeLength = instanced ? sizeof(g_shader_vs_instanced) : sizeof(g_shader_vs);
+    psod.VS.pShaderBytecode = instanced ? g_shader_vs_instanced : g_shader_vs;
     psod.PS.BytecodeLength = sizeof(g_shader_ps);
     psod.PS.pShaderBytecode = g_shader_ps;
     psod.RasterizerState.FillMode = D3D12_FILL_MODE_SOLID;
@@ -502,82 +1233,373 @@ bool create_pso() {
     psod.BlendState.RenderTarget[0].RenderTargetWriteMask = D3D12_COLOR_WRITE_ENABLE_ALL;
     psod.NumRenderTargets = 1;
     psod.SampleMask = UINT_MAX;
-    psod.InputLayout = { input_layout, numInputLayoutElements };
+    if (instanced && g_vertex_encoding == VertexEncoding::Quantized)
+        psod.InputLayout = { quantized_instanced_input_layout.data(), (UINT)quantized_instanced_input_layout.size() };
+    else if (instanced)
+        psod.InputLayout = { full_instanced_input_layout.data(), (UINT)full_instanced_input_layout.size() };
+    else if (g_vertex_encoding == VertexEncoding::Quantized)
+        psod.InputLayout = { quantized_input_layout.data(), (UINT)quantized_input_layout.size() };
+    else
+        psod.InputLayout = { full_input_layout.data(), (UINT)full_input_layout.size() };
     psod.IBStripCutValue = D3D12_INDEX_BUFFER_STRIP_CUT_VALUE_DISABLED;
     psod.DSVFormat = DXGI_FORMAT_UNKNOWN;
     psod.DepthStencilState.DepthFunc = D3D12_COMPARISON_FUNC_ALWAYS;
     psod.DepthStencilState.DepthEnable = false;
     psod.DepthStencilState.DepthWriteMask = D3D12_DEPTH_WRITE_MASK_ALL;
 
-    return SUCCEEDED(g_d3d12_device->CreateGraphicsPipelineState(&psod, __uuidof(ID3D12PipelineState), (void**)&g_pipeline_state_object));
+    g_pipeline = get_pso(psod, "compile pipeline");
+    return true;
 }
 
 
 /*
- * Initialize d3d12, this includes
- *   - pick a d3d12 compatible adapter
- *   - enable gpu validation
- *   - create d3d12 device
- *   - create a graphics command queue
- *   - create a swap chain
- *   - creata a command list and three command allocators
- *   - create a descriptor heap and setup the render target views
- *   - create a fence object for CPU and GPU synchronization
- *   - create the geometry data
- *   - create pipeline state object
+ * The pipeline library is only valid for the same GPU and driver.
  */
-bool D3D12GraphicsSample::initialize(const HINSTANCE hInstnace, const HWND hwnd) {
-    auto ret = enum_adapter();
-    if (!ret)
-        return false;
+PipelineCacheKey get_pipeline_library_key() {
+    PipelineCacheKey key;
+
+    DXGI_ADAPTER_DESC desc;
+    if (SUCCEEDED(g_adapter->GetDesc(&desc))) {
+        key.vendor_id = desc.VendorId;
+        key.device_id = desc.DeviceId;
+        memcpy(key.uuid, &desc.SubSysId, sizeof(desc.SubSysId));
+        memcpy(key.uuid + sizeof(desc.SubSysId), &desc.Revision, sizeof(desc.Revision));
+    }
 
-    enable_gpu_validation();
+    LARGE_INTEGER umd_version;
+    if (SUCCEEDED(g_adapter->CheckInterfaceSupport(__uuidof(IDXGIDevice), &umd_version)))
+        key.driver_version = (uint64_t)umd_version.QuadPart;
 
-    ret = create_d3d12_device();
-    if (!ret)
-        return false;
+    return key;
+}
+
+/*
+ * Create the pipeline library with the blob saved by the last launch.
+ * Nothing here is fatal, pipelines are simply compiled from scratch without a library.
+ */
+void create_pipeline_library() {
+    load_pipeline_cache(PIPELINE_LIBRARY_FILE, get_pipeline_library_key(), g_pipeline_library_blob);
+
+    // the runtime validates the blob too, it refuses blobs from other drivers or adapters
+    if (!g_pipeline_library_blob.empty() &&
+        SUCCEEDED(g_d3d12_device->CreatePipelineLibrary(g_pipeline_library_blob.data(), g_pipeline_library_blob.size(), IID_PPV_ARGS(&g_pipeline_library))))
+        return;
+
+    g_pipeline_library_blob.clear();
+    if (FAILED(g_d3d12_device->CreatePipelineLibrary(nullptr, 0, IID_PPV_ARGS(&g_pipeline_library))))
+        g_pipeline_library = nullptr;
+}
 
-    ret = create_command_queue();
-    if (!ret)
+/*
+ * Write the pipeline library to disk if anything is stored in it since it was loaded.
+ */
+bool save_pipeline_library() {
+    std::lock_guard<std::mutex> lock(g_pipeline_library_mutex);
+    if (!g_pipeline_library)
         return false;
+    if (!g_pipeline_library_dirty)
+        return true;
 
-    ret = create_swap_chain(hwnd);
-    if (!ret)
+    std::vector<uint8_t> blob(g_pipeline_library->GetSerializedSize());
+    if (FAILED(g_pipeline_library->Serialize(blob.data(), blob.size())))
+        return false;
+    if (!save_pipeline_cache(PIPELINE_LIBRARY_FILE, get_pipeline_library_key(), blob.data(), blob.size()))
         return false;
 
-    ret = create_commands();
-    if (!ret)
+    g_pipeline_library_dirty = false;
+    return true;
+}
+
+
+/*
+ * Create a committed buffer in a heap of the type.
+ */
+static bool create_committed_buffer(const D3D12_HEAP_TYPE type, const UINT64 size, const D3D12_RESOURCE_FLAGS flags, const D3D12_RESOURCE_STATES state, ComPtr<ID3D12Resource>& buffer) {
+    D3D12_RESOURCE_DESC buffer_desc = {};
+    buffer_desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
+    buffer_desc.Width = size;
+    buffer_desc.Height = 1;
+    buffer_desc.DepthOrArraySize = 1;
+    buffer_desc.MipLevels = 1;
+    buffer_desc.Format = DXGI_FORMAT_UNKNOWN;
+    buffer_desc.SampleDesc.Count = 1;
+    buffer_desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
+    buffer_desc.Flags = flags;
+
+    D3D12_HEAP_PROPERTIES heap_prop = {};
+    heap_prop.Type = type;
+    heap_prop.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
+    heap_prop.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
+    heap_prop.CreationNodeMask = 1;
+    heap_prop.VisibleNodeMask = 1;
+
+    return SUCCEEDED(g_d3d12_device->CreateCommittedResource(&heap_prop, D3D12_HEAP_FLAG_NONE, &buffer_desc, state, nullptr, IID_PPV_ARGS(&buffer)));
+}
+
+/*
+ * Create the buffer of all objects and upload it, it is both what culling reads and the instance stream of the draws. The
+ * draw arguments written by culling are followed by their count, which is copied into a readback buffer every frame.
+ */
+bool create_object_buffers() {
+    if (!g_gpu_culling)
+        return true;
+
+    std::vector<InstanceData> objects(g_draw_cnt);
+    for (unsigned int i = 0; i < g_draw_cnt; ++i)
+        objects[i] = get_instance_data(i, g_draw_cnt, g_position_decode);
+
+    const auto objects_size = (UINT64)sizeof(InstanceData) * g_draw_cnt;
+    g_object_count_offset = (UINT64)sizeof(D3D12_DRAW_INDEXED_ARGUMENTS) * g_draw_cnt;
+    if (!create_committed_buffer(D3D12_HEAP_TYPE_DEFAULT, objects_size, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COMMON, g_object_buffer) ||
+        !create_committed_buffer(D3D12_HEAP_TYPE_DEFAULT, g_object_count_offset + sizeof(UINT), D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_COMMON, g_object_draw_buffer) ||
+        !create_committed_buffer(D3D12_HEAP_TYPE_READBACK, sizeof(UINT) * g_frames_in_flight, D3D12_RESOURCE_FLAG_NONE, D3D12_RESOURCE_STATE_COPY_DEST, g_object_count_readback_buffer))
         return false;
 
-    ret = create_rtvs();
-    if (!ret)
+    if (!upload_buffer(g_object_buffer.Get(), 0, objects.data(), objects_size))
         return false;
+    submit_uploads();
 
-    ret = create_fence();
-    if (!ret)
+    g_gpu_culling_stats = GpuCullingStats();
+    g_gpu_culling_stats.path = GpuCullingPath::IndirectCount;
+    g_gpu_culling_stats.object_cnt = g_draw_cnt;
+    return true;
+}
+
+/*
+ * Create the culling pipeline and the command signature of the culled draws. It is a single small compute shader, it is
+ * simply created here instead of going through the pipeline compiler and the library. The root signature has the culling
+ * constants, the objects and the draw arguments, all of them are root parameters so that no descriptor heap is needed.
+ */
+bool create_object_cull_pipeline() {
+    if (!g_gpu_culling)
+        return true;
+
+    D3D12_ROOT_PARAMETER root_params[3] = {};
+    root_params[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
+    root_params[0].Constants.ShaderRegister = 0;
+    root_params[0].Constants.RegisterSpace = 0;
+    root_params[0].Constants.Num32BitValues = sizeof(GpuCullingConstants) / sizeof(UINT);
+    root_params[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+    root_params[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_SRV;
+    root_params[1].Descriptor.ShaderRegister = 0;
+    root_params[1].Descriptor.RegisterSpace = 0;
+    root_params[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+    root_params[2].ParameterType = D3D12_ROOT_PARAMETER_TYPE_UAV;
+    root_params[2].Descriptor.ShaderRegister = 0;
+    root_params[2].Descriptor.RegisterSpace = 0;
+    root_params[2].ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL;
+    D3D12_ROOT_SIGNATURE_DESC root_sig = { 3, root_params, 0, nullptr, D3D12_ROOT_SIGNATURE_FLAG_NONE };
+
+    g_object_cull_root_signature = get_root_signature(root_sig);
+    if (!g_object_cull_root_signature)
         return false;
 
-    ret = create_geomtry_data();
-    if (!ret)
+    D3D12_COMPUTE_PIPELINE_STATE_DESC psod = {};
+    psod.pRootSignature = g_object_cull_root_signature.Get();
+    psod.CS.BytecodeLength = sizeof(g_shader_object_cull);
+    psod.CS.pShaderBytecode = g_shader_object_cull;
+    if (FAILED(g_d3d12_device->CreateComputePipelineState(&psod, IID_PPV_ARGS(&g_object_cull_pso))))
         return false;
 
-    ret = create_pso();
-    if (!ret)
+    // the arguments are nothing but an indexed draw, so the signature needs no root signature
+    D3D12_INDIRECT_ARGUMENT_DESC argument = {};
+    argument.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED;
+    D3D12_COMMAND_SIGNATURE_DESC signature = {};
+    signature.ByteStride = sizeof(D3D12_DRAW_INDEXED_ARGUMENTS);
+    signature.NumArgumentDescs = 1;
+    signature.pArgumentDescs = &argument;
+    return SUCCEEDED(g_d3d12_device->CreateCommandSignature(&signature, nullptr, IID_PPV_ARGS(&g_object_draw_signature)));
+}
+
+/*
+ * The count of visible objects is cleared by a copy from the transient memory, the only thing written on CPU each frame. False
+ * if there is no room for it, all objects are drawn then.
+ */
+bool prepare_gpu_culling(const unsigned int frame_index, size_t& zero_offset) {
+    auto zero = (UINT*)g_frame_allocators[frame_index].allocate(sizeof(UINT), zero_offset);
+    if (!zero)
         return false;
 
+    *zero = 0;
     return true;
 }
 
+/*
+ * Clear the count of visible objects, it is a pass before culling.
+ */
+void record_object_count_clear(ID3D12GraphicsCommandList* command_list, const unsigned int frame_index, const size_t zero_offset) {
+    command_list->CopyBufferRegion(g_object_draw_buffer.Get(), g_object_count_offset, g_transient_buffer.Get(), g_transient_frame_size * frame_index + zero_offset, sizeof(UINT));
+}
+
+/*
+ * Cull all objects into draw arguments, it is a pass before anything is drawn.
+ */
+void record_gpu_culling(ID3D12GraphicsCommandList* command_list) {
+    GpuCullingConstants constants;
+    get_gpu_culling_sphere(g_mesh.get_bounds_min(), g_mesh.get_bounds_max(), g_position_decode, constants.sphere);
+    constants.object_cnt = g_draw_cnt;
+    constants.index_cnt = g_mesh_range.index_cnt;
+    constants.first_index = g_mesh_range.first_index;
+    constants.base_vertex = g_mesh_range.base_vertex;
+    constants.compact = 1;
+    constants.counter = (uint32_t)g_object_count_offset;
+
+    command_list->SetPipelineState(g_object_cull_pso.Get());
+    command_list->SetComputeRootSignature(g_object_cull_root_signature.Get());
+    command_list->SetComputeRootShaderResourceView(1, g_object_buffer->GetGPUVirtualAddress());
+    command_list->SetComputeRootUnorderedAccessView(2, g_object_draw_buffer->GetGPUVirtualAddress());
+
+    // a group culls 64 objects, a dispatch has at most 65535 groups in a dimension
+    const unsigned int objects_per_dispatch = 64 * D3D12_CS_DISPATCH_MAX_THREAD_GROUPS_PER_DIMENSION;
+    for (unsigned int first = 0; first < g_draw_cnt; first += objects_per_dispatch) {
+        constants.first = first;
+        command_list->SetComputeRoot32BitConstants(0, sizeof(constants) / sizeof(UINT), &constants, 0);
+        command_list->Dispatch((std::min(g_draw_cnt - first, objects_per_dispatch) + 63) / 64, 1, 1);
+    }
+}
+
+/*
+ * Draw the visible objects with the arguments written by culling.
+ */
+void record_gpu_culled_draws(ID3D12GraphicsCommandList* command_list) {
+    command_list->ExecuteIndirect(g_object_draw_signature.Get(), g_draw_cnt, g_object_draw_buffer.Get(), 0, g_object_draw_buffer.Get(), g_object_count_offset);
+}
+
+/*
+ * Copy the count of visible objects out for reading it back, it is a pass after the objects are drawn.
+ */
+void record_object_count_readback(ID3D12GraphicsCommandList* command_list, const unsigned int frame_index) {
+    command_list->CopyBufferRegion(g_object_count_readback_buffer.Get(), sizeof(UINT) * frame_index, g_object_draw_buffer.Get(), g_object_count_offset, sizeof(UINT));
+    g_object_count_pending[frame_index] = true;
+}
+
+/*
+ * Read back the count of visible objects of the frame that used the current frame index last time, it is already done on GPU.
+ */
+void read_object_count() {
+    const auto index = g_frame_index;
+    if (!g_object_count_pending[index])
+        return;
+
+    const D3D12_RANGE read_range = { sizeof(UINT) * index, sizeof(UINT) * (index + 1) };
+    const D3D12_RANGE write_range = { 0, 0 };
+    UINT* counts = nullptr;
+    if (FAILED(g_object_count_readback_buffer->Map(0, &read_range, reinterpret_cast<void**>(&counts))))
+        return;
+    g_gpu_culling_stats.visible = counts[index];
+    g_object_count_readback_buffer->Unmap(0, &write_range);
+    g_object_count_pending[index] = false;
+}
+
+
+/*
+ * Initialize d3d12, this includes
+ *   - pick a d3d12 compatible adapter
+ *   - enable gpu validation
+ *   - create d3d12 device
+ *   - create a graphics command queue
+ *   - create a copy queue for uploading
+ *   - create a swap chain
+ *   - creata a command list and a command allocator for each frame in flight
+ *   - create a descriptor heap and setup the render target views
+ *   - create a fence object for CPU and GPU synchronization
+ *   - create timestamp queries for measuring GPU time
+ *   - map the mesh file and upload the geometry data
+ *   - create the transient memory for per-draw constants
+ *   - create the objects and the culling pipeline if draws are culled on GPU
+ *   - load the pipeline library and start compiling the pipeline state object in the background
+ */
+bool D3D12GraphicsSample::initialize(const HINSTANCE hInstnace, const HWND hwnd) {
+    PROFILE_ZONE(m_profiler, "initialize");
+
+    // Culled objects are drawn with the instance stream of the objects, not with the one of the instancing path. The setting
+    // asked for is left as it is for the next initialization.
+    g_instancing = g_requested_instancing && !g_gpu_culling;
+
+    // The steps above run as a graph of tasks, only the adapter and the device are on the critical path. The swap chain is
+    // pinned to the calling thread since it owns the window, the rest runs on worker threads that only live during initialization.
+    TaskGraph graph;
+    const auto adapter = graph.add("adapter", enum_adapter);
+    const auto device = graph.add("device", []() {
+        enable_gpu_validation();
+        return create_d3d12_device();
+    }, { adapter });
+
+    const auto command_queue = graph.add("command queue", create_command_queue, { device });
+    const auto copy_queue = graph.add("copy queue", create_copy_queue, { device });
+    const auto swap_chain = graph.add("swap chain", [hwnd]() { return create_swap_chain(hwnd); }, { command_queue }, true);
+    graph.add("commands", create_commands, { device });
+    graph.add("render target views", create_rtvs, { swap_chain });
+    graph.add("fence", create_fence, { device });
+    graph.add("timestamp queries", create_timestamp_queries, { command_queue });
+
+    // the graphics queue waits for the uploads on GPU, so it has to exist before the uploads are submitted
+    const auto mesh = graph.add("mesh", load_mesh);
+    const auto geometry = graph.add("geometry", create_geomtry_data, { command_queue, copy_queue, mesh });
+    // objects are scaled by the decode of the positions, they are uploaded once the geometry is
+    graph.add("objects", create_object_buffers, { geometry });
+    graph.add("object culling pipeline", create_object_cull_pipeline, { device });
+    graph.add("transient memory", create_transient_memory, { device });
+
+    // A quarter of the hardware threads compile pipelines, they mostly sleep once the pipelines of the scene are compiled.
+    g_pipeline_compiler = std::make_unique<PipelineCompiler>(m_profiler, std::thread::hardware_concurrency() / 4);
+
+    const auto root_signature = graph.add("root signature", create_root_signature, { device });
+    const auto pipeline_library = graph.add("pipeline library", []() {
+        create_pipeline_library();
+        return true;
+    }, { device });
+    graph.add("pipeline", request_pso, { root_signature, pipeline_library });
+
+    // the calling thread runs tasks too
+    const auto thread_cnt = std::thread::hardware_concurrency();
+    ThreadPool pool(thread_cnt > 1 ? thread_cnt - 1 : 0);
+    return graph.run(pool, m_profiler);
+}
+
 /*
  * Render a frame.
  */
 void D3D12GraphicsSample::render_frame() {
-    auto commandAllocator = g_command_list_allocators[g_current_back_buffer_index];
-    auto backBuffer = g_back_buffers[g_current_back_buffer_index];
+    m_profiler.begin_frame();
+
+    // The back buffers follow the window before the frame begins, nothing is rendered while the window is minimized. A failed
+    // resize is tried again next frame.
+    if (g_resize_pending) {
+        if (!g_resize_width || !g_resize_height)
+            return;
+
+        PROFILE_ZONE(m_profiler, "resize");
+        g_resize_pending = !resize_swap_chain(g_resize_width, g_resize_height);
+        if (g_resize_pending)
+            return;
+    }
+
+    // wait until the swap chain can take another frame
+    if (g_frame_latency_waitable) {
+        PROFILE_ZONE(m_profiler, "latency wait");
+        ::WaitForSingleObjectEx(g_frame_latency_waitable, 1000, TRUE);
+    }
+
+    // the frame begins for real once it is paced, anything it samples is as fresh as it gets
+    {
+        PROFILE_ZONE(m_profiler, "pacing");
+        g_frame_pacer.wait(m_profiler);
+    }
+
+    const auto frame_index = g_frame_index;
+    const auto back_buffer_index = g_current_back_buffer_index;
+    auto commandAllocator = g_command_list_allocators[frame_index];
+    auto backBuffer = g_back_buffers[back_buffer_index];
     auto commandList = g_command_list;
 
     // reset the command list and the command allocator
     {
+        PROFILE_ZONE(m_profiler, "reset");
+
+        // the fence of this frame is already reached at the end of the previous frame, nothing is reading its constants
+        g_frame_allocators[frame_index].reset();
+
         commandAllocator->Reset();
 
         // The same command list is used again here. Since there is no memory maintained in a command list, it doesn't matter if the previous
@@ -585,83 +1607,188 @@ void D3D12GraphicsSample::render_frame() {
         commandList->Reset(commandAllocator.Get(), nullptr);
     }
 
-    // make sure the back buffer is in correct state
     {
+        PROFILE_ZONE(m_profiler, "record");
+
+        // the first timestamp of this frame
+        if (g_timestamp_query_heap)
+            commandList->EndQuery(g_timestamp_query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, frame_index * 2);
+
+        // The frame is a render graph, see 'common/render_graph.h'.
+        //
         // Using Resource Barriers to Synchronize Resource States in Direct3D 12
         // https://docs.microsoft.com/en-us/windows/win32/direct3d12/using-resource-barriers-to-synchronize-resource-states-in-direct3d-12
         //
         // Swap chain back buffers automatically start out in the D3D12_RESOURCE_STATE_COMMON state.
         // D3D12_RESOURCE_STATE_PRESENT is a synonym for D3D12_RESOURCE_STATE_COMMON.
-        resource_transition<D3D12_RESOURCE_STATE_PRESENT, D3D12_RESOURCE_STATE_RENDER_TARGET>(commandList.Get(), backBuffer.Get());
-    }
+        // The draw buffer decays to the common state once the frame is done, so it starts there every frame.
+        auto& graph = g_render_graph;
+        graph.reset();
+        g_graph_resources.clear();
+        const auto back_buffer = import_graph_resource("back buffer", backBuffer.Get(), false, ResourceUsage::Present, ResourceUsage::Present);
+
+        // the pipeline may still be compiling, the frame never waits for it, objects are culled once there is a pipeline
+        auto pipeline = g_pipeline ? static_cast<const D3D12Pipeline*>(g_pipeline->resolve()) : nullptr;
+        size_t zero_offset = 0;
+        const auto gpu_culled = pipeline && g_gpu_culling && prepare_gpu_culling(frame_index, zero_offset);
+        const auto object_draws = gpu_culled ? import_graph_resource("object draws", g_object_draw_buffer.Get(), true, ResourceUsage::None, ResourceUsage::None) : 0;
+
+        if (gpu_culled) {
+            const auto clear_pass = graph.add_pass("clear object count", [&]() { record_object_count_clear(commandList.Get(), frame_index, zero_offset); });
+            graph.use(clear_pass, object_draws, ResourceUsage::CopyDest);
+
+            const auto cull_pass = graph.add_pass("object culling", [&]() { record_gpu_culling(commandList.Get()); });
+            graph.use(cull_pass, object_draws, ResourceUsage::ComputeWrite);
+        }
 
-    // simply clear the back buffer
-    {
-        FLOAT clearColor[] = { 0.4f, 0.6f, 1.0f, 1.0f };
-        D3D12_CPU_DESCRIPTOR_HANDLE rtv;
-        rtv.ptr = g_descriptor_heap->GetCPUDescriptorHandleForHeapStart().ptr + g_current_back_buffer_index * g_rtv_size;
-        commandList->ClearRenderTargetView(rtv, clearColor, 0, nullptr);
+        const auto draw_pass = graph.add_pass("draw", [&]() {
+            // simply clear the back buffer
+            {
+                FLOAT clearColor[] = { 0.4f, 0.6f, 1.0f, 1.0f };
+                D3D12_CPU_DESCRIPTOR_HANDLE rtv;
+                rtv.ptr = g_descriptor_heap->GetCPUDescriptorHandleForHeapStart().ptr + back_buffer_index * g_rtv_size;
+                commandList->ClearRenderTargetView(rtv, clearColor, 0, nullptr);
 
-        commandList->OMSetRenderTargets(1, &rtv, FALSE, nullptr);
-    }
+                commandList->OMSetRenderTargets(1, &rtv, FALSE, nullptr);
+            }
 
-    // issue the draw call to draw a triangle
-    {
-        commandList->SetPipelineState(g_pipeline_state_object.Get());
-        commandList->SetGraphicsRootSignature(g_root_signature.Get());
-
-        commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-        commandList->IASetVertexBuffers(0, 1, &g_vertex_buffer_view);
-        commandList->IASetIndexBuffer(&g_index_buffer_view);
-
-        D3D12_VIEWPORT viewport;
-        viewport.TopLeftX = viewport.TopLeftY = 0;
-        viewport.Width = (float)g_window_width;
-        viewport.Height = (float)g_window_height;
-        viewport.MinDepth = 0.0f;
-        viewport.MaxDepth = 1.0f;
-        commandList->RSSetViewports(1, &viewport);
-
-        D3D12_RECT scissor_rect;
-        scissor_rect.left = 0;
-        scissor_rect.top = 0;
-        scissor_rect.right = g_window_width;
-        scissor_rect.bottom = g_window_height;
-        commandList->RSSetScissorRects(1, &scissor_rect);
-
-        commandList->DrawIndexedInstanced(g_indices_cnt, 1, 0, 0, 0);
+            // issue the draw call to draw a triangle
+            if (pipeline) {
+                commandList->SetPipelineState(pipeline->pso.Get());
+                commandList->SetGraphicsRootSignature(g_root_signature.Get());
+
+                commandList->IASetPrimitiveTopology(D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+                commandList->IASetVertexBuffers(0, 1, &g_vertex_buffer_view);
+                commandList->IASetIndexBuffer(&g_index_buffer_view);
+
+                D3D12_VIEWPORT viewport;
+                viewport.TopLeftX = viewport.TopLeftY = 0;
+                viewport.Width = (float)g_window_width;
+                viewport.Height = (float)g_window_height;
+                viewport.MinDepth = 0.0f;
+                viewport.MaxDepth = 1.0f;
+                commandList->RSSetViewports(1, &viewport);
+
+                D3D12_RECT scissor_rect;
+                scissor_rect.left = 0;
+                scissor_rect.top = 0;
+                scissor_rect.right = g_window_width;
+                scissor_rect.bottom = g_window_height;
+                commandList->RSSetScissorRects(1, &scissor_rect);
+
+                // constants of each draw are written right into the transient memory of the frame
+                const auto transient_address = g_transient_buffer->GetGPUVirtualAddress() + g_transient_frame_size * frame_index;
+                auto& allocator = g_frame_allocators[frame_index];
+
+                // All draws are a single instanced draw, the data of the instances goes to the transient memory instead. The root
+                // constant buffer view is never read, it simply points at valid memory. Objects culled on GPU are instances of the
+                // object buffer, all of them are drawn if the frame couldn't cull them.
+                if (g_gpu_culling) {
+                    const D3D12_VERTEX_BUFFER_VIEW object_view = { g_object_buffer->GetGPUVirtualAddress(), (UINT)(sizeof(InstanceData) * g_draw_cnt), (UINT)sizeof(InstanceData) };
+                    commandList->IASetVertexBuffers(1, 1, &object_view);
+                    commandList->SetGraphicsRootConstantBufferView(0, transient_address);
+                    if (gpu_culled)
+                        record_gpu_culled_draws(commandList.Get());
+                    else
+                        commandList->DrawIndexedInstanced(g_mesh_range.index_cnt, g_draw_cnt, g_mesh_range.first_index, g_mesh_range.base_vertex, 0);
+                } else if (g_instancing) {
+                    size_t instance_offset = 0;
+                    auto instances = (InstanceData*)allocator.allocate(sizeof(InstanceData) * g_draw_cnt, instance_offset);
+                    if (instances) {
+                        for (unsigned int i = 0; i < g_draw_cnt; ++i)
+                            instances[i] = get_instance_data(i, g_draw_cnt, g_position_decode);
+
+                        const D3D12_VERTEX_BUFFER_VIEW instance_view = { transient_address + instance_offset, (UINT)(sizeof(InstanceData) * g_draw_cnt), (UINT)sizeof(InstanceData) };
+                        commandList->IASetVertexBuffers(1, 1, &instance_view);
+                        commandList->SetGraphicsRootConstantBufferView(0, transient_address + instance_offset);
+                        commandList->DrawIndexedInstanced(g_mesh_range.index_cnt, g_draw_cnt, g_mesh_range.first_index, g_mesh_range.base_vertex, 0);
+                    }
+                } else {
+                    // there is room for the constants of all draws, a failure shows up in the transient memory stats
+                    for (unsigned int i = 0; i < g_draw_cnt; ++i) {
+                        size_t offset = 0;
+                        auto constants = (DrawConstants*)allocator.allocate(sizeof(DrawConstants), offset);
+                        if (!constants)
+                            continue;
+                        *constants = get_draw_constants(i, g_draw_cnt, g_position_decode);
+
+                        commandList->SetGraphicsRootConstantBufferView(0, transient_address + offset);
+                        commandList->DrawIndexedInstanced(g_mesh_range.index_cnt, 1, g_mesh_range.first_index, g_mesh_range.base_vertex, 0);
+                    }
+                }
+            }
+        });
+        graph.use(draw_pass, back_buffer, ResourceUsage::ColorAttachment);
+
+        if (gpu_culled) {
+            graph.use(draw_pass, object_draws, ResourceUsage::IndirectArgument);
+
+            const auto readback_pass = graph.add_pass("read object count", [&]() { record_object_count_readback(commandList.Get(), frame_index); });
+            graph.use(readback_pass, object_draws, ResourceUsage::CopySource);
+        }
+
+        // the back buffer goes back to the present state along with the last barriers of the frame
+        graph.compile();
+        graph.execute([&](const RenderGraphBarrier* barriers, const unsigned int barrier_cnt) { return record_barriers(commandList.Get(), barriers, barrier_cnt); });
+
+        // the last timestamp of this frame, both timestamps are resolved so that CPU can read them once the frame is done
+        if (g_timestamp_query_heap) {
+            commandList->EndQuery(g_timestamp_query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, frame_index * 2 + 1);
+            commandList->ResolveQueryData(g_timestamp_query_heap.Get(), D3D12_QUERY_TYPE_TIMESTAMP, frame_index * 2, 2, g_timestamp_readback_buffer.Get(), sizeof(UINT64) * frame_index * 2);
+        }
+
+        // the only command needed in the command list is the clear call and we are done here
+        commandList->Close();
     }
 
-    // before the back buffer can be present again, it needs to transit back to present state.
     {
-        resource_transition<D3D12_RESOURCE_STATE_RENDER_TARGET, D3D12_RESOURCE_STATE_PRESENT>(commandList.Get(), backBuffer.Get());
-    }
+        PROFILE_ZONE(m_profiler, "submit");
 
-    // the only command needed in the command list is the clear call and we are done here
-    commandList->Close();
+        g_submit_time[frame_index] = m_profiler.now();
+        g_timestamp_frames[frame_index] = m_profiler.frame();
 
-    // prepare the baked command list and submit it in the command queue
-    ID3D12CommandList* const commandLists[] = {
-        commandList.Get()
-    };
-    g_command_queue->ExecuteCommandLists(_countof(commandLists), commandLists);
+        // prepare the baked command list and submit it in the command queue
+        ID3D12CommandList* const commandLists[] = {
+            commandList.Get()
+        };
+        g_command_queue->ExecuteCommandLists(_countof(commandLists), commandLists);
+        g_frame_pacer.submitted(g_submit_time[frame_index]);
+    }
 
-    // present the frame, async is always on.
-    g_swap_chain->Present(1, 0);
+    {
+        PROFILE_ZONE(m_profiler, "present");
+
+        // only FIFO waits for vertical blank, tearing is only allowed with a sync interval of 0
+        const UINT sync_interval = g_present_mode == PresentMode::Fifo ? 1 : 0;
+        const UINT present_flags = g_present_mode == PresentMode::Immediate ? DXGI_PRESENT_ALLOW_TEARING : 0;
+        g_swap_chain->Present(sync_interval, present_flags);
+    }
 
     // signal the fence after this frame is done on GPU
     g_command_queue->Signal(g_fence.Get(), ++g_fence_value);
-    g_frame_fence_values[g_current_back_buffer_index] = g_fence_value;
+    g_frame_fence_values[frame_index] = g_fence_value;
 
-    // get the currnet frame back buffer index
+    // get the currnet frame back buffer index, the next frame index is independent of it
     g_current_back_buffer_index = g_swap_chain->GetCurrentBackBufferIndex();
-    
-    // wait for the fence value if CPU is three frames ahead of GPU
-    if (g_fence->GetCompletedValue() < g_frame_fence_values[g_current_back_buffer_index])
+    g_frame_index = (g_frame_index + 1) % g_frames_in_flight;
+
+    // wait for the fence value if CPU is as many frames ahead of GPU as there are frames in flight
     {
-        g_fence->SetEventOnCompletion(g_frame_fence_values[g_current_back_buffer_index], g_fence_event);
-        ::WaitForSingleObject(g_fence_event, INFINITE);
+        PROFILE_ZONE(m_profiler, "fence wait");
+
+        if (g_fence->GetCompletedValue() < g_frame_fence_values[g_frame_index])
+        {
+            g_fence->SetEventOnCompletion(g_frame_fence_values[g_frame_index], g_fence_event);
+            ::WaitForSingleObject(g_fence_event, INFINITE);
+        }
     }
+
+    // the previous frame using this frame index is done, so are its timestamps and its count of visible objects
+    read_timestamps(m_profiler);
+    read_object_count();
+
+    // release whatever GPU is done with, this doesn't wait for anything
+    g_deletion_queue.collect(g_fence->GetCompletedValue());
 }
 
 
@@ -670,25 +1797,164 @@ void D3D12GraphicsSample::render_frame() {
  */
 void D3D12GraphicsSample::shutdown() {
     // flush the command queue to make sure nothing is left in it before releasing anything.
+    // The graphics queue waited for all uploads, so the copy queue is idle as well.
     flush_command_queue();
 
-    // close the event handle
+    // close the event handles
     ::CloseHandle(g_fence_event);
+    if (g_frame_latency_waitable)
+        ::CloseHandle(g_frame_latency_waitable);
+    g_frame_latency_waitable = nullptr;
+    ::CloseHandle(g_copy_fence_event);
+
+    // GPU is idle, nothing needs to wait anymore
+    g_deletion_queue.flush();
+
+    // pipelines still compiling have to be done before saving the library, pipelines compiled in this launch are kept for the next one
+    g_pipeline_compiler = nullptr;
+    g_pipelines.clear();
+    save_pipeline_library();
 
     // These destruction is not totally necessary. However, instead of relying on the compiler to destroy them,
     // explicitly destruction will guarantee specific order of destruction.
     g_geometry_buffer = nullptr;
+    g_geometry_pool.free(g_mesh_range);
+    g_mesh_range = GeometryRange();
+    g_object_buffer = nullptr;
+    g_object_draw_buffer = nullptr;
+    g_object_count_readback_buffer = nullptr;
+    g_object_cull_pso = nullptr;
+    g_object_cull_root_signature = nullptr;
+    g_object_draw_signature = nullptr;
+    g_mesh.release();
     g_root_signature = nullptr;
-    g_pipeline_state_object = nullptr;
+    g_root_signatures.clear();
+    g_pipeline = nullptr;
+    g_pipeline_library = nullptr;
+    g_pipeline_library_blob.clear();
+    g_timestamp_query_heap = nullptr;
+    g_timestamp_readback_buffer = nullptr;
+    g_transient_buffer = nullptr;
     g_fence = nullptr;
+    g_copy_fence = nullptr;
+    g_copy_command_list = nullptr;
+    g_copy_command_allocator = nullptr;
     g_command_list = nullptr;
-    for (auto i = 0; i < NUM_FRAMES; ++i) {
-        g_command_list_allocators[i] = nullptr;
-        g_back_buffers[i] = nullptr;
-    }
+    for (auto& allocator : g_command_list_allocators)
+        allocator = nullptr;
+    for (auto& back_buffer : g_back_buffers)
+        back_buffer = nullptr;
+    g_frame_index = 0;
+    g_frame_pacer.reset();
+    g_resize_pending = false;
+    std::fill(std::begin(g_frame_fence_values), std::end(g_frame_fence_values), 0);
     g_descriptor_heap = nullptr;
     g_swap_chain = nullptr;
     g_command_queue = nullptr;
+    g_copy_queue = nullptr;
     g_d3d12_device = nullptr;
     g_adapter = nullptr;
-}
\ No newline at end of file
+}
+
+void D3D12GraphicsSample::set_draw_count(const unsigned int draw_cnt) {
+    g_draw_cnt = draw_cnt ? draw_cnt : 1;
+}
+
+void D3D12GraphicsSample::set_frames_in_flight(const unsigned int frame_cnt) {
+    g_frames_in_flight = std::min(std::max(frame_cnt, 1u), MAX_FRAMES_IN_FLIGHT);
+}
+
+void D3D12GraphicsSample::resize(const unsigned int width, const unsigned int height) {
+    if (!g_resize_pending && width == g_window_width && height == g_window_height)
+        return;
+
+    g_resize_pending = true;
+    g_resize_width = width;
+    g_resize_height = height;
+}
+
+void D3D12GraphicsSample::set_present_mode(const PresentMode mode) {
+    g_requested_present_mode = mode;
+}
+
+void D3D12GraphicsSample::set_low_latency(const bool low_latency) {
+    g_frame_pacer.set_low_latency(low_latency);
+}
+
+bool D3D12GraphicsSample::get_present_stats(PresentStats& stats) const {
+    stats.mode = g_present_mode;
+    stats.low_latency = g_frame_pacer.is_low_latency();
+    stats.waitable = g_frame_latency_waitable != nullptr;
+    return true;
+}
+
+void D3D12GraphicsSample::set_instancing(const bool instancing) {
+    g_requested_instancing = instancing;
+}
+
+bool D3D12GraphicsSample::get_instancing_stats(InstancingStats& stats) const {
+    stats = InstancingStats();
+    if (!g_instancing)
+        return false;
+
+    stats.instance_cnt = g_draw_cnt;
+    stats.draw_call_cnt = 1;
+    stats.instance_data_size = (unsigned long long)sizeof(InstanceData) * g_draw_cnt;
+    return true;
+}
+
+void D3D12GraphicsSample::set_gpu_culling(const bool gpu_culling) {
+    g_gpu_culling = gpu_culling;
+}
+
+bool D3D12GraphicsSample::get_gpu_culling_stats(GpuCullingStats& stats) const {
+    stats = g_gpu_culling_stats;
+    return g_gpu_culling;
+}
+
+bool D3D12GraphicsSample::get_render_graph_stats(RenderGraphStats& stats) const {
+    stats = g_render_graph.get_stats();
+    return stats.pass_cnt > 0;
+}
+
+void D3D12GraphicsSample::set_mesh(const char* filename) {
+    g_mesh_filename = filename ? filename : "";
+}
+
+void D3D12GraphicsSample::set_mesh_optimization(const bool optimize) {
+    g_mesh_optimization = optimize;
+}
+
+bool D3D12GraphicsSample::get_mesh_optimization_stats(MeshOptimizationStats& stats) const {
+    stats = g_mesh_optimization_stats;
+    return g_mesh_optimization;
+}
+
+bool D3D12GraphicsSample::get_geometry_pool_stats(GeometryPoolStats& stats) const {
+    g_geometry_pool.get_stats(stats);
+    return true;
+}
+
+void D3D12GraphicsSample::set_vertex_encoding(const VertexEncoding encoding) {
+    g_vertex_encoding = encoding;
+}
+
+bool D3D12GraphicsSample::get_vertex_encoding_stats(VertexEncodingStats& stats) const {
+    stats = g_vertex_encoding_stats;
+    return true;
+}
+
+bool D3D12GraphicsSample::get_transient_memory_stats(TransientMemoryStats& stats) const {
+    stats = TransientMemoryStats();
+    for (const auto& allocator : g_frame_allocators)
+        allocator.get_stats(stats);
+    return true;
+}
+
+bool D3D12GraphicsSample::save_pipeline_cache() {
+    return save_pipeline_library();
+}
+
+unsigned int D3D12GraphicsSample::get_pending_pipeline_count() const {
+    return g_pipeline_compiler ? g_pipeline_compiler->pending_count() : 0;
+}
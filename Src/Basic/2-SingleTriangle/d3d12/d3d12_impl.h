@@ -23,4 +23,107 @@ public:
      * Shutdown the graphics API.
      */
     void shutdown() override;
+
+    /*
+     * The back buffers are resized at the beginning of the next frame, once GPU is done with the last frame rendering into them.
+     */
+    void resize(const unsigned int width, const unsigned int height) override;
+
+    /*
+     * Number of times the triangle is drawn in each frame.
+     */
+    void set_draw_count(const unsigned int draw_cnt) override;
+
+    /*
+     * Frames recorded ahead of GPU, each owns a command allocator and a region of the transient memory. Back buffers are
+     * independent of it.
+     */
+    void set_frames_in_flight(const unsigned int frame_cnt) override;
+
+    /*
+     * FIFO presents with a sync interval of 1, mailbox with a sync interval of 0, immediate with DXGI tearing if the display
+     * supports it.
+     */
+    void set_present_mode(const PresentMode mode) override;
+
+    /*
+     * Delay each frame until just before GPU runs out of work, the swap chain latency is one frame too.
+     */
+    void set_low_latency(const bool low_latency) override;
+
+    /*
+     * The present mode of the swap chain and whether frames are paced for low latency.
+     */
+    bool get_present_stats(PresentStats& stats) const override;
+
+    /*
+     * Draw all instances with a single instanced draw call, it has to be set before initialization.
+     */
+    void set_instancing(const bool instancing) override;
+
+    /*
+     * Instances drawn in each frame and the size of their data.
+     */
+    bool get_instancing_stats(InstancingStats& stats) const override;
+
+    /*
+     * Cull the draws in a compute shader and draw the visible ones with a single ExecuteIndirect with a count buffer.
+     * It has to be set before initialization.
+     */
+    void set_gpu_culling(const bool gpu_culling) override;
+
+    /*
+     * How culled draws are drawn and how many of them are visible in the last frame read back.
+     */
+    bool get_gpu_culling_stats(GpuCullingStats& stats) const override;
+
+    /*
+     * Passes culled and barriers recorded by the render graph of the last frame.
+     */
+    bool get_render_graph_stats(RenderGraphStats& stats) const override;
+
+    /*
+     * Mesh file to draw, it has to be set before initialization.
+     */
+    void set_mesh(const char* filename) override;
+
+    /*
+     * Optimize the mesh when it is loaded, it has to be set before initialization.
+     */
+    void set_mesh_optimization(const bool optimize) override;
+
+    /*
+     * Cache efficiency of the mesh before and after optimization.
+     */
+    bool get_mesh_optimization_stats(MeshOptimizationStats& stats) const override;
+
+    /*
+     * Meshes sub-allocated from the vertices and indices of the geometry pool.
+     */
+    bool get_geometry_pool_stats(GeometryPoolStats& stats) const override;
+
+    /*
+     * Encoding of the vertex buffer, it has to be set before initialization.
+     */
+    void set_vertex_encoding(const VertexEncoding encoding) override;
+
+    /*
+     * Size of the vertex buffer before and after encoding.
+     */
+    bool get_vertex_encoding_stats(VertexEncodingStats& stats) const override;
+
+    /*
+     * Usage of the per-frame memory for per-draw constants.
+     */
+    bool get_transient_memory_stats(TransientMemoryStats& stats) const override;
+
+    /*
+     * Write the pipeline library to disk.
+     */
+    bool save_pipeline_cache() override;
+
+    /*
+     * Number of pipeline state objects the pipeline compiler is still working on.
+     */
+    unsigned int get_pending_pipeline_count() const override;
 };
\ No newline at end of file
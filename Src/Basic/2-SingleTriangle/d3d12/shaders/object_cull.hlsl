@@ -0,0 +1,69 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+// 'GpuCullingConstants' in common/gpu_culling.h, the draws are always compacted with a count on D3D12.
+cbuffer CullConstants : register(b0) {
+    float4  sphere;             // bounding sphere of the mesh, center and radius
+    uint    first;              // first object of the dispatch
+    uint    object_cnt;
+    uint    index_cnt;
+    uint    first_index;        // where the mesh is in the geometry pool
+    int     base_vertex;
+    uint    compact;
+    uint    counter;            // byte offset of the count in the draws
+};
+
+// 'InstanceData' in common/common.h, 28 bytes each
+ByteAddressBuffer   objects : register(t0);
+// 'D3D12_DRAW_INDEXED_ARGUMENTS' of the visible objects, followed by their count
+RWByteAddressBuffer draws   : register(u0);
+
+groupshared uint group_visible_cnt;
+groupshared uint group_first_draw;
+
+/*
+ * Compute Shader
+ * Each thread culls an object against the frustum and appends an indexed draw of the whole mesh for it if it is visible, the
+ * object is the first instance of the draw so that its data is fetched as an instance.
+ */
+[numthreads(64, 1, 1)]
+void main(uint3 thread : SV_DispatchThreadID, uint local : SV_GroupIndex) {
+    if (local == 0)
+        group_visible_cnt = 0;
+    GroupMemoryBarrierWithGroupSync();
+
+    const uint object = first + thread.x;
+    bool visible = false;
+    if (object < object_cnt) {
+        const uint base = object * 28;
+        const float3 scale = asfloat(objects.Load3(base));
+        const float3 offset = asfloat(objects.Load3(base + 12));
+        const float3 center = sphere.xyz * scale + offset;
+        const float radius = sphere.w * max(abs(scale.x), max(abs(scale.y), abs(scale.z)));
+
+        // clip space is [-1, 1] in x and y, [0, 1] in z
+        visible = all(center + radius >= float3(-1.0f, -1.0f, 0.0f)) && all(center - radius <= float3(1.0f, 1.0f, 1.0f));
+    }
+
+    // visible objects of the group take a contiguous range of draws, there is a single global atomic for each group
+    uint slot = 0;
+    if (visible)
+        InterlockedAdd(group_visible_cnt, 1, slot);
+    GroupMemoryBarrierWithGroupSync();
+
+    if (local == 0) {
+        uint first_draw;
+        draws.InterlockedAdd(counter, group_visible_cnt, first_draw);
+        group_first_draw = first_draw;
+    }
+    GroupMemoryBarrierWithGroupSync();
+
+    // IndexCountPerInstance, InstanceCount, StartIndexLocation, BaseVertexLocation and StartInstanceLocation
+    if (visible) {
+        const uint draw = (group_first_draw + slot) * 20;
+        draws.Store4(draw, uint4(index_cnt, 1, first_index, base_vertex));
+        draws.Store(draw + 16, object);
+    }
+}
@@ -3,11 +3,21 @@
 //  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
 //
 
+// Semantic names follow 'VertexSemantic' in common/vertex_layout.h
 struct Vertex{
     float3 position : POSITION;     // clip space position
     float3 color    : COLOR;
 };
 
+/*
+ * Per-draw constants, they live in the transient memory of the frame and are bound as a root constant buffer view.
+ */
+cbuffer DrawConstants : register(b0){
+    // the scale and offset also decode quantized positions, which are fetched as SNORM in [-1, 1] of the bounding box
+    float3 scale;
+    float3 offset;
+};
+
 struct VSOutput{
     float4 color    : COLOR;
     float4 position : SV_Position;
@@ -15,12 +25,13 @@ struct VSOutput{
 
 /*
  * Vertex Shader
- * Nothing needs to be done apart from passthrough VS input data.
+ * The triangle is moved into the cell of the draw, nothing else is needed.
  */
 VSOutput main(Vertex vs_in){
     VSOutput vs_out;
 
-    vs_out.position = float4(vs_in.position, 1.0f);
+    // move the triangle into the cell of this draw
+    vs_out.position = float4(vs_in.position * scale + offset, 1.0f);
     vs_out.color = float4(vs_in.color, 1.0f);
 
     return vs_out;
@@ -0,0 +1,36 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+// Semantic names follow 'VertexSemantic' in common/vertex_layout.h
+struct Vertex{
+    float3 position : POSITION;     // clip space position
+    float3 color    : COLOR;
+};
+
+// Per-instance data, see 'InstanceData' in common/common.h. It replaces the per-draw constants of the regular vertex shader.
+struct Instance{
+    float3 scale    : INSTANCE_SCALE;
+    float3 offset   : INSTANCE_OFFSET;
+    float4 color    : INSTANCE_COLOR;
+};
+
+struct VSOutput{
+    float4 color    : COLOR;
+    float4 position : SV_Position;
+};
+
+/*
+ * Vertex Shader
+ * The mesh is moved into the cell of the instance and tinted with its color.
+ */
+VSOutput main(Vertex vs_in, Instance instance){
+    VSOutput vs_out;
+
+    // move the mesh into the cell of this instance
+    vs_out.position = float4(vs_in.position * instance.scale + instance.offset, 1.0f);
+    vs_out.color = float4(vs_in.color, 1.0f) * instance.color;
+
+    return vs_out;
+}
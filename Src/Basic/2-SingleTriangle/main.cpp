@@ -9,6 +9,7 @@
 #include <memory>
 #include "d3d12/d3d12_impl.h"
 #include "vulkan/vulkan_impl.h"
+#include "software/software_impl.h"
 
 // class name and window title
 static constexpr wchar_t  CLASS_NAME[] = L"Jiayin's Graphics Samples";
@@ -27,6 +28,11 @@ static inline LRESULT CALLBACK WndProc(HWND hWnd, UINT message, WPARAM wParam, L
     case WM_DESTROY:
         g_quiting = true;
         break;
+    case WM_SIZE:
+        // the swapchain follows at the beginning of the next frame, a minimized window has a size of 0
+        if (g_graphics_sample)
+            g_graphics_sample->resize(LOWORD(lParam), HIWORD(lParam));
+        break;
     case WM_PAINT:
         // render a frame
         g_graphics_sample->render_frame();
@@ -44,6 +50,10 @@ int WINAPI WinMain(HINSTANCE hInInstance, HINSTANCE hPrevInstance, char* lpCmdLi
         g_graphics_sample = std::make_unique<VulkanGraphicsSample>();
         window_title = L"2 - SingleTriangle (Vulkan)";
     }
+    else if (strcmp(lpCmdLine, "-software") == 0) {
+        g_graphics_sample = std::make_unique<SoftwareGraphicsSample>();
+        window_title = L"2 - SingleTriangle (Software)";
+    }
     else {
         g_graphics_sample = std::make_unique<D3D12GraphicsSample>();
         window_title = L"2 - SingleTriangle (D3D12)";
@@ -66,7 +76,7 @@ int WINAPI WinMain(HINSTANCE hInInstance, HINSTANCE hPrevInstance, char* lpCmdLi
     RegisterClassExW(&wcex);
 
     // Create the window.
-    HWND hwnd = CreateWindowW(CLASS_NAME, window_title, WS_OVERLAPPED | WS_CAPTION | WS_SYSMENU | WS_MINIMIZEBOX,
+    HWND hwnd = CreateWindowW(CLASS_NAME, window_title, WS_OVERLAPPEDWINDOW,
         CW_USEDEFAULT, 0, g_window_width, g_window_height, nullptr, nullptr, hInInstance, nullptr);
     if (hwnd == NULL)
         return 0;
@@ -98,4 +108,209 @@ int WINAPI WinMain(HINSTANCE hInInstance, HINSTANCE hPrevInstance, char* lpCmdLi
     return 0;
 }
 
+#elif PLATFORM_LINUX
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <memory>
+#include <thread>
+#include <algorithm>
+#include "vulkan/vulkan_impl.h"
+#include "software/software_impl.h"
+#include "common/mesh.h"
+
+// There is no window system on a headless machine, the resolution of the offscreen render target is used instead.
+static unsigned int g_window_width = 1280;
+static unsigned int g_window_height = 720;
+
+// Number of frames to render before quitting.
+static unsigned int g_frame_cnt = 1000;
+
+// Number of threads of the software rasterizer or threads recording Vulkan commands, 0 means one per hardware thread.
+static unsigned int g_thread_cnt = 0;
+
+// Number of times the triangles are drawn each frame.
+static unsigned int g_draw_cnt = 1;
+
+// Number of frames CPU records ahead of GPU, more hides stalls better at the cost of latency.
+static unsigned int g_frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
+
+// How frames are presented, presenting goes to a headless surface since there is no window.
+static bool g_headless = false;
+static PresentMode g_present_mode = PresentMode::Fifo;
+// Whether frames are delayed until just before GPU needs them.
+static bool g_low_latency = false;
+
+// Where to dump the chrome trace of the last frames, nothing is dumped if it is not specified.
+static const char* g_trace_filename = nullptr;
+
+// Mesh file to draw, see 'Scripts/convert_mesh.py', the triangle is drawn if it is not specified.
+static const char* g_mesh_filename = nullptr;
+// Whether the mesh is optimized when it is loaded.
+static bool g_optimize = false;
+
+/*
+ * Measure the throughput of the software rasterizer with different number of threads.
+ * The number of threads doubles each time until it reaches the number of hardware threads.
+ */
+static int run_software_perf() {
+    const auto max_thread_cnt = std::max(1u, std::thread::hardware_concurrency());
+
+    printf("threads, frames, seconds, triangles/sec, pixels/sec\n");
+    for (unsigned int thread_cnt = 1; ; thread_cnt = std::min(thread_cnt * 2, max_thread_cnt)) {
+        SoftwareGraphicsSample graphics_sample(thread_cnt);
+        graphics_sample.set_draw_count(g_draw_cnt);
+        graphics_sample.set_mesh(g_mesh_filename);
+        graphics_sample.set_mesh_optimization(g_optimize);
+        if (!graphics_sample.initialize(g_window_width, g_window_height)) {
+            fprintf(stderr, "Failed to initialized the software rasterizer.\n");
+            return -1;
+        }
+
+        // one frame to warm up the caches and the threads
+        graphics_sample.render_frame();
+        const auto warm_up_stats = graphics_sample.get_stats();
+
+        const auto start = std::chrono::steady_clock::now();
+        for (unsigned int i = 0; i < g_frame_cnt; ++i)
+            graphics_sample.render_frame();
+        const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+        const auto& stats = graphics_sample.get_stats();
+        const auto triangles = (double)(stats.triangles - warm_up_stats.triangles);
+        const auto pixels = (double)(stats.pixels - warm_up_stats.pixels);
+        printf("%u, %u, %.3f, %.0f, %.0f\n", graphics_sample.thread_count(), g_frame_cnt, elapsed,
+            elapsed > 0.0 ? triangles / elapsed : 0.0, elapsed > 0.0 ? pixels / elapsed : 0.0);
+
+        graphics_sample.shutdown();
+
+        if (thread_cnt == max_thread_cnt)
+            break;
+    }
+
+    return 0;
+}
+
+/*
+ * Optimize a mesh file offline, so that it is drawn optimized without any cost at load time.
+ */
+static int optimize_mesh_file(const char* input_filename, const char* output_filename) {
+    Mesh input, output;
+    MeshOptimizationStats stats;
+    if (!input.load(input_filename) || !optimize_mesh(input, output, stats) || !output.save(output_filename)) {
+        fprintf(stderr, "Failed to optimize %s into %s.\n", input_filename, output_filename);
+        return -1;
+    }
+
+    printf("%s: %u triangles, %u -> %u vertices, %u -> %u bytes indices, ACMR %.3f -> %.3f, ATVR %.3f -> %.3f, %u meshlets\n", output_filename,
+        stats.triangle_cnt, stats.original_vertex_cnt, stats.optimized_vertex_cnt, stats.original_index_size, stats.optimized_index_size,
+        stats.original_cache.acmr, stats.optimized_cache.acmr, stats.original_cache.atvr, stats.optimized_cache.atvr, stats.meshlet_cnt);
+    return 0;
+}
+
+// Entry point of the application
+// Everything is rendered offscreen through Vulkan since there is no d3d12 on Linux, this is mostly for batch rendering and
+// benchmarking on machines without a window system. '-software' switches to the software rasterizer, '-perf' measures
+// the software rasterizer with different number of threads, '-quantize' stores vertices of the Vulkan backend quantized.
+// '-optimize' optimizes the mesh when it is loaded, '-optimize-mesh input output' optimizes a mesh file offline and quits.
+// '-meshlets' culls and draws the mesh in meshlets with the Vulkan backend, '-instanced' draws all the draws with a single
+// instanced draw call, '-gpu-culling' culls the draws in a compute shader and draws the visible ones indirectly.
+// '-headless' presents to a headless surface instead of rendering offscreen, '-present fifo|mailbox|immediate' picks its present
+// mode and '-low-latency' paces frames for latency.
+int main(int argc, char** argv) {
+    bool software = false;
+    bool perf = false;
+    bool quantize = false;
+    bool meshlets = false;
+    bool instanced = false;
+    bool gpu_culling = false;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc)
+            g_frame_cnt = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-width") == 0 && i + 1 < argc)
+            g_window_width = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-height") == 0 && i + 1 < argc)
+            g_window_height = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc)
+            g_thread_cnt = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-draws") == 0 && i + 1 < argc)
+            g_draw_cnt = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-frames-in-flight") == 0 && i + 1 < argc)
+            g_frames_in_flight = atoi(argv[++i]);
+        else if (strcmp(argv[i], "-headless") == 0)
+            g_headless = true;
+        else if (strcmp(argv[i], "-present") == 0 && i + 1 < argc) {
+            ++i;
+            g_present_mode = strcmp(argv[i], "mailbox") == 0 ? PresentMode::Mailbox :
+                             strcmp(argv[i], "immediate") == 0 ? PresentMode::Immediate : PresentMode::Fifo;
+        }
+        else if (strcmp(argv[i], "-low-latency") == 0)
+            g_low_latency = true;
+        else if (strcmp(argv[i], "-software") == 0)
+            software = true;
+        else if (strcmp(argv[i], "-perf") == 0)
+            perf = true;
+        else if (strcmp(argv[i], "-mesh") == 0 && i + 1 < argc)
+            g_mesh_filename = argv[++i];
+        else if (strcmp(argv[i], "-optimize") == 0)
+            g_optimize = true;
+        else if (strcmp(argv[i], "-optimize-mesh") == 0 && i + 2 < argc)
+            return optimize_mesh_file(argv[i + 1], argv[i + 2]);
+        else if (strcmp(argv[i], "-quantize") == 0)
+            quantize = true;
+        else if (strcmp(argv[i], "-meshlets") == 0)
+            meshlets = true;
+        else if (strcmp(argv[i], "-instanced") == 0)
+            instanced = true;
+        else if (strcmp(argv[i], "-gpu-culling") == 0)
+            gpu_culling = true;
+        else if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc)
+            g_trace_filename = argv[++i];
+    }
+
+    if (perf)
+        return run_software_perf();
+
+    std::unique_ptr<GraphicsSample> graphics_sample = nullptr;
+    if (software)
+        graphics_sample = std::make_unique<SoftwareGraphicsSample>(g_thread_cnt);
+    else
+        graphics_sample = std::make_unique<VulkanGraphicsSample>(g_thread_cnt);
+    graphics_sample->set_draw_count(g_draw_cnt);
+    graphics_sample->set_frames_in_flight(g_frames_in_flight);
+    graphics_sample->set_present_mode(g_present_mode);
+    graphics_sample->set_low_latency(g_low_latency);
+    graphics_sample->set_headless_surface(g_headless);
+    graphics_sample->set_instancing(instanced);
+    graphics_sample->set_gpu_culling(gpu_culling);
+    graphics_sample->set_mesh(g_mesh_filename);
+    graphics_sample->set_mesh_optimization(g_optimize);
+    graphics_sample->set_vertex_encoding(quantize ? VertexEncoding::Quantized : VertexEncoding::Full);
+    graphics_sample->set_meshlets(meshlets);
+
+    // Initialize graphics api
+    const auto graphics_initialized = graphics_sample->initialize(g_window_width, g_window_height);
+    if (!graphics_initialized) {
+        fprintf(stderr, "Failed to initialized graphics API.\n");
+        return -1;
+    }
+
+    const auto start = std::chrono::steady_clock::now();
+    for (unsigned int i = 0; i < g_frame_cnt; ++i)
+        graphics_sample->render_frame();
+    const auto elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    graphics_sample->shutdown();
+
+    if (g_trace_filename && !graphics_sample->get_profiler().dump_chrome_trace(g_trace_filename))
+        fprintf(stderr, "Failed to dump chrome trace to %s.\n", g_trace_filename);
+
+    printf("2 - SingleTriangle (%s, %s %ux%u): %u frames in %.3f s, %.1f frames per second.\n", software ? "Software" : "Vulkan",
+        g_headless && !software ? "headless" : "offscreen", g_window_width, g_window_height, g_frame_cnt, elapsed, elapsed > 0.0 ? g_frame_cnt / elapsed : 0.0);
+
+    return 0;
+}
+
 #endif
\ No newline at end of file
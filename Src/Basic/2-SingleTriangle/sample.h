@@ -5,7 +5,48 @@
 
 #pragma once
 
+#if PLATFORM_WIN
 #include <Windows.h>
+#endif
+#include "common/profiler.h"
+#include "common/linear_allocator.h"
+#include "common/vertex_encoding.h"
+#include "common/mesh_optimizer.h"
+#include "common/meshlet.h"
+#include "common/gpu_culling.h"
+#include "common/geometry_pool.h"
+#include "common/frame_pacing.h"
+#include "common/render_graph.h"
+
+/*
+ * Usage of GPU memory owned by a backend, everything is in bytes.
+ */
+struct GpuMemoryStats {
+    unsigned int        block_cnt = 0;              // number of memory allocations of the graphics API
+    unsigned long long  reserved = 0;               // size of all memory allocations of the graphics API
+    unsigned int        allocation_cnt = 0;         // number of live sub-allocations
+    unsigned long long  used = 0;                   // size of all live sub-allocations
+    unsigned int        free_range_cnt = 0;         // number of free ranges in all blocks
+    unsigned long long  largest_free_range = 0;     // size of the largest free range
+    // 0 means all free memory is in one range, it gets close to 1 when free memory is scattered in lots of small ranges.
+    float               fragmentation = 0.0f;
+};
+
+/*
+ * What the instanced path draws each frame.
+ */
+struct InstancingStats {
+    unsigned int        instance_cnt = 0;
+    unsigned int        draw_call_cnt = 0;          // instanced draw calls of a frame
+    unsigned long long  instance_data_size = 0;     // bytes of instance data written every frame
+};
+
+/*
+ * Frames CPU records ahead of GPU. More frames in flight keep GPU busy through uneven CPU frames, fewer of them cut the
+ * latency between recording a frame and seeing it. It has nothing to do with the number of swapchain images.
+ */
+static constexpr unsigned int DEFAULT_FRAMES_IN_FLIGHT = 3;
+static constexpr unsigned int MAX_FRAMES_IN_FLIGHT = 4;
 
 class GraphicsSample {
 public:
@@ -14,13 +55,22 @@ public:
      */
     virtual ~GraphicsSample() {}
 
+#if PLATFORM_WIN
     /*
      * Initialize graphics API.
      */
     virtual bool initialize(const HINSTANCE hInstnace, const HWND hwnd) = 0;
+#endif
+
+    /*
+     * Initialize graphics API without any window.
+     * Everything is rendered into an offscreen render target of the given size. Backends that can't render offscreen
+     * will simply fail here.
+     */
+    virtual bool initialize(const unsigned int width, const unsigned int height) { return false; }
 
     /*
-     * Render a frame. 
+     * Render a frame.
      */
     virtual void render_frame() = 0;
 
@@ -28,4 +78,151 @@ public:
      * Shutdown the graphics API.
      */
     virtual void shutdown() = 0;
-};
\ No newline at end of file
+
+    /*
+     * The window is resized, it is safe to call at any time between frames. The swapchain follows at the beginning of the next
+     * frame, a size of 0 means the window is minimized and nothing is rendered until it is restored. Backends without a
+     * swapchain ignore it.
+     */
+    virtual void resize(const unsigned int width, const unsigned int height) {}
+
+    /*
+     * Number of times the scene is drawn in each frame, this is purely for stress testing. Backends that don't support it
+     * simply draw the scene once.
+     */
+    virtual void set_draw_count(const unsigned int draw_cnt) {}
+
+    /*
+     * Number of frames in flight, from 1 to 'MAX_FRAMES_IN_FLIGHT', it has to be set before initialization. Backends that
+     * don't run ahead of GPU ignore it.
+     */
+    virtual void set_frames_in_flight(const unsigned int frame_cnt) {}
+
+    /*
+     * How frames are presented, it has to be set before initialization. A mode the surface doesn't support falls back to FIFO,
+     * which is always there. Backends that don't present ignore it.
+     */
+    virtual void set_present_mode(const PresentMode mode) {}
+
+    /*
+     * Delay the beginning of each frame until just before GPU needs its commands, see 'common/frame_pacing.h'. It trades a
+     * little throughput for latency, backends that don't run ahead of GPU ignore it.
+     */
+    virtual void set_low_latency(const bool low_latency) {}
+
+    /*
+     * Present to a surface without any window when initialized without one, instead of rendering into offscreen images. It
+     * goes through the same swapchain and present as a window does, so presentation can be measured on headless machines.
+     * Backends without headless surfaces render offscreen as usual.
+     */
+    virtual void set_headless_surface(const bool headless) {}
+
+    /*
+     * How presentation is set up, backends that don't present return false.
+     */
+    virtual bool get_present_stats(PresentStats& stats) const { return false; }
+
+    /*
+     * Draw the scene count times with a single instanced draw call instead of one draw call each, it has to be set before
+     * initialization. Per-instance data is written every frame into the transient memory. Backends without instancing ignore it.
+     */
+    virtual void set_instancing(const bool instancing) {}
+
+    /*
+     * Instances drawn in each frame, backends not drawing instances return false.
+     */
+    virtual bool get_instancing_stats(InstancingStats& stats) const { return false; }
+
+    /*
+     * Cull the draws against the frustum on GPU and draw the visible ones with indirect draws, it has to be set before
+     * initialization. The data of all draws stays in GPU memory, so the CPU cost of a frame doesn't grow with the number of
+     * draws. Backends without compute shaders draw on CPU as usual.
+     */
+    virtual void set_gpu_culling(const bool gpu_culling) {}
+
+    /*
+     * How culled draws are drawn and how many survive culling, backends not culling on GPU return false.
+     */
+    virtual bool get_gpu_culling_stats(GpuCullingStats& stats) const { return false; }
+
+    /*
+     * Passes and barriers of the render graph of the last frame, backends without a render graph return false.
+     */
+    virtual bool get_render_graph_stats(RenderGraphStats& stats) const { return false; }
+
+    /*
+     * Mesh file to draw instead of the triangle, see 'common/mesh.h', it has to be set before initialization. Null draws the
+     * triangle.
+     */
+    virtual void set_mesh(const char* filename) {}
+
+    /*
+     * Optimize the mesh for the post-transform cache, overdraw and vertex fetch when it is loaded, it has to be set before
+     * initialization. Mesh files are usually optimized offline, this is for measuring what it is worth.
+     */
+    virtual void set_mesh_optimization(const bool optimize) {}
+
+    /*
+     * Efficiency of the mesh before and after optimization, backends return false if the mesh is not optimized.
+     */
+    virtual bool get_mesh_optimization_stats(MeshOptimizationStats& stats) const { return false; }
+
+    /*
+     * Usage of the geometry pool all meshes are sub-allocated from, backends without one return false.
+     */
+    virtual bool get_geometry_pool_stats(GeometryPoolStats& stats) const { return false; }
+
+    /*
+     * Draw the mesh as meshlets culled on GPU, it has to be set before initialization. Backends without a meshlet path draw
+     * the mesh as a whole.
+     */
+    virtual void set_meshlets(const bool meshlets) {}
+
+    /*
+     * The meshlet path of the device and how many meshlets survive culling, backends not drawing meshlets return false.
+     */
+    virtual bool get_meshlet_stats(MeshletStats& stats) const { return false; }
+
+    /*
+     * How vertices are stored in GPU memory, it has to be set before initialization. Backends that don't fetch vertices on GPU
+     * ignore it.
+     */
+    virtual void set_vertex_encoding(const VertexEncoding encoding) {}
+
+    /*
+     * Size of the vertices before and after encoding, backends that don't encode vertices return false.
+     */
+    virtual bool get_vertex_encoding_stats(VertexEncodingStats& stats) const { return false; }
+
+    /*
+     * Usage of the per-frame memory for transient data, it is for sizing the memory for real scenes. Backends without any
+     * transient data return false.
+     */
+    virtual bool get_transient_memory_stats(TransientMemoryStats& stats) const { return false; }
+
+    /*
+     * Usage of GPU memory, backends that don't manage GPU memory themselves return false.
+     */
+    virtual bool get_gpu_memory_stats(GpuMemoryStats& stats) const { return false; }
+
+    /*
+     * Write compiled pipelines to disk now, they are written at shutdown anyway. Backends without a pipeline cache return false.
+     */
+    virtual bool save_pipeline_cache() { return false; }
+
+    /*
+     * Number of pipelines still compiling in the background, draws using them are skipped or drawn with a fallback pipeline
+     * until they are done. Backends compiling everything during initialization return 0.
+     */
+    virtual unsigned int get_pending_pipeline_count() const { return 0; }
+
+    /*
+     * Instrumentation of the recent frames.
+     * Each frame records CPU zones of its phases, like recording and submitting commands, along with the GPU time of the frame
+     * if the graphics API supports timestamp queries.
+     */
+    FrameProfiler& get_profiler() { return m_profiler; }
+
+protected:
+    FrameProfiler   m_profiler;
+};
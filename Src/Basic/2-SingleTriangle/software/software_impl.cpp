@@ -0,0 +1,553 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <string>
+#include <math.h>
+#include <string.h>
+#if PLATFORM_WIN
+#include <windows.h>
+#endif
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#endif
+#include "software_impl.h"
+#include "../common/common.h"
+#include "../common/thread_pool.h"
+#include "../common/mesh.h"
+#include "../common/mesh_optimizer.h"
+
+/*
+    This tutorial demonstrate how to draw a single triangle on screen without any graphics hardware.
+    It demonstrates the following things about software rasterization.
+        - Splitting the frame buffer into tiles and binning triangles into the tiles they touch.
+        - Rasterizing tiles on multiple threads, each tile is owned by exactly one thread, no synchronization is needed.
+        - Evaluating edge functions with fixed point precision and the top-left fill rule, several pixels at a time with SIMD.
+*/
+
+// Size of a tile in pixels, it has to be a multiple of the SIMD width.
+static constexpr int TILE_SIZE = 64;
+// Vertices are snapped to 1/16 of a pixel, the same precision most GPUs use.
+static constexpr int SUBPIXEL_BITS = 4;
+static constexpr int SUBPIXEL_ONE = 1 << SUBPIXEL_BITS;
+// Triangles with any vertex farther than this from the screen are dropped since there is no clipper. This limit makes sure
+// the edge functions never overflow 32 bits integer inside a tile.
+static constexpr float GUARD_BAND = 8192.0f;
+// Edge function values beyond this mean the whole tile is on the same side of the edge.
+static constexpr long long EDGE_CLAMP = 1ll << 30;
+
+// The clear color, same with the other graphics APIs, { 0.4f, 0.6f, 1.0f, 1.0f }.
+static constexpr unsigned int CLEAR_COLOR = 0xffff9966;
+
+/*
+ * Everything needed to rasterize a triangle, this is done once per triangle before binning.
+ * The edge function k is the one opposite to vertex k, dividing it by the area results in the barycentric coordinate of vertex k.
+ */
+struct TriangleSetup {
+    int         min_x, min_y, max_x, max_y;     // bounding box in pixels, inclusive, already clamped to the screen
+    int         step_x[3], step_y[3];           // edge function increment for one pixel in x and y
+    long long   origin[3];                      // edge function value at the center of pixel (0, 0)
+    float       inv_area;                       // 1.0 / ( twice the area of the triangle )
+    float       color[3][3];                    // color of the three vertices, [vertex][channel]
+};
+
+// The frame buffer, its size is always padded to whole tiles so that SIMD never writes out of bound.
+static std::vector<unsigned int>                g_framebuffer;
+// Size of the frame buffer.
+static unsigned int                             g_width = 0;
+static unsigned int                             g_height = 0;
+// Number of pixels between two rows in the frame buffer.
+static unsigned int                             g_pitch = 0;
+// Number of tiles in each direction.
+static unsigned int                             g_tile_cnt_x = 0;
+static unsigned int                             g_tile_cnt_y = 0;
+// The thread pool to setup and rasterize triangles.
+static std::unique_ptr<ThreadPool>              g_thread_pool;
+// Number of threads requested, 0 means one per hardware thread.
+static unsigned int                             g_requested_thread_cnt = 0;
+// Triangles of the current frame after setup.
+static std::vector<TriangleSetup>               g_setups;
+// Bins of triangles, triangles are split into contiguous chunks, one chunk for each thread slot. Each chunk has its own bins so that
+// binning needs no synchronization, while rasterizing a tile walks the chunks in order, which keeps the submission order.
+// Index of a bin is 'chunk * tile count + tile'.
+static std::vector<std::vector<unsigned int>>   g_bins;
+// Number of times to draw the triangles each frame.
+static unsigned int                             g_draw_cnt = 1;
+// The mesh drawn by the rasterizer, it is mapped from a mesh file or the built-in triangle if there is no file.
+static Mesh                                     g_mesh;
+static std::string                              g_mesh_filename;
+// Whether the mesh is optimized when it is loaded, along with its efficiency before and after.
+static bool                                     g_mesh_optimization = false;
+static MeshOptimizationStats                    g_mesh_optimization_stats;
+// Statistics since initialization.
+static RasterizerStats                          g_stats;
+#if PLATFORM_WIN
+// The window to present to.
+static HWND                                     g_hwnd = nullptr;
+// The frame buffer swizzled to what GDI expects.
+static std::vector<unsigned int>                g_present_buffer;
+#endif
+
+
+/*
+ * A thin wrapper of the SIMD instructions the rasterizer needs, so that the rasterizing loop is written only once.
+ * AVX2 processes eight pixels at a time, SSE2 four pixels, there is a scalar fallback for everything else.
+ */
+#if defined(__AVX2__)
+struct Simd {
+    static constexpr int WIDTH = 8;
+    typedef __m256i VInt;
+    typedef __m256  VFloat;
+
+    static inline VInt      set1(const int v) { return _mm256_set1_epi32(v); }
+    static inline VInt      lanes(const int v, const int step) { return _mm256_add_epi32(_mm256_set1_epi32(v), _mm256_mullo_epi32(_mm256_set1_epi32(step), _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7))); }
+    static inline VInt      add(const VInt a, const VInt b) { return _mm256_add_epi32(a, b); }
+    static inline VInt      negative(const VInt a, const VInt b, const VInt c) { return _mm256_srai_epi32(_mm256_or_si256(_mm256_or_si256(a, b), c), 31); }
+    static inline int       mask(const VInt v) { return _mm256_movemask_ps(_mm256_castsi256_ps(v)); }
+    static inline VFloat    to_float(const VInt v) { return _mm256_cvtepi32_ps(v); }
+    static inline VFloat    set1f(const float v) { return _mm256_set1_ps(v); }
+    static inline VFloat    mad(const VFloat a, const VFloat b, const VFloat c) { return _mm256_add_ps(_mm256_mul_ps(a, b), c); }
+    static inline VFloat    mul(const VFloat a, const VFloat b) { return _mm256_mul_ps(a, b); }
+    static inline VInt      to_byte(const VFloat v) { return _mm256_cvtps_epi32(_mm256_min_ps(_mm256_max_ps(v, _mm256_setzero_ps()), _mm256_set1_ps(255.0f))); }
+    static inline VInt      pack(const VInt r, const VInt g, const VInt b) { return _mm256_or_si256(_mm256_or_si256(r, _mm256_slli_epi32(g, 8)), _mm256_or_si256(_mm256_slli_epi32(b, 16), _mm256_set1_epi32((int)0xff000000))); }
+    static inline void      store(unsigned int* dst, const VInt color, const VInt outside) {
+        const auto old = _mm256_loadu_si256((const __m256i*)dst);
+        _mm256_storeu_si256((__m256i*)dst, _mm256_or_si256(_mm256_andnot_si256(outside, color), _mm256_and_si256(outside, old)));
+    }
+};
+#elif defined(__SSE2__) || defined(_M_X64)
+struct Simd {
+    static constexpr int WIDTH = 4;
+    typedef __m128i VInt;
+    typedef __m128  VFloat;
+
+    static inline VInt      set1(const int v) { return _mm_set1_epi32(v); }
+    static inline VInt      lanes(const int v, const int step) { return _mm_setr_epi32(v, v + step, v + 2 * step, v + 3 * step); }
+    static inline VInt      add(const VInt a, const VInt b) { return _mm_add_epi32(a, b); }
+    static inline VInt      negative(const VInt a, const VInt b, const VInt c) { return _mm_srai_epi32(_mm_or_si128(_mm_or_si128(a, b), c), 31); }
+    static inline int       mask(const VInt v) { return _mm_movemask_ps(_mm_castsi128_ps(v)); }
+    static inline VFloat    to_float(const VInt v) { return _mm_cvtepi32_ps(v); }
+    static inline VFloat    set1f(const float v) { return _mm_set1_ps(v); }
+    static inline VFloat    mad(const VFloat a, const VFloat b, const VFloat c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static inline VFloat    mul(const VFloat a, const VFloat b) { return _mm_mul_ps(a, b); }
+    static inline VInt      to_byte(const VFloat v) { return _mm_cvtps_epi32(_mm_min_ps(_mm_max_ps(v, _mm_setzero_ps()), _mm_set1_ps(255.0f))); }
+    static inline VInt      pack(const VInt r, const VInt g, const VInt b) { return _mm_or_si128(_mm_or_si128(r, _mm_slli_epi32(g, 8)), _mm_or_si128(_mm_slli_epi32(b, 16), _mm_set1_epi32((int)0xff000000))); }
+    static inline void      store(unsigned int* dst, const VInt color, const VInt outside) {
+        const auto old = _mm_loadu_si128((const __m128i*)dst);
+        _mm_storeu_si128((__m128i*)dst, _mm_or_si128(_mm_andnot_si128(outside, color), _mm_and_si128(outside, old)));
+    }
+};
+#else
+struct Simd {
+    static constexpr int WIDTH = 1;
+    typedef int             VInt;
+    typedef float           VFloat;
+
+    static inline VInt      set1(const int v) { return v; }
+    static inline VInt      lanes(const int v, const int step) { return v; }
+    static inline VInt      add(const VInt a, const VInt b) { return a + b; }
+    static inline VInt      negative(const VInt a, const VInt b, const VInt c) { return (a | b | c) < 0 ? -1 : 0; }
+    static inline int       mask(const VInt v) { return v & 1; }
+    static inline VFloat    to_float(const VInt v) { return (float)v; }
+    static inline VFloat    set1f(const float v) { return v; }
+    static inline VFloat    mad(const VFloat a, const VFloat b, const VFloat c) { return a * b + c; }
+    static inline VFloat    mul(const VFloat a, const VFloat b) { return a * b; }
+    static inline VInt      to_byte(const VFloat v) { return (int)(std::min(std::max(v, 0.0f), 255.0f) + 0.5f); }
+    static inline VInt      pack(const VInt r, const VInt g, const VInt b) { return (int)((unsigned int)r | ((unsigned int)g << 8) | ((unsigned int)b << 16) | 0xff000000u); }
+    static inline void      store(unsigned int* dst, const VInt color, const VInt outside) {
+        if (!outside)
+            *dst = (unsigned int)color;
+    }
+};
+#endif
+
+static_assert(TILE_SIZE % Simd::WIDTH == 0, "Tile size has to be a multiple of SIMD width.");
+
+// Lanes of a SIMD mask that are all set.
+static constexpr int FULL_MASK = (1 << Simd::WIDTH) - 1;
+
+/*
+ * Count the number of bits set in a SIMD mask.
+ */
+static inline int count_bits(unsigned int v) {
+    int cnt = 0;
+    for (; v; v &= v - 1)
+        ++cnt;
+    return cnt;
+}
+
+
+/*
+ * Convert the vertices of a triangle to screen space and get it ready for rasterization.
+ * Returns false if the triangle is not visible at all.
+ */
+static bool setup_triangle(const Vertex& v0, const Vertex& v1, const Vertex& v2, TriangleSetup& setup) {
+    const Vertex* vertices[3] = { &v0, &v1, &v2 };
+
+    // snap the vertices to fixed point screen coordinates, y is flipped since the frame buffer goes from top to bottom
+    long long x[3], y[3];
+    for (int i = 0; i < 3; ++i) {
+        const auto sx = (vertices[i]->position.x + 1.0f) * 0.5f * g_width;
+        const auto sy = (1.0f - vertices[i]->position.y) * 0.5f * g_height;
+        if (fabsf(sx) > GUARD_BAND || fabsf(sy) > GUARD_BAND)
+            return false;
+        x[i] = (long long)lrintf(sx * SUBPIXEL_ONE);
+        y[i] = (long long)lrintf(sy * SUBPIXEL_ONE);
+    }
+
+    // twice the signed area, there is no culling, counter-clockwise triangles are flipped
+    auto area = (x[1] - x[0]) * (y[2] - y[0]) - (y[1] - y[0]) * (x[2] - x[0]);
+    if (area == 0)
+        return false;
+    int order[3] = { 0, 1, 2 };
+    if (area < 0) {
+        std::swap(order[1], order[2]);
+        area = -area;
+    }
+
+    // bounding box clamped to the screen
+    const auto min_fx = std::min(x[0], std::min(x[1], x[2]));
+    const auto min_fy = std::min(y[0], std::min(y[1], y[2]));
+    const auto max_fx = std::max(x[0], std::max(x[1], x[2]));
+    const auto max_fy = std::max(y[0], std::max(y[1], y[2]));
+    setup.min_x = std::max(0, (int)(min_fx >> SUBPIXEL_BITS));
+    setup.min_y = std::max(0, (int)(min_fy >> SUBPIXEL_BITS));
+    setup.max_x = std::min((int)g_width - 1, (int)((max_fx + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS));
+    setup.max_y = std::min((int)g_height - 1, (int)((max_fy + SUBPIXEL_ONE - 1) >> SUBPIXEL_BITS));
+    if (setup.min_x > setup.max_x || setup.min_y > setup.max_y)
+        return false;
+
+    for (int k = 0; k < 3; ++k) {
+        // edge k goes from vertex a to vertex b, it is the edge opposite to vertex k
+        const auto a = order[(k + 1) % 3];
+        const auto b = order[(k + 2) % 3];
+        const auto dx = x[b] - x[a];
+        const auto dy = y[b] - y[a];
+
+        // E(p) = dx * (p.y - a.y) - dy * (p.x - a.x), it is positive inside the triangle
+        const auto coef_x = -dy;
+        const auto coef_y = dx;
+        auto c = dy * x[a] - dx * y[a];
+
+        // Top-left fill rule, pixels exactly on an edge that is neither a top edge nor a left edge don't belong to this triangle.
+        // Subtracting one from the edge function makes '>= 0' behave like '> 0' for these edges.
+        const auto top_left = (dy < 0) || (dy == 0 && dx > 0);
+        if (!top_left)
+            c -= 1;
+
+        // the edge function at the center of pixel (0, 0)
+        setup.origin[k] = c + (coef_x + coef_y) * (SUBPIXEL_ONE / 2);
+        setup.step_x[k] = (int)(coef_x * SUBPIXEL_ONE);
+        setup.step_y[k] = (int)(coef_y * SUBPIXEL_ONE);
+    }
+
+    setup.inv_area = 1.0f / (float)area;
+    for (int k = 0; k < 3; ++k) {
+        const auto color = vertices[order[k]]->color;
+        setup.color[k][0] = (float)(color & 0xff);
+        setup.color[k][1] = (float)((color >> 8) & 0xff);
+        setup.color[k][2] = (float)((color >> 16) & 0xff);
+    }
+
+    return true;
+}
+
+
+/*
+ * Evaluate an edge function at a pixel and clamp it to 32 bits. The clamped value is still on the same side of the edge for the
+ * whole tile since no edge function changes more than EDGE_CLAMP across a tile.
+ */
+static inline int evaluate_edge(const TriangleSetup& setup, const int k, const int x, const int y) {
+    const auto e = setup.origin[k] + (long long)setup.step_x[k] * x + (long long)setup.step_y[k] * y;
+    return (int)std::max(-EDGE_CLAMP, std::min(EDGE_CLAMP, e));
+}
+
+
+/*
+ * Bin a triangle into all the tiles it may touch.
+ */
+static void bin_triangle(const TriangleSetup& setup, const unsigned int triangle_index, std::vector<unsigned int>* bins) {
+    const int tile_x0 = setup.min_x / TILE_SIZE, tile_x1 = setup.max_x / TILE_SIZE;
+    const int tile_y0 = setup.min_y / TILE_SIZE, tile_y1 = setup.max_y / TILE_SIZE;
+
+    for (int ty = tile_y0; ty <= tile_y1; ++ty) {
+        for (int tx = tile_x0; tx <= tile_x1; ++tx) {
+            // Trivial reject, if the corner of the tile that is most inside an edge is still outside of it, so is the whole tile.
+            bool outside = false;
+            for (int k = 0; k < 3 && !outside; ++k) {
+                const auto x = tx * TILE_SIZE + (setup.step_x[k] > 0 ? TILE_SIZE - 1 : 0);
+                const auto y = ty * TILE_SIZE + (setup.step_y[k] > 0 ? TILE_SIZE - 1 : 0);
+                outside = evaluate_edge(setup, k, x, y) < 0;
+            }
+
+            if (!outside)
+                bins[ty * g_tile_cnt_x + tx].push_back(triangle_index);
+        }
+    }
+}
+
+
+/*
+ * Rasterize a triangle inside a tile, returns the number of pixels covered.
+ */
+static unsigned long long rasterize_triangle(const TriangleSetup& setup, const int tile_x, const int tile_y) {
+    // the part of the bounding box inside this tile, x is aligned to SIMD width, coverage test takes care of the extra pixels
+    const auto x0 = std::max(tile_x, setup.min_x) & ~(Simd::WIDTH - 1);
+    const auto x1 = std::min(tile_x + TILE_SIZE - 1, setup.max_x);
+    const auto y0 = std::max(tile_y, setup.min_y);
+    const auto y1 = std::min(tile_y + TILE_SIZE - 1, setup.max_y);
+
+    const auto inv_area = Simd::set1f(setup.inv_area);
+    const Simd::VInt group_step[3] = { Simd::set1(setup.step_x[0] * Simd::WIDTH), Simd::set1(setup.step_x[1] * Simd::WIDTH), Simd::set1(setup.step_x[2] * Simd::WIDTH) };
+
+    // Colors are interpolated as c0 + (c1 - c0) * b1 + (c2 - c0) * b2, which only takes two barycentric coordinates.
+    Simd::VFloat base[3], delta1[3], delta2[3];
+    for (int c = 0; c < 3; ++c) {
+        base[c] = Simd::set1f(setup.color[0][c]);
+        delta1[c] = Simd::set1f(setup.color[1][c] - setup.color[0][c]);
+        delta2[c] = Simd::set1f(setup.color[2][c] - setup.color[0][c]);
+    }
+
+    unsigned long long covered = 0;
+    for (int y = y0; y <= y1; ++y) {
+        Simd::VInt e[3];
+        for (int k = 0; k < 3; ++k)
+            e[k] = Simd::lanes(evaluate_edge(setup, k, x0, y), setup.step_x[k]);
+
+        auto dst = g_framebuffer.data() + (size_t)y * g_pitch + x0;
+        for (int x = x0; x <= x1; x += Simd::WIDTH, dst += Simd::WIDTH) {
+            // a pixel is outside if any of the edge functions is negative
+            const auto outside = Simd::negative(e[0], e[1], e[2]);
+            const auto outside_mask = Simd::mask(outside);
+
+            if (outside_mask != FULL_MASK) {
+                covered += Simd::WIDTH - count_bits((unsigned int)outside_mask);
+
+                const auto b1 = Simd::mul(Simd::to_float(e[1]), inv_area);
+                const auto b2 = Simd::mul(Simd::to_float(e[2]), inv_area);
+                const auto r = Simd::to_byte(Simd::mad(delta2[0], b2, Simd::mad(delta1[0], b1, base[0])));
+                const auto g = Simd::to_byte(Simd::mad(delta2[1], b2, Simd::mad(delta1[1], b1, base[1])));
+                const auto b = Simd::to_byte(Simd::mad(delta2[2], b2, Simd::mad(delta1[2], b1, base[2])));
+                Simd::store(dst, Simd::pack(r, g, b), outside);
+            }
+
+            for (int k = 0; k < 3; ++k)
+                e[k] = Simd::add(e[k], group_step[k]);
+        }
+    }
+
+    return covered;
+}
+
+
+/*
+ * Clear a tile and rasterize all triangles binned in it, returns the number of pixels covered.
+ */
+static unsigned long long rasterize_tile(const unsigned int tile) {
+    const int tile_x = (tile % g_tile_cnt_x) * TILE_SIZE;
+    const int tile_y = (tile / g_tile_cnt_x) * TILE_SIZE;
+
+    for (int y = 0; y < TILE_SIZE; ++y)
+        std::fill_n(g_framebuffer.data() + (size_t)(tile_y + y) * g_pitch + tile_x, TILE_SIZE, CLEAR_COLOR);
+
+    unsigned long long covered = 0;
+    const auto tile_cnt = g_tile_cnt_x * g_tile_cnt_y;
+    for (unsigned int chunk = 0; chunk < g_thread_pool->slot_count(); ++chunk) {
+        for (const auto triangle : g_bins[chunk * tile_cnt + tile])
+            covered += rasterize_triangle(g_setups[triangle], tile_x, tile_y);
+    }
+
+    return covered;
+}
+
+
+/*
+ * Allocate the frame buffer and the bins, create the threads.
+ */
+static bool create_rasterizer(const unsigned int width, const unsigned int height) {
+    if (width == 0 || height == 0)
+        return false;
+
+    if (!load_sample_mesh(g_mesh, g_mesh_filename.c_str(), g_mesh_optimization, false, g_mesh_optimization_stats))
+        return false;
+
+    g_width = width;
+    g_height = height;
+    g_tile_cnt_x = (width + TILE_SIZE - 1) / TILE_SIZE;
+    g_tile_cnt_y = (height + TILE_SIZE - 1) / TILE_SIZE;
+    g_pitch = g_tile_cnt_x * TILE_SIZE;
+    g_framebuffer.assign((size_t)g_pitch * g_tile_cnt_y * TILE_SIZE, CLEAR_COLOR);
+
+    // the calling thread is also rasterizing, so one less worker thread is needed
+    auto thread_cnt = g_requested_thread_cnt ? g_requested_thread_cnt : std::thread::hardware_concurrency();
+    thread_cnt = std::max(thread_cnt, 1u);
+    g_thread_pool = std::make_unique<ThreadPool>(thread_cnt - 1);
+
+    g_bins.clear();
+    g_bins.resize((size_t)g_thread_pool->slot_count() * g_tile_cnt_x * g_tile_cnt_y);
+
+    g_stats = RasterizerStats();
+
+    return true;
+}
+
+
+SoftwareGraphicsSample::SoftwareGraphicsSample(const unsigned int thread_cnt) {
+    g_requested_thread_cnt = thread_cnt;
+}
+
+#if PLATFORM_WIN
+/*
+ * Initialize the software rasterizer, the frame buffer is as large as the client area of the window.
+ */
+bool SoftwareGraphicsSample::initialize(const HINSTANCE hInstnace, const HWND hwnd) {
+    PROFILE_ZONE(m_profiler, "initialize");
+
+    ::RECT rect;
+    ::GetClientRect(hwnd, &rect);
+
+    if (!create_rasterizer(rect.right - rect.left, rect.bottom - rect.top))
+        return false;
+
+    g_hwnd = hwnd;
+    g_present_buffer.resize(g_framebuffer.size());
+
+    return true;
+}
+#endif
+
+/*
+ * Initialize the software rasterizer without a window.
+ */
+bool SoftwareGraphicsSample::initialize(const unsigned int width, const unsigned int height) {
+    PROFILE_ZONE(m_profiler, "initialize");
+    return create_rasterizer(width, height);
+}
+
+/*
+ * Render a frame.
+ * There are two phases, setup and binning is done in parallel on contiguous chunks of triangles. Once it is done, each tile
+ * is rasterized by exactly one thread.
+ */
+void SoftwareGraphicsSample::render_frame() {
+    m_profiler.begin_frame();
+
+    const auto vertices = g_mesh.get_vertices();
+    const auto base_triangle_cnt = g_mesh.get_index_count() / 3;
+    const auto triangle_cnt = base_triangle_cnt * g_draw_cnt;
+    const auto tile_cnt = g_tile_cnt_x * g_tile_cnt_y;
+    const auto chunk_cnt = g_thread_pool->slot_count();
+
+    g_setups.resize(triangle_cnt);
+
+    // setup and bin triangles
+    g_thread_pool->parallel_for(chunk_cnt, [&](const unsigned int chunk, const unsigned int slot) {
+        PROFILE_ZONE(m_profiler, "setup");
+
+        auto bins = g_bins.data() + (size_t)chunk * tile_cnt;
+        for (unsigned int i = 0; i < tile_cnt; ++i)
+            bins[i].clear();
+
+        const auto begin = (unsigned int)((unsigned long long)triangle_cnt * chunk / chunk_cnt);
+        const auto end = (unsigned int)((unsigned long long)triangle_cnt * (chunk + 1) / chunk_cnt);
+        for (auto i = begin; i < end; ++i) {
+            const auto triangle = (i % base_triangle_cnt) * 3;
+            if (setup_triangle(vertices[g_mesh.get_index(triangle)], vertices[g_mesh.get_index(triangle + 1)], vertices[g_mesh.get_index(triangle + 2)], g_setups[i]))
+                bin_triangle(g_setups[i], i, bins);
+        }
+    });
+
+    // rasterize tiles
+    std::atomic<unsigned long long> covered(0);
+    {
+        PROFILE_ZONE(m_profiler, "rasterize");
+        g_thread_pool->parallel_for(tile_cnt, [&](const unsigned int tile, const unsigned int slot) {
+            covered += rasterize_tile(tile);
+        });
+    }
+
+    ++g_stats.frames;
+    g_stats.triangles += triangle_cnt;
+    g_stats.pixels += covered;
+
+#if PLATFORM_WIN
+    // GDI expects BGRA, while the frame buffer is in RGBA
+    if (g_hwnd) {
+        PROFILE_ZONE(m_profiler, "present");
+
+        for (size_t i = 0; i < g_framebuffer.size(); ++i) {
+            const auto c = g_framebuffer[i];
+            g_present_buffer[i] = (c & 0xff00ff00) | ((c & 0xff) << 16) | ((c >> 16) & 0xff);
+        }
+
+        BITMAPINFO info;
+        memset(&info, 0, sizeof(info));
+        info.bmiHeader.biSize = sizeof(BITMAPINFOHEADER);
+        info.bmiHeader.biWidth = g_pitch;
+        info.bmiHeader.biHeight = -(LONG)(g_tile_cnt_y * TILE_SIZE);
+        info.bmiHeader.biPlanes = 1;
+        info.bmiHeader.biBitCount = 32;
+        info.bmiHeader.biCompression = BI_RGB;
+
+        auto dc = ::GetDC(g_hwnd);
+        ::SetDIBitsToDevice(dc, 0, 0, g_width, g_height, 0, 0, 0, g_tile_cnt_y * TILE_SIZE, g_present_buffer.data(), &info, DIB_RGB_COLORS);
+        ::ReleaseDC(g_hwnd, dc);
+    }
+#endif
+}
+
+/*
+ * Shutdown the software rasterizer.
+ */
+void SoftwareGraphicsSample::shutdown() {
+    g_thread_pool = nullptr;
+    g_bins.clear();
+    g_setups.clear();
+    g_framebuffer.clear();
+    g_mesh.release();
+#if PLATFORM_WIN
+    g_present_buffer.clear();
+    g_hwnd = nullptr;
+#endif
+}
+
+void SoftwareGraphicsSample::set_draw_count(const unsigned int draw_cnt) {
+    g_draw_cnt = std::max(draw_cnt, 1u);
+}
+
+void SoftwareGraphicsSample::set_mesh(const char* filename) {
+    g_mesh_filename = filename ? filename : "";
+}
+
+void SoftwareGraphicsSample::set_mesh_optimization(const bool optimize) {
+    g_mesh_optimization = optimize;
+}
+
+bool SoftwareGraphicsSample::get_mesh_optimization_stats(MeshOptimizationStats& stats) const {
+    stats = g_mesh_optimization_stats;
+    return g_mesh_optimization;
+}
+
+unsigned int SoftwareGraphicsSample::thread_count() const {
+    return g_thread_pool ? g_thread_pool->slot_count() : 0;
+}
+
+const RasterizerStats& SoftwareGraphicsSample::get_stats() const {
+    return g_stats;
+}
+
+const unsigned int* SoftwareGraphicsSample::get_framebuffer() const {
+    return g_framebuffer.data();
+}
+
+unsigned int SoftwareGraphicsSample::get_framebuffer_pitch() const {
+    return g_pitch;
+}
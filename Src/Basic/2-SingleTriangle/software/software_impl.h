@@ -0,0 +1,83 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include "../sample.h"
+
+/*
+ * Statistics of the software rasterizer, everything is accumulated since initialization.
+ */
+struct RasterizerStats {
+    unsigned long long  frames = 0;         // number of frames rendered
+    unsigned long long  triangles = 0;      // number of triangles submitted
+    unsigned long long  pixels = 0;         // number of pixels covered by triangles, overdraw is counted too
+};
+
+class SoftwareGraphicsSample : public GraphicsSample {
+public:
+    /*
+     * Number of threads to rasterize tiles, 0 means one thread for each hardware thread.
+     */
+    explicit SoftwareGraphicsSample(const unsigned int thread_cnt = 0);
+
+#if PLATFORM_WIN
+    /*
+     * Initialize the rasterizer, the framebuffer is blitted to the window every frame.
+     */
+    bool initialize(const HINSTANCE hInstnace, const HWND hwnd) override;
+#endif
+
+    /*
+     * Initialize the rasterizer without a window, nothing leaves the framebuffer in memory.
+     */
+    bool initialize(const unsigned int width, const unsigned int height) override;
+
+    /*
+     * Render a frame.
+     */
+    void render_frame() override;
+
+    /*
+     * Shutdown the rasterizer.
+     */
+    void shutdown() override;
+
+    /*
+     * Number of times the triangles are drawn in each frame, this is purely for stress testing.
+     */
+    void set_draw_count(const unsigned int draw_cnt) override;
+
+    /*
+     * Mesh file to rasterize, it has to be set before initialization.
+     */
+    void set_mesh(const char* filename) override;
+
+    /*
+     * Optimize the mesh when it is loaded, it has to be set before initialization.
+     */
+    void set_mesh_optimization(const bool optimize) override;
+
+    /*
+     * Cache efficiency of the mesh before and after optimization.
+     */
+    bool get_mesh_optimization_stats(MeshOptimizationStats& stats) const override;
+
+    /*
+     * Number of threads rasterizing tiles, including the calling thread.
+     */
+    unsigned int thread_count() const;
+
+    /*
+     * Statistics accumulated so far.
+     */
+    const RasterizerStats& get_stats() const;
+
+    /*
+     * The RGBA8 framebuffer, each row is 'get_framebuffer_pitch' pixels apart.
+     */
+    const unsigned int* get_framebuffer() const;
+    unsigned int get_framebuffer_pitch() const;
+};
@@ -0,0 +1,66 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#version 450
+#extension GL_EXT_mesh_shader : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "meshlet_cull.glsl"
+
+// A workgroup outputs a meshlet, the limits are 'MESHLET_MAX_VERTICES' and 'MESHLET_MAX_TRIANGLES' in common/meshlet.h.
+layout (local_size_x = 32) in;
+layout (triangles, max_vertices = 64, max_primitives = 124) out;
+
+// The layout of 'Vertex' in common/common.h, vertices are always full precision on this path.
+struct Vertex {
+    float x, y, z;
+    uint color;
+};
+
+layout (std430, set = 0, binding = 0) readonly buffer Vertices {
+    Vertex vertices[];
+};
+
+layout (std430, set = 0, binding = 3) readonly buffer MeshletVertices {
+    uint meshlet_vertices[];
+};
+
+// three bytes for each triangle, packed without padding
+layout (std430, set = 0, binding = 4) readonly buffer MeshletTriangles {
+    uint meshlet_triangles[];
+};
+
+struct MeshletPayload {
+    uint meshlets[32];
+};
+taskPayloadSharedEXT MeshletPayload payload;
+
+layout (location = 0) out vec4 outColor[];
+
+uint read_triangle_byte(uint offset) {
+    return (meshlet_triangles[offset >> 2] >> ((offset & 3) * 8)) & 0xffu;
+}
+
+void main() {
+    uvec4 meshlet = meshlets[payload.meshlets[gl_WorkGroupID.x]];
+    SetMeshOutputsEXT(meshlet.z, meshlet.w);
+
+    // the same transform as the vertex shader
+    uint constant = push.constant_base + push.draw * push.constant_stride;
+    vec3 scale = constants[constant].xyz;
+    vec3 offset = constants[constant + 1].xyz;
+
+    for (uint i = gl_LocalInvocationIndex; i < meshlet.z; i += 32u) {
+        Vertex vertex = vertices[push.base_vertex + meshlet_vertices[meshlet.x + i]];
+        vec3 position = vec3(vertex.x, vertex.y, vertex.z) * scale + offset;
+        gl_MeshVerticesEXT[i].gl_Position = vec4(position.x, -position.y, position.z, 1.0f);
+        outColor[i] = unpackUnorm4x8(vertex.color);
+    }
+
+    for (uint i = gl_LocalInvocationIndex; i < meshlet.w; i += 32u) {
+        uint triangle = meshlet.y + i * 3;
+        gl_PrimitiveTriangleIndicesEXT[i] = uvec3(read_triangle_byte(triangle), read_triangle_byte(triangle + 1), read_triangle_byte(triangle + 2));
+    }
+}
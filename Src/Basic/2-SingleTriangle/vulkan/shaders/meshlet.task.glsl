@@ -0,0 +1,40 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#version 450
+#extension GL_EXT_mesh_shader : require
+#extension GL_GOOGLE_include_directive : require
+
+#include "meshlet_cull.glsl"
+
+// Each thread culls a meshlet, the visible ones are compacted into the payload and each of them gets a mesh shader workgroup.
+layout (local_size_x = 32) in;
+
+struct MeshletPayload {
+    uint meshlets[32];
+};
+taskPayloadSharedEXT MeshletPayload payload;
+
+shared uint visible_cnt;
+
+void main() {
+    if (gl_LocalInvocationIndex == 0)
+        visible_cnt = 0;
+    barrier();
+
+    uint meshlet = gl_GlobalInvocationID.x;
+    if (meshlet < push.meshlet_cnt && is_meshlet_visible(meshlet, push.draw)) {
+        uint slot = atomicAdd(visible_cnt, 1u);
+        payload.meshlets[slot] = meshlet;
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0) {
+        atomicAdd(counters[push.counter_base], min(32u, push.meshlet_cnt - gl_WorkGroupID.x * 32u));
+        atomicAdd(counters[push.counter_base + 1], visible_cnt);
+    }
+
+    EmitMeshTasksEXT(visible_cnt, 1, 1);
+}
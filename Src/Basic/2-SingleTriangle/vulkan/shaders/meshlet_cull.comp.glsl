@@ -0,0 +1,63 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#version 450
+#extension GL_GOOGLE_include_directive : require
+
+#include "meshlet_cull.glsl"
+
+// The fallback of the task shader on devices without mesh shaders. Each thread culls a meshlet for a draw, the draw is the
+// y of the workgroup, and writes an indexed indirect draw of its triangles, the draw has no instance at all if it is culled.
+layout (local_size_x = 64) in;
+
+// 'VkDrawIndexedIndirectCommand'
+struct DrawIndexedIndirectCommand {
+    uint index_cnt;
+    uint instance_cnt;
+    uint first_index;
+    int  vertex_offset;
+    uint first_instance;
+};
+
+layout (std430, set = 0, binding = 7) writeonly buffer Commands {
+    DrawIndexedIndirectCommand commands[];
+};
+
+shared uint tested_cnt;
+shared uint visible_cnt;
+
+void main() {
+    if (gl_LocalInvocationIndex == 0) {
+        tested_cnt = 0;
+        visible_cnt = 0;
+    }
+    barrier();
+
+    uint meshlet = gl_GlobalInvocationID.x;
+    uint draw = push.draw + gl_WorkGroupID.y;
+    if (meshlet < push.meshlet_cnt) {
+        bool visible = is_meshlet_visible(meshlet, draw);
+        uvec4 data = meshlets[meshlet];
+
+        // triangles of meshlets are expanded into the index buffer in the same order, so the offset is the first index
+        DrawIndexedIndirectCommand command;
+        command.index_cnt = data.w * 3;
+        command.instance_cnt = visible ? 1u : 0u;
+        command.first_index = data.y;
+        command.vertex_offset = int(push.base_vertex);
+        command.first_instance = 0;
+        commands[draw * push.meshlet_cnt + meshlet] = command;
+
+        atomicAdd(tested_cnt, 1u);
+        if (visible)
+            atomicAdd(visible_cnt, 1u);
+    }
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0) {
+        atomicAdd(counters[push.counter_base], tested_cnt);
+        atomicAdd(counters[push.counter_base + 1], visible_cnt);
+    }
+}
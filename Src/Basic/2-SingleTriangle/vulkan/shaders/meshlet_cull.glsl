@@ -0,0 +1,59 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+// Everything the meshlet shaders share, it is included by the task, the mesh and the culling compute shader.
+// Layouts follow 'Meshlet' and 'MeshletBounds' in common/meshlet.h.
+
+// vertex_offset, triangle_offset, vertex_cnt, triangle_cnt
+layout (std430, set = 0, binding = 1) readonly buffer Meshlets {
+    uvec4 meshlets[];
+};
+
+struct MeshletBounds {
+    vec4 sphere;        // center and radius
+    vec4 cone;          // axis and cutoff
+};
+
+layout (std430, set = 0, binding = 2) readonly buffer Bounds {
+    MeshletBounds bounds[];
+};
+
+// Per-draw constants of the frame, scale and offset of each draw, they are 'constant_stride' vec4s apart.
+layout (std430, set = 0, binding = 5) readonly buffer Constants {
+    vec4 constants[];
+};
+
+// Counters of the frame, the number of meshlets tested and the number of visible ones, read back on CPU.
+layout (std430, set = 0, binding = 6) buffer Counters {
+    uint counters[];
+};
+
+layout (push_constant) uniform MeshletConstants {
+    uint draw;                  // the draw, or the first draw of a culling dispatch
+    uint meshlet_cnt;
+    uint constant_base;         // in vec4s
+    uint constant_stride;       // in vec4s
+    uint counter_base;          // in uints
+    uint base_vertex;           // where the mesh is in the geometry pool
+} push;
+
+// Positions are only scaled and moved, the view direction is +z everywhere. Scales are positive, they keep the facing of
+// triangles, so the normal cone is tested as it is.
+bool is_meshlet_visible(uint meshlet, uint draw) {
+    MeshletBounds meshlet_bounds = bounds[meshlet];
+
+    // all triangles face away from the viewer
+    if (meshlet_bounds.cone.z <= -meshlet_bounds.cone.w)
+        return false;
+
+    uint constant = push.constant_base + draw * push.constant_stride;
+    vec3 scale = constants[constant].xyz;
+    vec3 offset = constants[constant + 1].xyz;
+    vec3 center = meshlet_bounds.sphere.xyz * scale + offset;
+    float radius = meshlet_bounds.sphere.w * max(abs(scale.x), max(abs(scale.y), abs(scale.z)));
+
+    // clip space is [-1, 1] in x and y, [0, 1] in z, flipping y doesn't change anything
+    return all(greaterThanEqual(center + radius, vec3(-1.0f, -1.0f, 0.0f))) && all(lessThanEqual(center - radius, vec3(1.0f)));
+}
@@ -0,0 +1,90 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#version 450
+
+// Each thread culls an object against the frustum and writes an indexed indirect draw of the whole mesh for it, the object
+// is the first instance of the draw. Visible draws are either compacted at the front of the draws, the count is what the
+// indirect count draw reads, or each object writes its own draw with no instance at all if it is culled.
+layout (local_size_x = 64) in;
+
+// 'VkDrawIndexedIndirectCommand'
+struct DrawIndexedIndirectCommand {
+    uint index_cnt;
+    uint instance_cnt;
+    uint first_index;
+    int  vertex_offset;
+    uint first_instance;
+};
+
+// 'InstanceData' in common/common.h, seven 32 bits words each. It is read as words since a vec3 is 16 bytes aligned in std430.
+layout (std430, set = 0, binding = 0) readonly buffer Objects {
+    float objects[];
+};
+
+layout (std430, set = 0, binding = 1) writeonly buffer Commands {
+    DrawIndexedIndirectCommand commands[];
+};
+
+// The transient memory of the frame, the counter of visible objects is in it.
+layout (std430, set = 0, binding = 2) buffer Counters {
+    uint counters[];
+};
+
+// 'GpuCullingConstants' in common/gpu_culling.h
+layout (push_constant) uniform CullConstants {
+    vec4 sphere;
+    uint first;
+    uint object_cnt;
+    uint index_cnt;
+    uint first_index;           // where the mesh is in the geometry pool
+    int  base_vertex;
+    uint compact;
+    uint counter;
+} push;
+
+shared uint group_visible_cnt;
+shared uint group_first_draw;
+
+void main() {
+    if (gl_LocalInvocationIndex == 0)
+        group_visible_cnt = 0;
+    barrier();
+
+    uint object = push.first + gl_GlobalInvocationID.x;
+    bool valid = object < push.object_cnt;
+    bool visible = false;
+    if (valid) {
+        uint base = object * 7;
+        vec3 scale = vec3(objects[base], objects[base + 1], objects[base + 2]);
+        vec3 offset = vec3(objects[base + 3], objects[base + 4], objects[base + 5]);
+        vec3 center = push.sphere.xyz * scale + offset;
+        float radius = push.sphere.w * max(abs(scale.x), max(abs(scale.y), abs(scale.z)));
+
+        // clip space is [-1, 1] in x and y, [0, 1] in z, flipping y doesn't change anything
+        visible = all(greaterThanEqual(center + radius, vec3(-1.0f, -1.0f, 0.0f))) && all(lessThanEqual(center - radius, vec3(1.0f)));
+    }
+
+    // visible objects of the workgroup take a contiguous range of draws, there is a single global atomic for each workgroup
+    uint slot = 0;
+    if (visible)
+        slot = atomicAdd(group_visible_cnt, 1u);
+    barrier();
+
+    if (gl_LocalInvocationIndex == 0)
+        group_first_draw = atomicAdd(counters[push.counter], group_visible_cnt);
+    barrier();
+
+    if (!valid || (push.compact != 0 && !visible))
+        return;
+
+    DrawIndexedIndirectCommand command;
+    command.index_cnt = push.index_cnt;
+    command.instance_cnt = visible ? 1u : 0u;
+    command.first_index = push.first_index;
+    command.vertex_offset = push.base_vertex;
+    command.first_instance = object;
+    commands[push.compact != 0 ? group_first_draw + slot : object] = command;
+}
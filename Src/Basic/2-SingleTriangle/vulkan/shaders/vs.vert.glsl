@@ -7,16 +7,24 @@
 #extension GL_ARB_separate_shader_objects : enable
 #extension GL_ARB_shading_language_420pack : enable
 
-// Vertex input data
+// Vertex input data, locations are the values of 'VertexSemantic' in common/vertex_layout.h
 layout (location = 0) in vec4 pos;
 layout (location = 1) in vec4 inColor;
 
+// Per-draw constants, they live in the transient memory of the frame and are bound with a dynamic offset.
+// The scale and offset also decode quantized positions, which are fetched as SNORM in [-1, 1] of the bounding box.
+layout (std140, set = 0, binding = 0) uniform DrawConstants {
+    vec4  scale;
+    vec4  offset;
+} draw;
+
 // VS vertex output
 layout (location = 0) out vec4 outColor;
 
 // Vertex shader entry
 void main() {
-    // simply pass through the vertex data
-    gl_Position = vec4(pos.x, -pos.y, pos.z, 1.0f);
+    // move the triangle into the cell of this draw
+    vec3 position = pos.xyz * draw.scale.xyz + draw.offset.xyz;
+    gl_Position = vec4(position.x, -position.y, position.z, 1.0f);
     outColor = inColor;
 }
\ No newline at end of file
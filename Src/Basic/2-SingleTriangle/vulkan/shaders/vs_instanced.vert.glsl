@@ -0,0 +1,28 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#version 400
+#extension GL_ARB_separate_shader_objects : enable
+#extension GL_ARB_shading_language_420pack : enable
+
+// Vertex input data, locations are the values of 'VertexSemantic' in common/vertex_layout.h
+layout (location = 0) in vec4 pos;
+layout (location = 1) in vec4 inColor;
+
+// Per-instance data, see 'InstanceData' in common/common.h. It replaces the per-draw constants of the regular vertex shader.
+layout (location = 4) in vec3 instanceScale;
+layout (location = 5) in vec3 instanceOffset;
+layout (location = 6) in vec4 instanceColor;
+
+// VS vertex output
+layout (location = 0) out vec4 outColor;
+
+// Vertex shader entry
+void main() {
+    // move the mesh into the cell of this instance
+    vec3 position = pos.xyz * instanceScale + instanceOffset;
+    gl_Position = vec4(position.x, -position.y, position.z, 1.0f);
+    outColor = inColor * instanceColor;
+}
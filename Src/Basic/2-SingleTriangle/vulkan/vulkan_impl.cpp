@@ -4,24 +4,69 @@
 //
 
 #include <vector>
-#include <windows.h>
 #include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <algorithm>
+#include <string>
+#include <assert.h>
+#include <string.h>
+#include "vulkan_include.h"
 #include "vulkan_impl.h"
+#include "vulkan_memory.h"
+#include "vulkan_upload.h"
+#include "vulkan_pipeline.h"
 #include "shaders/generated_vs.h"
+#include "shaders/generated_vs_instanced.h"
 #include "shaders/generated_ps.h"
+#include "shaders/generated_meshlet_task.h"
+#include "shaders/generated_meshlet_mesh.h"
+#include "shaders/generated_meshlet_cull.h"
+#include "shaders/generated_object_cull.h"
 #include "../common/common.h"
-
-#define VULKAN_HPP_NO_EXCEPTIONS
-#define VULKAN_HPP_TYPESAFE_CONVERSION
-#include <vulkan/vulkan.hpp>
-#include <vulkan/vk_sdk_platform.h>
+#include "../common/thread_pool.h"
+#include "../common/linear_allocator.h"
+#include "../common/deletion_queue.h"
+#include "../common/pipeline_cache.h"
+#include "../common/task_graph.h"
+#include "../common/mesh.h"
+#include "../common/mesh_optimizer.h"
+#include "../common/meshlet.h"
+#include "../common/geometry_pool.h"
+#include "../common/gpu_culling.h"
+#include "../common/frame_pacing.h"
+#include "../common/render_graph.h"
 
 /*
     This tutorial demonstrate how to draw a single triangle on screen.
 */
 
-// Allow a maximum of three outstanding presentation operations.
-#define NUM_FRAMES 3
+// Per-frame resources are sized for 'MAX_FRAMES_IN_FLIGHT' in sample.h, how many frames are really in flight is a runtime
+// setting. Swapchain images are independent of it, the presentation engine decides how many there are, up to this many.
+#define MAX_SWAPCHAIN_IMAGES 8
+
+// Draws are recorded in slices, a slice is never smaller than this so that recording a secondary command buffer is worth it.
+#define MIN_DRAWS_PER_SLICE 256
+
+// Size of the transient memory of each frame, each draw takes at most 256 bytes of it, depending on the alignment of uniform buffers.
+#define TRANSIENT_MEMORY_PER_FRAME  (8 * 1024 * 1024)
+
+// Compiled pipelines are kept in this file between launches.
+#define PIPELINE_CACHE_FILE "2_single_triangle_vk.pipeline_cache"
+
+// Meshlets culled by each task shader workgroup and by each workgroup of the culling compute shader, they match the shaders.
+#define MESHLETS_PER_TASK           32
+#define MESHLETS_PER_CULL_GROUP     64
+
+// Instance data is written by all recording threads, each task writes this many instances.
+#define INSTANCES_PER_TASK          4096
+
+// Largest number of draws culled by a single dispatch, it is the minimum 'maxComputeWorkGroupCount' of all devices.
+#define MAX_CULL_DRAWS_PER_DISPATCH 65535
+
+// Objects culled by each workgroup of the object culling compute shader, it matches the shader.
+#define OBJECTS_PER_CULL_GROUP      64
 
 #define VERIFY(ret)         if(ret != vk::Result::eSuccess) return false;
 
@@ -40,61 +85,213 @@ vk::Device                                      g_vk_device;
 // Unlike the EmptyWindow tutorial, which handles the corner case that graphics queue doesn't support present.
 // This tutorial will assume the graphics queue always support present so that lots of logic can be simplified by a lot.
 vk::Queue                                       g_vk_graphics_queue;
+// Queue for uploading, it is a dedicated transfer queue if the device has one, otherwise it falls back to the graphics queue.
+vk::Queue                                       g_vk_transfer_queue;
+// Submitting to a queue needs external synchronization, the transfer queue may be the graphics queue itself.
+std::mutex                                      g_vk_queue_mutex;
 // Vulkan swapchain surface
 vk::SurfaceKHR                                  g_vk_surface;
 // Vulkan swap chain
 vk::SwapchainKHR                                g_vk_swapchain;
 // Vulkan image in swapchain
 // Upon creation of vulkan swapchain, there are already a few images inside. This is just to explictly keep track of them.
-vk::Image                                       g_vk_images[NUM_FRAMES];
+vk::Image                                       g_vk_images[MAX_SWAPCHAIN_IMAGES];
+// Number of swapchain images, or of offscreen images, which are one for each frame in flight.
+uint32_t                                        g_vk_image_cnt = 0;
 // Vulkan command pool
 // Command pool keeps track of all memory for command buffers.
 vk::CommandPool                                 g_vk_graphics_cmd_pool;
 // Vulkan command list
 // In this tutorial, nothing, but clearing the backbuffer is done in this command list.
-vk::CommandBuffer                               g_vk_graphics_cmd[NUM_FRAMES];
+vk::CommandBuffer                               g_vk_graphics_cmd[MAX_FRAMES_IN_FLIGHT];
+// Command pools of the recording threads
+// Command pools are not thread safe, each thread slot owns one command pool for each frame, the whole pool is reset once the
+// frame is done on GPU, which is a lot cheaper than resetting the command buffers one by one.
+std::vector<vk::CommandPool>                    g_vk_slot_cmd_pools[MAX_FRAMES_IN_FLIGHT];
+// Secondary command buffers allocated from the command pools above, they are reused every time the frame index comes back.
+std::vector<std::vector<vk::CommandBuffer>>     g_vk_slot_cmds[MAX_FRAMES_IN_FLIGHT];
 // Pipeline layout
 // Description of vertex buffer layout.
 vk::PipelineLayout                              g_vk_pipeline_layout;
 // Pipeline cache
 vk::PipelineCache                               g_vk_pipeline_cache;
+// What the pipeline cache is created with, there is no need to write the cache back if nothing is added to it.
+std::vector<uint8_t>                            g_vk_loaded_pipeline_cache;
 // Pipeline state
-vk::Pipeline                                    g_vk_pipeline;
+// It is compiled in the background, the triangle is not drawn until it is ready since there is no cheaper pipeline to fall back to.
+std::shared_ptr<VulkanPipeline>                 g_vk_pipeline;
+// Background threads compiling pipelines.
+std::unique_ptr<PipelineCompiler>               g_vk_pipeline_compiler;
+// Pipelines, their layouts, shader modules and render passes are all looked up in the registry, identical states are only
+// created once and the registry owns all of them.
+VulkanPipelineRegistry                          g_vk_pipeline_registry;
+// The pipeline the current frame draws with, it is resolved once a frame so that all slices of the frame agree on it.
+vk::Pipeline                                    g_vk_frame_pipeline;
 // Vulkan fences
 // Fence objects are for CPU to wait for certain operations on GPU to be done. We can write a fence on command buffer to indicate the
 // previous operations are all done. CPU can choose to wait for fence to make sure the commands of its interest are already executed on
-// GPU. This is a useful data structure to make sure CPU is not too fast than GPU, in this tutorial, too fast means 3 frames faster than
-// GPU execution.
-vk::Fence                                       g_vk_fence[NUM_FRAMES];
+// GPU. This is a useful data structure to make sure CPU is not too fast than GPU, too fast means more frames ahead of GPU than
+// the frames in flight. Fences are only the fallback for devices without timeline semaphores.
+vk::Fence                                       g_vk_fence[MAX_FRAMES_IN_FLIGHT];
+// Timeline semaphore of the graphics queue, 'VK_KHR_timeline_semaphore'
+// Every frame signals its serial on it when it is done. Before a frame index is reused, CPU waits for the serial of the frame
+// that used it last time, one semaphore paces any number of frames in flight and tells how far GPU is at any time.
+bool                                            g_vk_timeline_supported = false;
+vk::Semaphore                                   g_vk_frame_timeline;
+PFN_vkWaitSemaphoresKHR                         g_vk_wait_semaphores = nullptr;
+PFN_vkGetSemaphoreCounterValueKHR               g_vk_get_semaphore_counter_value = nullptr;
 // Vulkan semaphores
 // Different from fence, semaphores are used to explicitly sychronize between different command buffers in gpu command queues.
 // One typical usage of this semaphore concepts is we need to acquire the next avaiable image in swapchain and the command buffer should 
-// not start executing on command queue before it acquires the image successfully.
-vk::Semaphore                                   g_vk_image_acquired_semaphores[NUM_FRAMES];
-vk::Semaphore                                   g_vk_draw_complete_semaphores[NUM_FRAMES];
-vk::Semaphore                                   g_vk_image_ownership_semaphores[NUM_FRAMES];
+// not start executing on command queue before it acquires the image successfully. An image is acquired by each frame in flight,
+// while drawing is complete for each swapchain image, it is only signaled again once the image is presented and acquired again.
+vk::Semaphore                                   g_vk_image_acquired_semaphores[MAX_FRAMES_IN_FLIGHT];
+vk::Semaphore                                   g_vk_draw_complete_semaphores[MAX_SWAPCHAIN_IMAGES];
+// Neither fences nor the timeline cover presents, the only way to know a present is done is that the image it presented is
+// released, which is when the acquire of the image signals its fence. Presents are done in the order they are queued, the
+// serial of the last present of the acquired image tells how far presenting is.
+vk::Fence                                       g_vk_image_acquired_fences[MAX_FRAMES_IN_FLIGHT];
+// Whether each frame in flight passed its fence to an acquire that is not waited for yet, along with the serial of the last
+// present of the image it acquired.
+bool                                            g_vk_acquire_pending[MAX_FRAMES_IN_FLIGHT] = {};
+unsigned long long                              g_vk_acquired_present_serials[MAX_FRAMES_IN_FLIGHT] = {};
+// Serial of the last present, it increases by one every present, 0 means nothing is presented yet. The serial of the last
+// present of each image of the current swapchain, and of the last present known to be done.
+unsigned long long                              g_vk_present_serial = 0;
+unsigned long long                              g_vk_image_present_serials[MAX_SWAPCHAIN_IMAGES] = {};
+unsigned long long                              g_vk_completed_present_serial = 0;
+// Retired swapchains, along with their semaphores, waiting for the presents to them to be done.
+DeletionQueue                                   g_vk_present_deletion_queue;
+// Whether the swapchain needs to be recreated before the next frame, because the window is resized or the swapchain no longer
+// matches the surface.
+bool                                            g_vk_swapchain_dirty = false;
 // Shader modules
 vk::ShaderModule                                g_vk_vs_module;
+vk::ShaderModule                                g_vk_vs_instanced_module;
 vk::ShaderModule                                g_vk_ps_module;
 // swap chain surface format
 vk::Format                                      g_vk_format;
+vk::ColorSpaceKHR                               g_vk_color_space;
 // vulkan render pass
 vk::RenderPass                                  g_vk_render_pass;
 // vulkan swapchain image view
-vk::ImageView                                   g_vk_image_views[NUM_FRAMES];
+vk::ImageView                                   g_vk_image_views[MAX_SWAPCHAIN_IMAGES];
 // vulkan frame buffers
-vk::Framebuffer                                 g_vk_frame_buffers[NUM_FRAMES];
+vk::Framebuffer                                 g_vk_frame_buffers[MAX_SWAPCHAIN_IMAGES];
 // descriptor pool
 vk::DescriptorPool                              g_vk_desc_pool;
-vk::DescriptorSet                               g_vk_desc_set[NUM_FRAMES];
+vk::DescriptorSet                               g_vk_desc_set[MAX_FRAMES_IN_FLIGHT];
 // descriptor layout
 vk::DescriptorSetLayout                         g_vk_desc_layout;
-// vertex buffer
+// Vertex buffer of the geometry pool, see 'common/geometry_pool.h'. All meshes are sub-allocated from it and drawn with
+// their base vertex, so it is bound once no matter how many meshes there are.
 vk::Buffer                                      g_vk_vertex_buffer;
-// device memory
-vk::DeviceMemory                                g_vk_device_memory;
-// physical device memory properties
-vk::PhysicalDeviceMemoryProperties              g_vk_physical_memory_props;
+VulkanAllocation                                g_vk_vertex_allocation;
+// Index buffer of the geometry pool, it lives in device local memory as the vertex buffer does.
+vk::Buffer                                      g_vk_index_buffer;
+VulkanAllocation                                g_vk_index_allocation;
+GeometryPool                                    g_vk_geometry_pool;
+// where the mesh is in the geometry pool, every draw of the mesh goes through it
+GeometryRange                                   g_vk_mesh_range;
+
+// Geometry is uploaded through staging buffers on the transfer queue.
+VulkanUploader                                  g_vk_uploader;
+// GPU memory sub-allocator
+// Instead of allocating device memory for each resource, which easily hits 'maxMemoryAllocationCount', resources are bound
+// with ranges of a few large blocks.
+VulkanMemoryAllocator                           g_vk_allocator;
+// Transient memory for per-draw constants
+// It is a single host visible buffer that stays mapped all the time, each frame owns a region of it.
+vk::Buffer                                      g_vk_transient_buffer;
+VulkanAllocation                                g_vk_transient_allocation;
+// Linear allocators of the transient memory, one for each frame, they are reset once the fence of the frame signals.
+LinearAllocator                                 g_vk_frame_allocators[MAX_FRAMES_IN_FLIGHT];
+// Size of the region of each frame in the transient buffer, it is aligned with the offset alignment of uniform buffers.
+vk::DeviceSize                                  g_vk_transient_frame_size = 0;
+// Timestamp query pool
+// There are two queries for each frame, one at the beginning and the other one at the end of its command buffer.
+vk::QueryPool                                   g_vk_timestamp_query_pool;
+// memory of the offscreen render targets
+// Without a swapchain, there is nobody else to own the memory of the images to be rendered into.
+VulkanAllocation                                g_vk_offscreen_allocations[MAX_FRAMES_IN_FLIGHT];
+
+// Meshlet rendering, see 'common/meshlet.h'. Task and mesh shaders cull and draw meshlets if the device supports them,
+// otherwise a compute shader culls them into indexed indirect draws of the regular pipeline.
+bool                                            g_vk_meshlets = false;
+MeshletPath                                     g_vk_meshlet_path = MeshletPath::None;
+MeshletStats                                    g_vk_meshlet_stats;
+// API version of the instance, mesh shaders need Vulkan 1.1.
+uint32_t                                        g_vk_api_version = VK_API_VERSION_1_0;
+// Whether the device supports task and mesh shaders, along with the most task workgroups of a single draw.
+bool                                            g_vk_mesh_shader_supported = false;
+uint32_t                                        g_vk_max_task_workgroup_cnt = 0;
+// Whether an indirect draw call can draw more than once, at most 'g_vk_max_draw_indirect_cnt' times.
+bool                                            g_vk_multi_draw_indirect = false;
+uint32_t                                        g_vk_max_draw_indirect_cnt = 1;
+#if defined(VK_EXT_mesh_shader)
+// The static loader doesn't export commands of extensions, it is fetched from the device.
+PFN_vkCmdDrawMeshTasksEXT                       g_vk_cmd_draw_mesh_tasks = nullptr;
+#endif
+// Shader modules of meshlets, the task and mesh shader only exist if the device supports them.
+vk::ShaderModule                                g_vk_task_module;
+vk::ShaderModule                                g_vk_mesh_module;
+vk::ShaderModule                                g_vk_meshlet_cull_module;
+// All meshlet shaders share the same layout, a descriptor set of storage buffers and a few push constants.
+vk::DescriptorSetLayout                         g_vk_meshlet_desc_layout;
+vk::PipelineLayout                              g_vk_meshlet_pipeline_layout;
+vk::DescriptorPool                              g_vk_meshlet_desc_pool;
+vk::DescriptorSet                               g_vk_meshlet_desc_set[MAX_FRAMES_IN_FLIGHT];
+// The mesh shader pipeline or the culling compute pipeline, depending on the path, and what the current frame uses of it.
+std::shared_ptr<VulkanPipeline>                 g_vk_meshlet_pipeline;
+vk::Pipeline                                    g_vk_frame_meshlet_pipeline;
+// Buffers of meshlets in device local memory, the expanded indices and the indirect draws are only needed by compute culling.
+enum VulkanMeshletBuffer {
+    MESHLET_BUFFER_TABLE = 0,
+    MESHLET_BUFFER_BOUNDS,
+    MESHLET_BUFFER_VERTICES,
+    MESHLET_BUFFER_TRIANGLES,
+    MESHLET_BUFFER_INDICES,
+    MESHLET_BUFFER_COMMANDS,
+    MESHLET_BUFFER_CNT
+};
+vk::Buffer                                      g_vk_meshlet_buffers[MESHLET_BUFFER_CNT];
+VulkanAllocation                                g_vk_meshlet_allocations[MESHLET_BUFFER_CNT];
+// Number of draws compute culling has room for, the rest of the draws draw the whole mesh.
+unsigned int                                    g_vk_meshlet_culled_draw_cnt = 0;
+// Constants of all draws of the current frame are written up front, culling reads them before any draw is recorded.
+size_t                                          g_vk_meshlet_constant_offset = 0;
+// Offset of the culling counters of each frame in its transient memory, SIZE_MAX if the frame culled nothing.
+size_t                                          g_vk_meshlet_counter_offsets[MAX_FRAMES_IN_FLIGHT];
+// Whether the current frame draws meshlets, it doesn't until the pipelines are compiled.
+bool                                            g_vk_frame_meshlets = false;
+
+// GPU culling, see 'common/gpu_culling.h'. The data of all objects is in device local memory for good, a compute shader culls
+// them every frame into indexed indirect draws and counts the visible ones in the transient memory of the frame. Culling asked
+// for and whether the device is asked for it, meshlets turn it off.
+bool                                            g_vk_requested_gpu_culling = false;
+bool                                            g_vk_gpu_culling = false;
+GpuCullingPath                                  g_vk_gpu_culling_path = GpuCullingPath::None;
+GpuCullingStats                                 g_vk_gpu_culling_stats;
+// The static loader doesn't export commands of extensions, it is fetched from the device.
+PFN_vkCmdDrawIndexedIndirectCountKHR            g_vk_cmd_draw_indexed_indirect_count = nullptr;
+vk::ShaderModule                                g_vk_object_cull_module;
+vk::DescriptorSetLayout                         g_vk_object_cull_desc_layout;
+vk::PipelineLayout                              g_vk_object_cull_pipeline_layout;
+vk::DescriptorPool                              g_vk_object_cull_desc_pool;
+vk::DescriptorSet                               g_vk_object_cull_desc_set[MAX_FRAMES_IN_FLIGHT];
+std::shared_ptr<VulkanPipeline>                 g_vk_object_cull_pipeline;
+vk::Pipeline                                    g_vk_frame_object_cull_pipeline;
+// The data of all objects, it is the instance stream of the draws too, and the indirect draws written by culling.
+vk::Buffer                                      g_vk_object_buffer;
+VulkanAllocation                                g_vk_object_allocation;
+vk::Buffer                                      g_vk_object_draw_buffer;
+VulkanAllocation                                g_vk_object_draw_allocation;
+// Offset of the counter of visible objects of each frame in its transient memory, SIZE_MAX if the frame culled nothing.
+size_t                                          g_vk_object_counter_offsets[MAX_FRAMES_IN_FLIGHT];
+// Whether the current frame culls objects, all objects are drawn until the culling pipeline is compiled.
+bool                                            g_vk_frame_gpu_culling = false;
+// Alignment of the transient memory, it is the distance between the constants of two draws too.
+size_t                                          g_vk_transient_alignment = 0;
 
 // Vulkan extensions
 std::vector<const char*>                        g_device_exts;
@@ -102,11 +299,72 @@ std::vector<const char*>                        g_device_exts;
 std::vector<const char*>                        g_instance_layers;
 // Vulkan queue index
 unsigned int                                    g_graphics_queue_family_index = UINT32_MAX;
-// Current frame index
+unsigned int                                    g_transfer_queue_family_index = UINT32_MAX;
+unsigned int                                    g_transfer_queue_index = 0;
+// Current frame index, it goes round the frames in flight
 unsigned int                                    g_frame_index = 0;
+// Frames CPU records ahead of GPU.
+unsigned int                                    g_vk_frames_in_flight = DEFAULT_FRAMES_IN_FLIGHT;
 // client size
 uint32_t                                        g_width = 0;
 uint32_t                                        g_height = 0;
+// Number of threads recording commands requested by the user, 0 means one for each hardware thread.
+unsigned int                                    g_vk_requested_thread_cnt = 0;
+// Threads recording secondary command buffers, the calling thread records too.
+std::unique_ptr<ThreadPool>                     g_vk_thread_pool;
+// Number of times the triangle is drawn in each frame.
+unsigned int                                    g_vk_draw_cnt = 1;
+// Whether all draws are a single instanced draw, the data of each instance is a second vertex stream in the transient memory.
+// Instancing asked for and whether the device really draws with it, meshlets and GPU culling turn it off.
+bool                                            g_vk_requested_instancing = false;
+bool                                            g_vk_instancing = false;
+// Whether the current frame has its instance data written, along with where it is in the transient memory of the frame.
+bool                                            g_vk_frame_instances = false;
+size_t                                          g_vk_instance_offset = 0;
+// Encoding of the vertex buffer asked for and the one really used, along with the decode of its positions and its size before
+// and after encoding.
+VertexEncoding                                  g_vk_requested_vertex_encoding = VertexEncoding::Full;
+VertexEncoding                                  g_vk_vertex_encoding = VertexEncoding::Full;
+PositionDecode                                  g_vk_position_decode;
+VertexEncodingStats                             g_vk_vertex_encoding_stats;
+// The mesh drawn by the sample, it is mapped from a mesh file or the built-in triangle if there is no file.
+Mesh                                            g_vk_mesh;
+std::string                                     g_vk_mesh_filename;
+// Whether the mesh is optimized when it is loaded, along with its efficiency before and after.
+bool                                            g_vk_mesh_optimization = false;
+MeshOptimizationStats                           g_vk_mesh_optimization_stats;
+// Whether the sample renders into offscreen images, there is no surface or swapchain at all in this case.
+bool                                            g_vk_offscreen = false;
+// Whether the sample presents to a headless surface when there is no window, it is not offscreen then.
+bool                                            g_vk_headless = false;
+// Present mode asked for and the one the swapchain really uses.
+PresentMode                                     g_vk_requested_present_mode = PresentMode::Fifo;
+PresentMode                                     g_vk_present_mode = PresentMode::Fifo;
+// Low latency frame pacing, it is fed with the GPU time of the timestamp queries.
+FramePacer                                      g_vk_frame_pacer;
+// Passes of the current frame, see 'common/render_graph.h'. Resources of the graph are images or buffers, buffers have no image.
+RenderGraph                                     g_vk_render_graph;
+std::vector<vk::Image>                          g_vk_graph_images;
+// Number of valid bits in timestamps of the graphics queue, 0 means timestamp queries are not supported.
+uint32_t                                        g_vk_timestamp_valid_bits = 0;
+// Nanoseconds per timestamp tick.
+float                                           g_vk_timestamp_period = 0.0f;
+// The profiler frame that last used the queries of each frame, 0 means there is nothing to read back yet.
+unsigned long long                              g_vk_timestamp_frames[MAX_FRAMES_IN_FLIGHT] = {};
+// CPU time of submitting each frame.
+long long                                       g_vk_submit_time[MAX_FRAMES_IN_FLIGHT] = {};
+// GPU timestamps have nothing to do with the CPU clock. The beginning of the first GPU frame is aligned with the time it was
+// submitted on CPU, all later GPU frames are placed relative to it.
+long long                                       g_vk_gpu_time_offset = 0;
+bool                                            g_vk_gpu_time_calibrated = false;
+// Serial of the last submitted frame, it increases by one every submission, 0 means nothing is submitted yet.
+std::atomic<unsigned long long>                 g_vk_submitted_serial(0);
+// Serial of the last submission of each frame, once the timeline semaphore reaches it, or the fence of the frame signals,
+// everything up to it is done on GPU.
+unsigned long long                              g_vk_frame_serials[MAX_FRAMES_IN_FLIGHT] = {};
+// Resources waiting for GPU to be done with them
+// Nothing is destroyed right away at runtime, resources are destroyed once the serial of the last frame using them is reached.
+DeletionQueue                                   g_vk_deletion_queue;
 
 
 /*
@@ -149,8 +407,9 @@ static bool create_vk_instance() {
     // Vulkan instance extensions
     std::vector<const char*> instance_exts;
 
-    // get vulkan properties
-    {
+    // get vulkan properties, offscreen rendering doesn't need any surface extension, a headless surface takes the place of the
+    // platform surface
+    if (!g_vk_offscreen) {
         bool surface_ext_found = false, platform_surface_ext_found = false;
 
         // get the number of instance extension properties
@@ -168,10 +427,20 @@ static bool create_vk_instance() {
                     instance_exts.push_back(VK_KHR_SURFACE_EXTENSION_NAME);
                 }
 
+                if (g_vk_headless) {
+                    if (!strcmp(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME, instance_extensions[i].extensionName)) {
+                        platform_surface_ext_found = 1;
+                        instance_exts.push_back(VK_EXT_HEADLESS_SURFACE_EXTENSION_NAME);
+                    }
+                    continue;
+                }
+
+#if PLATFORM_WIN
                 if (!strcmp(VK_KHR_WIN32_SURFACE_EXTENSION_NAME, instance_extensions[i].extensionName)) {
                     platform_surface_ext_found = 1;
                     instance_exts.push_back(VK_KHR_WIN32_SURFACE_EXTENSION_NAME);
                 }
+#endif
             }
         }
 
@@ -180,6 +449,15 @@ static bool create_vk_instance() {
             return false;
     }
 
+    // Mesh shaders need Vulkan 1.1, so does querying timeline semaphores, the instance asks for it only if the loader knows
+    // about it.
+    g_vk_api_version = VK_API_VERSION_1_0;
+    {
+        uint32_t loader_version = VK_API_VERSION_1_0;
+        if (vk::enumerateInstanceVersion(&loader_version) == vk::Result::eSuccess && loader_version >= VK_API_VERSION_1_1)
+            g_vk_api_version = VK_API_VERSION_1_1;
+    }
+
     // create the vulkan instance
     {
         // The app information is mostly like to be ignored by the driver.
@@ -190,7 +468,7 @@ static bool create_vk_instance() {
             .setApplicationVersion(0)
             .setPEngineName("1 - EmptyWindow")
             .setEngineVersion(0)
-            .setApiVersion(VK_API_VERSION_1_0);
+            .setApiVersion(g_vk_api_version);
         auto const inst_info = vk::InstanceCreateInfo()
             .setPApplicationInfo(&app)
             .setEnabledLayerCount((uint32_t)g_instance_layers.size())
@@ -231,6 +509,9 @@ static bool create_vk_physical_device() {
         /* Look for device extensions */
         uint32_t device_extension_count = 0;
         bool swapchain_ext_found = false;
+        bool mesh_shader_ext_found = false, spirv_1_4_ext_found = false, float_controls_ext_found = false;
+        bool draw_indirect_count_ext_found = false;
+        bool timeline_semaphore_ext_found = false;
 
         auto result = g_vk_physical_device.enumerateDeviceExtensionProperties(nullptr, &device_extension_count, static_cast<vk::ExtensionProperties*>(nullptr));
         VERIFY(result);
@@ -245,28 +526,123 @@ static bool create_vk_physical_device() {
                     swapchain_ext_found = 1;
                     g_device_exts.push_back(VK_KHR_SWAPCHAIN_EXTENSION_NAME);
                 }
+
+                draw_indirect_count_ext_found |= !strcmp(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME, device_exts[i].extensionName);
+                timeline_semaphore_ext_found |= !strcmp(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME, device_exts[i].extensionName);
+
+#if defined(VK_EXT_mesh_shader)
+                mesh_shader_ext_found |= !strcmp(VK_EXT_MESH_SHADER_EXTENSION_NAME, device_exts[i].extensionName);
+                spirv_1_4_ext_found |= !strcmp(VK_KHR_SPIRV_1_4_EXTENSION_NAME, device_exts[i].extensionName);
+                float_controls_ext_found |= !strcmp(VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME, device_exts[i].extensionName);
+#endif
             }
         }
 
-        if (!swapchain_ext_found)
+        // swapchain is not needed if the sample renders offscreen
+        if (!swapchain_ext_found && !g_vk_offscreen)
             return false;
-    }
 
-    g_vk_physical_device.getMemoryProperties(&g_vk_physical_memory_props);
+        // Meshlets are culled by compute shaders on any device, task and mesh shaders are used on top of Vulkan 1.1 if the
+        // device has them. CPU drivers usually don't.
+        vk::PhysicalDeviceProperties properties;
+        g_vk_physical_device.getProperties(&properties);
+        g_vk_mesh_shader_supported = false;
+#if defined(VK_EXT_mesh_shader)
+        if (g_vk_meshlets && mesh_shader_ext_found && spirv_1_4_ext_found && float_controls_ext_found &&
+            g_vk_api_version >= VK_API_VERSION_1_1 && properties.apiVersion >= VK_API_VERSION_1_1) {
+            vk::PhysicalDeviceMeshShaderFeaturesEXT mesh_features;
+            auto features = vk::PhysicalDeviceFeatures2().setPNext(&mesh_features);
+            g_vk_physical_device.getFeatures2(&features);
+
+            vk::PhysicalDeviceMeshShaderPropertiesEXT mesh_properties;
+            auto properties2 = vk::PhysicalDeviceProperties2().setPNext(&mesh_properties);
+            g_vk_physical_device.getProperties2(&properties2);
+
+            if (mesh_features.taskShader && mesh_features.meshShader) {
+                g_vk_mesh_shader_supported = true;
+                g_vk_max_task_workgroup_cnt = mesh_properties.maxTaskWorkGroupCount[0];
+                g_device_exts.push_back(VK_EXT_MESH_SHADER_EXTENSION_NAME);
+                g_device_exts.push_back(VK_KHR_SPIRV_1_4_EXTENSION_NAME);
+                g_device_exts.push_back(VK_KHR_SHADER_FLOAT_CONTROLS_EXTENSION_NAME);
+            }
+        }
+#endif
+
+        // Frames are paced with a timeline semaphore if the device has them, with a fence for each frame otherwise.
+        g_vk_timeline_supported = false;
+        if (timeline_semaphore_ext_found && g_vk_api_version >= VK_API_VERSION_1_1 && properties.apiVersion >= VK_API_VERSION_1_1) {
+            vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR timeline_features;
+            auto features = vk::PhysicalDeviceFeatures2().setPNext(&timeline_features);
+            g_vk_physical_device.getFeatures2(&features);
+            if (timeline_features.timelineSemaphore) {
+                g_vk_timeline_supported = true;
+                g_device_exts.push_back(VK_KHR_TIMELINE_SEMAPHORE_EXTENSION_NAME);
+            }
+        }
+
+        // compute culling draws each meshlet with its own indirect draw, they are batched into one call if possible
+        vk::PhysicalDeviceFeatures features;
+        g_vk_physical_device.getFeatures(&features);
+        g_vk_multi_draw_indirect = features.multiDrawIndirect == VK_TRUE;
+        g_vk_max_draw_indirect_cnt = g_vk_multi_draw_indirect ? std::max(properties.limits.maxDrawIndirectCount, 1u) : 1u;
+
+        // GPU culling draws each object as the first instance of its indirect draw. Visible draws are compacted if the device
+        // draws as many indirect draws as a count buffer says, otherwise culled objects are indirect draws without instances.
+        // Objects and their draws have to fit in storage buffers.
+        g_vk_gpu_culling_path = GpuCullingPath::None;
+        const auto max_object_cnt = properties.limits.maxStorageBufferRange / sizeof(InstanceData);
+        if (g_vk_gpu_culling && features.drawIndirectFirstInstance && g_vk_draw_cnt <= max_object_cnt) {
+            g_vk_gpu_culling_path = GpuCullingPath::DrawIndirect;
+            if (draw_indirect_count_ext_found && g_vk_draw_cnt <= g_vk_max_draw_indirect_cnt) {
+                g_vk_gpu_culling_path = GpuCullingPath::IndirectCount;
+                g_device_exts.push_back(VK_KHR_DRAW_INDIRECT_COUNT_EXTENSION_NAME);
+            }
+
+            // culled draws are drawn with the instance stream of the objects, not with the one of the instancing path
+            g_vk_instancing = false;
+        }
+    }
 
     return true;
 }
 
 
+#if PLATFORM_WIN
 /*
- * Create vulkan device.
+ * Create vulkan surface.
  */
-static bool create_vk_device(const HINSTANCE hInstnace, const HWND hwnd) {
-    // Create vulkan surface
+static bool create_vk_surface(const HINSTANCE hInstnace, const HWND hwnd) {
     auto const createInfo = vk::Win32SurfaceCreateInfoKHR().setHinstance(hInstnace).setHwnd(hwnd);
     auto result = g_vk_instance.createWin32SurfaceKHR(&createInfo, nullptr, &g_vk_surface);
     VERIFY(result);
 
+    return true;
+}
+#endif
+
+/*
+ * Create a surface without any window, 'VK_EXT_headless_surface'.
+ * Everything presented to it is simply dropped, but the swapchain, acquiring and presenting work as they do with a window.
+ */
+static bool create_vk_headless_surface() {
+    auto create_headless_surface = (PFN_vkCreateHeadlessSurfaceEXT)g_vk_instance.getProcAddr("vkCreateHeadlessSurfaceEXT");
+    if (!create_headless_surface)
+        return false;
+
+    auto const createInfo = vk::HeadlessSurfaceCreateInfoEXT();
+    VkSurfaceKHR surface = VK_NULL_HANDLE;
+    if (create_headless_surface(static_cast<VkInstance>(g_vk_instance), reinterpret_cast<const VkHeadlessSurfaceCreateInfoEXT*>(&createInfo), nullptr, &surface) != VK_SUCCESS)
+        return false;
+    g_vk_surface = surface;
+
+    return true;
+}
+
+
+/*
+ * Create vulkan device.
+ */
+static bool create_vk_device() {
     // Graphics hardware may have multiple type of queues, this will keep track of how many type of queues are available on the graphics card.
     uint32_t queue_family_count = 0;
     g_vk_physical_device.getQueueFamilyProperties(&queue_family_count, static_cast<vk::QueueFamilyProperties*>(nullptr));
@@ -275,10 +651,13 @@ static bool create_vk_device(const HINSTANCE hInstnace, const HWND hwnd) {
     auto vk_queue_properties = std::make_unique<vk::QueueFamilyProperties[]>(queue_family_count);
     g_vk_physical_device.getQueueFamilyProperties(&queue_family_count, vk_queue_properties.get());
 
-    // Iterate over each queue to learn whether it supports presenting:
+    // Iterate over each queue to learn whether it supports presenting, there is nothing to present to without a surface.
     auto supportsPresent = std::make_unique<vk::Bool32[]>(queue_family_count);
-    for (uint32_t i = 0; i < queue_family_count; i++)
-        g_vk_physical_device.getSurfaceSupportKHR(i, g_vk_surface, &supportsPresent[i]);
+    for (uint32_t i = 0; i < queue_family_count; i++) {
+        supportsPresent[i] = VK_TRUE;
+        if (!g_vk_offscreen)
+            g_vk_physical_device.getSurfaceSupportKHR(i, g_vk_surface, &supportsPresent[i]);
+    }
 
     // Pick a graphics queue and set the present queue too if the graphics queue also supports present
     for (uint32_t i = 0; i < queue_family_count; i++) {
@@ -295,28 +674,89 @@ static bool create_vk_device(const HINSTANCE hInstnace, const HWND hwnd) {
     if (g_graphics_queue_family_index == UINT32_MAX)
         return false;
 
+    // not all queues support timestamps
+    g_vk_timestamp_valid_bits = vk_queue_properties[g_graphics_queue_family_index].timestampValidBits;
+
+    // A transfer only queue family is usually backed by the DMA engines, copies on it run in parallel with rendering.
+    // Any other queue family supports transfer too, a second queue of the graphics family is the next best thing.
+    for (uint32_t i = 0; i < queue_family_count; i++) {
+        const auto flags = vk_queue_properties[i].queueFlags;
+        if ((flags & vk::QueueFlagBits::eTransfer) && !(flags & (vk::QueueFlagBits::eGraphics | vk::QueueFlagBits::eCompute))) {
+            g_transfer_queue_family_index = i;
+            break;
+        }
+    }
+    if (g_transfer_queue_family_index == UINT32_MAX) {
+        g_transfer_queue_family_index = g_graphics_queue_family_index;
+        g_transfer_queue_index = vk_queue_properties[g_graphics_queue_family_index].queueCount > 1 ? 1 : 0;
+    }
+
     // Create vulkan device
     {
-        float const priorities[1] = { 0.0 };
+        float const priorities[2] = { 0.0, 0.0 };
 
         vk::DeviceQueueCreateInfo queues[2];
         queues[0].setQueueFamilyIndex(g_graphics_queue_family_index);
-        queues[0].setQueueCount(1);
+        queues[0].setQueueCount(g_transfer_queue_family_index == g_graphics_queue_family_index ? g_transfer_queue_index + 1 : 1);
         queues[0].setPQueuePriorities(priorities);
 
+        queues[1].setQueueFamilyIndex(g_transfer_queue_family_index);
+        queues[1].setQueueCount(1);
+        queues[1].setPQueuePriorities(priorities);
+
+        vk::PhysicalDeviceFeatures features;
+        features.multiDrawIndirect = g_vk_multi_draw_indirect ? VK_TRUE : VK_FALSE;
+        features.drawIndirectFirstInstance = g_vk_gpu_culling_path != GpuCullingPath::None ? VK_TRUE : VK_FALSE;
+
         auto deviceInfo = vk::DeviceCreateInfo()
-            .setQueueCreateInfoCount(1)
+            .setQueueCreateInfoCount(g_transfer_queue_family_index == g_graphics_queue_family_index ? 1 : 2)
             .setPQueueCreateInfos(queues)
             .setEnabledLayerCount(0)
             .setPpEnabledLayerNames(nullptr)
             .setEnabledExtensionCount((uint32_t)g_device_exts.size())
             .setPpEnabledExtensionNames((const char* const*)g_device_exts.data())
-            .setPEnabledFeatures(nullptr);
+            .setPEnabledFeatures(&features);
+
+        // features of extensions are chained, core features move into the chain too
+        auto features2 = vk::PhysicalDeviceFeatures2().setFeatures(features);
+        auto timeline_features = vk::PhysicalDeviceTimelineSemaphoreFeaturesKHR().setTimelineSemaphore(VK_TRUE);
+        if (g_vk_timeline_supported)
+            features2.setPNext(&timeline_features.setPNext(features2.pNext));
+#if defined(VK_EXT_mesh_shader)
+        auto mesh_features = vk::PhysicalDeviceMeshShaderFeaturesEXT().setTaskShader(VK_TRUE).setMeshShader(VK_TRUE);
+        if (g_vk_mesh_shader_supported)
+            features2.setPNext(&mesh_features.setPNext(features2.pNext));
+#endif
+        if (features2.pNext)
+            deviceInfo.setPEnabledFeatures(nullptr).setPNext(&features2);
 
         auto result = g_vk_physical_device.createDevice(&deviceInfo, nullptr, &g_vk_device);
         VERIFY(result);
     }
 
+#if defined(VK_EXT_mesh_shader)
+    if (g_vk_mesh_shader_supported) {
+        g_vk_cmd_draw_mesh_tasks = (PFN_vkCmdDrawMeshTasksEXT)g_vk_device.getProcAddr("vkCmdDrawMeshTasksEXT");
+        g_vk_mesh_shader_supported = g_vk_cmd_draw_mesh_tasks != nullptr;
+    }
+#endif
+
+    if (g_vk_timeline_supported) {
+        g_vk_wait_semaphores = (PFN_vkWaitSemaphoresKHR)g_vk_device.getProcAddr("vkWaitSemaphoresKHR");
+        g_vk_get_semaphore_counter_value = (PFN_vkGetSemaphoreCounterValueKHR)g_vk_device.getProcAddr("vkGetSemaphoreCounterValueKHR");
+        g_vk_timeline_supported = g_vk_wait_semaphores && g_vk_get_semaphore_counter_value;
+    }
+
+    if (g_vk_gpu_culling_path == GpuCullingPath::IndirectCount) {
+        g_vk_cmd_draw_indexed_indirect_count = (PFN_vkCmdDrawIndexedIndirectCountKHR)g_vk_device.getProcAddr("vkCmdDrawIndexedIndirectCountKHR");
+        if (!g_vk_cmd_draw_indexed_indirect_count)
+            g_vk_gpu_culling_path = GpuCullingPath::DrawIndirect;
+    }
+
+    g_vk_gpu_culling_stats = GpuCullingStats();
+    g_vk_gpu_culling_stats.path = g_vk_gpu_culling_path;
+    g_vk_gpu_culling_stats.object_cnt = g_vk_gpu_culling_path == GpuCullingPath::None ? 0 : g_vk_draw_cnt;
+
     return true;
 }
 
@@ -326,14 +766,21 @@ static bool create_vk_device(const HINSTANCE hInstnace, const HWND hwnd) {
  */
 static bool acquire_vk_command_queue() {
     g_vk_device.getQueue(g_graphics_queue_family_index, 0, &g_vk_graphics_queue);
+    g_vk_device.getQueue(g_transfer_queue_family_index, g_transfer_queue_index, &g_vk_transfer_queue);
     return true;
 }
 
 /*
- * Create the vulkan swapchain.
- * This function also creates a few sychronization objects too.
+ * Pick the format of the render targets.
+ * It only depends on the surface, the render pass and the pipeline don't need to wait for the swapchain.
  */
-static bool create_vk_swapchain() {
+static bool select_vk_surface_format() {
+    // offscreen images can be of any format
+    if (g_vk_offscreen) {
+        g_vk_format = vk::Format::eR8G8B8A8Unorm;
+        return true;
+    }
+
     // Get the list of VkFormat's that are supported:
     uint32_t format_count;
     auto result = g_vk_physical_device.getSurfaceFormatsKHR(g_vk_surface, &format_count, static_cast<vk::SurfaceFormatKHR*>(nullptr));
@@ -343,18 +790,26 @@ static bool create_vk_swapchain() {
     result = g_vk_physical_device.getSurfaceFormatsKHR(g_vk_surface, &format_count, surface_format.get());
     VERIFY(result);
 
-    vk::Format vk_surface_format;
     // If the format list includes just one entry of VK_FORMAT_UNDEFINED, the surface has no preferred format.  Otherwise, at least one
     // supported format will be returned.
     if (format_count == 1 && surface_format[0].format == vk::Format::eUndefined)
-        vk_surface_format = vk::Format::eB8G8R8A8Unorm;
+        g_vk_format = vk::Format::eB8G8R8A8Unorm;
     else
-        vk_surface_format = surface_format[0].format;
-    auto vk_color_space = surface_format[0].colorSpace;
+        g_vk_format = surface_format[0].format;
+    g_vk_color_space = surface_format[0].colorSpace;
+
+    return true;
+}
 
+/*
+ * Create the vulkan swapchain, along with the views of its images.
+ * The old swapchain, if there is one, is retired by the new one, images it has already acquired can still be presented, and
+ * the presentation engine may reuse its resources.
+ */
+static bool create_vk_swapchain(const vk::SwapchainKHR old_swapchain) {
     // Check the surface capabilities and formats
     vk::SurfaceCapabilitiesKHR surf_caps;
-    result = g_vk_physical_device.getSurfaceCapabilitiesKHR(g_vk_surface, &surf_caps);
+    auto result = g_vk_physical_device.getSurfaceCapabilitiesKHR(g_vk_surface, &surf_caps);
     VERIFY(result);
 
     uint32_t present_mode_count;
@@ -365,12 +820,35 @@ static bool create_vk_swapchain() {
     result = g_vk_physical_device.getSurfacePresentModesKHR(g_vk_surface, &present_mode_count, present_modes.get());
     VERIFY(result);
 
+    // A surface without a window, like a headless one, has no extent of its own, the swapchain decides it.
     vk::Extent2D swapchainExtent;
     swapchainExtent = surf_caps.currentExtent;
+    if (swapchainExtent.width == UINT32_MAX) {
+        swapchainExtent.width = std::min(std::max(g_width, surf_caps.minImageExtent.width), surf_caps.maxImageExtent.width);
+        swapchainExtent.height = std::min(std::max(g_height, surf_caps.minImageExtent.height), surf_caps.maxImageExtent.height);
+    }
 
+    // FIFO is the only present mode that is always supported, it is what any other mode falls back to.
+    const vk::PresentModeKHR requested_present_mode = g_vk_requested_present_mode == PresentMode::Mailbox ? vk::PresentModeKHR::eMailbox :
+                                                      g_vk_requested_present_mode == PresentMode::Immediate ? vk::PresentModeKHR::eImmediate :
+                                                      vk::PresentModeKHR::eFifo;
     vk::PresentModeKHR present_mode = vk::PresentModeKHR::eFifo;
+    g_vk_present_mode = PresentMode::Fifo;
+    for (uint32_t i = 0; i < present_mode_count; ++i) {
+        if (present_modes[i] == requested_present_mode) {
+            present_mode = requested_present_mode;
+            g_vk_present_mode = g_vk_requested_present_mode;
+            break;
+        }
+    }
 
-    assert(NUM_FRAMES <= surf_caps.maxImageCount);
+    // One more image than the presentation engine needs so that acquiring rarely waits, a max image count of 0 means there
+    // is no limit. It has nothing to do with the frames in flight. Mailbox needs a third image to replace the queued one
+    // while another one is on screen.
+    auto image_cnt = std::max(surf_caps.minImageCount + 1, present_mode == vk::PresentModeKHR::eMailbox ? 3u : 2u);
+    if (surf_caps.maxImageCount)
+        image_cnt = std::min(image_cnt, surf_caps.maxImageCount);
+    image_cnt = std::min(image_cnt, (uint32_t)MAX_SWAPCHAIN_IMAGES);
 
     vk::SurfaceTransformFlagBitsKHR pre_transform;
     if (surf_caps.supportedTransforms & vk::SurfaceTransformFlagBitsKHR::eIdentity)
@@ -395,9 +873,9 @@ static bool create_vk_swapchain() {
 
     auto const swapchain_ci = vk::SwapchainCreateInfoKHR()
         .setSurface(g_vk_surface)
-        .setMinImageCount(NUM_FRAMES)
-        .setImageFormat(vk_surface_format)
-        .setImageColorSpace(vk_color_space)
+        .setMinImageCount(image_cnt)
+        .setImageFormat(g_vk_format)
+        .setImageColorSpace(g_vk_color_space)
         .setImageExtent({ swapchainExtent.width, swapchainExtent.height })
         .setImageArrayLayers(1)
         .setImageUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferDst)
@@ -407,25 +885,30 @@ static bool create_vk_swapchain() {
         .setPreTransform(pre_transform)
         .setCompositeAlpha(compositeAlpha)
         .setPresentMode(present_mode)
-        .setClipped(true);
+        .setClipped(true)
+        .setOldSwapchain(old_swapchain);
+
+    // a minimized window has no extent, there is no swapchain until it comes back
+    if (swapchainExtent.width == 0 || swapchainExtent.height == 0)
+        return false;
 
     result = g_vk_device.createSwapchainKHR(&swapchain_ci, nullptr, &g_vk_swapchain);
     VERIFY(result);
 
-    g_vk_format = vk_surface_format;
-
-    // check how many images there are in the swapchain
+    // check how many images there are in the swapchain, it could be more than requested
     uint32_t swapchain_image_cnt = 0;
     result = g_vk_device.getSwapchainImagesKHR(g_vk_swapchain, &swapchain_image_cnt, static_cast<vk::Image*>(nullptr));
     VERIFY(result);
-    assert(swapchain_image_cnt == NUM_FRAMES);
+    if (swapchain_image_cnt > MAX_SWAPCHAIN_IMAGES)
+        return false;
+    g_vk_image_cnt = swapchain_image_cnt;
 
     // get vulkan images in the swapchain
     result = g_vk_device.getSwapchainImagesKHR(g_vk_swapchain, &swapchain_image_cnt, g_vk_images);
     VERIFY(result);
 
     // create swapchain image view
-    for (uint32_t i = 0; i < NUM_FRAMES; ++i) {
+    for (uint32_t i = 0; i < g_vk_image_cnt; ++i) {
         auto color_image_view = vk::ImageViewCreateInfo()
             .setViewType(vk::ImageViewType::e2D)
             .setFormat(g_vk_format)
@@ -442,6 +925,55 @@ static bool create_vk_swapchain() {
     return true;
 }
 
+/*
+ * Create offscreen render targets.
+ * These are device local images that take the place of the swapchain images when there is no window to present to, each
+ * frame in flight renders into its own image.
+ */
+static bool create_vk_offscreen_targets() {
+    g_vk_image_cnt = g_vk_frames_in_flight;
+    for (uint32_t i = 0; i < g_vk_image_cnt; ++i) {
+        auto const image_info = vk::ImageCreateInfo()
+            .setImageType(vk::ImageType::e2D)
+            .setFormat(g_vk_format)
+            .setExtent(vk::Extent3D(g_width, g_height, 1))
+            .setMipLevels(1)
+            .setArrayLayers(1)
+            .setSamples(vk::SampleCountFlagBits::e1)
+            .setTiling(vk::ImageTiling::eOptimal)
+            .setUsage(vk::ImageUsageFlagBits::eColorAttachment | vk::ImageUsageFlagBits::eTransferSrc)
+            .setSharingMode(vk::SharingMode::eExclusive)
+            .setInitialLayout(vk::ImageLayout::eUndefined);
+
+        if (!g_vk_allocator.create_image(image_info, vk::MemoryPropertyFlagBits::eDeviceLocal, g_vk_images[i], g_vk_offscreen_allocations[i]))
+            return false;
+
+        auto color_image_view = vk::ImageViewCreateInfo()
+            .setViewType(vk::ImageViewType::e2D)
+            .setFormat(g_vk_format)
+            .setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1))
+            .setImage(g_vk_images[i]);
+
+        auto result = g_vk_device.createImageView(&color_image_view, nullptr, &g_vk_image_views[i]);
+        VERIFY(result);
+    }
+
+    return true;
+}
+
+
+/*
+ * Create the semaphores signaled once drawing to each swapchain image is complete, they change with the swapchain.
+ */
+static bool create_vk_draw_complete_semaphores() {
+    auto const semaphoreCreateInfo = vk::SemaphoreCreateInfo();
+    for (uint32_t i = 0; i < g_vk_image_cnt; i++) {
+        auto const result = g_vk_device.createSemaphore(&semaphoreCreateInfo, nullptr, &g_vk_draw_complete_semaphores[i]);
+        VERIFY(result);
+    }
+
+    return true;
+}
 
 /*
  * Create sychronization objects.
@@ -453,23 +985,140 @@ static bool create_vk_sychronization_objs() {
 
     auto result = vk::Result::eSuccess;
 
+    // The timeline starts at 0, which is the serial of nothing submitted at all, so waiting for a frame index never used
+    // returns right away.
+    if (g_vk_timeline_supported) {
+        auto timeline_info = vk::SemaphoreTypeCreateInfoKHR().setSemaphoreType(vk::SemaphoreTypeKHR::eTimeline).setInitialValue(0);
+        auto const timeline_ci = vk::SemaphoreCreateInfo().setPNext(&timeline_info);
+        result = g_vk_device.createSemaphore(&timeline_ci, nullptr, &g_vk_frame_timeline);
+        VERIFY(result);
+    }
+
     // Create fences that we can use to throttle if we get too far ahead of the image presents
     auto const fence_ci = vk::FenceCreateInfo().setFlags(vk::FenceCreateFlagBits::eSignaled);
-    for (uint32_t i = 0; i < NUM_FRAMES; i++) {
-        result = g_vk_device.createFence(&fence_ci, nullptr, &g_vk_fence[i]);
-        VERIFY(result);
+    auto const fence_ci_unsignaled = vk::FenceCreateInfo();
+    for (uint32_t i = 0; i < g_vk_frames_in_flight; i++) {
+        if (!g_vk_frame_timeline) {
+            result = g_vk_device.createFence(&fence_ci, nullptr, &g_vk_fence[i]);
+            VERIFY(result);
+        }
 
         result = g_vk_device.createSemaphore(&semaphoreCreateInfo, nullptr, &g_vk_image_acquired_semaphores[i]);
         VERIFY(result);
 
-        result = g_vk_device.createSemaphore(&semaphoreCreateInfo, nullptr, &g_vk_draw_complete_semaphores[i]);
+        // fences tracking presents start unsignaled, they are passed to acquires
+        result = g_vk_device.createFence(&fence_ci_unsignaled, nullptr, &g_vk_image_acquired_fences[i]);
         VERIFY(result);
     }
 
+    return create_vk_draw_complete_semaphores();
+}
+
+/*
+ * Wait until GPU is done with the frame that used the current frame index last time, nothing of the frame is reused before.
+ * The fence is only reset right before the frame is submitted, a frame that is skipped after waiting leaves it signaled.
+ */
+static void wait_for_vk_frame() {
+    if (g_vk_frame_timeline) {
+        const uint64_t serial = g_vk_frame_serials[g_frame_index];
+        auto const wait_info = vk::SemaphoreWaitInfoKHR().setSemaphoreCount(1).setPSemaphores(&g_vk_frame_timeline).setPValues(&serial);
+        g_vk_wait_semaphores(static_cast<VkDevice>(g_vk_device), reinterpret_cast<const VkSemaphoreWaitInfoKHR*>(&wait_info), UINT64_MAX);
+        return;
+    }
+
+    g_vk_device.waitForFences(1, &g_vk_fence[g_frame_index], VK_TRUE, UINT64_MAX);
+}
+
+/*
+ * Find out how far presenting is through the acquire of the frame that used the current frame index last time. The frame
+ * waited for the same acquire on GPU through its semaphore, so the fence is signaled by now, waiting for it doesn't stall.
+ */
+static void read_vk_present_progress() {
+    if (!g_vk_acquire_pending[g_frame_index])
+        return;
+
+    g_vk_device.waitForFences(1, &g_vk_image_acquired_fences[g_frame_index], VK_TRUE, UINT64_MAX);
+    g_vk_device.resetFences({ g_vk_image_acquired_fences[g_frame_index] });
+    g_vk_acquire_pending[g_frame_index] = false;
+    g_vk_completed_present_serial = std::max(g_vk_completed_present_serial, g_vk_acquired_present_serials[g_frame_index]);
+}
+
+/*
+ * Serial of the last frame done on GPU. The timeline semaphore knows exactly, otherwise it is at least the frame waited for.
+ */
+static unsigned long long get_vk_completed_serial() {
+    uint64_t serial = 0;
+    if (g_vk_frame_timeline && g_vk_get_semaphore_counter_value(static_cast<VkDevice>(g_vk_device), static_cast<VkSemaphore>(g_vk_frame_timeline), &serial) == VK_SUCCESS)
+        return serial;
+    return g_vk_frame_serials[g_frame_index];
+}
+
+
+/*
+ * Create the timestamp queries to measure GPU time of each frame.
+ */
+static bool create_vk_timestamp_queries() {
+    // GPU timing is simply disabled if the queue doesn't support it
+    if (g_vk_timestamp_valid_bits == 0)
+        return true;
+
+    vk::PhysicalDeviceProperties properties;
+    g_vk_physical_device.getProperties(&properties);
+    g_vk_timestamp_period = properties.limits.timestampPeriod;
+
+    auto const query_pool_info = vk::QueryPoolCreateInfo()
+        .setQueryType(vk::QueryType::eTimestamp)
+        .setQueryCount(g_vk_frames_in_flight * 2);
+    auto result = g_vk_device.createQueryPool(&query_pool_info, nullptr, &g_vk_timestamp_query_pool);
+    VERIFY(result);
+
     return true;
 }
 
 
+/*
+ * Read back the GPU time of the frame that used the current frame index last time, it is already done on GPU.
+ */
+static void read_vk_timestamps(FrameProfiler& profiler) {
+    if (!g_vk_timestamp_query_pool || g_vk_timestamp_frames[g_frame_index] == 0)
+        return;
+
+    uint64_t ticks[2] = { 0, 0 };
+    auto result = g_vk_device.getQueryPoolResults(g_vk_timestamp_query_pool, g_frame_index * 2, 2, sizeof(ticks), ticks, sizeof(uint64_t), vk::QueryResultFlagBits::e64);
+    if (result != vk::Result::eSuccess)
+        return;
+
+    // only the lower bits are valid
+    if (g_vk_timestamp_valid_bits < 64) {
+        const auto mask = (1ull << g_vk_timestamp_valid_bits) - 1;
+        ticks[0] &= mask;
+        ticks[1] &= mask;
+    }
+
+    const auto begin = (long long)(ticks[0] * (double)g_vk_timestamp_period);
+    const auto end = (long long)(ticks[1] * (double)g_vk_timestamp_period);
+    if (!g_vk_gpu_time_calibrated) {
+        g_vk_gpu_time_offset = g_vk_submit_time[g_frame_index] - begin;
+        g_vk_gpu_time_calibrated = true;
+    }
+
+    profiler.record_gpu("gpu frame", g_vk_timestamp_frames[g_frame_index], begin + g_vk_gpu_time_offset, end + g_vk_gpu_time_offset);
+    g_vk_frame_pacer.gpu_frame_done(end - begin);
+    g_vk_timestamp_frames[g_frame_index] = 0;
+}
+
+
+/*
+ * Create the threads recording commands, they run the tasks of initialization too.
+ */
+static void create_vk_thread_pool() {
+    // the calling thread is also recording, so one less worker thread is needed
+    auto thread_cnt = g_vk_requested_thread_cnt ? g_vk_requested_thread_cnt : std::thread::hardware_concurrency();
+    thread_cnt = std::max(thread_cnt, 1u);
+    g_vk_thread_pool = std::make_unique<ThreadPool>(thread_cnt - 1);
+}
+
+
 /*
  * Create command pool and command buffers
  */
@@ -489,232 +1138,924 @@ static bool create_vk_command() {
         .setCommandBufferCount(1);
 
     // create the command buffer
-    for (uint32_t i = 0; i < NUM_FRAMES; ++i) {
+    for (uint32_t i = 0; i < g_vk_frames_in_flight; ++i) {
         result = g_vk_device.allocateCommandBuffers(&cmd, &g_vk_graphics_cmd[i]);
         VERIFY(result);
     }
 
+    // Secondary command buffers are allocated lazily, there is no need to allocate them at all if the calling thread
+    // records everything itself.
+    auto const slot_pool_info = vk::CommandPoolCreateInfo()
+        .setQueueFamilyIndex(g_graphics_queue_family_index)
+        .setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+    for (uint32_t i = 0; i < g_vk_frames_in_flight; ++i) {
+        g_vk_slot_cmd_pools[i].resize(g_vk_thread_pool->slot_count());
+        g_vk_slot_cmds[i].resize(g_vk_thread_pool->slot_count());
+        for (auto& pool : g_vk_slot_cmd_pools[i]) {
+            result = g_vk_device.createCommandPool(&slot_pool_info, nullptr, &pool);
+            VERIFY(result);
+        }
+    }
+
     return true;
 }
 
 
 /*
- * Resource transition.
+ * Push constants of meshlet shaders, see 'shaders/meshlet_cull.glsl'.
  */
-template<vk::ImageLayout old_layout, vk::ImageLayout new_layout>
-void image_transition(vk::CommandBuffer& cb, const unsigned int current_buffer, const uint32_t src_queue_index, const uint32_t dst_queue_index) {
-    auto const barrier =
-        vk::ImageMemoryBarrier()
-        .setSrcAccessMask(vk::AccessFlags())
-        .setDstAccessMask(vk::AccessFlags())
-        .setOldLayout(old_layout)
-        .setNewLayout(new_layout)
-        .setSrcQueueFamilyIndex(src_queue_index)
-        .setDstQueueFamilyIndex(dst_queue_index)
-        .setImage(g_vk_images[current_buffer])
-        .setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1));
-
-    cb.pipelineBarrier(vk::PipelineStageFlagBits::eBottomOfPipe, vk::PipelineStageFlagBits::eBottomOfPipe,
-        vk::DependencyFlagBits(), 0, nullptr, 0, nullptr, 1, &barrier);
+struct MeshletPushConstants {
+    uint32_t    draw;
+    uint32_t    meshlet_cnt;
+    uint32_t    constant_base;          // in 16 bytes
+    uint32_t    constant_stride;        // in 16 bytes
+    uint32_t    counter_base;           // in 4 bytes
+    uint32_t    base_vertex;            // where the mesh is in the geometry pool
+};
+
+static MeshletPushConstants get_vk_meshlet_push_constants() {
+    MeshletPushConstants push;
+    push.draw = 0;
+    push.meshlet_cnt = g_vk_mesh.get_meshlet_count();
+    push.constant_base = (uint32_t)(g_vk_meshlet_constant_offset / 16);
+    push.constant_stride = (uint32_t)(g_vk_transient_alignment / 16);
+    push.counter_base = (uint32_t)(g_vk_meshlet_counter_offsets[g_frame_index] / sizeof(uint32_t));
+    push.base_vertex = g_vk_mesh_range.base_vertex;
+    return push;
 }
 
-
 /*
- * Create render pass.
+ * Write the constants of all draws of the frame and clear its culling counters, meshlet shaders read the constants of any
+ * draw, so they are laid out as an array in the transient memory instead of being allocated draw by draw.
  */
-static bool create_vk_render_pass() {
-    const vk::AttachmentDescription attachments[1] = { vk::AttachmentDescription()
-                                                          .setFormat(g_vk_format)
-                                                          .setSamples(vk::SampleCountFlagBits::e1)
-                                                          .setLoadOp(vk::AttachmentLoadOp::eClear)
-                                                          .setStoreOp(vk::AttachmentStoreOp::eStore)
-                                                          .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
-                                                          .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
-                                                          .setInitialLayout(vk::ImageLayout::eUndefined)
-                                                          .setFinalLayout(vk::ImageLayout::ePresentSrcKHR) };
-
-    auto const color_reference = vk::AttachmentReference().setAttachment(0).setLayout(vk::ImageLayout::eColorAttachmentOptimal);
-
-    auto const subpass = vk::SubpassDescription()
-        .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
-        .setInputAttachmentCount(0)
-        .setPInputAttachments(nullptr)
-        .setColorAttachmentCount(1)
-        .setPColorAttachments(&color_reference)
-        .setPResolveAttachments(nullptr)
-        .setPDepthStencilAttachment(nullptr)
-        .setPreserveAttachmentCount(0)
-        .setPPreserveAttachments(nullptr);
-
-    vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
-    vk::SubpassDependency const dependencies[1] = {
-        vk::SubpassDependency()  // Image layout transition
-            .setSrcSubpass(VK_SUBPASS_EXTERNAL)
-            .setDstSubpass(0)
-            .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-            .setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
-            .setSrcAccessMask(vk::AccessFlagBits())
-            .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eColorAttachmentRead)
-            .setDependencyFlags(vk::DependencyFlags()),
-    };
+static bool prepare_vk_meshlet_frame() {
+    auto& allocator = g_vk_frame_allocators[g_frame_index];
 
-    auto const rp_info = vk::RenderPassCreateInfo()
-        .setAttachmentCount(1)
-        .setPAttachments(attachments)
-        .setSubpassCount(1)
-        .setPSubpasses(&subpass)
-        .setDependencyCount(1)
-        .setPDependencies(dependencies);
+    size_t constant_offset = 0, counter_offset = 0;
+    auto constants = (uint8_t*)allocator.allocate(g_vk_transient_alignment * g_vk_draw_cnt, constant_offset);
+    auto counters = (uint32_t*)allocator.allocate(2 * sizeof(uint32_t), counter_offset);
+    if (!constants || !counters)
+        return false;
 
-    auto result = g_vk_device.createRenderPass(&rp_info, nullptr, &g_vk_render_pass);
-    VERIFY(result);
+    for (unsigned int i = 0; i < g_vk_draw_cnt; ++i)
+        *(DrawConstants*)(constants + g_vk_transient_alignment * i) = get_draw_constants(i, g_vk_draw_cnt, g_vk_position_decode);
+    counters[0] = counters[1] = 0;
 
+    g_vk_meshlet_constant_offset = constant_offset;
+    g_vk_meshlet_counter_offsets[g_frame_index] = counter_offset;
     return true;
 }
 
-
 /*
- * Create vulkan frame buffers
+ * Read the culling counters of the last frame with the current frame index, its fence has signaled.
  */
-static bool create_frame_buffers() {
-    // create frame buffer
-    vk::ImageView attachments[1];
-
-    auto const fb_info = vk::FramebufferCreateInfo()
-        .setRenderPass(g_vk_render_pass)
-        .setAttachmentCount(1)
-        .setPAttachments(attachments)
-        .setWidth((uint32_t)g_width)
-        .setHeight((uint32_t)g_height)
-        .setLayers(1);
+static void read_vk_meshlet_counters() {
+    auto& offset = g_vk_meshlet_counter_offsets[g_frame_index];
+    if (offset == SIZE_MAX)
+        return;
+
+    const auto counters = (const uint32_t*)((const uint8_t*)g_vk_transient_allocation.mapped + g_vk_transient_frame_size * g_frame_index + offset);
+    g_vk_meshlet_stats.tested = counters[0];
+    g_vk_meshlet_stats.visible = counters[1];
+    offset = SIZE_MAX;
+}
 
-    for (uint32_t i = 0; i < NUM_FRAMES; i++) {
-        attachments[0] = g_vk_image_views[i];
-        auto const result = g_vk_device.createFramebuffer(&fb_info, nullptr, &g_vk_frame_buffers[i]);
-        VERIFY(result);
+/*
+ * Cull the meshlets of all draws into indexed indirect draws, it is a pass before the render pass. The indirect buffer is
+ * shared by all frames, the render graph makes culling wait for the draws of the previous frame to be done reading it.
+ */
+static void record_vk_meshlet_culling(vk::CommandBuffer& cmd) {
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, g_vk_frame_meshlet_pipeline);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, g_vk_meshlet_pipeline_layout, 0, 1, &g_vk_meshlet_desc_set[g_frame_index], 0, nullptr);
+
+    // a workgroup culls a few meshlets of a draw, there is a row of workgroups for each draw
+    auto push = get_vk_meshlet_push_constants();
+    const auto group_cnt = (push.meshlet_cnt + MESHLETS_PER_CULL_GROUP - 1) / MESHLETS_PER_CULL_GROUP;
+    for (unsigned int first = 0; first < g_vk_meshlet_culled_draw_cnt; first += MAX_CULL_DRAWS_PER_DISPATCH) {
+        push.draw = first;
+        cmd.pushConstants(g_vk_meshlet_pipeline_layout, get_vk_meshlet_stages(), 0, sizeof(push), &push);
+        cmd.dispatch(group_cnt, std::min(g_vk_meshlet_culled_draw_cnt - first, (unsigned int)MAX_CULL_DRAWS_PER_DISPATCH), 1);
     }
-
-    return true;
 }
 
 /*
- * Create graphics pipeline.
+ * Draw the meshlets of the draws in [begin, end). With mesh shaders, each draw launches a task shader workgroup for every
+ * few meshlets. Otherwise the indirect draws of the meshlets written by culling are drawn with the regular pipeline, culled
+ * meshlets are draws without any instance.
  */
-static bool create_graphics_pipeline() {
-    // wait for shader to be ready
-    vk::PipelineCacheCreateInfo const pipeline_cache_info;
-    auto result = g_vk_device.createPipelineCache(&pipeline_cache_info, nullptr, &g_vk_pipeline_cache);
-    VERIFY(result);
-
-    auto const descriptor_layout = vk::DescriptorSetLayoutCreateInfo().setBindingCount(0);
-    result = g_vk_device.createDescriptorSetLayout(&descriptor_layout, nullptr, &g_vk_desc_layout);
-    VERIFY(result);
-
-    // descriptor layout
-    auto const pipeline_layout_create_info = vk::PipelineLayoutCreateInfo().setSetLayoutCount(1).setPSetLayouts(&g_vk_desc_layout);
-    result = g_vk_device.createPipelineLayout(&pipeline_layout_create_info, nullptr, &g_vk_pipeline_layout);
-    VERIFY(result);
-
-    // vertex format layout
-    vk::VertexInputAttributeDescription vertex_input_attr_descs[] = {
-        vk::VertexInputAttributeDescription().setOffset(0).setFormat(vk::Format::eR32G32B32Sfloat).setBinding(0).setLocation(0),
-        vk::VertexInputAttributeDescription().setOffset(12).setFormat(vk::Format::eR8G8B8A8Unorm).setBinding(0).setLocation(1)
-    };
-    const auto vertex_input_binding_descs = std::array<vk::VertexInputBindingDescription, 1>({
-        vk::VertexInputBindingDescription().setBinding(0).setStride(sizeof(Vertex)).setInputRate(vk::VertexInputRate::eVertex),
-    });
-    auto const vertex_input_layout = vk::PipelineVertexInputStateCreateInfo()
-                                .setVertexAttributeDescriptionCount(2)
-                                .setPVertexAttributeDescriptions(vertex_input_attr_descs)
-                                .setVertexBindingDescriptionCount(1)
-                                .setVertexBindingDescriptions(vertex_input_binding_descs);
-    
-    // input assembly info
-    auto const input_assembler_info = vk::PipelineInputAssemblyStateCreateInfo()
-                                .setTopology(vk::PrimitiveTopology::eTriangleList);
-
-    // rasterizer information
-    auto const rasterizer_info = vk::PipelineRasterizationStateCreateInfo()
-                                .setDepthClampEnable(VK_FALSE)
-                                .setRasterizerDiscardEnable(VK_FALSE)
-                                .setPolygonMode(vk::PolygonMode::eFill)
-                                .setCullMode(vk::CullModeFlagBits::eNone)
-                                .setFrontFace(vk::FrontFace::eCounterClockwise)
-                                .setDepthBiasEnable(VK_FALSE)
-                                .setLineWidth(1.0f);
-
-    // depth stencil info
-    auto const depth_stencil_info = vk::PipelineDepthStencilStateCreateInfo()
-                                .setDepthTestEnable(VK_FALSE)
-                                .setDepthWriteEnable(VK_FALSE);
-    
-    // color blend state
-    vk::PipelineColorBlendAttachmentState const color_blend[1] = {
-        vk::PipelineColorBlendAttachmentState().setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
-                                                                  vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA) };
-    auto const color_blend_state =
-        vk::PipelineColorBlendStateCreateInfo().setAttachmentCount(1).setPAttachments(color_blend);
-
-    // dynamic state
-    vk::DynamicState const dynamic_states[2] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
-    auto const dynamic_state_info = vk::PipelineDynamicStateCreateInfo().setPDynamicStates(dynamic_states).setDynamicStateCount(2);
+static void record_vk_meshlet_draws(vk::CommandBuffer& cmd, const unsigned int begin, const unsigned int end) {
+    auto push = get_vk_meshlet_push_constants();
+
+    if (g_vk_meshlet_path == MeshletPath::MeshShader) {
+#if defined(VK_EXT_mesh_shader)
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, g_vk_meshlet_pipeline_layout, 0, 1, &g_vk_meshlet_desc_set[g_frame_index], 0, nullptr);
+        const auto task_cnt = (push.meshlet_cnt + MESHLETS_PER_TASK - 1) / MESHLETS_PER_TASK;
+        for (auto i = begin; i < end; ++i) {
+            push.draw = i;
+            cmd.pushConstants(g_vk_meshlet_pipeline_layout, get_vk_meshlet_stages(), 0, sizeof(push), &push);
+            g_vk_cmd_draw_mesh_tasks(static_cast<VkCommandBuffer>(cmd), task_cnt, 1, 1);
+        }
+#endif
+        return;
+    }
 
-    // multi sample info
-    auto const multi_sample_info = vk::PipelineMultisampleStateCreateInfo();
+    cmd.bindIndexBuffer(g_vk_meshlet_buffers[MESHLET_BUFFER_INDICES], 0, vk::IndexType::eUint32);
+    const auto stride = (uint32_t)sizeof(vk::DrawIndexedIndirectCommand);
+    for (auto i = begin; i < end; ++i) {
+        const auto dynamic_offset = (uint32_t)(g_vk_meshlet_constant_offset + g_vk_transient_alignment * i);
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, g_vk_pipeline_layout, 0, 1, &g_vk_desc_set[g_frame_index], 1, &dynamic_offset);
 
-    // viewport info
-    auto const viewport_info = vk::PipelineViewportStateCreateInfo().setViewportCount(1).setScissorCount(1);
+        // there is no room to cull this draw, all triangles of all meshlets are drawn
+        if (i >= g_vk_meshlet_culled_draw_cnt) {
+            cmd.drawIndexed(g_vk_mesh.get_meshlet_triangles_size(), 1, 0, (int32_t)g_vk_mesh_range.base_vertex, 0);
+            continue;
+        }
 
-    // create vertex shader module
-    {
-        const auto moduleCreateInfo = vk::ShaderModuleCreateInfo().setCodeSize(sizeof(vs_vert_glsl)).setPCode(vs_vert_glsl);
-        auto result = g_vk_device.createShaderModule(&moduleCreateInfo, nullptr, &g_vk_vs_module);
-        VERIFY(result);
-    }
-    // create pixel shader module
-    {
-        const auto moduleCreateInfo = vk::ShaderModuleCreateInfo().setCodeSize(sizeof(ps_frag_glsl)).setPCode(ps_frag_glsl);
-        auto result = g_vk_device.createShaderModule(&moduleCreateInfo, nullptr, &g_vk_ps_module);
-        VERIFY(result);
+        // without 'multiDrawIndirect', each meshlet is an indirect draw of its own
+        const auto offset = (vk::DeviceSize)stride * push.meshlet_cnt * i;
+        for (uint32_t first = 0; first < push.meshlet_cnt; first += g_vk_max_draw_indirect_cnt) {
+            const auto cnt = std::min(push.meshlet_cnt - first, g_vk_max_draw_indirect_cnt);
+            cmd.drawIndexedIndirect(g_vk_meshlet_buffers[MESHLET_BUFFER_COMMANDS], offset + (vk::DeviceSize)stride * first, cnt, stride);
+        }
     }
+}
 
-    vk::PipelineShaderStageCreateInfo const shaderStageInfo[2] = {
-        vk::PipelineShaderStageCreateInfo().setStage(vk::ShaderStageFlagBits::eVertex).setModule(g_vk_vs_module).setPName("main"),
-        vk::PipelineShaderStageCreateInfo().setStage(vk::ShaderStageFlagBits::eFragment).setModule(g_vk_ps_module).setPName("main") };
-
-    // pipeline create info
-    auto const pipeline = vk::GraphicsPipelineCreateInfo()
-                                .setStageCount(2)
-                                .setPVertexInputState(&vertex_input_layout)
-                                .setPInputAssemblyState(&input_assembler_info)
-                                .setPRasterizationState(&rasterizer_info)
-                                .setPDepthStencilState(&depth_stencil_info)
-                                .setPViewportState(&viewport_info)
-                                .setPStages(shaderStageInfo)
-                                .setPColorBlendState(&color_blend_state)
-                                .setLayout(g_vk_pipeline_layout)
-                                .setPDynamicState(&dynamic_state_info)
-                                .setPMultisampleState(&multi_sample_info)
-                                .setRenderPass(g_vk_render_pass);
-
-    result = g_vk_device.createGraphicsPipelines(g_vk_pipeline_cache, 1, &pipeline, nullptr, &g_vk_pipeline);
-    VERIFY(result);
+/*
+ * Clear the counter of visible objects of the frame, it is the only thing culling needs from CPU each frame.
+ */
+static bool prepare_vk_gpu_culling_frame() {
+    size_t offset = 0;
+    auto counter = (uint32_t*)g_vk_frame_allocators[g_frame_index].allocate(sizeof(uint32_t), offset);
+    if (!counter)
+        return false;
 
+    *counter = 0;
+    g_vk_object_counter_offsets[g_frame_index] = offset;
     return true;
 }
 
-
 /*
- * Create an empty descripot set.
+ * Read the counter of visible objects of the last frame with the current frame index, its fence has signaled.
  */
-static bool create_descriptor_set() {
-    // this is not really needed since empty pool will result in failure in vulkan gpu validation
+static void read_vk_gpu_culling_counter() {
+    auto& offset = g_vk_object_counter_offsets[g_frame_index];
+    if (offset == SIZE_MAX)
+        return;
+
+    g_vk_gpu_culling_stats.visible = *(const uint32_t*)((const uint8_t*)g_vk_transient_allocation.mapped + g_vk_transient_frame_size * g_frame_index + offset);
+    offset = SIZE_MAX;
+}
+
+/*
+ * Cull all objects into indexed indirect draws, it is a pass before the render pass. The indirect draws are shared by all
+ * frames, the render graph makes culling wait for the draws of the previous frame to be done reading them.
+ */
+static void record_vk_gpu_culling(vk::CommandBuffer& cmd) {
+    cmd.bindPipeline(vk::PipelineBindPoint::eCompute, g_vk_frame_object_cull_pipeline);
+    cmd.bindDescriptorSets(vk::PipelineBindPoint::eCompute, g_vk_object_cull_pipeline_layout, 0, 1, &g_vk_object_cull_desc_set[g_frame_index], 0, nullptr);
+
+    GpuCullingConstants push;
+    get_gpu_culling_sphere(g_vk_mesh.get_bounds_min(), g_vk_mesh.get_bounds_max(), g_vk_position_decode, push.sphere);
+    push.object_cnt = g_vk_draw_cnt;
+    push.index_cnt = g_vk_mesh_range.index_cnt;
+    push.first_index = g_vk_mesh_range.first_index;
+    push.base_vertex = g_vk_mesh_range.base_vertex;
+    push.compact = g_vk_gpu_culling_path == GpuCullingPath::IndirectCount ? 1 : 0;
+    push.counter = (uint32_t)(g_vk_object_counter_offsets[g_frame_index] / sizeof(uint32_t));
+
+    // a million objects is still a single dispatch
+    const auto objects_per_dispatch = OBJECTS_PER_CULL_GROUP * MAX_CULL_DRAWS_PER_DISPATCH;
+    for (unsigned int first = 0; first < g_vk_draw_cnt; first += objects_per_dispatch) {
+        push.first = first;
+        cmd.pushConstants(g_vk_object_cull_pipeline_layout, vk::ShaderStageFlagBits::eCompute, 0, sizeof(push), &push);
+        cmd.dispatch((std::min(g_vk_draw_cnt - first, (unsigned int)objects_per_dispatch) + OBJECTS_PER_CULL_GROUP - 1) / OBJECTS_PER_CULL_GROUP, 1, 1);
+    }
+}
+
+/*
+ * Draw the objects, the instance stream is the data of all objects. Once culling runs, the visible objects are a single
+ * indirect count draw, or indirect draws of all objects with the culled ones drawing nothing. Until then, all objects in
+ * [begin, end) are simply drawn as instances.
+ */
+static void record_vk_gpu_culled_draws(vk::CommandBuffer& cmd, const unsigned int begin, const unsigned int end) {
+    const vk::DeviceSize object_offset = 0;
+    cmd.bindVertexBuffers(1, 1, &g_vk_object_buffer, &object_offset);
+
+    if (!g_vk_frame_gpu_culling) {
+        cmd.drawIndexed(g_vk_mesh_range.index_cnt, end - begin, g_vk_mesh_range.first_index, (int32_t)g_vk_mesh_range.base_vertex, begin);
+        return;
+    }
+
+    const auto stride = (uint32_t)sizeof(vk::DrawIndexedIndirectCommand);
+    if (g_vk_gpu_culling_path == GpuCullingPath::IndirectCount) {
+        const auto counter_offset = g_vk_transient_frame_size * g_frame_index + g_vk_object_counter_offsets[g_frame_index];
+        g_vk_cmd_draw_indexed_indirect_count(static_cast<VkCommandBuffer>(cmd), static_cast<VkBuffer>(g_vk_object_draw_buffer), 0,
+                                             static_cast<VkBuffer>(g_vk_transient_buffer), counter_offset, g_vk_draw_cnt, stride);
+        return;
+    }
+
+    // without 'multiDrawIndirect', each object is an indirect draw of its own
+    for (uint32_t first = 0; first < g_vk_draw_cnt; first += g_vk_max_draw_indirect_cnt) {
+        const auto cnt = std::min(g_vk_draw_cnt - first, g_vk_max_draw_indirect_cnt);
+        cmd.drawIndexedIndirect(g_vk_object_draw_buffer, (vk::DeviceSize)stride * first, cnt, stride);
+    }
+}
+
+/*
+ * Bind everything needed for drawing the triangle and issue the draw calls in [begin, end).
+ * Secondary command buffers don't inherit any state from the primary one, this is done for each of them.
+ */
+static void record_vk_draws(vk::CommandBuffer& cmd, const unsigned int begin, const unsigned int end) {
+    // mesh shaders draw without the regular pipeline, the vertex and index buffers are not used either
+    if (g_vk_frame_meshlets && g_vk_meshlet_path == MeshletPath::MeshShader) {
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, g_vk_frame_meshlet_pipeline);
+    }
+    else {
+        // nothing to draw with yet
+        if (!g_vk_frame_pipeline)
+            return;
+
+        cmd.bindPipeline(vk::PipelineBindPoint::eGraphics, g_vk_frame_pipeline);
+        const VkDeviceSize offsets[1] = { 0 };
+        cmd.bindVertexBuffers(0, 1, &g_vk_vertex_buffer, offsets);
+        cmd.bindIndexBuffer(g_vk_index_buffer, 0, g_vk_geometry_pool.get_index_size() == 2 ? vk::IndexType::eUint16 : vk::IndexType::eUint32);
+    }
+
+    // setup viewport
+    auto const viewport = vk::Viewport()
+        .setX(0)
+        .setY(0)
+        .setWidth((float)g_width)
+        .setHeight((float)g_height)
+        .setMinDepth((float)0.0f)
+        .setMaxDepth((float)1.0f);
+    cmd.setViewport(0, 1, &viewport);
+
+    // setup scissor rect
+    vk::Rect2D const scissor(vk::Offset2D(0, 0), vk::Extent2D(g_width, g_height));
+    cmd.setScissor(0, 1, &scissor);
+
+    if (g_vk_frame_meshlets) {
+        record_vk_meshlet_draws(cmd, begin, end);
+        return;
+    }
+
+    if (g_vk_gpu_culling_path != GpuCullingPath::None) {
+        record_vk_gpu_culled_draws(cmd, begin, end);
+        return;
+    }
+
+    // The instanced pipeline doesn't read the per-draw constants, all draws are a single draw of the instances in the transient
+    // memory. Nothing is drawn if there is no room for the instance data.
+    if (g_vk_instancing) {
+        if (g_vk_frame_instances) {
+            const vk::DeviceSize instance_offset = g_vk_transient_frame_size * g_frame_index + g_vk_instance_offset;
+            cmd.bindVertexBuffers(1, 1, &g_vk_transient_buffer, &instance_offset);
+            cmd.drawIndexed(g_vk_mesh_range.index_cnt, end - begin, g_vk_mesh_range.first_index, (int32_t)g_vk_mesh_range.base_vertex, begin);
+        }
+        return;
+    }
+
+    // Constants of each draw are written right into the transient memory of the frame, the only thing left is to bind them
+    // with the dynamic offset. The memory of the frame has room for the constants of all draws, a failure is only possible
+    // if that is broken, it shows up in the failed allocations of the transient memory stats.
+    auto& allocator = g_vk_frame_allocators[g_frame_index];
+    for (auto i = begin; i < end; ++i) {
+        size_t offset = 0;
+        auto constants = (DrawConstants*)allocator.allocate(sizeof(DrawConstants), offset);
+        if (!constants)
+            continue;
+        *constants = get_draw_constants(i, g_vk_draw_cnt, g_vk_position_decode);
+
+        const auto dynamic_offset = (uint32_t)offset;
+        cmd.bindDescriptorSets(vk::PipelineBindPoint::eGraphics, g_vk_pipeline_layout, 0, 1, &g_vk_desc_set[g_frame_index], 1, &dynamic_offset);
+        cmd.drawIndexed(g_vk_mesh_range.index_cnt, 1, g_vk_mesh_range.first_index, (int32_t)g_vk_mesh_range.base_vertex, 0);
+    }
+}
+
+
+/*
+ * Write the data of all instances of the frame into its transient memory, the instances are split between all threads.
+ */
+static bool prepare_vk_instances() {
+    size_t offset = 0;
+    auto instances = (InstanceData*)g_vk_frame_allocators[g_frame_index].allocate(sizeof(InstanceData) * g_vk_draw_cnt, offset);
+    if (!instances)
+        return false;
+
+    const auto task_cnt = (g_vk_draw_cnt + INSTANCES_PER_TASK - 1) / INSTANCES_PER_TASK;
+    g_vk_thread_pool->parallel_for(task_cnt, [instances](const unsigned int task, const unsigned int slot) {
+        const auto end = std::min(g_vk_draw_cnt, (task + 1) * INSTANCES_PER_TASK);
+        for (auto i = task * INSTANCES_PER_TASK; i < end; ++i)
+            instances[i] = get_instance_data(i, g_vk_draw_cnt, g_vk_position_decode);
+    });
+
+    g_vk_instance_offset = offset;
+    return true;
+}
+
+
+/*
+ * Record a slice of the draw calls into a secondary command buffer of the thread slot, it is executed inside the render pass
+ * of the primary command buffer.
+ */
+static vk::CommandBuffer record_vk_slice(const unsigned int slot, const unsigned int current_buffer, const unsigned int begin, const unsigned int end, unsigned int& cmd_index) {
+    auto& cmds = g_vk_slot_cmds[g_frame_index][slot];
+
+    // a thread slot may record more than one slice, allocate a new command buffer if there is none left
+    if (cmd_index == cmds.size()) {
+        auto const alloc_info = vk::CommandBufferAllocateInfo()
+            .setCommandPool(g_vk_slot_cmd_pools[g_frame_index][slot])
+            .setLevel(vk::CommandBufferLevel::eSecondary)
+            .setCommandBufferCount(1);
+
+        vk::CommandBuffer cmd;
+        auto result = g_vk_device.allocateCommandBuffers(&alloc_info, &cmd);
+        assert(result == vk::Result::eSuccess);
+        cmds.push_back(cmd);
+    }
+    auto& cmd = cmds[cmd_index++];
+
+    auto const inheritance_info = vk::CommandBufferInheritanceInfo()
+        .setRenderPass(g_vk_render_pass)
+        .setSubpass(0)
+        .setFramebuffer(g_vk_frame_buffers[current_buffer]);
+    auto const begin_info = vk::CommandBufferBeginInfo()
+        .setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit | vk::CommandBufferUsageFlagBits::eRenderPassContinue)
+        .setPInheritanceInfo(&inheritance_info);
+
+    cmd.begin(&begin_info);
+    record_vk_draws(cmd, begin, end);
+    cmd.end();
+
+    return cmd;
+}
+
+
+/*
+ * Pipeline stages, accesses and image layout of a usage of the render graph.
+ */
+struct VulkanUsage {
+    vk::PipelineStageFlags  stages;
+    vk::AccessFlags         access;
+    vk::ImageLayout         layout;
+};
+
+static VulkanUsage get_vk_usage(const ResourceUsage usage) {
+    switch (usage) {
+    case ResourceUsage::IndirectArgument:
+        return { vk::PipelineStageFlagBits::eDrawIndirect, vk::AccessFlagBits::eIndirectCommandRead, vk::ImageLayout::eUndefined };
+    case ResourceUsage::ComputeWrite:
+        return { vk::PipelineStageFlagBits::eComputeShader, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral };
+    case ResourceUsage::TaskShaderWrite:
+#if defined(VK_EXT_mesh_shader)
+        return { vk::PipelineStageFlagBits::eTaskShaderEXT, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral };
+#else
+        return { vk::PipelineStageFlagBits::eAllCommands, vk::AccessFlagBits::eShaderRead | vk::AccessFlagBits::eShaderWrite, vk::ImageLayout::eGeneral };
+#endif
+    case ResourceUsage::ColorAttachment:
+        return { vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlagBits::eColorAttachmentRead | vk::AccessFlagBits::eColorAttachmentWrite, vk::ImageLayout::eColorAttachmentOptimal };
+    case ResourceUsage::CopySource:
+        return { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferRead, vk::ImageLayout::eTransferSrcOptimal };
+    case ResourceUsage::CopyDest:
+        return { vk::PipelineStageFlagBits::eTransfer, vk::AccessFlagBits::eTransferWrite, vk::ImageLayout::eTransferDstOptimal };
+    case ResourceUsage::HostRead:
+        return { vk::PipelineStageFlagBits::eHost, vk::AccessFlagBits::eHostRead, vk::ImageLayout::eGeneral };
+    case ResourceUsage::Present:
+        // the stage the image acquired semaphore is waited at, the presentation engine waits for the draw complete semaphore
+        return { vk::PipelineStageFlagBits::eColorAttachmentOutput, vk::AccessFlags(), vk::ImageLayout::ePresentSrcKHR };
+    default:
+        return { vk::PipelineStageFlagBits::eTopOfPipe, vk::AccessFlags(), vk::ImageLayout::eUndefined };
+    }
+}
+
+/*
+ * A resource of the render graph of the current frame, buffers are tracked as a whole and take no handle.
+ */
+static RenderGraph::ResourceId import_vk_resource(const char* name, const vk::Image image, const ResourceUsage initial, const ResourceUsage final_usage) {
+    g_vk_graph_images.push_back(image);
+    return g_vk_render_graph.import_resource(name, initial, final_usage);
+}
+
+/*
+ * Record the barriers placed between two passes by the render graph as a single pipeline barrier. Buffers need no barrier if
+ * nothing writes them, they share a single memory barrier since there is nothing to transition, images get one each. Only
+ * writes are made available, a read before a write only needs its stage to be done.
+ */
+static unsigned int record_vk_barriers(vk::CommandBuffer& cmd, const RenderGraphBarrier* barriers, const unsigned int barrier_cnt) {
+    vk::PipelineStageFlags src_stages, dst_stages;
+    vk::AccessFlags src_access, dst_access;
+    std::vector<vk::ImageMemoryBarrier> image_barriers;
+
+    unsigned int recorded = 0;
+    for (unsigned int i = 0; i < barrier_cnt; ++i) {
+        const auto& barrier = barriers[i];
+        const auto before = get_vk_usage(barrier.before);
+        const auto after = get_vk_usage(barrier.after);
+        const auto image = g_vk_graph_images[barrier.resource];
+        const auto src = is_write_usage(barrier.before) ? before.access : vk::AccessFlags();
+        const auto hazard = is_write_usage(barrier.before) || is_write_usage(barrier.after);
+
+        if (!image) {
+            // Host only sees memory made visible to it, even if the last access on GPU is a read. Memory written by nobody in
+            // the frame is visible already, the submission takes care of host writes.
+            if (barrier.before == ResourceUsage::None || (!hazard && barrier.after != ResourceUsage::HostRead))
+                continue;
+            src_access |= src;
+            dst_access |= (src || barrier.after == ResourceUsage::HostRead) ? after.access : vk::AccessFlags();
+        } else {
+            const auto old_layout = barrier.discard ? vk::ImageLayout::eUndefined : before.layout;
+            if (!hazard && old_layout == after.layout)
+                continue;
+            image_barriers.push_back(vk::ImageMemoryBarrier()
+                .setSrcAccessMask(src)
+                .setDstAccessMask(after.access)
+                .setOldLayout(old_layout)
+                .setNewLayout(after.layout)
+                .setSrcQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setDstQueueFamilyIndex(VK_QUEUE_FAMILY_IGNORED)
+                .setImage(image)
+                .setSubresourceRange(vk::ImageSubresourceRange(vk::ImageAspectFlagBits::eColor, 0, 1, 0, 1)));
+        }
+
+        src_stages |= before.stages;
+        dst_stages |= after.stages;
+        ++recorded;
+    }
+
+    if (!recorded)
+        return 0;
+
+    auto const memory_barrier = vk::MemoryBarrier().setSrcAccessMask(src_access).setDstAccessMask(dst_access);
+    const auto memory_barrier_cnt = (src_access || dst_access) ? 1u : 0u;
+    cmd.pipelineBarrier(src_stages, dst_stages, vk::DependencyFlags(), memory_barrier_cnt, &memory_barrier, 0, nullptr, (uint32_t)image_barriers.size(), image_barriers.data());
+    return recorded;
+}
+
+
+/*
+ * Create render pass.
+ */
+static bool create_vk_render_pass() {
+    const vk::AttachmentDescription attachments[1] = { vk::AttachmentDescription()
+                                                          .setFormat(g_vk_format)
+                                                          .setSamples(vk::SampleCountFlagBits::e1)
+                                                          .setLoadOp(vk::AttachmentLoadOp::eClear)
+                                                          .setStoreOp(vk::AttachmentStoreOp::eStore)
+                                                          .setStencilLoadOp(vk::AttachmentLoadOp::eDontCare)
+                                                          .setStencilStoreOp(vk::AttachmentStoreOp::eDontCare)
+                                                          .setInitialLayout(vk::ImageLayout::eUndefined)
+                                                          .setFinalLayout(g_vk_offscreen ? vk::ImageLayout::eTransferSrcOptimal : vk::ImageLayout::ePresentSrcKHR) };
+
+    auto const color_reference = vk::AttachmentReference().setAttachment(0).setLayout(vk::ImageLayout::eColorAttachmentOptimal);
+
+    auto const subpass = vk::SubpassDescription()
+        .setPipelineBindPoint(vk::PipelineBindPoint::eGraphics)
+        .setInputAttachmentCount(0)
+        .setPInputAttachments(nullptr)
+        .setColorAttachmentCount(1)
+        .setPColorAttachments(&color_reference)
+        .setPResolveAttachments(nullptr)
+        .setPDepthStencilAttachment(nullptr)
+        .setPreserveAttachmentCount(0)
+        .setPPreserveAttachments(nullptr);
+
+    vk::PipelineStageFlags stages = vk::PipelineStageFlagBits::eEarlyFragmentTests | vk::PipelineStageFlagBits::eLateFragmentTests;
+    vk::SubpassDependency const dependencies[1] = {
+        vk::SubpassDependency()  // Image layout transition
+            .setSrcSubpass(VK_SUBPASS_EXTERNAL)
+            .setDstSubpass(0)
+            .setSrcStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+            .setDstStageMask(vk::PipelineStageFlagBits::eColorAttachmentOutput)
+            .setSrcAccessMask(vk::AccessFlagBits())
+            .setDstAccessMask(vk::AccessFlagBits::eColorAttachmentWrite | vk::AccessFlagBits::eColorAttachmentRead)
+            .setDependencyFlags(vk::DependencyFlags()),
+    };
+
+    auto const rp_info = vk::RenderPassCreateInfo()
+        .setAttachmentCount(1)
+        .setPAttachments(attachments)
+        .setSubpassCount(1)
+        .setPSubpasses(&subpass)
+        .setDependencyCount(1)
+        .setPDependencies(dependencies);
+
+    g_vk_render_pass = g_vk_pipeline_registry.get_render_pass(rp_info);
+    if (!g_vk_render_pass)
+        return false;
+
+    return true;
+}
+
+
+/*
+ * Create vulkan frame buffers
+ */
+static bool create_frame_buffers() {
+    // create frame buffer
+    vk::ImageView attachments[1];
+
+    auto const fb_info = vk::FramebufferCreateInfo()
+        .setRenderPass(g_vk_render_pass)
+        .setAttachmentCount(1)
+        .setPAttachments(attachments)
+        .setWidth((uint32_t)g_width)
+        .setHeight((uint32_t)g_height)
+        .setLayers(1);
+
+    for (uint32_t i = 0; i < g_vk_image_cnt; i++) {
+        attachments[0] = g_vk_image_views[i];
+        auto const result = g_vk_device.createFramebuffer(&fb_info, nullptr, &g_vk_frame_buffers[i]);
+        VERIFY(result);
+    }
+
+    return true;
+}
+
+/*
+ * Destroy the swapchain and everything created along with it right away, it is only for a swapchain GPU has never used, like
+ * one whose recreation fails half way. Objects that are not created yet are null, destroying them does nothing.
+ */
+static void destroy_unused_vk_swapchain() {
+    for (uint32_t i = 0; i < MAX_SWAPCHAIN_IMAGES; i++) {
+        g_vk_device.destroyFramebuffer(g_vk_frame_buffers[i], nullptr);
+        g_vk_device.destroyImageView(g_vk_image_views[i], nullptr);
+        g_vk_device.destroySemaphore(g_vk_draw_complete_semaphores[i], nullptr);
+        g_vk_frame_buffers[i] = vk::Framebuffer();
+        g_vk_image_views[i] = vk::ImageView();
+        g_vk_draw_complete_semaphores[i] = vk::Semaphore();
+    }
+    g_vk_device.destroySwapchainKHR(g_vk_swapchain, nullptr);
+    g_vk_swapchain = vk::SwapchainKHR();
+    g_vk_image_cnt = 0;
+}
+
+/*
+ * Recreate the swapchain when the window is resized or the swapchain no longer matches the surface.
+ * Only what depends on the swapchain images is rebuilt, the render pass and the pipelines stay since the format doesn't change
+ * and the viewport is dynamic. Nothing waits for GPU to be idle. The frame buffers and the image views are retired once the
+ * frames in flight are done with them. That is not enough for the old swapchain, presents to it may still be waiting for its
+ * semaphores. They are retired once the first present to the new swapchain is done, all presents before it are done by then.
+ */
+static bool recreate_vk_swapchain() {
+    std::vector<vk::ImageView> old_views(g_vk_image_views, g_vk_image_views + g_vk_image_cnt);
+    std::vector<vk::Framebuffer> old_frame_buffers(g_vk_frame_buffers, g_vk_frame_buffers + g_vk_image_cnt);
+    std::vector<vk::Semaphore> old_semaphores(g_vk_draw_complete_semaphores, g_vk_draw_complete_semaphores + g_vk_image_cnt);
+    const auto old_swapchain = g_vk_swapchain;
+
+    // the old objects belong to the deletion queues from now on, nothing else may destroy them
+    std::fill(std::begin(g_vk_image_views), std::end(g_vk_image_views), vk::ImageView());
+    std::fill(std::begin(g_vk_frame_buffers), std::end(g_vk_frame_buffers), vk::Framebuffer());
+    std::fill(std::begin(g_vk_draw_complete_semaphores), std::end(g_vk_draw_complete_semaphores), vk::Semaphore());
+    g_vk_swapchain = vk::SwapchainKHR();
+    g_vk_image_cnt = 0;
+    std::fill(std::begin(g_vk_image_present_serials), std::end(g_vk_image_present_serials), 0);
+
+    // A failed recreation leaves nothing to retire, the next one starts from scratch. Frame buffers and image views are only
+    // used by the frames, they go once the frames submitted so far are done.
+    if (old_swapchain) {
+        g_vk_deletion_queue.push(g_vk_submitted_serial, [=]() {
+            for (auto& frame_buffer : old_frame_buffers)
+                g_vk_device.destroyFramebuffer(frame_buffer, nullptr);
+            for (auto& view : old_views)
+                g_vk_device.destroyImageView(view, nullptr);
+        });
+        g_vk_present_deletion_queue.push(g_vk_present_serial + 1, [=]() {
+            for (auto& semaphore : old_semaphores)
+                g_vk_device.destroySemaphore(semaphore, nullptr);
+            g_vk_device.destroySwapchainKHR(old_swapchain, nullptr);
+        });
+    }
+
+    // A failure, like a minimized window, leaves no swapchain at all, it is tried again next frame. The old swapchain is
+    // retired anyway, whatever is created for the new one is never used, it is destroyed right away.
+    if (!create_vk_swapchain(old_swapchain) || !create_frame_buffers() || !create_vk_draw_complete_semaphores()) {
+        destroy_unused_vk_swapchain();
+        return false;
+    }
+
+    g_vk_swapchain_dirty = false;
+    return true;
+}
+
+/*
+ * The pipeline cache is only valid for the same GPU and driver.
+ */
+static PipelineCacheKey get_vk_pipeline_cache_key() {
+    vk::PhysicalDeviceProperties properties;
+    g_vk_physical_device.getProperties(&properties);
+
+    PipelineCacheKey key;
+    key.vendor_id = properties.vendorID;
+    key.device_id = properties.deviceID;
+    key.driver_version = properties.driverVersion;
+    memcpy(key.uuid, properties.pipelineCacheUUID.data(), VK_UUID_SIZE);
+    return key;
+}
+
+/*
+ * Create the pipeline cache with the blob saved by the last launch, so that pipelines don't need to be compiled again.
+ */
+static bool create_vk_pipeline_cache() {
+    const auto key = get_vk_pipeline_cache_key();
+    auto& blob = g_vk_loaded_pipeline_cache;
+    load_pipeline_cache(PIPELINE_CACHE_FILE, key, blob);
+
+    // Drivers are supposed to ignore a blob from another device, but not all of them do, the header of the blob is checked
+    // before passing it to the driver.
+    if (!blob.empty()) {
+        uint32_t header[4] = {};
+        if (blob.size() >= sizeof(header) + VK_UUID_SIZE)
+            memcpy(header, blob.data(), sizeof(header));
+        if (header[0] < sizeof(header) + VK_UUID_SIZE || header[0] > blob.size() || header[1] != VK_PIPELINE_CACHE_HEADER_VERSION_ONE ||
+            header[2] != key.vendor_id || header[3] != key.device_id || memcmp(blob.data() + sizeof(header), key.uuid, VK_UUID_SIZE) != 0)
+            blob.clear();
+    }
+
+    auto const pipeline_cache_info = vk::PipelineCacheCreateInfo()
+        .setInitialDataSize(blob.size())
+        .setPInitialData(blob.empty() ? nullptr : blob.data());
+    auto result = g_vk_device.createPipelineCache(&pipeline_cache_info, nullptr, &g_vk_pipeline_cache);
+    if (result != vk::Result::eSuccess) {
+        // it doesn't hurt to start with an empty cache
+        blob.clear();
+        auto const empty_cache_info = vk::PipelineCacheCreateInfo();
+        result = g_vk_device.createPipelineCache(&empty_cache_info, nullptr, &g_vk_pipeline_cache);
+        VERIFY(result);
+    }
+
+    g_vk_pipeline_registry.set_pipeline_cache(g_vk_pipeline_cache);
+    return true;
+}
+
+/*
+ * Write the pipeline cache to disk if anything is added since it was created.
+ */
+static bool save_vk_pipeline_cache() {
+    if (!g_vk_pipeline_cache)
+        return false;
+
+    size_t size = 0;
+    auto result = g_vk_device.getPipelineCacheData(g_vk_pipeline_cache, &size, nullptr);
+    VERIFY(result);
+    std::vector<uint8_t> blob(size);
+    result = g_vk_device.getPipelineCacheData(g_vk_pipeline_cache, &size, blob.data());
+    VERIFY(result);
+    blob.resize(size);
+
+    if (blob == g_vk_loaded_pipeline_cache)
+        return true;
+    if (!save_pipeline_cache(PIPELINE_CACHE_FILE, get_vk_pipeline_cache_key(), blob.data(), blob.size()))
+        return false;
+
+    g_vk_loaded_pipeline_cache.swap(blob);
+    return true;
+}
+
+/*
+ * Whether draws fetch their scale and offset from an instance stream instead of the per-draw constants, both the instancing
+ * path and GPU culling do.
+ */
+static bool is_vk_instanced() {
+    return g_vk_instancing || g_vk_gpu_culling_path != GpuCullingPath::None;
+}
+
+/*
+ * Create the shader modules.
+ */
+static bool create_vk_shader_modules() {
+    g_vk_vs_module = g_vk_pipeline_registry.get_shader_module(vs_vert_glsl, sizeof(vs_vert_glsl));
+    g_vk_ps_module = g_vk_pipeline_registry.get_shader_module(ps_frag_glsl, sizeof(ps_frag_glsl));
+    if (!g_vk_vs_module || !g_vk_ps_module)
+        return false;
+
+    if (is_vk_instanced()) {
+        g_vk_vs_instanced_module = g_vk_pipeline_registry.get_shader_module(vs_instanced_vert_glsl, sizeof(vs_instanced_vert_glsl));
+        if (!g_vk_vs_instanced_module)
+            return false;
+    }
+
+    if (g_vk_gpu_culling_path != GpuCullingPath::None) {
+        g_vk_object_cull_module = g_vk_pipeline_registry.get_shader_module(object_cull_comp_glsl, sizeof(object_cull_comp_glsl));
+        if (!g_vk_object_cull_module)
+            return false;
+    }
+
+    // Task and mesh shaders are SPIR-V 1.4, creating them on a device without mesh shaders is not even valid.
+    if (g_vk_meshlets) {
+        g_vk_meshlet_cull_module = g_vk_pipeline_registry.get_shader_module(meshlet_cull_comp_glsl, sizeof(meshlet_cull_comp_glsl));
+        if (!g_vk_meshlet_cull_module)
+            return false;
+
+        if (g_vk_mesh_shader_supported) {
+            g_vk_task_module = g_vk_pipeline_registry.get_shader_module(meshlet_task_glsl, sizeof(meshlet_task_glsl));
+            g_vk_mesh_module = g_vk_pipeline_registry.get_shader_module(meshlet_mesh_glsl, sizeof(meshlet_mesh_glsl));
+            if (!g_vk_task_module || !g_vk_mesh_module)
+                return false;
+        }
+    }
+
+    return true;
+}
+
+/*
+ * Create the descriptor set layout and the pipeline layout, both the pipeline and the descriptor sets need them.
+ */
+static bool create_vk_pipeline_layout() {
+    // per-draw constants are bound through a dynamic offset, so that there is no need to update the descriptor set every draw
+    auto const layout_binding = vk::DescriptorSetLayoutBinding()
+        .setBinding(0)
+        .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+        .setDescriptorCount(1)
+        .setStageFlags(vk::ShaderStageFlagBits::eVertex);
+    auto const descriptor_layout = vk::DescriptorSetLayoutCreateInfo().setBindingCount(1).setPBindings(&layout_binding);
+    g_vk_desc_layout = g_vk_pipeline_registry.get_descriptor_set_layout(descriptor_layout);
+    if (!g_vk_desc_layout)
+        return false;
+
+    // descriptor layout
+    auto const pipeline_layout_create_info = vk::PipelineLayoutCreateInfo().setSetLayoutCount(1).setPSetLayouts(&g_vk_desc_layout);
+    g_vk_pipeline_layout = g_vk_pipeline_registry.get_pipeline_layout(pipeline_layout_create_info);
+    if (!g_vk_pipeline_layout)
+        return false;
+
+    return true;
+}
+
+/*
+ * Shader stages reading the meshlet descriptor set, task and mesh shaders are only valid stages with the extension enabled.
+ */
+static vk::ShaderStageFlags get_vk_meshlet_stages() {
+    vk::ShaderStageFlags stages = vk::ShaderStageFlagBits::eCompute;
+#if defined(VK_EXT_mesh_shader)
+    if (g_vk_mesh_shader_supported)
+        stages |= vk::ShaderStageFlagBits::eTaskEXT | vk::ShaderStageFlagBits::eMeshEXT;
+#endif
+    return stages;
+}
+
+/*
+ * Create the layouts of meshlet shaders. Everything is a storage buffer in a single descriptor set, see
+ * 'shaders/meshlet_cull.glsl' for the bindings, the draw to cull is a push constant.
+ */
+static bool create_vk_meshlet_layout() {
+    if (!g_vk_meshlets)
+        return true;
+
+    const auto stages = get_vk_meshlet_stages();
+
+    vk::DescriptorSetLayoutBinding bindings[8];
+    for (uint32_t i = 0; i < 8; ++i) {
+        bindings[i].setBinding(i)
+                   .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                   .setDescriptorCount(1)
+                   .setStageFlags(stages);
+    }
+    auto const descriptor_layout = vk::DescriptorSetLayoutCreateInfo().setBindingCount(8).setPBindings(bindings);
+    g_vk_meshlet_desc_layout = g_vk_pipeline_registry.get_descriptor_set_layout(descriptor_layout);
+    if (!g_vk_meshlet_desc_layout)
+        return false;
+
+    auto const push_constant_range = vk::PushConstantRange().setStageFlags(stages).setOffset(0).setSize(sizeof(MeshletPushConstants));
+    auto const pipeline_layout_create_info = vk::PipelineLayoutCreateInfo()
+        .setSetLayoutCount(1)
+        .setPSetLayouts(&g_vk_meshlet_desc_layout)
+        .setPushConstantRangeCount(1)
+        .setPPushConstantRanges(&push_constant_range);
+    g_vk_meshlet_pipeline_layout = g_vk_pipeline_registry.get_pipeline_layout(pipeline_layout_create_info);
+    if (!g_vk_meshlet_pipeline_layout)
+        return false;
+
+    return true;
+}
+
+/*
+ * Pick how meshlets are culled and drawn once both the device and the mesh are known. Mesh shaders are preferred, unless a
+ * single draw of the mesh needs more task workgroups than the device launches at once.
+ */
+static bool select_vk_meshlet_path() {
+    const auto meshlet_cnt = g_vk_mesh.get_meshlet_count();
+
+    g_vk_meshlet_path = MeshletPath::None;
+    if (g_vk_meshlets && meshlet_cnt) {
+        const auto task_cnt = (meshlet_cnt + MESHLETS_PER_TASK - 1) / MESHLETS_PER_TASK;
+        g_vk_meshlet_path = g_vk_mesh_shader_supported && task_cnt <= g_vk_max_task_workgroup_cnt ? MeshletPath::MeshShader : MeshletPath::ComputeCulled;
+    }
+
+    g_vk_meshlet_stats = MeshletStats();
+    g_vk_meshlet_stats.path = g_vk_meshlet_path;
+    g_vk_meshlet_stats.meshlet_cnt = g_vk_meshlet_path == MeshletPath::None ? 0 : meshlet_cnt;
+    return true;
+}
+
+/*
+ * Request the pipeline of the meshlet path, the mesh shader pipeline or the culling compute pipeline. Compute culling draws
+ * with the regular graphics pipeline afterwards.
+ */
+static bool request_meshlet_pipeline() {
+    if (g_vk_meshlet_path == MeshletPath::ComputeCulled) {
+        g_vk_meshlet_pipeline = g_vk_pipeline_registry.get_compute_pipeline(g_vk_meshlet_cull_module, g_vk_meshlet_pipeline_layout, "compile meshlet culling pipeline");
+    }
+    else if (g_vk_meshlet_path == MeshletPath::MeshShader) {
+        VulkanPipelineDesc desc;
+        desc.task = g_vk_task_module;
+        desc.mesh = g_vk_mesh_module;
+        desc.ps = g_vk_ps_module;
+        desc.blend = {
+            vk::PipelineColorBlendAttachmentState().setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+                                                                      vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA) };
+        desc.layout = g_vk_meshlet_pipeline_layout;
+        desc.render_pass = g_vk_render_pass;
+
+        g_vk_meshlet_pipeline = g_vk_pipeline_registry.get_graphics_pipeline(desc, "compile meshlet pipeline");
+    }
+    return true;
+}
+
+/*
+ * Create the layouts of the object culling shader, the objects, the indirect draws and the counters are storage buffers of
+ * a single descriptor set, see 'shaders/object_cull.comp.glsl'. The rest is 'GpuCullingConstants' in push constants.
+ */
+static bool create_vk_object_cull_layout() {
+    if (g_vk_gpu_culling_path == GpuCullingPath::None)
+        return true;
+
+    vk::DescriptorSetLayoutBinding bindings[3];
+    for (uint32_t i = 0; i < 3; ++i) {
+        bindings[i].setBinding(i)
+                   .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                   .setDescriptorCount(1)
+                   .setStageFlags(vk::ShaderStageFlagBits::eCompute);
+    }
+    auto const descriptor_layout = vk::DescriptorSetLayoutCreateInfo().setBindingCount(3).setPBindings(bindings);
+    g_vk_object_cull_desc_layout = g_vk_pipeline_registry.get_descriptor_set_layout(descriptor_layout);
+    if (!g_vk_object_cull_desc_layout)
+        return false;
+
+    auto const push_constant_range = vk::PushConstantRange().setStageFlags(vk::ShaderStageFlagBits::eCompute).setOffset(0).setSize(sizeof(GpuCullingConstants));
+    auto const pipeline_layout_create_info = vk::PipelineLayoutCreateInfo()
+        .setSetLayoutCount(1)
+        .setPSetLayouts(&g_vk_object_cull_desc_layout)
+        .setPushConstantRangeCount(1)
+        .setPPushConstantRanges(&push_constant_range);
+    g_vk_object_cull_pipeline_layout = g_vk_pipeline_registry.get_pipeline_layout(pipeline_layout_create_info);
+    if (!g_vk_object_cull_pipeline_layout)
+        return false;
+
+    return true;
+}
+
+/*
+ * Request the object culling pipeline, the culled objects are drawn with the regular graphics pipeline.
+ */
+static bool request_object_cull_pipeline() {
+    if (g_vk_gpu_culling_path != GpuCullingPath::None)
+        g_vk_object_cull_pipeline = g_vk_pipeline_registry.get_compute_pipeline(g_vk_object_cull_module, g_vk_object_cull_pipeline_layout, "compile object culling pipeline");
+    return true;
+}
+
+/*
+ * Request the graphics pipeline, it returns right away since the pipeline is compiled in the background. Nothing waits for
+ * the pipeline, frames simply skip the draws until it is ready.
+ */
+static bool request_graphics_pipeline() {
+    VulkanPipelineDesc desc;
+    desc.vs = is_vk_instanced() ? g_vk_vs_instanced_module : g_vk_vs_module;
+    desc.ps = g_vk_ps_module;
+
+    // vertex format layout, it comes from the layout of the vertex of the encoding
+    if (g_vk_vertex_encoding == VertexEncoding::Quantized)
+        add_vertex_stream<QuantizedVertex>(desc, 0);
+    else
+        add_vertex_stream<Vertex>(desc, 0);
+
+    // instances step through the second stream once per instance instead of once per vertex
+    if (is_vk_instanced())
+        add_vertex_stream<InstanceData>(desc, 1, vk::VertexInputRate::eInstance);
+
+    // color blend state
+    desc.blend = {
+        vk::PipelineColorBlendAttachmentState().setColorWriteMask(vk::ColorComponentFlagBits::eR | vk::ColorComponentFlagBits::eG |
+                                                                  vk::ColorComponentFlagBits::eB | vk::ColorComponentFlagBits::eA) };
+
+    desc.layout = g_vk_pipeline_layout;
+    desc.render_pass = g_vk_render_pass;
+
+    g_vk_pipeline = g_vk_pipeline_registry.get_graphics_pipeline(desc, "compile pipeline");
+    return true;
+}
+
+
+/*
+ * Create a descriptor set for each frame, each of them points to the region of the frame in the transient buffer.
+ */
+static bool create_descriptor_set() {
     vk::DescriptorPoolSize const pool_sizes = vk::DescriptorPoolSize()
-                                                .setType(vk::DescriptorType::eUniformBuffer)
-                                                .setDescriptorCount(NUM_FRAMES);
+                                                .setType(vk::DescriptorType::eUniformBufferDynamic)
+                                                .setDescriptorCount(g_vk_frames_in_flight);
 
     auto const descriptor_pool = vk::DescriptorPoolCreateInfo()
-                                .setMaxSets(NUM_FRAMES)
+                                .setMaxSets(g_vk_frames_in_flight)
                                 .setPoolSizeCount(1)
                                 .setPPoolSizes(&pool_sizes);
     auto result = g_vk_device.createDescriptorPool(&descriptor_pool, nullptr, &g_vk_desc_pool);
@@ -724,242 +2065,755 @@ static bool create_descriptor_set() {
                             .setDescriptorPool(g_vk_desc_pool)
                             .setDescriptorSetCount(1)
                             .setPSetLayouts(&g_vk_desc_layout);
-    for (unsigned int i = 0; i < NUM_FRAMES; i++) {
+    for (unsigned int i = 0; i < g_vk_frames_in_flight; i++) {
         auto result = g_vk_device.allocateDescriptorSets(&alloc_info, &g_vk_desc_set[i]);
         VERIFY(result);
+
+        auto const buffer_info = vk::DescriptorBufferInfo()
+                                .setBuffer(g_vk_transient_buffer)
+                                .setOffset(g_vk_transient_frame_size * i)
+                                .setRange(sizeof(DrawConstants));
+        auto const write = vk::WriteDescriptorSet()
+                                .setDstSet(g_vk_desc_set[i])
+                                .setDstBinding(0)
+                                .setDescriptorCount(1)
+                                .setDescriptorType(vk::DescriptorType::eUniformBufferDynamic)
+                                .setPBufferInfo(&buffer_info);
+        g_vk_device.updateDescriptorSets(1, &write, 0, nullptr);
     }
 
     return true;
 }
 
-bool memory_type_from_properties(uint32_t typeBits, vk::MemoryPropertyFlags requirements_mask, uint32_t* typeIndex) {
-    // Search memtypes to find first index with those properties
-    for (uint32_t i = 0; i < VK_MAX_MEMORY_TYPES; i++) {
-        if ((typeBits & 1) == 1) {
-            // Type is available, does it match user properties?
-            if ((g_vk_physical_memory_props.memoryTypes[i].propertyFlags & requirements_mask) == requirements_mask) {
-                *typeIndex = i;
-                return true;
-            }
+/*
+ * Create a descriptor set of the meshlet buffers for each frame, the constants and the counters are in the region of the
+ * frame in the transient buffer.
+ */
+static bool create_meshlet_descriptor_sets() {
+    if (g_vk_meshlet_path == MeshletPath::None)
+        return true;
+
+    vk::DescriptorPoolSize const pool_sizes = vk::DescriptorPoolSize()
+                                                .setType(vk::DescriptorType::eStorageBuffer)
+                                                .setDescriptorCount(8 * g_vk_frames_in_flight);
+
+    auto const descriptor_pool = vk::DescriptorPoolCreateInfo()
+                                .setMaxSets(g_vk_frames_in_flight)
+                                .setPoolSizeCount(1)
+                                .setPPoolSizes(&pool_sizes);
+    auto result = g_vk_device.createDescriptorPool(&descriptor_pool, nullptr, &g_vk_meshlet_desc_pool);
+    VERIFY(result);
+
+    // the vertex buffer and the packed triangles are only read by mesh shaders, the indirect draws only by compute culling
+    const vk::Buffer buffers[8] = {
+        g_vk_meshlet_path == MeshletPath::MeshShader ? g_vk_vertex_buffer : vk::Buffer(),
+        g_vk_meshlet_buffers[MESHLET_BUFFER_TABLE],
+        g_vk_meshlet_buffers[MESHLET_BUFFER_BOUNDS],
+        g_vk_meshlet_buffers[MESHLET_BUFFER_VERTICES],
+        g_vk_meshlet_buffers[MESHLET_BUFFER_TRIANGLES],
+        g_vk_transient_buffer,
+        g_vk_transient_buffer,
+        g_vk_meshlet_buffers[MESHLET_BUFFER_COMMANDS] };
+
+    auto const alloc_info = vk::DescriptorSetAllocateInfo()
+                            .setDescriptorPool(g_vk_meshlet_desc_pool)
+                            .setDescriptorSetCount(1)
+                            .setPSetLayouts(&g_vk_meshlet_desc_layout);
+    for (unsigned int i = 0; i < g_vk_frames_in_flight; i++) {
+        auto result = g_vk_device.allocateDescriptorSets(&alloc_info, &g_vk_meshlet_desc_set[i]);
+        VERIFY(result);
+
+        vk::DescriptorBufferInfo buffer_infos[8];
+        vk::WriteDescriptorSet writes[8];
+        uint32_t write_cnt = 0;
+        for (uint32_t binding = 0; binding < 8; ++binding) {
+            if (!buffers[binding])
+                continue;
+
+            const auto transient = buffers[binding] == g_vk_transient_buffer;
+            buffer_infos[write_cnt] = vk::DescriptorBufferInfo()
+                                        .setBuffer(buffers[binding])
+                                        .setOffset(transient ? g_vk_transient_frame_size * i : 0)
+                                        .setRange(transient ? g_vk_transient_frame_size : VK_WHOLE_SIZE);
+            writes[write_cnt] = vk::WriteDescriptorSet()
+                                    .setDstSet(g_vk_meshlet_desc_set[i])
+                                    .setDstBinding(binding)
+                                    .setDescriptorCount(1)
+                                    .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                                    .setPBufferInfo(&buffer_infos[write_cnt]);
+            ++write_cnt;
         }
-        typeBits >>= 1;
+        g_vk_device.updateDescriptorSets(write_cnt, writes, 0, nullptr);
     }
 
-    // No memory types matched, return failure
-    return false;
+    return true;
 }
 
 /*
- * Create a vertex buffer.
+ * Create a descriptor set of the object culling buffers for each frame, the counters are in the region of the frame in the
+ * transient buffer.
  */
-static bool create_vertex_buffer() {
-    vk::BufferCreateInfo buf_info = vk::BufferCreateInfo()
-                                    .setUsage(vk::BufferUsageFlagBits::eVertexBuffer)
-                                    .setSharingMode(vk::SharingMode::eExclusive)
-                                    .setSize((uint32_t)g_total_vertices_size)
-                                    .setQueueFamilyIndexCount(0);
+static bool create_object_cull_descriptor_sets() {
+    if (g_vk_gpu_culling_path == GpuCullingPath::None)
+        return true;
 
-    auto result = g_vk_device.createBuffer(&buf_info, nullptr, &g_vk_vertex_buffer);
+    vk::DescriptorPoolSize const pool_sizes = vk::DescriptorPoolSize()
+                                                .setType(vk::DescriptorType::eStorageBuffer)
+                                                .setDescriptorCount(3 * g_vk_frames_in_flight);
+
+    auto const descriptor_pool = vk::DescriptorPoolCreateInfo()
+                                .setMaxSets(g_vk_frames_in_flight)
+                                .setPoolSizeCount(1)
+                                .setPPoolSizes(&pool_sizes);
+    auto result = g_vk_device.createDescriptorPool(&descriptor_pool, nullptr, &g_vk_object_cull_desc_pool);
     VERIFY(result);
 
-    vk::MemoryRequirements mem_reqs;
-    g_vk_device.getBufferMemoryRequirements(g_vk_vertex_buffer, &mem_reqs);
+    auto const alloc_info = vk::DescriptorSetAllocateInfo()
+                            .setDescriptorPool(g_vk_object_cull_desc_pool)
+                            .setDescriptorSetCount(1)
+                            .setPSetLayouts(&g_vk_object_cull_desc_layout);
+    for (unsigned int i = 0; i < g_vk_frames_in_flight; i++) {
+        auto result = g_vk_device.allocateDescriptorSets(&alloc_info, &g_vk_object_cull_desc_set[i]);
+        VERIFY(result);
 
-    vk::MemoryAllocateInfo alloc_info = vk::MemoryAllocateInfo()
-        .setMemoryTypeIndex(0)
-        .setAllocationSize(mem_reqs.size);
+        const vk::DescriptorBufferInfo buffer_infos[3] = {
+            vk::DescriptorBufferInfo().setBuffer(g_vk_object_buffer).setOffset(0).setRange(VK_WHOLE_SIZE),
+            vk::DescriptorBufferInfo().setBuffer(g_vk_object_draw_buffer).setOffset(0).setRange(VK_WHOLE_SIZE),
+            vk::DescriptorBufferInfo().setBuffer(g_vk_transient_buffer).setOffset(g_vk_transient_frame_size * i).setRange(g_vk_transient_frame_size) };
+        vk::WriteDescriptorSet writes[3];
+        for (uint32_t binding = 0; binding < 3; ++binding) {
+            writes[binding] = vk::WriteDescriptorSet()
+                                .setDstSet(g_vk_object_cull_desc_set[i])
+                                .setDstBinding(binding)
+                                .setDescriptorCount(1)
+                                .setDescriptorType(vk::DescriptorType::eStorageBuffer)
+                                .setPBufferInfo(&buffer_infos[binding]);
+        }
+        g_vk_device.updateDescriptorSets(3, writes, 0, nullptr);
+    }
 
+    return true;
+}
 
-    {
-        auto result = memory_type_from_properties(
-            mem_reqs.memoryTypeBits, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent,
-            &alloc_info.memoryTypeIndex);
-        if (!result)
-            return false;
+/*
+ * Map the mesh file, nothing is read from it until its content is uploaded unless it is optimized. Meshlets are built if
+ * they are asked for and the file doesn't have them.
+ */
+static bool load_vk_mesh() {
+    return load_sample_mesh(g_vk_mesh, g_vk_mesh_filename.c_str(), g_vk_mesh_optimization, g_vk_meshlets, g_vk_mesh_optimization_stats);
+}
+
+/*
+ * Create the meshlet buffers in device local memory and queue their uploads, they are submitted along with the geometry.
+ * Compute culling draws meshlets from an index buffer with the triangles of each meshlet expanded into vertex indices, in
+ * the same order, and from the indirect draws of each meshlet of each draw.
+ */
+static bool create_meshlet_buffers() {
+    if (g_vk_meshlet_path == MeshletPath::None)
+        return true;
+
+    const auto meshlet_cnt = g_vk_mesh.get_meshlet_count();
+    const auto triangles_size = g_vk_mesh.get_meshlet_triangles_size();
+
+    const void* data[MESHLET_BUFFER_CNT] = {
+        g_vk_mesh.get_meshlets(), g_vk_mesh.get_meshlet_bounds(), g_vk_mesh.get_meshlet_vertices(), g_vk_mesh.get_meshlet_triangles() };
+    vk::DeviceSize sizes[MESHLET_BUFFER_CNT] = {
+        sizeof(Meshlet) * meshlet_cnt, sizeof(MeshletBounds) * meshlet_cnt, sizeof(uint32_t) * g_vk_mesh.get_meshlet_vertex_count(), triangles_size };
+    vk::BufferUsageFlags usages[MESHLET_BUFFER_CNT] = {
+        vk::BufferUsageFlagBits::eStorageBuffer, vk::BufferUsageFlagBits::eStorageBuffer, vk::BufferUsageFlagBits::eStorageBuffer,
+        vk::BufferUsageFlagBits::eStorageBuffer, vk::BufferUsageFlagBits::eIndexBuffer,
+        vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer };
+
+    std::vector<uint32_t> indices;
+    if (g_vk_meshlet_path == MeshletPath::ComputeCulled) {
+        const auto meshlets = g_vk_mesh.get_meshlets();
+        const auto vertices = g_vk_mesh.get_meshlet_vertices();
+        const auto triangles = g_vk_mesh.get_meshlet_triangles();
+        indices.resize(triangles_size);
+        for (uint32_t i = 0; i < meshlet_cnt; ++i) {
+            for (uint32_t j = 0; j < meshlets[i].triangle_cnt * 3; ++j)
+                indices[meshlets[i].triangle_offset + j] = vertices[meshlets[i].vertex_offset + triangles[meshlets[i].triangle_offset + j]];
+        }
+        data[MESHLET_BUFFER_INDICES] = indices.data();
+        sizes[MESHLET_BUFFER_INDICES] = sizeof(uint32_t) * indices.size();
+
+        // culling only reads the meshlets and their bounds
+        sizes[MESHLET_BUFFER_VERTICES] = 0;
+        sizes[MESHLET_BUFFER_TRIANGLES] = 0;
+
+        // draws beyond what a storage buffer can hold are not culled at all
+        vk::PhysicalDeviceProperties properties;
+        g_vk_physical_device.getProperties(&properties);
+        const auto max_draw_cnt = properties.limits.maxStorageBufferRange / (sizeof(vk::DrawIndexedIndirectCommand) * meshlet_cnt);
+        g_vk_meshlet_culled_draw_cnt = (unsigned int)std::min<vk::DeviceSize>(g_vk_draw_cnt, max_draw_cnt);
+        sizes[MESHLET_BUFFER_COMMANDS] = sizeof(vk::DrawIndexedIndirectCommand) * meshlet_cnt * g_vk_meshlet_culled_draw_cnt;
+    }
+    else {
+        // mesh shaders read the triangles as 32 bits words
+        sizes[MESHLET_BUFFER_TRIANGLES] = (sizes[MESHLET_BUFFER_TRIANGLES] + 3) & ~3ull;
     }
-    
-    g_vk_device.allocateMemory(&alloc_info, nullptr, &g_vk_device_memory);
 
-    uint8_t* pData;
-    result = g_vk_device.mapMemory(g_vk_device_memory, 0, mem_reqs.size, vk::MemoryMapFlags(), (void**)&pData);
-    VERIFY(result);
-    memcpy(pData, g_vertices, g_total_vertices_size);
-    g_vk_device.unmapMemory(g_vk_device_memory);
+    for (uint32_t i = 0; i < MESHLET_BUFFER_CNT; ++i) {
+        if (!sizes[i])
+            continue;
 
-    result = g_vk_device.bindBufferMemory(g_vk_vertex_buffer, g_vk_device_memory, 0);
-    VERIFY(result);
+        // indirect draws are written on GPU, the rest is uploaded on the transfer queue
+        auto buf_info = vk::BufferCreateInfo().setUsage(usages[i]).setSize(sizes[i]);
+        if (data[i])
+            buf_info.setUsage(usages[i] | vk::BufferUsageFlagBits::eTransferDst);
+        if (!g_vk_allocator.create_buffer(data[i] ? g_vk_uploader.share_with_graphics(buf_info) : buf_info, vk::MemoryPropertyFlagBits::eDeviceLocal, g_vk_meshlet_buffers[i], g_vk_meshlet_allocations[i]))
+            return false;
+
+        if (data[i] && !g_vk_uploader.upload_buffer(g_vk_meshlet_buffers[i], 0, data[i], i == MESHLET_BUFFER_TRIANGLES ? triangles_size : sizes[i]))
+            return false;
+    }
 
     return true;
 }
 
 /*
- * Initialize the vulkan sample.
- * Followings are the basic steps to initialize a Vulkan application.
- *   - [Opt] Enable Vulkan validataion ( This is only active on debug build. )
- *   - Create Vulkan instance
- *   - Enumerate vulkan physical devices and use the first one
- *   - Create Vulkan surface
- *   - Enumerate all available queues and pick a graphics queue and it needs to support present too
- *   - Create Vulkan swapchain
- *     - Get all vulkan images in the swapchain
- *   - Create command pool and command buffers
+ * Create the buffer of all objects in device local memory and queue its upload, along with the buffer of their indirect
+ * draws, which is only ever written by culling. Objects are the same as the instances of the instancing path, they are
+ * written once here instead of every frame.
  */
-bool VulkanGraphicsSample::initialize(const HINSTANCE hInstnace, const HWND hwnd) {
-    // enable gpu validation if needed
-    enable_gpu_validation();
-
-    // initialize vulkan instance
-    if (!create_vk_instance())
+static bool create_object_buffers() {
+    if (g_vk_gpu_culling_path == GpuCullingPath::None)
+        return true;
+
+    std::vector<InstanceData> objects(g_vk_draw_cnt);
+    for (unsigned int i = 0; i < g_vk_draw_cnt; ++i)
+        objects[i] = get_instance_data(i, g_vk_draw_cnt, g_vk_position_decode);
+
+    auto buf_info = vk::BufferCreateInfo()
+                    .setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst)
+                    .setSize(sizeof(InstanceData) * objects.size());
+    if (!g_vk_allocator.create_buffer(g_vk_uploader.share_with_graphics(buf_info), vk::MemoryPropertyFlagBits::eDeviceLocal, g_vk_object_buffer, g_vk_object_allocation))
         return false;
-
-    // enumerate all d3d12 compatible graphis hardware on this machine.
-    if (!create_vk_physical_device())
+    if (!g_vk_uploader.upload_buffer(g_vk_object_buffer, 0, objects.data(), sizeof(InstanceData) * objects.size()))
         return false;
 
-    // create vulkan device
-    if (!create_vk_device(hInstnace, hwnd))
-        return false;
+    auto const draw_buf_info = vk::BufferCreateInfo()
+                                .setUsage(vk::BufferUsageFlagBits::eStorageBuffer | vk::BufferUsageFlagBits::eIndirectBuffer)
+                                .setSize(sizeof(vk::DrawIndexedIndirectCommand) * objects.size());
+    return g_vk_allocator.create_buffer(draw_buf_info, vk::MemoryPropertyFlagBits::eDeviceLocal, g_vk_object_draw_buffer, g_vk_object_draw_allocation);
+}
 
-    // enumerate the vulkan command queues, this won't fail, but just to keep consistency, still checking.
-    if (!acquire_vk_command_queue())
-        return false;
+/*
+ * Create the vertex and index buffers of the geometry pool in device local memory and sub-allocate the mesh from them.
+ * Their content is uploaded on the transfer queue, the first frame waits for it on GPU, not on CPU. Vertices and indices are
+ * copied from the mesh into the staging buffers as they are, unless vertices are quantized. The pool is never smaller than
+ * the mesh, the rest of it is room for more meshes.
+ */
+static bool create_vertex_buffer() {
+    std::vector<uint8_t> encoded;
+    g_vk_vertex_encoding_stats = encode_vertices(g_vk_mesh.get_vertices(), g_vk_mesh.get_vertex_count(), g_vk_vertex_encoding, encoded, g_vk_position_decode);
+
+    const void* vertices = encoded.empty() ? (const void*)g_vk_mesh.get_vertices() : encoded.data();
+    const auto vertices_size = (vk::DeviceSize)g_vk_vertex_encoding_stats.encoded_size;
+    const auto vertex_stride = g_vk_vertex_encoding == VertexEncoding::Quantized ? get_vertex_stride<QuantizedVertex>() : get_vertex_stride<Vertex>();
+    const auto index_size = get_geometry_pool_index_size(g_vk_mesh);
+
+    std::vector<uint8_t> converted;
+    const auto indices = get_geometry_pool_indices(g_vk_mesh, index_size, converted);
+    const auto indices_size = (vk::DeviceSize)g_vk_mesh.get_index_count() * index_size;
 
-    // create swap chain
-    if (!create_vk_swapchain())
+    g_vk_geometry_pool.initialize(std::max(g_vk_mesh.get_vertex_count(), GeometryPool::DEFAULT_VERTEX_CAPACITY), vertex_stride,
+                                  std::max(g_vk_mesh.get_index_count(), GeometryPool::DEFAULT_INDEX_CAPACITY), index_size);
+    if (!indices || !g_vk_geometry_pool.allocate(g_vk_mesh.get_vertex_count(), g_vk_mesh.get_index_count(), g_vk_mesh_range))
         return false;
 
-    // create command pool and commnad list
-    if (!create_vk_command())
+    // mesh shaders fetch vertices themselves
+    auto vertex_usage = vk::BufferUsageFlagBits::eVertexBuffer | vk::BufferUsageFlagBits::eTransferDst;
+    if (g_vk_meshlet_path == MeshletPath::MeshShader)
+        vertex_usage |= vk::BufferUsageFlagBits::eStorageBuffer;
+
+    vk::BufferCreateInfo buf_info = vk::BufferCreateInfo()
+                                    .setUsage(vertex_usage)
+                                    .setSize(g_vk_geometry_pool.get_vertex_buffer_size());
+    if (!g_vk_allocator.create_buffer(g_vk_uploader.share_with_graphics(buf_info), vk::MemoryPropertyFlagBits::eDeviceLocal, g_vk_vertex_buffer, g_vk_vertex_allocation))
         return false;
 
-    // create fence and semaphores
-    if (!create_vk_sychronization_objs())
+    buf_info.setUsage(vk::BufferUsageFlagBits::eIndexBuffer | vk::BufferUsageFlagBits::eTransferDst)
+            .setSize(g_vk_geometry_pool.get_index_buffer_size());
+    if (!g_vk_allocator.create_buffer(g_vk_uploader.share_with_graphics(buf_info), vk::MemoryPropertyFlagBits::eDeviceLocal, g_vk_index_buffer, g_vk_index_allocation))
         return false;
 
-    // create a render pass
-    if (!create_vk_render_pass())
+    if (!g_vk_uploader.upload_buffer(g_vk_vertex_buffer, g_vk_geometry_pool.get_vertex_offset(g_vk_mesh_range), vertices, vertices_size) ||
+        !g_vk_uploader.upload_buffer(g_vk_index_buffer, g_vk_geometry_pool.get_index_offset(g_vk_mesh_range), indices, indices_size))
         return false;
 
-    // create graphics pipeline
-    if (!create_graphics_pipeline())
+    if (!create_meshlet_buffers() || !create_object_buffers())
         return false;
 
-    // create frame buffers
-    if (!create_frame_buffers())
+    return g_vk_uploader.submit() != 0;
+}
+
+/*
+ * Create the transient buffer for per-draw constants, it is mapped once and never unmapped.
+ */
+static bool create_vk_transient_memory() {
+    vk::PhysicalDeviceProperties properties;
+    g_vk_physical_device.getProperties(&properties);
+    // meshlet shaders read the constants and write the counters through storage buffers, so does object culling
+    auto alignment = std::max(properties.limits.minUniformBufferOffsetAlignment, (vk::DeviceSize)sizeof(DrawConstants));
+    auto usage = vk::BufferUsageFlags(vk::BufferUsageFlagBits::eUniformBuffer);
+    if (g_vk_meshlets || g_vk_gpu_culling_path != GpuCullingPath::None) {
+        alignment = std::max(alignment, properties.limits.minStorageBufferOffsetAlignment);
+        usage |= vk::BufferUsageFlagBits::eStorageBuffer;
+    }
+    // the counter of visible objects is the count of the indirect count draw
+    if (g_vk_gpu_culling_path != GpuCullingPath::None)
+        usage |= vk::BufferUsageFlagBits::eIndirectBuffer;
+
+    // Instance data is fetched as a vertex stream, the memory of each frame grows by the data of all instances. Otherwise it
+    // grows by the constants of all draws, each takes an aligned slot, so that no draw is dropped for lack of room. Objects
+    // culled on GPU have no per-draw constants at all.
+    vk::DeviceSize frame_size = TRANSIENT_MEMORY_PER_FRAME;
+    if (g_vk_instancing) {
+        frame_size += (vk::DeviceSize)sizeof(InstanceData) * g_vk_draw_cnt + alignment;
+        usage |= vk::BufferUsageFlagBits::eVertexBuffer;
+    }
+    else if (g_vk_gpu_culling_path == GpuCullingPath::None) {
+        frame_size += alignment * g_vk_draw_cnt;
+    }
+    g_vk_transient_frame_size = (frame_size + alignment - 1) & ~(alignment - 1);
+    g_vk_transient_alignment = (size_t)alignment;
+
+    auto const buf_info = vk::BufferCreateInfo()
+                            .setUsage(usage)
+                            .setSharingMode(vk::SharingMode::eExclusive)
+                            .setSize(g_vk_transient_frame_size * g_vk_frames_in_flight);
+
+    // coherent memory doesn't need flushing, whatever is written before submitting is visible to GPU
+    if (!g_vk_allocator.create_buffer(buf_info, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, g_vk_transient_buffer, g_vk_transient_allocation))
         return false;
 
-    // create descriptor set
-    if (!create_descriptor_set())
+    auto data = (uint8_t*)g_vk_transient_allocation.mapped;
+    for (uint32_t i = 0; i < g_vk_frames_in_flight; ++i)
+        g_vk_frame_allocators[i].initialize(data + g_vk_transient_frame_size * i, (size_t)g_vk_transient_frame_size, (size_t)alignment);
+
+    // no frame has culling counters to read back yet
+    std::fill(std::begin(g_vk_meshlet_counter_offsets), std::end(g_vk_meshlet_counter_offsets), SIZE_MAX);
+    std::fill(std::begin(g_vk_object_counter_offsets), std::end(g_vk_object_counter_offsets), SIZE_MAX);
+
+    return true;
+}
+
+/*
+ * Create the device along with everything that comes with it, the memory allocator, the queues and the uploader.
+ */
+static bool create_vk_device_and_queues() {
+    // create vulkan device
+    if (!create_vk_device())
         return false;
 
-    // create vertex buffer
-    if (!create_vertex_buffer())
+    // all device memory comes from the sub-allocator
+    g_vk_allocator.initialize(g_vk_device, g_vk_physical_device);
+
+    // enumerate the vulkan command queues, this won't fail, but just to keep consistency, still checking.
+    if (!acquire_vk_command_queue())
         return false;
 
-    return true;
+    // everything pipelines are built from is created through the registry
+    g_vk_pipeline_registry.initialize(g_vk_device, *g_vk_pipeline_compiler);
+
+    // uploads go through the transfer queue
+    return g_vk_uploader.initialize(g_vk_device, g_vk_allocator, g_transfer_queue_family_index, g_vk_transfer_queue, g_graphics_queue_family_index, g_vk_queue_mutex);
+}
+
+/*
+ * Initialize everything as a graph of tasks, both windowed and offscreen rendering share it.
+ * Only the instance, the physical device and the device are on the critical path. Once the device is created, shader modules,
+ * the pipeline, the descriptor sets and the geometry upload are done on worker threads while the calling thread creates
+ * the swapchain, which is pinned to it since it owns the window. The surface is only created with a window.
+ */
+static bool initialize_vk(FrameProfiler& profiler, std::function<bool()> create_surface) {
+    create_vk_thread_pool();
+
+    // A quarter of the hardware threads compile pipelines, they mostly sleep once the pipelines of the scene are compiled.
+    g_vk_pipeline_compiler = std::make_unique<PipelineCompiler>(profiler, std::thread::hardware_concurrency() / 4);
+
+    // Mesh shaders fetch full precision vertices, so does compute culling to draw exactly the same thing. Meshlets are culled
+    // draw by draw, they don't go through the instanced pipeline. What the device can't do is turned off once it is picked,
+    // the settings asked for are left as they are for the next initialization.
+    g_vk_vertex_encoding = g_vk_meshlets ? VertexEncoding::Full : g_vk_requested_vertex_encoding;
+    g_vk_instancing = g_vk_requested_instancing && !g_vk_meshlets;
+    g_vk_gpu_culling = g_vk_requested_gpu_culling && !g_vk_meshlets;
+
+    TaskGraph graph;
+    const auto instance = graph.add("instance", []() {
+        // enable gpu validation if needed
+        enable_gpu_validation();
+        return create_vk_instance();
+    });
+    const auto physical_device = graph.add("physical device", create_vk_physical_device, { instance });
+
+    std::vector<TaskGraph::TaskId> surface_deps = { physical_device };
+    if (create_surface)
+        surface_deps.push_back(graph.add("surface", create_surface, { instance }, true));
+
+    const auto device = graph.add("device", create_vk_device_and_queues, surface_deps);
+    const auto format = graph.add("surface format", select_vk_surface_format, surface_deps);
+
+    // create swap chain, or the offscreen images if there is no window at all
+    const auto swapchain = g_vk_offscreen ? graph.add("offscreen targets", create_vk_offscreen_targets, { device, format })
+                                          : graph.add("swapchain", []() { return create_vk_swapchain(vk::SwapchainKHR()); }, { device, format }, true);
+
+    graph.add("commands", create_vk_command, { device });
+    graph.add("sync objects", create_vk_sychronization_objs, { device, swapchain });
+    graph.add("timestamp queries", create_vk_timestamp_queries, { device });
+
+    const auto render_pass = graph.add("render pass", create_vk_render_pass, { device, format });
+    const auto shader_modules = graph.add("shader modules", create_vk_shader_modules, { device });
+    const auto pipeline_layout = graph.add("pipeline layout", create_vk_pipeline_layout, { device });
+    // pipelines compiled by the last launch are in the cache already
+    const auto pipeline_cache = graph.add("pipeline cache", create_vk_pipeline_cache, { device });
+    graph.add("pipeline", request_graphics_pipeline, { render_pass, shader_modules, pipeline_layout, pipeline_cache });
+    graph.add("frame buffers", create_frame_buffers, { render_pass, swapchain });
+
+    // the transient memory for per-draw constants is what the descriptor sets point to
+    const auto transient_memory = graph.add("transient memory", create_vk_transient_memory, { device });
+    graph.add("descriptor sets", create_descriptor_set, { pipeline_layout, transient_memory });
+
+    // the meshlet path depends on what the device supports and on the mesh having meshlets at all
+    const auto mesh = graph.add("mesh", load_vk_mesh);
+    const auto meshlet_path = graph.add("meshlet path", select_vk_meshlet_path, { device, mesh });
+    const auto meshlet_layout = graph.add("meshlet layout", create_vk_meshlet_layout, { device });
+    graph.add("meshlet pipeline", request_meshlet_pipeline, { render_pass, shader_modules, meshlet_layout, pipeline_cache, meshlet_path });
+
+    const auto geometry = graph.add("geometry", create_vertex_buffer, { device, meshlet_path });
+    graph.add("meshlet descriptor sets", create_meshlet_descriptor_sets, { meshlet_layout, transient_memory, geometry });
+
+    // the culling path is known along with the device, the objects are uploaded with the geometry
+    const auto object_cull_layout = graph.add("object culling layout", create_vk_object_cull_layout, { device });
+    graph.add("object culling pipeline", request_object_cull_pipeline, { shader_modules, object_cull_layout, pipeline_cache });
+    graph.add("object culling descriptor sets", create_object_cull_descriptor_sets, { object_cull_layout, transient_memory, geometry });
+
+    return graph.run(*g_vk_thread_pool, profiler);
+}
+
+
+#if PLATFORM_WIN
+/*
+ * Initialize the vulkan sample.
+ * Followings are the basic steps to initialize a Vulkan application.
+ *   - [Opt] Enable Vulkan validataion ( This is only active on debug build. )
+ *   - Create Vulkan instance
+ *   - Enumerate vulkan physical devices and use the first one
+ *   - Create Vulkan surface
+ *   - Enumerate all available queues and pick a graphics queue and it needs to support present too
+ *   - Create Vulkan swapchain
+ *     - Get all vulkan images in the swapchain
+ *   - Create command pool and command buffers
+ * Steps that don't depend on each other run in parallel, see 'initialize_vk'.
+ */
+bool VulkanGraphicsSample::initialize(const HINSTANCE hInstnace, const HWND hwnd) {
+    PROFILE_ZONE(m_profiler, "initialize");
+    g_vk_offscreen = false;
+
+    return initialize_vk(m_profiler, [=]() { return create_vk_surface(hInstnace, hwnd); });
+}
+#endif
+
+
+/*
+ * Initialize the vulkan sample without a window.
+ * This is mostly the same with the windowed version, except that there is no surface, no swapchain and no present. Instead,
+ * each frame is rendered into a device local image. This allows the sample to run on headless machines with a CPU driver,
+ * like lavapipe. With a headless surface, there is a surface and a swapchain of the given size, only the window is missing.
+ */
+bool VulkanGraphicsSample::initialize(const unsigned int width, const unsigned int height) {
+    PROFILE_ZONE(m_profiler, "initialize");
+    g_vk_offscreen = !g_vk_headless;
+    g_width = width;
+    g_height = height;
+
+    return initialize_vk(m_profiler, g_vk_headless ? create_vk_headless_surface : nullptr);
+}
+
+
+VulkanGraphicsSample::VulkanGraphicsSample(const unsigned int thread_cnt) {
+    g_vk_requested_thread_cnt = thread_cnt;
 }
 
 
 /*
  * Renders a frame.
+ * With enough draw calls, draws are split into slices and each slice is recorded into a secondary command buffer on one of the
+ * recording threads, the primary command buffer only begins the render pass and executes them.
  */
 void VulkanGraphicsSample::render_frame() {
-    static std::vector<bool> first_time(NUM_FRAMES, true);
+    m_profiler.begin_frame();
+
+    // The swapchain is recreated before the frame waits for anything, the frame is skipped if there is nothing to present to,
+    // like when the window is minimized.
+    if (!g_vk_offscreen && (g_vk_swapchain_dirty || !g_vk_swapchain)) {
+        PROFILE_ZONE(m_profiler, "recreate swapchain");
+        if (!recreate_vk_swapchain())
+            return;
+    }
 
     // making sure the frame to be written is not pending on execution
-    g_vk_device.waitForFences(1, &g_vk_fence[g_frame_index], VK_TRUE, UINT64_MAX);
-    g_vk_device.resetFences({ g_vk_fence[g_frame_index] });
+    {
+        PROFILE_ZONE(m_profiler, "fence wait");
+        wait_for_vk_frame();
+    }
 
-    // Different from the frame index, which is modulated by NUM_FRAMES, this index is indicating the frame buffer index to render on.
-    uint32_t current_buffer = 0;
+    // the previous frame using this frame index is done, so are its timestamps and its transient memory
+    read_vk_timestamps(m_profiler);
+    read_vk_present_progress();
+    read_vk_meshlet_counters();
+    read_vk_gpu_culling_counter();
+    g_vk_frame_allocators[g_frame_index].reset();
+
+    // everything submitted before this frame is done too, resources waiting for them can go away now
+    const auto completed_serial = get_vk_completed_serial();
+    g_vk_deletion_queue.collect(completed_serial);
+    g_vk_present_deletion_queue.collect(g_vk_completed_present_serial);
+    g_vk_uploader.poll(completed_serial);
+
+    // the frame begins for real once it is paced, anything it samples is as fresh as it gets
+    {
+        PROFILE_ZONE(m_profiler, "pacing");
+        g_vk_frame_pacer.wait(m_profiler);
+    }
+
+    // the pipeline may still be compiling, the frame never waits for it
+    auto pipeline = g_vk_pipeline ? static_cast<const VulkanPipeline*>(g_vk_pipeline->resolve()) : nullptr;
+    g_vk_frame_pipeline = pipeline ? pipeline->pipeline : vk::Pipeline();
+
+    // the whole mesh is drawn until the pipelines of the meshlet path are ready, compute culling draws with both of them
+    auto meshlet_pipeline = g_vk_meshlet_pipeline ? static_cast<const VulkanPipeline*>(g_vk_meshlet_pipeline->resolve()) : nullptr;
+    g_vk_frame_meshlet_pipeline = meshlet_pipeline ? meshlet_pipeline->pipeline : vk::Pipeline();
+    g_vk_frame_meshlets = g_vk_frame_meshlet_pipeline && (g_vk_frame_pipeline || g_vk_meshlet_path == MeshletPath::MeshShader) && prepare_vk_meshlet_frame();
+
+    // all objects are drawn until the culling pipeline is ready
+    auto object_cull_pipeline = g_vk_object_cull_pipeline ? static_cast<const VulkanPipeline*>(g_vk_object_cull_pipeline->resolve()) : nullptr;
+    g_vk_frame_object_cull_pipeline = object_cull_pipeline ? object_cull_pipeline->pipeline : vk::Pipeline();
+    g_vk_frame_gpu_culling = g_vk_frame_object_cull_pipeline && g_vk_frame_pipeline && prepare_vk_gpu_culling_frame();
+
+    // instance data is only written once there is a pipeline to draw it with
+    g_vk_frame_instances = false;
+    if (g_vk_instancing && g_vk_frame_pipeline) {
+        PROFILE_ZONE(m_profiler, "instance data");
+        g_vk_frame_instances = prepare_vk_instances();
+    }
+
+    // Different from the frame index, which goes round the frames in flight, this index is indicating the frame buffer index to render on.
+    // Offscreen images are not owned by any swapchain, each frame simply renders into its own image.
+    uint32_t current_buffer = g_frame_index;
 
     vk::Result result;
-    result = g_vk_device.acquireNextImageKHR(g_vk_swapchain, UINT64_MAX, g_vk_image_acquired_semaphores[g_frame_index], vk::Fence(), &current_buffer);
-    assert(result == vk::Result::eSuccess);
+    if (!g_vk_offscreen) {
+        PROFILE_ZONE(m_profiler, "acquire");
+        result = g_vk_device.acquireNextImageKHR(g_vk_swapchain, UINT64_MAX, g_vk_image_acquired_semaphores[g_frame_index], g_vk_image_acquired_fences[g_frame_index], &current_buffer);
+
+        // Nothing is acquired if the swapchain is out of date, the semaphore is not signaled either, so the frame is simply
+        // skipped. A suboptimal swapchain can still be presented to, it is recreated next frame.
+        if (result == vk::Result::eErrorOutOfDateKHR) {
+            g_vk_swapchain_dirty = true;
+            return;
+        }
+        assert(result == vk::Result::eSuccess || result == vk::Result::eSuboptimalKHR);
+        g_vk_swapchain_dirty |= result == vk::Result::eSuboptimalKHR;
+
+        // once the fence signals, the last present of the image is done
+        g_vk_acquire_pending[g_frame_index] = true;
+        g_vk_acquired_present_serials[g_frame_index] = g_vk_image_present_serials[current_buffer];
+    }
+
+    auto& cmd = g_vk_graphics_cmd[g_frame_index];
 
     // start building command list
-    auto const commandInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
-    g_vk_graphics_cmd[g_frame_index].reset((vk::CommandBufferResetFlags)0);
-    result = g_vk_graphics_cmd[g_frame_index].begin(&commandInfo);
+    {
+        PROFILE_ZONE(m_profiler, "reset");
+        auto const commandInfo = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eSimultaneousUse);
+        cmd.reset((vk::CommandBufferResetFlags)0);
+        result = cmd.begin(&commandInfo);
+    }
 
-    // resource transition
     {
-        if (first_time[current_buffer]) {
-            image_transition<vk::ImageLayout::eUndefined, vk::ImageLayout::eTransferDstOptimal>(g_vk_graphics_cmd[g_frame_index], current_buffer, g_graphics_queue_family_index, g_graphics_queue_family_index);
-            first_time[current_buffer] = false;
+        PROFILE_ZONE(m_profiler, "record");
+
+        // the first timestamp of this frame
+        if (g_vk_timestamp_query_pool) {
+            cmd.resetQueryPool(g_vk_timestamp_query_pool, g_frame_index * 2, 2);
+            cmd.writeTimestamp(vk::PipelineStageFlagBits::eTopOfPipe, g_vk_timestamp_query_pool, g_frame_index * 2);
+        }
+
+        // The frame is a render graph. The render pass clears the image from an undefined layout and leaves it ready to be
+        // presented, or copied out if it is offscreen, so the image needs no barrier at all. Culling writes the indirect draws
+        // shared by all frames, and counters in the transient memory that are read on CPU once the frame is done.
+        auto& graph = g_vk_render_graph;
+        graph.reset();
+        g_vk_graph_images.clear();
+        const auto image = import_vk_resource("image", g_vk_images[current_buffer], ResourceUsage::None, g_vk_offscreen ? ResourceUsage::CopySource : ResourceUsage::Present);
+
+        // task shaders cull meshlets in the render pass with mesh shaders
+        const auto meshlet_culling = g_vk_frame_meshlets && g_vk_meshlet_path == MeshletPath::ComputeCulled && g_vk_meshlet_culled_draw_cnt;
+        const auto task_culling = g_vk_frame_meshlets && g_vk_meshlet_path == MeshletPath::MeshShader;
+        const auto meshlet_draws = meshlet_culling ? import_vk_resource("meshlet draws", vk::Image(), ResourceUsage::IndirectArgument, ResourceUsage::None) : 0;
+        const auto meshlet_counters = (meshlet_culling || task_culling) ? import_vk_resource("meshlet counters", vk::Image(), ResourceUsage::None, ResourceUsage::HostRead) : 0;
+        const auto object_draws = g_vk_frame_gpu_culling ? import_vk_resource("object draws", vk::Image(), ResourceUsage::IndirectArgument, ResourceUsage::None) : 0;
+        const auto object_counter = g_vk_frame_gpu_culling ? import_vk_resource("object counter", vk::Image(), ResourceUsage::None, ResourceUsage::HostRead) : 0;
+
+        // meshlets and objects are culled outside of the render pass on the compute path
+        if (meshlet_culling) {
+            const auto pass = graph.add_pass("meshlet culling", [&]() { record_vk_meshlet_culling(cmd); });
+            graph.use(pass, meshlet_draws, ResourceUsage::ComputeWrite);
+            graph.use(pass, meshlet_counters, ResourceUsage::ComputeWrite);
         }
-        else {
-            image_transition<vk::ImageLayout::ePresentSrcKHR, vk::ImageLayout::eTransferDstOptimal>(g_vk_graphics_cmd[g_frame_index], current_buffer, g_graphics_queue_family_index, g_graphics_queue_family_index);
+        if (g_vk_frame_gpu_culling) {
+            const auto pass = graph.add_pass("object culling", [&]() { record_vk_gpu_culling(cmd); });
+            graph.use(pass, object_draws, ResourceUsage::ComputeWrite);
+            graph.use(pass, object_counter, ResourceUsage::ComputeWrite);
         }
+
+        // issue the draw calls
+        const auto draw_pass = graph.add_pass("draw", [&]() {
+            vk::ClearValue values[] = { std::array<float, 4>({ {0.4f, 0.6f, 1.0f, 1.0f} }) };
+
+            auto const pass_info = vk::RenderPassBeginInfo()
+                .setRenderPass(g_vk_render_pass)
+                .setFramebuffer(g_vk_frame_buffers[current_buffer])
+                .setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), vk::Extent2D(g_width, g_height)))
+                .setClearValueCount(1)
+                .setPClearValues(values);
+
+            // A single slice is recorded right into the primary command buffer, there is nothing to gain from a secondary one.
+            // An instanced frame is a single draw call, so is a frame culled on GPU.
+            const auto slice_cnt = is_vk_instanced() ? 1 : std::min(g_vk_thread_pool->slot_count(), (g_vk_draw_cnt + MIN_DRAWS_PER_SLICE - 1) / MIN_DRAWS_PER_SLICE);
+            if (slice_cnt <= 1) {
+                cmd.beginRenderPass(&pass_info, vk::SubpassContents::eInline);
+                record_vk_draws(cmd, 0, g_vk_draw_cnt);
+            }
+            else {
+                // the command buffers recorded last time this frame index was used are done on GPU too
+                for (auto& pool : g_vk_slot_cmd_pools[g_frame_index])
+                    g_vk_device.resetCommandPool(pool, vk::CommandPoolResetFlags());
+
+                // Each slice goes to its own secondary command buffer, they are executed in order of the slices so that the
+                // result is exactly the same as recording everything on a single thread.
+                std::vector<vk::CommandBuffer> slice_cmds(slice_cnt);
+                std::vector<unsigned int> slot_cmd_cnt(g_vk_thread_pool->slot_count(), 0);
+                g_vk_thread_pool->parallel_for(slice_cnt, [&](const unsigned int slice, const unsigned int slot) {
+                    PROFILE_ZONE(m_profiler, "record slice");
+                    const auto begin = (unsigned int)((unsigned long long)g_vk_draw_cnt * slice / slice_cnt);
+                    const auto end = (unsigned int)((unsigned long long)g_vk_draw_cnt * (slice + 1) / slice_cnt);
+                    slice_cmds[slice] = record_vk_slice(slot, current_buffer, begin, end, slot_cmd_cnt[slot]);
+                });
+
+                cmd.beginRenderPass(&pass_info, vk::SubpassContents::eSecondaryCommandBuffers);
+                cmd.executeCommands((uint32_t)slice_cmds.size(), slice_cmds.data());
+            }
+
+            // Note that ending the renderpass changes the image's layout from
+            // COLOR_ATTACHMENT_OPTIMAL to PRESENT_SRC_KHR
+            cmd.endRenderPass();
+        }, true);
+        graph.use(draw_pass, image, ResourceUsage::ColorAttachment);
+        if (meshlet_culling)
+            graph.use(draw_pass, meshlet_draws, ResourceUsage::IndirectArgument);
+        else if (task_culling)
+            graph.use(draw_pass, meshlet_counters, ResourceUsage::TaskShaderWrite);
+        if (g_vk_frame_gpu_culling) {
+            graph.use(draw_pass, object_draws, ResourceUsage::IndirectArgument);
+            if (g_vk_gpu_culling_path == GpuCullingPath::IndirectCount)
+                graph.use(draw_pass, object_counter, ResourceUsage::IndirectArgument);
+        }
+
+        graph.compile();
+        graph.execute([&](const RenderGraphBarrier* barriers, const unsigned int barrier_cnt) { return record_vk_barriers(cmd, barriers, barrier_cnt); });
+
+        // the last timestamp of this frame
+        if (g_vk_timestamp_query_pool)
+            cmd.writeTimestamp(vk::PipelineStageFlagBits::eBottomOfPipe, g_vk_timestamp_query_pool, g_frame_index * 2 + 1);
+
+        // command list generation is done
+        cmd.end();
     }
 
-    // issue the draw call
     {
-        vk::ClearValue values[] = { std::array<float, 4>({ {0.4f, 0.6f, 1.0f, 1.0f} }) };
-
-        auto const pass_info = vk::RenderPassBeginInfo()
-            .setRenderPass(g_vk_render_pass)
-            .setFramebuffer(g_vk_frame_buffers[current_buffer])
-            .setRenderArea(vk::Rect2D(vk::Offset2D(0, 0), vk::Extent2D(g_width, g_height)))
-            .setClearValueCount(1)
-            .setPClearValues(values);
-
-        g_vk_graphics_cmd[g_frame_index].beginRenderPass(&pass_info, vk::SubpassContents::eInline);
-        g_vk_graphics_cmd[g_frame_index].bindPipeline(vk::PipelineBindPoint::eGraphics, g_vk_pipeline);
-        g_vk_graphics_cmd[g_frame_index].bindDescriptorSets(vk::PipelineBindPoint::eGraphics, g_vk_pipeline_layout, 0, 1, &g_vk_desc_set[g_frame_index], 0, nullptr);
-        const VkDeviceSize offsets[1] = { 0 };
-        g_vk_graphics_cmd[g_frame_index].bindVertexBuffers(0, 1, &g_vk_vertex_buffer, offsets);
-        
-        // setup viewport
-        auto const viewport = vk::Viewport()
-            .setX(0)
-            .setY(0)
-            .setWidth((float)g_width)
-            .setHeight((float)g_height)
-            .setMinDepth((float)0.0f)
-            .setMaxDepth((float)1.0f);
-        g_vk_graphics_cmd[g_frame_index].setViewport(0, 1, &viewport);
-
-        // setup scissor rect
-        vk::Rect2D const scissor(vk::Offset2D(0, 0), vk::Extent2D(g_width, g_height));
-        g_vk_graphics_cmd[g_frame_index].setScissor(0, 1, &scissor);
-
-        // issue the draw call
-        g_vk_graphics_cmd[g_frame_index].draw(3, 1, 0, 0);
-
-        // Note that ending the renderpass changes the image's layout from
-        // COLOR_ATTACHMENT_OPTIMAL to PRESENT_SRC_KHR
-        g_vk_graphics_cmd[g_frame_index].endRenderPass();
-    }
-
-    // command list generation is done
-    g_vk_graphics_cmd[g_frame_index].end();
-
-    vk::PipelineStageFlags const pipe_stage_flags = vk::PipelineStageFlagBits::eColorAttachmentOutput;
-    auto const submit_info = vk::SubmitInfo()
-        .setPWaitDstStageMask(&pipe_stage_flags)
-        .setWaitSemaphoreCount(1)
-        .setPWaitSemaphores(&g_vk_image_acquired_semaphores[g_frame_index])
-        .setCommandBufferCount(1)
-        .setPCommandBuffers(&g_vk_graphics_cmd[g_frame_index])
-        .setSignalSemaphoreCount(1)
-        .setPSignalSemaphores(&g_vk_draw_complete_semaphores[g_frame_index]);
-
-    result = g_vk_graphics_queue.submit(1, &submit_info, g_vk_fence[g_frame_index]);
-    assert(result == vk::Result::eSuccess);
-
-    auto const presentInfo = vk::PresentInfoKHR()
-        .setWaitSemaphoreCount(1)
-        .setPWaitSemaphores(&g_vk_draw_complete_semaphores[g_frame_index])
-        .setSwapchainCount(1)
-        .setPSwapchains(&g_vk_swapchain)
-        .setPImageIndices(&current_buffer);
-
-    result = g_vk_graphics_queue.presentKHR(&presentInfo);
-    assert(result == vk::Result::eSuccess);
+        PROFILE_ZONE(m_profiler, "submit");
+
+        // there is no image to acquire or present in offscreen mode, so there is no semaphore to wait for or to signal either.
+        std::vector<vk::Semaphore> wait_semaphores;
+        std::vector<vk::PipelineStageFlags> wait_stages;
+        if (!g_vk_offscreen) {
+            wait_semaphores.push_back(g_vk_image_acquired_semaphores[g_frame_index]);
+            wait_stages.push_back(vk::PipelineStageFlagBits::eColorAttachmentOutput);
+        }
+
+        // uploads that are submitted since the last frame have to be done before anything reads them
+        g_vk_uploader.take_wait_semaphores(g_vk_submitted_serial + 1, wait_semaphores);
+        wait_stages.resize(wait_semaphores.size(), vk::PipelineStageFlagBits::eAllCommands);
+
+        g_vk_submit_time[g_frame_index] = m_profiler.now();
+        g_vk_timestamp_frames[g_frame_index] = m_profiler.frame();
+        g_vk_frame_serials[g_frame_index] = ++g_vk_submitted_serial;
+
+        // The swapchain image is presented once drawing is done, the timeline semaphore reaches the serial of the frame at
+        // the same time. Values of binary semaphores are ignored.
+        std::vector<vk::Semaphore> signal_semaphores;
+        std::vector<uint64_t> signal_values;
+        if (!g_vk_offscreen) {
+            signal_semaphores.push_back(g_vk_draw_complete_semaphores[current_buffer]);
+            signal_values.push_back(0);
+        }
+        if (g_vk_frame_timeline) {
+            signal_semaphores.push_back(g_vk_frame_timeline);
+            signal_values.push_back(g_vk_frame_serials[g_frame_index]);
+        }
+
+        auto timeline_info = vk::TimelineSemaphoreSubmitInfoKHR()
+            .setSignalSemaphoreValueCount((uint32_t)signal_values.size())
+            .setPSignalSemaphoreValues(signal_values.data());
+        auto submit_info = vk::SubmitInfo()
+            .setPWaitDstStageMask(wait_stages.data())
+            .setWaitSemaphoreCount((uint32_t)wait_semaphores.size())
+            .setPWaitSemaphores(wait_semaphores.data())
+            .setCommandBufferCount(1)
+            .setPCommandBuffers(&cmd)
+            .setSignalSemaphoreCount((uint32_t)signal_semaphores.size())
+            .setPSignalSemaphores(signal_semaphores.data());
+        if (g_vk_frame_timeline)
+            submit_info.setPNext(&timeline_info);
+
+        // the frame is certainly submitted now, its fence can be reset
+        if (!g_vk_frame_timeline)
+            g_vk_device.resetFences({ g_vk_fence[g_frame_index] });
+
+        std::lock_guard<std::mutex> lock(g_vk_queue_mutex);
+        result = g_vk_graphics_queue.submit(1, &submit_info, g_vk_frame_timeline ? vk::Fence() : g_vk_fence[g_frame_index]);
+        assert(result == vk::Result::eSuccess);
+        g_vk_frame_pacer.submitted(g_vk_submit_time[g_frame_index]);
+    }
+
+    if (!g_vk_offscreen) {
+        PROFILE_ZONE(m_profiler, "present");
+
+        auto const presentInfo = vk::PresentInfoKHR()
+            .setWaitSemaphoreCount(1)
+            .setPWaitSemaphores(&g_vk_draw_complete_semaphores[current_buffer])
+            .setSwapchainCount(1)
+            .setPSwapchains(&g_vk_swapchain)
+            .setPImageIndices(&current_buffer);
+
+        // an out of date present is still queued, it waits for the semaphore just like any other present
+        g_vk_image_present_serials[current_buffer] = ++g_vk_present_serial;
+
+        std::lock_guard<std::mutex> lock(g_vk_queue_mutex);
+        result = g_vk_graphics_queue.presentKHR(&presentInfo);
+
+        // the frame is presented or dropped either way, the swapchain is recreated before the next frame
+        if (result == vk::Result::eErrorOutOfDateKHR || result == vk::Result::eSuboptimalKHR)
+            g_vk_swapchain_dirty = true;
+        else
+            assert(result == vk::Result::eSuccess);
+    }
 
     g_frame_index += 1;
-    g_frame_index %= NUM_FRAMES;
+    g_frame_index %= g_vk_frames_in_flight;
 }
 
 
@@ -967,26 +2821,241 @@ void VulkanGraphicsSample::render_frame() {
  * Teardown vulkan related stuff.
  */
 void VulkanGraphicsSample::shutdown() {
-    // Wait for fences from present operations
-    for (uint32_t i = 0; i < NUM_FRAMES; i++) {
-        g_vk_device.waitForFences(1, &g_vk_fence[i], VK_TRUE, UINT64_MAX);
-        g_vk_device.destroyFence(g_vk_fence[i], nullptr);
+    // Wait for all frames, the last one submitted is the last one to be done
+    if (g_vk_frame_timeline) {
+        const uint64_t serial = g_vk_submitted_serial;
+        auto const wait_info = vk::SemaphoreWaitInfoKHR().setSemaphoreCount(1).setPSemaphores(&g_vk_frame_timeline).setPValues(&serial);
+        g_vk_wait_semaphores(static_cast<VkDevice>(g_vk_device), reinterpret_cast<const VkSemaphoreWaitInfoKHR*>(&wait_info), UINT64_MAX);
+        g_vk_device.destroySemaphore(g_vk_frame_timeline, nullptr);
+        g_vk_frame_timeline = vk::Semaphore();
+    }
+    for (uint32_t i = 0; i < g_vk_frames_in_flight; i++) {
+        if (g_vk_fence[i]) {
+            g_vk_device.waitForFences(1, &g_vk_fence[i], VK_TRUE, UINT64_MAX);
+            g_vk_device.destroyFence(g_vk_fence[i], nullptr);
+            g_vk_fence[i] = vk::Fence();
+        }
         g_vk_device.destroySemaphore(g_vk_image_acquired_semaphores[i], nullptr);
-        g_vk_device.destroySemaphore(g_vk_draw_complete_semaphores[i], nullptr);
+        if (g_vk_image_acquired_fences[i]) {
+            if (g_vk_acquire_pending[i])
+                g_vk_device.waitForFences(1, &g_vk_image_acquired_fences[i], VK_TRUE, UINT64_MAX);
+            g_vk_device.destroyFence(g_vk_image_acquired_fences[i], nullptr);
+            g_vk_image_acquired_fences[i] = vk::Fence();
+        }
+        g_vk_acquire_pending[i] = false;
     }
+    // a new timeline starts from 0 again, no frame waits for a serial of this one
+    g_frame_index = 0;
+    g_vk_frame_pacer.reset();
+    std::fill(std::begin(g_vk_frame_serials), std::end(g_vk_frame_serials), 0);
+
+    // GPU is done with all frames, nothing needs to wait anymore. Presents are not covered by the frames, waiting for the
+    // device to be idle is as close as it gets for them. Uploads no frame has waited for yet, like the ones of a sample that
+    // never renders, may still be copying into the buffers destroyed below, they are done too once the device is idle.
+    g_vk_device.waitIdle();
+    g_vk_uploader.shutdown();
+    g_vk_deletion_queue.flush();
+    g_vk_present_deletion_queue.flush();
+    g_vk_present_serial = g_vk_completed_present_serial = 0;
+    std::fill(std::begin(g_vk_image_present_serials), std::end(g_vk_image_present_serials), 0);
 
-    g_vk_device.destroySwapchainKHR(g_vk_swapchain, nullptr);
+    for (uint32_t i = 0; i < g_vk_image_cnt; i++) {
+        g_vk_device.destroySemaphore(g_vk_draw_complete_semaphores[i], nullptr);
+        g_vk_device.destroyFramebuffer(g_vk_frame_buffers[i], nullptr);
+        g_vk_device.destroyImageView(g_vk_image_views[i], nullptr);
+    }
+    if (g_vk_offscreen) {
+        // offscreen images are owned by the sample itself
+        for (uint32_t i = 0; i < g_vk_image_cnt; i++)
+            g_vk_allocator.destroy_image(g_vk_images[i], g_vk_offscreen_allocations[i]);
+    }
+    else if (g_vk_swapchain) {
+        g_vk_device.destroySwapchainKHR(g_vk_swapchain, nullptr);
+    }
+    g_vk_swapchain = vk::SwapchainKHR();
+    g_vk_swapchain_dirty = false;
 
-    for (auto& cmd : g_vk_graphics_cmd)
-        g_vk_device.freeCommandBuffers(g_vk_graphics_cmd_pool, { cmd });
+    for (uint32_t i = 0; i < g_vk_frames_in_flight; i++)
+        g_vk_device.freeCommandBuffers(g_vk_graphics_cmd_pool, { g_vk_graphics_cmd[i] });
     g_vk_device.destroyCommandPool(g_vk_graphics_cmd_pool, nullptr);
 
-    g_vk_device.destroyPipeline(g_vk_pipeline);
+    // destroying the command pools frees the secondary command buffers in them too
+    for (uint32_t i = 0; i < g_vk_frames_in_flight; i++) {
+        for (auto& pool : g_vk_slot_cmd_pools[i])
+            g_vk_device.destroyCommandPool(pool, nullptr);
+        g_vk_slot_cmd_pools[i].clear();
+        g_vk_slot_cmds[i].clear();
+    }
+    g_vk_thread_pool = nullptr;
+
+    if (g_vk_timestamp_query_pool)
+        g_vk_device.destroyQueryPool(g_vk_timestamp_query_pool, nullptr);
+
+    g_vk_allocator.destroy_buffer(g_vk_transient_buffer, g_vk_transient_allocation);
+    g_vk_allocator.destroy_buffer(g_vk_vertex_buffer, g_vk_vertex_allocation);
+    g_vk_allocator.destroy_buffer(g_vk_index_buffer, g_vk_index_allocation);
+    g_vk_geometry_pool.free(g_vk_mesh_range);
+    g_vk_mesh_range = GeometryRange();
+    for (uint32_t i = 0; i < MESHLET_BUFFER_CNT; ++i) {
+        if (g_vk_meshlet_buffers[i])
+            g_vk_allocator.destroy_buffer(g_vk_meshlet_buffers[i], g_vk_meshlet_allocations[i]);
+        g_vk_meshlet_buffers[i] = vk::Buffer();
+    }
+    if (g_vk_meshlet_desc_pool)
+        g_vk_device.destroyDescriptorPool(g_vk_meshlet_desc_pool, nullptr);
+    g_vk_meshlet_desc_pool = vk::DescriptorPool();
+    if (g_vk_object_buffer)
+        g_vk_allocator.destroy_buffer(g_vk_object_buffer, g_vk_object_allocation);
+    if (g_vk_object_draw_buffer)
+        g_vk_allocator.destroy_buffer(g_vk_object_draw_buffer, g_vk_object_draw_allocation);
+    g_vk_object_buffer = g_vk_object_draw_buffer = vk::Buffer();
+    if (g_vk_object_cull_desc_pool)
+        g_vk_device.destroyDescriptorPool(g_vk_object_cull_desc_pool, nullptr);
+    g_vk_object_cull_desc_pool = vk::DescriptorPool();
+    g_vk_mesh.release();
+
+    // pipelines still compiling have to be done before anything they use goes away
+    g_vk_pipeline_compiler = nullptr;
+    g_vk_pipeline = nullptr;
+    g_vk_frame_pipeline = vk::Pipeline();
+    g_vk_meshlet_pipeline = nullptr;
+    g_vk_frame_meshlet_pipeline = vk::Pipeline();
+    g_vk_object_cull_pipeline = nullptr;
+    g_vk_frame_object_cull_pipeline = vk::Pipeline();
+    g_vk_pipeline_registry.shutdown();
+    save_vk_pipeline_cache();
     g_vk_device.destroyPipelineCache(g_vk_pipeline_cache);
-    g_vk_device.destroyPipelineLayout(g_vk_pipeline_layout);
 
-    g_vk_device.waitIdle();
+    g_vk_allocator.shutdown();
     g_vk_device.destroy(nullptr);
-    g_vk_instance.destroySurfaceKHR(g_vk_surface, nullptr);
+    if (!g_vk_offscreen)
+        g_vk_instance.destroySurfaceKHR(g_vk_surface, nullptr);
     g_vk_instance.destroy(nullptr);
-}
\ No newline at end of file
+}
+
+
+void VulkanGraphicsSample::set_draw_count(const unsigned int draw_cnt) {
+    g_vk_draw_cnt = std::max(draw_cnt, 1u);
+}
+
+void VulkanGraphicsSample::set_frames_in_flight(const unsigned int frame_cnt) {
+    g_vk_frames_in_flight = std::min(std::max(frame_cnt, 1u), MAX_FRAMES_IN_FLIGHT);
+}
+
+void VulkanGraphicsSample::resize(const unsigned int width, const unsigned int height) {
+    // offscreen images never change, the swapchain follows the size of the window, or this size for a headless surface
+    if (g_vk_offscreen || (width == g_width && height == g_height))
+        return;
+
+    g_width = width;
+    g_height = height;
+    g_vk_swapchain_dirty = true;
+}
+
+void VulkanGraphicsSample::set_present_mode(const PresentMode mode) {
+    g_vk_requested_present_mode = mode;
+}
+
+void VulkanGraphicsSample::set_low_latency(const bool low_latency) {
+    g_vk_frame_pacer.set_low_latency(low_latency);
+}
+
+void VulkanGraphicsSample::set_headless_surface(const bool headless) {
+    g_vk_headless = headless;
+}
+
+bool VulkanGraphicsSample::get_present_stats(PresentStats& stats) const {
+    if (g_vk_offscreen)
+        return false;
+
+    stats.mode = g_vk_present_mode;
+    stats.low_latency = g_vk_frame_pacer.is_low_latency();
+    stats.waitable = false;
+    return true;
+}
+
+void VulkanGraphicsSample::set_instancing(const bool instancing) {
+    g_vk_requested_instancing = instancing;
+}
+
+bool VulkanGraphicsSample::get_instancing_stats(InstancingStats& stats) const {
+    stats = InstancingStats();
+    if (!g_vk_instancing)
+        return false;
+
+    stats.instance_cnt = g_vk_draw_cnt;
+    stats.draw_call_cnt = 1;
+    stats.instance_data_size = (unsigned long long)sizeof(InstanceData) * g_vk_draw_cnt;
+    return true;
+}
+
+void VulkanGraphicsSample::set_gpu_culling(const bool gpu_culling) {
+    g_vk_requested_gpu_culling = gpu_culling;
+}
+
+bool VulkanGraphicsSample::get_gpu_culling_stats(GpuCullingStats& stats) const {
+    stats = g_vk_gpu_culling_stats;
+    return g_vk_gpu_culling_path != GpuCullingPath::None;
+}
+
+bool VulkanGraphicsSample::get_render_graph_stats(RenderGraphStats& stats) const {
+    stats = g_vk_render_graph.get_stats();
+    return stats.pass_cnt > 0;
+}
+
+void VulkanGraphicsSample::set_mesh(const char* filename) {
+    g_vk_mesh_filename = filename ? filename : "";
+}
+
+void VulkanGraphicsSample::set_mesh_optimization(const bool optimize) {
+    g_vk_mesh_optimization = optimize;
+}
+
+bool VulkanGraphicsSample::get_mesh_optimization_stats(MeshOptimizationStats& stats) const {
+    stats = g_vk_mesh_optimization_stats;
+    return g_vk_mesh_optimization;
+}
+
+bool VulkanGraphicsSample::get_geometry_pool_stats(GeometryPoolStats& stats) const {
+    g_vk_geometry_pool.get_stats(stats);
+    return true;
+}
+
+void VulkanGraphicsSample::set_vertex_encoding(const VertexEncoding encoding) {
+    g_vk_requested_vertex_encoding = encoding;
+}
+
+bool VulkanGraphicsSample::get_vertex_encoding_stats(VertexEncodingStats& stats) const {
+    stats = g_vk_vertex_encoding_stats;
+    return true;
+}
+
+void VulkanGraphicsSample::set_meshlets(const bool meshlets) {
+    g_vk_meshlets = meshlets;
+}
+
+bool VulkanGraphicsSample::get_meshlet_stats(MeshletStats& stats) const {
+    stats = g_vk_meshlet_stats;
+    return g_vk_meshlets;
+}
+
+
+bool VulkanGraphicsSample::get_transient_memory_stats(TransientMemoryStats& stats) const {
+    stats = TransientMemoryStats();
+    for (const auto& allocator : g_vk_frame_allocators)
+        allocator.get_stats(stats);
+    return true;
+}
+
+bool VulkanGraphicsSample::get_gpu_memory_stats(GpuMemoryStats& stats) const {
+    g_vk_allocator.get_stats(stats);
+    return true;
+}
+
+bool VulkanGraphicsSample::save_pipeline_cache() {
+    return save_vk_pipeline_cache();
+}
+
+unsigned int VulkanGraphicsSample::get_pending_pipeline_count() const {
+    return g_vk_pipeline_compiler ? g_vk_pipeline_compiler->pending_count() : 0;
+}
@@ -9,10 +9,23 @@
 
 class VulkanGraphicsSample : public GraphicsSample {
 public:
+    /*
+     * Number of threads recording commands, 0 means one thread for each hardware thread. Draws are recorded into secondary
+     * command buffers on multiple threads only if there are enough of them.
+     */
+    explicit VulkanGraphicsSample(const unsigned int thread_cnt = 0);
+
+#if PLATFORM_WIN
     /*
      * Initialize graphics API.
      */
     bool initialize(const HINSTANCE hInstnace, const HWND hwnd) override;
+#endif
+
+    /*
+     * Initialize graphics API without a window, the sample renders into device local images instead of a swapchain.
+     */
+    bool initialize(const unsigned int width, const unsigned int height) override;
 
     /*
      * Render a frame.
@@ -23,4 +36,127 @@ public:
      * Shutdown the graphics API.
      */
     void shutdown() override;
-};
\ No newline at end of file
+
+    /*
+     * The swapchain is recreated at the beginning of the next frame, the old one is retired once the frames in flight are done.
+     */
+    void resize(const unsigned int width, const unsigned int height) override;
+
+    /*
+     * Number of times the triangle is drawn in each frame.
+     */
+    void set_draw_count(const unsigned int draw_cnt) override;
+
+    /*
+     * Frames recorded ahead of GPU, each owns a command buffer and a region of the transient memory. Swapchain images are
+     * independent of it, there are as many of them as the presentation engine wants.
+     */
+    void set_frames_in_flight(const unsigned int frame_cnt) override;
+
+    /*
+     * Present mode of the swapchain, it falls back to FIFO if the surface doesn't support it.
+     */
+    void set_present_mode(const PresentMode mode) override;
+
+    /*
+     * Delay each frame until just before GPU runs out of work, GPU time comes from the timestamp queries.
+     */
+    void set_low_latency(const bool low_latency) override;
+
+    /*
+     * Present to a 'VK_EXT_headless_surface' when initialized without a window, it fails if the instance doesn't have it.
+     */
+    void set_headless_surface(const bool headless) override;
+
+    /*
+     * The present mode of the swapchain and whether frames are paced for low latency.
+     */
+    bool get_present_stats(PresentStats& stats) const override;
+
+    /*
+     * Draw all instances with a single instanced draw call, it has to be set before initialization.
+     */
+    void set_instancing(const bool instancing) override;
+
+    /*
+     * Instances drawn in each frame and the size of their data.
+     */
+    bool get_instancing_stats(InstancingStats& stats) const override;
+
+    /*
+     * Cull the draws in a compute shader and draw the visible ones with an indexed indirect count draw, or with multi draw indirect on devices without it.
+     * It has to be set before initialization.
+     */
+    void set_gpu_culling(const bool gpu_culling) override;
+
+    /*
+     * How culled draws are drawn and how many of them are visible in the last frame read back.
+     */
+    bool get_gpu_culling_stats(GpuCullingStats& stats) const override;
+
+    /*
+     * Passes culled and barriers recorded by the render graph of the last frame.
+     */
+    bool get_render_graph_stats(RenderGraphStats& stats) const override;
+
+    /*
+     * Mesh file to draw, it has to be set before initialization.
+     */
+    void set_mesh(const char* filename) override;
+
+    /*
+     * Optimize the mesh when it is loaded, it has to be set before initialization.
+     */
+    void set_mesh_optimization(const bool optimize) override;
+
+    /*
+     * Cache efficiency of the mesh before and after optimization.
+     */
+    bool get_mesh_optimization_stats(MeshOptimizationStats& stats) const override;
+
+    /*
+     * Meshes sub-allocated from the vertex and index buffers of the geometry pool.
+     */
+    bool get_geometry_pool_stats(GeometryPoolStats& stats) const override;
+
+    /*
+     * Draw meshlets with task and mesh shaders, or with compute culling and indirect draws on devices without mesh shaders.
+     * Vertices are always full precision on this path. It has to be set before initialization.
+     */
+    void set_meshlets(const bool meshlets) override;
+
+    /*
+     * The meshlet path picked for the device and the culling result of the last frame read back.
+     */
+    bool get_meshlet_stats(MeshletStats& stats) const override;
+
+    /*
+     * Encoding of the vertex buffer, it has to be set before initialization.
+     */
+    void set_vertex_encoding(const VertexEncoding encoding) override;
+
+    /*
+     * Size of the vertex buffer before and after encoding.
+     */
+    bool get_vertex_encoding_stats(VertexEncodingStats& stats) const override;
+
+    /*
+     * Usage of the per-frame memory for per-draw constants.
+     */
+    bool get_transient_memory_stats(TransientMemoryStats& stats) const override;
+
+    /*
+     * Usage of the GPU memory sub-allocator.
+     */
+    bool get_gpu_memory_stats(GpuMemoryStats& stats) const override;
+
+    /*
+     * Write the pipeline cache to disk.
+     */
+    bool save_pipeline_cache() override;
+
+    /*
+     * Number of pipelines the pipeline compiler is still working on.
+     */
+    unsigned int get_pending_pipeline_count() const override;
+};
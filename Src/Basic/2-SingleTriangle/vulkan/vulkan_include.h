@@ -0,0 +1,18 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+// Every file including vulkan.hpp has to see the same configuration of it, this is the only place to include it.
+#if PLATFORM_WIN
+#include <windows.h>
+#endif
+
+#define VULKAN_HPP_NO_EXCEPTIONS
+#define VULKAN_HPP_TYPESAFE_CONVERSION
+#include <vulkan/vulkan.hpp>
+#if PLATFORM_WIN
+#include <vulkan/vk_sdk_platform.h>
+#endif
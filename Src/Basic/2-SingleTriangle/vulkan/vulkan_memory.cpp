@@ -0,0 +1,338 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <algorithm>
+#include "vulkan_memory.h"
+
+static inline vk::DeviceSize align_up(const vk::DeviceSize value, const vk::DeviceSize alignment) {
+    return (value + alignment - 1) / alignment * alignment;
+}
+
+void VulkanMemoryAllocator::initialize(const vk::Device& device, const vk::PhysicalDevice& physical_device, const vk::DeviceSize block_size) {
+    m_device = device;
+    m_block_size = block_size;
+    physical_device.getMemoryProperties(&m_memory_props);
+
+    vk::PhysicalDeviceProperties properties;
+    physical_device.getProperties(&properties);
+    m_granularity = std::max(properties.limits.bufferImageGranularity, (vk::DeviceSize)1);
+}
+
+void VulkanMemoryAllocator::shutdown() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    for (auto& block : m_blocks) {
+        if (!block)
+            continue;
+        if (block->mapped)
+            m_device.unmapMemory(block->memory);
+        m_device.freeMemory(block->memory, nullptr);
+    }
+    m_blocks.clear();
+
+    for (auto& free_lists : m_free_lists) {
+        for (auto& free_list : free_lists)
+            free_list.clear();
+    }
+}
+
+unsigned int VulkanMemoryAllocator::size_class(vk::DeviceSize size) {
+    unsigned int ret = 0;
+    while (size >>= 1)
+        ++ret;
+    return ret;
+}
+
+bool VulkanMemoryAllocator::find_memory_type(uint32_t type_bits, const vk::MemoryPropertyFlags flags, uint32_t& memory_type) const {
+    for (uint32_t i = 0; i < m_memory_props.memoryTypeCount; i++, type_bits >>= 1) {
+        if ((type_bits & 1) && (m_memory_props.memoryTypes[i].propertyFlags & flags) == flags) {
+            memory_type = i;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool VulkanMemoryAllocator::create_block(const uint32_t memory_type, const vk::DeviceSize size, const bool dedicated, uint32_t& block_index) {
+    auto block = std::make_unique<Block>();
+    block->size = size;
+    block->memory_type = memory_type;
+    block->dedicated = dedicated;
+
+    auto const alloc_info = vk::MemoryAllocateInfo()
+        .setAllocationSize(size)
+        .setMemoryTypeIndex(memory_type);
+    auto result = m_device.allocateMemory(&alloc_info, nullptr, &block->memory);
+    if (result != vk::Result::eSuccess)
+        return false;
+
+    // host visible memory is mapped for its whole life time
+    if (m_memory_props.memoryTypes[memory_type].propertyFlags & vk::MemoryPropertyFlagBits::eHostVisible) {
+        result = m_device.mapMemory(block->memory, 0, VK_WHOLE_SIZE, vk::MemoryMapFlags(), (void**)&block->mapped);
+        if (result != vk::Result::eSuccess) {
+            m_device.freeMemory(block->memory, nullptr);
+            return false;
+        }
+    }
+
+    block->ranges[0] = Range{ size, true };
+
+    // reuse the slot of a released block if there is any
+    auto it = std::find(m_blocks.begin(), m_blocks.end(), nullptr);
+    block_index = (uint32_t)(it - m_blocks.begin());
+    if (it == m_blocks.end())
+        m_blocks.push_back(std::move(block));
+    else
+        *it = std::move(block);
+
+    add_free_range(block_index, 0, size);
+    return true;
+}
+
+void VulkanMemoryAllocator::release_block(const uint32_t block_index) {
+    auto& block = m_blocks[block_index];
+    for (const auto& range : block->ranges) {
+        if (range.second.free)
+            remove_free_range(block_index, range.first, range.second.size);
+    }
+
+    if (block->mapped)
+        m_device.unmapMemory(block->memory);
+    m_device.freeMemory(block->memory, nullptr);
+    block = nullptr;
+}
+
+void VulkanMemoryAllocator::add_free_range(const uint32_t block_index, const vk::DeviceSize offset, const vk::DeviceSize size) {
+    const auto memory_type = m_blocks[block_index]->memory_type;
+    m_free_lists[memory_type][size_class(size)].insert(FreeRange{ size, block_index, offset });
+}
+
+void VulkanMemoryAllocator::remove_free_range(const uint32_t block_index, const vk::DeviceSize offset, const vk::DeviceSize size) {
+    const auto memory_type = m_blocks[block_index]->memory_type;
+    m_free_lists[memory_type][size_class(size)].erase(FreeRange{ size, block_index, offset });
+}
+
+bool VulkanMemoryAllocator::allocate_from_free_lists(const uint32_t memory_type, const vk::DeviceSize size, const vk::DeviceSize alignment, VulkanAllocation& allocation) {
+    for (auto c = size_class(size); c < SIZE_CLASS_CNT; ++c) {
+        auto& free_list = m_free_lists[memory_type][c];
+
+        // the smallest range that is large enough, alignment could still make it too small, in which case the next one is checked
+        for (auto it = free_list.lower_bound(FreeRange{ size, 0, 0 }); it != free_list.end(); ++it) {
+            const auto aligned_offset = align_up(it->offset, alignment);
+            if (aligned_offset + size > it->offset + it->size)
+                continue;
+
+            const auto free_range = *it;
+            free_list.erase(it);
+
+            // split the free range into the padding for alignment, the allocation and whatever is left after it
+            auto& block = m_blocks[free_range.block];
+            block->ranges.erase(free_range.offset);
+            if (aligned_offset > free_range.offset) {
+                block->ranges[free_range.offset] = Range{ aligned_offset - free_range.offset, true };
+                add_free_range(free_range.block, free_range.offset, aligned_offset - free_range.offset);
+            }
+            block->ranges[aligned_offset] = Range{ size, false };
+            const auto tail_offset = aligned_offset + size;
+            const auto tail_size = free_range.offset + free_range.size - tail_offset;
+            if (tail_size > 0) {
+                block->ranges[tail_offset] = Range{ tail_size, true };
+                add_free_range(free_range.block, tail_offset, tail_size);
+            }
+
+            allocation.memory = block->memory;
+            allocation.offset = aligned_offset;
+            allocation.size = size;
+            allocation.mapped = block->mapped ? block->mapped + aligned_offset : nullptr;
+            allocation.block = free_range.block;
+            return true;
+        }
+    }
+    return false;
+}
+
+bool VulkanMemoryAllocator::allocate(const vk::MemoryRequirements& requirements, const vk::MemoryPropertyFlags flags, const bool linear, VulkanAllocation& allocation) {
+    uint32_t memory_type = 0;
+    if (!find_memory_type(requirements.memoryTypeBits, flags, memory_type))
+        return false;
+
+    // optimal images occupy whole pages of the granularity, so that no buffer could ever share a page with them
+    auto alignment = std::max(requirements.alignment, (vk::DeviceSize)1);
+    auto size = requirements.size;
+    if (!linear) {
+        alignment = align_up(alignment, m_granularity);
+        size = align_up(size, m_granularity);
+    }
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // large requests are not worth sharing a block
+    if (size > m_block_size / 2) {
+        uint32_t block_index = 0;
+        if (!create_block(memory_type, size, true, block_index))
+            return false;
+
+        // the whole block goes to this allocation, memory is always aligned well enough at the beginning of it
+        auto& block = m_blocks[block_index];
+        remove_free_range(block_index, 0, size);
+        block->ranges[0].free = false;
+
+        allocation.memory = block->memory;
+        allocation.offset = 0;
+        allocation.size = size;
+        allocation.mapped = block->mapped;
+        allocation.block = block_index;
+        return true;
+    }
+
+    if (allocate_from_free_lists(memory_type, size, alignment, allocation))
+        return true;
+
+    uint32_t block_index = 0;
+    if (!create_block(memory_type, m_block_size, false, block_index))
+        return false;
+    return allocate_from_free_lists(memory_type, size, alignment, allocation);
+}
+
+void VulkanMemoryAllocator::free(VulkanAllocation& allocation) {
+    if (allocation.block == UINT32_MAX)
+        return;
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    const auto block_index = allocation.block;
+    const auto offset = allocation.offset;
+    allocation = VulkanAllocation();
+
+    auto& block = m_blocks[block_index];
+    auto it = block->ranges.find(offset);
+    if (it == block->ranges.end() || it->second.free)
+        return;
+    it->second.free = true;
+
+    // a dedicated block is never shared, it goes away with its only allocation
+    if (block->dedicated) {
+        release_block(block_index);
+        return;
+    }
+
+    // merge with the next range if it is free
+    auto next = std::next(it);
+    if (next != block->ranges.end() && next->second.free) {
+        remove_free_range(block_index, next->first, next->second.size);
+        it->second.size += next->second.size;
+        block->ranges.erase(next);
+    }
+
+    // merge with the previous range if it is free
+    if (it != block->ranges.begin()) {
+        auto prev = std::prev(it);
+        if (prev->second.free) {
+            remove_free_range(block_index, prev->first, prev->second.size);
+            prev->second.size += it->second.size;
+            block->ranges.erase(it);
+            it = prev;
+        }
+    }
+
+    add_free_range(block_index, it->first, it->second.size);
+
+    // An empty block is released if there is already another empty one of the same memory type, keeping one around avoids
+    // allocating and freeing device memory over and over again when a single resource is created and destroyed repeatedly.
+    if (it->second.size == block->size) {
+        for (uint32_t i = 0; i < (uint32_t)m_blocks.size(); ++i) {
+            const auto& other = m_blocks[i];
+            if (i != block_index && other && !other->dedicated && other->memory_type == block->memory_type &&
+                other->ranges.size() == 1 && other->ranges.begin()->second.free) {
+                release_block(block_index);
+                break;
+            }
+        }
+    }
+}
+
+void VulkanMemoryAllocator::get_stats(GpuMemoryStats& stats) const {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    stats = GpuMemoryStats();
+    unsigned long long free_size = 0;
+    for (const auto& block : m_blocks) {
+        if (!block)
+            continue;
+
+        ++stats.block_cnt;
+        stats.reserved += block->size;
+        for (const auto& range : block->ranges) {
+            if (range.second.free) {
+                ++stats.free_range_cnt;
+                free_size += range.second.size;
+                stats.largest_free_range = std::max(stats.largest_free_range, (unsigned long long)range.second.size);
+            }
+            else {
+                ++stats.allocation_cnt;
+                stats.used += range.second.size;
+            }
+        }
+    }
+
+    if (free_size > 0)
+        stats.fragmentation = 1.0f - (float)((double)stats.largest_free_range / free_size);
+}
+
+bool VulkanMemoryAllocator::create_buffer(const vk::BufferCreateInfo& info, const vk::MemoryPropertyFlags flags, vk::Buffer& buffer, VulkanAllocation& allocation) {
+    auto result = m_device.createBuffer(&info, nullptr, &buffer);
+    if (result != vk::Result::eSuccess)
+        return false;
+
+    vk::MemoryRequirements mem_reqs;
+    m_device.getBufferMemoryRequirements(buffer, &mem_reqs);
+    if (!allocate(mem_reqs, flags, true, allocation)) {
+        m_device.destroyBuffer(buffer, nullptr);
+        buffer = vk::Buffer();
+        return false;
+    }
+
+    result = m_device.bindBufferMemory(buffer, allocation.memory, allocation.offset);
+    if (result != vk::Result::eSuccess) {
+        destroy_buffer(buffer, allocation);
+        return false;
+    }
+    return true;
+}
+
+bool VulkanMemoryAllocator::create_image(const vk::ImageCreateInfo& info, const vk::MemoryPropertyFlags flags, vk::Image& image, VulkanAllocation& allocation) {
+    auto result = m_device.createImage(&info, nullptr, &image);
+    if (result != vk::Result::eSuccess)
+        return false;
+
+    vk::MemoryRequirements mem_reqs;
+    m_device.getImageMemoryRequirements(image, &mem_reqs);
+    if (!allocate(mem_reqs, flags, info.tiling == vk::ImageTiling::eLinear, allocation)) {
+        m_device.destroyImage(image, nullptr);
+        image = vk::Image();
+        return false;
+    }
+
+    result = m_device.bindImageMemory(image, allocation.memory, allocation.offset);
+    if (result != vk::Result::eSuccess) {
+        destroy_image(image, allocation);
+        return false;
+    }
+    return true;
+}
+
+void VulkanMemoryAllocator::destroy_buffer(vk::Buffer& buffer, VulkanAllocation& allocation) {
+    if (buffer)
+        m_device.destroyBuffer(buffer, nullptr);
+    buffer = vk::Buffer();
+    free(allocation);
+}
+
+void VulkanMemoryAllocator::destroy_image(vk::Image& image, VulkanAllocation& allocation) {
+    if (image)
+        m_device.destroyImage(image, nullptr);
+    image = vk::Image();
+    free(allocation);
+}
@@ -0,0 +1,141 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <map>
+#include <set>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include "vulkan_include.h"
+#include "../sample.h"
+
+/*
+ * A range of device memory sub-allocated from a block.
+ */
+struct VulkanAllocation {
+    vk::DeviceMemory    memory;                     // the block this allocation lives in
+    vk::DeviceSize      offset = 0;                 // offset in the block, this is what resources are bound with
+    vk::DeviceSize      size = 0;                   // size of the allocation, it could be larger than requested
+    void*               mapped = nullptr;           // CPU address of the allocation, only valid for host visible memory
+    uint32_t            block = UINT32_MAX;         // index of the block, UINT32_MAX means nothing is allocated
+};
+
+/*
+ * A block based GPU memory sub-allocator.
+ * Device memory is allocated in large blocks, which are split into ranges for buffers and images. Free ranges are kept in
+ * free lists of power of two size classes for each memory type. Allocation looks for the best fit from the size class of
+ * the request upwards, freeing merges the range with its free neighbors. Host visible blocks are mapped once when they are
+ * allocated, so are all allocations in them.
+ *
+ * Linear resources ( buffers ) and optimal images can't share a page of 'bufferImageGranularity', images are aligned with
+ * it and padded to it so that a buffer never lands on the same page with an image.
+ *
+ * Requests larger than half of a block get their own dedicated block, which is freed as soon as the allocation is freed.
+ */
+class VulkanMemoryAllocator {
+public:
+    // Default size of each block.
+    static constexpr vk::DeviceSize DEFAULT_BLOCK_SIZE = 64ull * 1024 * 1024;
+
+    /*
+     * Query the memory types and limits of the physical device, nothing is allocated until the first request.
+     */
+    void initialize(const vk::Device& device, const vk::PhysicalDevice& physical_device, const vk::DeviceSize block_size = DEFAULT_BLOCK_SIZE);
+
+    /*
+     * Free all blocks, every resource bound with them needs to be destroyed before this.
+     */
+    void shutdown();
+
+    /*
+     * Allocate memory for the requirements, 'linear' is true for buffers and linear images.
+     */
+    bool allocate(const vk::MemoryRequirements& requirements, const vk::MemoryPropertyFlags flags, const bool linear, VulkanAllocation& allocation);
+
+    /*
+     * Return the memory to its block.
+     */
+    void free(VulkanAllocation& allocation);
+
+    /*
+     * Create a buffer and bind it with sub-allocated memory.
+     */
+    bool create_buffer(const vk::BufferCreateInfo& info, const vk::MemoryPropertyFlags flags, vk::Buffer& buffer, VulkanAllocation& allocation);
+
+    /*
+     * Create an image and bind it with sub-allocated memory.
+     */
+    bool create_image(const vk::ImageCreateInfo& info, const vk::MemoryPropertyFlags flags, vk::Image& image, VulkanAllocation& allocation);
+
+    /*
+     * Destroy a buffer or an image along with its memory.
+     */
+    void destroy_buffer(vk::Buffer& buffer, VulkanAllocation& allocation);
+    void destroy_image(vk::Image& image, VulkanAllocation& allocation);
+
+    /*
+     * Utilization and fragmentation of all blocks.
+     */
+    void get_stats(GpuMemoryStats& stats) const;
+
+private:
+    // number of size classes, one for each power of two
+    static constexpr unsigned int SIZE_CLASS_CNT = 64;
+
+    // A range in a block, either free or allocated.
+    struct Range {
+        vk::DeviceSize  size = 0;
+        bool            free = true;
+    };
+
+    // A block of device memory.
+    struct Block {
+        vk::DeviceMemory                        memory;
+        vk::DeviceSize                          size = 0;
+        uint8_t*                                mapped = nullptr;
+        uint32_t                                memory_type = 0;
+        bool                                    dedicated = false;
+        // all ranges in the block ordered by their offsets, so that neighbors can be found when freeing
+        std::map<vk::DeviceSize, Range>         ranges;
+    };
+
+    // A free range in a free list, free lists are ordered by size for best fit.
+    struct FreeRange {
+        vk::DeviceSize  size;
+        uint32_t        block;
+        vk::DeviceSize  offset;
+
+        bool operator<(const FreeRange& other) const {
+            if (size != other.size)
+                return size < other.size;
+            if (block != other.block)
+                return block < other.block;
+            return offset < other.offset;
+        }
+    };
+
+    bool find_memory_type(uint32_t type_bits, const vk::MemoryPropertyFlags flags, uint32_t& memory_type) const;
+    bool create_block(const uint32_t memory_type, const vk::DeviceSize size, const bool dedicated, uint32_t& block_index);
+    void release_block(const uint32_t block_index);
+    void add_free_range(const uint32_t block_index, const vk::DeviceSize offset, const vk::DeviceSize size);
+    void remove_free_range(const uint32_t block_index, const vk::DeviceSize offset, const vk::DeviceSize size);
+    bool allocate_from_free_lists(const uint32_t memory_type, const vk::DeviceSize size, const vk::DeviceSize alignment, VulkanAllocation& allocation);
+
+    static unsigned int size_class(vk::DeviceSize size);
+
+    vk::Device                              m_device;
+    vk::PhysicalDeviceMemoryProperties      m_memory_props;
+    vk::DeviceSize                          m_block_size = DEFAULT_BLOCK_SIZE;
+    vk::DeviceSize                          m_granularity = 1;
+
+    // Blocks are never moved, released blocks leave a hole in the vector which is reused by the next block.
+    std::vector<std::unique_ptr<Block>>     m_blocks;
+    std::set<FreeRange>                     m_free_lists[VK_MAX_MEMORY_TYPES][SIZE_CLASS_CNT];
+
+    // Resources are created on loading threads too.
+    mutable std::mutex                      m_mutex;
+};
@@ -0,0 +1,356 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <algorithm>
+#include "vulkan_pipeline.h"
+
+/*
+ * Handles are added as their values, objects from the registry have only one handle for each state.
+ */
+template<class Handle>
+static void add_handle(StateKey& key, const Handle& handle) {
+    key.add((uint64_t)static_cast<typename Handle::CType>(handle));
+}
+
+template<class Bits>
+static void add_flags(StateKey& key, const vk::Flags<Bits>& flags) {
+    key.add((uint32_t)flags);
+}
+
+static void add_attachment_reference(StateKey& key, const vk::AttachmentReference* reference, const bool with_layout) {
+    key.add(reference ? reference->attachment : VK_ATTACHMENT_UNUSED);
+    if (with_layout)
+        key.add(reference ? reference->layout : vk::ImageLayout::eUndefined);
+}
+
+static void add_attachment_references(StateKey& key, const uint32_t cnt, const vk::AttachmentReference* references, const bool with_layout) {
+    key.add(references ? cnt : 0u);
+    for (uint32_t i = 0; references && i < cnt; ++i)
+        add_attachment_reference(key, &references[i], with_layout);
+}
+
+/*
+ * Two render passes are compatible if they only differ in load and store operations and layouts, 'with_everything' adds them
+ * too, which makes it the full description of the render pass.
+ */
+static StateKey get_render_pass_key(const vk::RenderPassCreateInfo& info, const bool with_everything) {
+    StateKey key;
+    add_flags(key, info.flags);
+
+    key.add(info.attachmentCount);
+    for (uint32_t i = 0; i < info.attachmentCount; ++i) {
+        const auto& attachment = info.pAttachments[i];
+        add_flags(key, attachment.flags);
+        key.add(attachment.format);
+        key.add(attachment.samples);
+        if (with_everything) {
+            key.add(attachment.loadOp).add(attachment.storeOp).add(attachment.stencilLoadOp).add(attachment.stencilStoreOp);
+            key.add(attachment.initialLayout).add(attachment.finalLayout);
+        }
+    }
+
+    key.add(info.subpassCount);
+    for (uint32_t i = 0; i < info.subpassCount; ++i) {
+        const auto& subpass = info.pSubpasses[i];
+        add_flags(key, subpass.flags);
+        key.add(subpass.pipelineBindPoint);
+        add_attachment_references(key, subpass.inputAttachmentCount, subpass.pInputAttachments, with_everything);
+        add_attachment_references(key, subpass.colorAttachmentCount, subpass.pColorAttachments, with_everything);
+        add_attachment_references(key, subpass.colorAttachmentCount, subpass.pResolveAttachments, with_everything);
+        add_attachment_reference(key, subpass.pDepthStencilAttachment, with_everything);
+        key.add(subpass.preserveAttachmentCount);
+        key.add_bytes(subpass.pPreserveAttachments, subpass.preserveAttachmentCount * sizeof(uint32_t));
+    }
+
+    key.add(info.dependencyCount);
+    for (uint32_t i = 0; i < info.dependencyCount; ++i) {
+        const auto& dependency = info.pDependencies[i];
+        key.add(dependency.srcSubpass).add(dependency.dstSubpass);
+        add_flags(key, dependency.srcStageMask);
+        add_flags(key, dependency.dstStageMask);
+        add_flags(key, dependency.srcAccessMask);
+        add_flags(key, dependency.dstAccessMask);
+        add_flags(key, dependency.dependencyFlags);
+    }
+
+    return key;
+}
+
+/*
+ * Create the pipeline, it runs on the threads of the pipeline compiler.
+ */
+static bool create_graphics_pipeline(const vk::Device& device, const vk::PipelineCache& cache, const VulkanPipelineDesc& desc, vk::Pipeline& pipeline_state) {
+    // vertex format layout
+    auto const vertex_input_layout = vk::PipelineVertexInputStateCreateInfo()
+                                .setVertexAttributeDescriptionCount((uint32_t)desc.vertex_attributes.size())
+                                .setPVertexAttributeDescriptions(desc.vertex_attributes.data())
+                                .setVertexBindingDescriptionCount((uint32_t)desc.vertex_bindings.size())
+                                .setPVertexBindingDescriptions(desc.vertex_bindings.data());
+
+    // input assembly info
+    auto const input_assembler_info = vk::PipelineInputAssemblyStateCreateInfo()
+                                .setTopology(desc.topology);
+
+    // rasterizer information
+    auto const rasterizer_info = vk::PipelineRasterizationStateCreateInfo()
+                                .setDepthClampEnable(VK_FALSE)
+                                .setRasterizerDiscardEnable(VK_FALSE)
+                                .setPolygonMode(desc.polygon_mode)
+                                .setCullMode(desc.cull_mode)
+                                .setFrontFace(desc.front_face)
+                                .setDepthBiasEnable(VK_FALSE)
+                                .setLineWidth(1.0f);
+
+    // depth stencil info
+    auto const depth_stencil_info = vk::PipelineDepthStencilStateCreateInfo()
+                                .setDepthTestEnable(desc.depth_test ? VK_TRUE : VK_FALSE)
+                                .setDepthWriteEnable(desc.depth_write ? VK_TRUE : VK_FALSE)
+                                .setDepthCompareOp(desc.depth_compare);
+
+    // color blend state
+    auto const color_blend_state = vk::PipelineColorBlendStateCreateInfo()
+                                .setAttachmentCount((uint32_t)desc.blend.size())
+                                .setPAttachments(desc.blend.data());
+
+    // dynamic state
+    vk::DynamicState const dynamic_states[2] = { vk::DynamicState::eViewport, vk::DynamicState::eScissor };
+    auto const dynamic_state_info = vk::PipelineDynamicStateCreateInfo().setPDynamicStates(dynamic_states).setDynamicStateCount(2);
+
+    // multi sample info
+    auto const multi_sample_info = vk::PipelineMultisampleStateCreateInfo();
+
+    // viewport info
+    auto const viewport_info = vk::PipelineViewportStateCreateInfo().setViewportCount(1).setScissorCount(1);
+
+    // mesh shaders replace everything before rasterization, vertex input and input assembly included
+    std::vector<vk::PipelineShaderStageCreateInfo> stages;
+    if (desc.mesh) {
+#if defined(VK_EXT_mesh_shader)
+        if (desc.task)
+            stages.push_back(vk::PipelineShaderStageCreateInfo().setStage(vk::ShaderStageFlagBits::eTaskEXT).setModule(desc.task).setPName("main"));
+        stages.push_back(vk::PipelineShaderStageCreateInfo().setStage(vk::ShaderStageFlagBits::eMeshEXT).setModule(desc.mesh).setPName("main"));
+#else
+        return false;
+#endif
+    } else {
+        stages.push_back(vk::PipelineShaderStageCreateInfo().setStage(vk::ShaderStageFlagBits::eVertex).setModule(desc.vs).setPName("main"));
+    }
+    stages.push_back(vk::PipelineShaderStageCreateInfo().setStage(vk::ShaderStageFlagBits::eFragment).setModule(desc.ps).setPName("main"));
+
+    // pipeline create info
+    auto const pipeline = vk::GraphicsPipelineCreateInfo()
+                                .setStageCount((uint32_t)stages.size())
+                                .setPVertexInputState(desc.mesh ? nullptr : &vertex_input_layout)
+                                .setPInputAssemblyState(desc.mesh ? nullptr : &input_assembler_info)
+                                .setPRasterizationState(&rasterizer_info)
+                                .setPDepthStencilState(&depth_stencil_info)
+                                .setPViewportState(&viewport_info)
+                                .setPStages(stages.data())
+                                .setPColorBlendState(&color_blend_state)
+                                .setLayout(desc.layout)
+                                .setPDynamicState(&dynamic_state_info)
+                                .setPMultisampleState(&multi_sample_info)
+                                .setRenderPass(desc.render_pass)
+                                .setSubpass(desc.subpass);
+
+    auto result = device.createGraphicsPipelines(cache, 1, &pipeline, nullptr, &pipeline_state);
+    return result == vk::Result::eSuccess;
+}
+
+/*
+ * Create the compute pipeline, it runs on the threads of the pipeline compiler too.
+ */
+static bool create_compute_pipeline(const vk::Device& device, const vk::PipelineCache& cache, const vk::ShaderModule& cs, const vk::PipelineLayout& layout, vk::Pipeline& pipeline_state) {
+    auto const pipeline = vk::ComputePipelineCreateInfo()
+                                .setStage(vk::PipelineShaderStageCreateInfo().setStage(vk::ShaderStageFlagBits::eCompute).setModule(cs).setPName("main"))
+                                .setLayout(layout);
+
+    auto result = device.createComputePipelines(cache, 1, &pipeline, nullptr, &pipeline_state);
+    return result == vk::Result::eSuccess;
+}
+
+void VulkanPipelineRegistry::initialize(const vk::Device& device, PipelineCompiler& compiler) {
+    m_device = device;
+    m_compiler = &compiler;
+}
+
+void VulkanPipelineRegistry::shutdown() {
+    // pipelines first, everything else is what they are built from
+    m_pipelines.for_each([&](std::shared_ptr<VulkanPipeline>& pipeline) {
+        if (pipeline->is_ready())
+            m_device.destroyPipeline(pipeline->pipeline, nullptr);
+    });
+    m_pipeline_layouts.for_each([&](vk::PipelineLayout& layout) { m_device.destroyPipelineLayout(layout, nullptr); });
+    m_descriptor_set_layouts.for_each([&](vk::DescriptorSetLayout& layout) { m_device.destroyDescriptorSetLayout(layout, nullptr); });
+    m_render_passes.for_each([&](RenderPass& render_pass) { m_device.destroyRenderPass(render_pass.render_pass, nullptr); });
+    m_shader_modules.for_each([&](vk::ShaderModule& module) { m_device.destroyShaderModule(module, nullptr); });
+
+    m_pipelines.clear();
+    m_pipeline_layouts.clear();
+    m_descriptor_set_layouts.clear();
+    m_render_pass_compatibility.clear();
+    m_render_passes.clear();
+    m_shader_modules.clear();
+}
+
+vk::ShaderModule VulkanPipelineRegistry::get_shader_module(const uint32_t* code, const size_t size) {
+    StateKey key;
+    key.add((uint64_t)size).add_bytes(code, size);
+
+    auto found = m_shader_modules.get_or_create(key, [&](vk::ShaderModule& module) {
+        const auto module_info = vk::ShaderModuleCreateInfo().setCodeSize(size).setPCode(code);
+        return m_device.createShaderModule(&module_info, nullptr, &module) == vk::Result::eSuccess;
+    });
+    return found ? *found : vk::ShaderModule();
+}
+
+vk::RenderPass VulkanPipelineRegistry::get_render_pass(const vk::RenderPassCreateInfo& info) {
+    auto found = m_render_passes.get_or_create(get_render_pass_key(info, true), [&](RenderPass& render_pass) {
+        if (m_device.createRenderPass(&info, nullptr, &render_pass.render_pass) != vk::Result::eSuccess)
+            return false;
+        render_pass.compatibility = get_render_pass_key(info, false);
+
+        // pipelines only know the handle of the render pass, this is how they find the compatibility of it
+        StateKey handle_key;
+        add_handle(handle_key, render_pass.render_pass);
+        m_render_pass_compatibility.get_or_create(handle_key, [&](StateKey& compatibility) {
+            compatibility = render_pass.compatibility;
+            return true;
+        });
+        return true;
+    });
+    return found ? found->render_pass : vk::RenderPass();
+}
+
+vk::DescriptorSetLayout VulkanPipelineRegistry::get_descriptor_set_layout(const vk::DescriptorSetLayoutCreateInfo& info) {
+    // bindings are sorted, the order they are listed in means nothing
+    std::vector<const vk::DescriptorSetLayoutBinding*> bindings(info.bindingCount);
+    for (uint32_t i = 0; i < info.bindingCount; ++i)
+        bindings[i] = &info.pBindings[i];
+    std::sort(bindings.begin(), bindings.end(), [](const vk::DescriptorSetLayoutBinding* a, const vk::DescriptorSetLayoutBinding* b) {
+        return a->binding < b->binding;
+    });
+
+    StateKey key;
+    add_flags(key, info.flags);
+    key.add(info.bindingCount);
+    for (const auto binding : bindings) {
+        key.add(binding->binding).add(binding->descriptorType).add(binding->descriptorCount);
+        add_flags(key, binding->stageFlags);
+        key.add(binding->pImmutableSamplers ? binding->descriptorCount : 0u);
+        for (uint32_t i = 0; binding->pImmutableSamplers && i < binding->descriptorCount; ++i)
+            add_handle(key, binding->pImmutableSamplers[i]);
+    }
+
+    auto found = m_descriptor_set_layouts.get_or_create(key, [&](vk::DescriptorSetLayout& layout) {
+        return m_device.createDescriptorSetLayout(&info, nullptr, &layout) == vk::Result::eSuccess;
+    });
+    return found ? *found : vk::DescriptorSetLayout();
+}
+
+vk::PipelineLayout VulkanPipelineRegistry::get_pipeline_layout(const vk::PipelineLayoutCreateInfo& info) {
+    StateKey key;
+    add_flags(key, info.flags);
+    key.add(info.setLayoutCount);
+    for (uint32_t i = 0; i < info.setLayoutCount; ++i)
+        add_handle(key, info.pSetLayouts[i]);
+    key.add(info.pushConstantRangeCount);
+    for (uint32_t i = 0; i < info.pushConstantRangeCount; ++i) {
+        const auto& range = info.pPushConstantRanges[i];
+        add_flags(key, range.stageFlags);
+        key.add(range.offset).add(range.size);
+    }
+
+    auto found = m_pipeline_layouts.get_or_create(key, [&](vk::PipelineLayout& layout) {
+        return m_device.createPipelineLayout(&info, nullptr, &layout) == vk::Result::eSuccess;
+    });
+    return found ? *found : vk::PipelineLayout();
+}
+
+std::shared_ptr<VulkanPipeline> VulkanPipelineRegistry::get_graphics_pipeline(const VulkanPipelineDesc& desc, const char* name) {
+    // Vertex inputs are sorted, states that have no effect, like blend factors without blending, are left out.
+    auto bindings = desc.vertex_bindings;
+    std::sort(bindings.begin(), bindings.end(), [](const vk::VertexInputBindingDescription& a, const vk::VertexInputBindingDescription& b) {
+        return a.binding < b.binding;
+    });
+    auto attributes = desc.vertex_attributes;
+    std::sort(attributes.begin(), attributes.end(), [](const vk::VertexInputAttributeDescription& a, const vk::VertexInputAttributeDescription& b) {
+        return a.location < b.location;
+    });
+
+    StateKey key;
+    add_handle(key, desc.vs);
+    add_handle(key, desc.task);
+    add_handle(key, desc.mesh);
+    add_handle(key, desc.ps);
+
+    key.add((uint32_t)bindings.size());
+    for (const auto& binding : bindings)
+        key.add(binding.binding).add(binding.stride).add(binding.inputRate);
+    key.add((uint32_t)attributes.size());
+    for (const auto& attribute : attributes)
+        key.add(attribute.location).add(attribute.binding).add(attribute.format).add(attribute.offset);
+
+    key.add(desc.topology).add(desc.polygon_mode).add(desc.front_face);
+    add_flags(key, desc.cull_mode);
+
+    // there is no depth write without depth test
+    key.add(desc.depth_test);
+    if (desc.depth_test)
+        key.add(desc.depth_write).add(desc.depth_compare);
+
+    key.add((uint32_t)desc.blend.size());
+    for (const auto& blend : desc.blend) {
+        key.add(blend.blendEnable);
+        if (blend.blendEnable) {
+            key.add(blend.srcColorBlendFactor).add(blend.dstColorBlendFactor).add(blend.colorBlendOp);
+            key.add(blend.srcAlphaBlendFactor).add(blend.dstAlphaBlendFactor).add(blend.alphaBlendOp);
+        }
+        add_flags(key, blend.colorWriteMask);
+    }
+
+    add_handle(key, desc.layout);
+
+    // a pipeline works with any render pass compatible with the one it is created with
+    StateKey handle_key;
+    add_handle(handle_key, desc.render_pass);
+    const auto compatibility = m_render_pass_compatibility.find(handle_key);
+    key.add(compatibility != nullptr);
+    if (compatibility)
+        key.add_bytes(compatibility->bytes().data(), compatibility->bytes().size());
+    else
+        add_handle(key, desc.render_pass);
+    key.add(desc.subpass);
+
+    auto found = m_pipelines.get_or_create(key, [&](std::shared_ptr<VulkanPipeline>& pipeline) {
+        pipeline = std::make_shared<VulkanPipeline>(name);
+
+        auto target = pipeline.get();
+        auto device = m_device;
+        auto cache = m_pipeline_cache;
+        m_compiler->compile(pipeline, [device, cache, desc, target]() { return create_graphics_pipeline(device, cache, desc, target->pipeline); });
+        return true;
+    });
+    return *found;
+}
+
+std::shared_ptr<VulkanPipeline> VulkanPipelineRegistry::get_compute_pipeline(const vk::ShaderModule& cs, const vk::PipelineLayout& layout, const char* name) {
+    // compute pipelines share the cache with graphics pipelines, the stage keeps their keys apart
+    StateKey key;
+    key.add(vk::ShaderStageFlagBits::eCompute);
+    add_handle(key, cs);
+    add_handle(key, layout);
+
+    auto found = m_pipelines.get_or_create(key, [&](std::shared_ptr<VulkanPipeline>& pipeline) {
+        pipeline = std::make_shared<VulkanPipeline>(name);
+
+        auto target = pipeline.get();
+        auto device = m_device;
+        auto cache = m_pipeline_cache;
+        m_compiler->compile(pipeline, [device, cache, cs, layout, target]() { return create_compute_pipeline(device, cache, cs, layout, target->pipeline); });
+        return true;
+    });
+    return *found;
+}
@@ -0,0 +1,164 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <vector>
+#include <memory>
+#include "vulkan_include.h"
+#include "../common/state_cache.h"
+#include "../common/pipeline_compiler.h"
+#include "../common/vertex_layout.h"
+
+/*
+ * A pipeline compiled in the background, the pipeline object is only valid once it is ready.
+ */
+struct VulkanPipeline : public AsyncPipeline {
+    explicit VulkanPipeline(const char* name) : AsyncPipeline(name) {}
+
+    vk::Pipeline    pipeline;
+};
+
+/*
+ * Everything a graphics pipeline is made of.
+ * Different from 'vk::GraphicsPipelineCreateInfo', it owns all of its data so that it can be handed to the compiler threads
+ * as it is. Viewport and scissor are always dynamic, there is always a single sample and the entry of all shaders is 'main'.
+ * A pipeline with a mesh shader has no vertex shader and no vertex input, the task shader is optional.
+ */
+struct VulkanPipelineDesc {
+    vk::ShaderModule                                    vs;
+    vk::ShaderModule                                    task;
+    vk::ShaderModule                                    mesh;
+    vk::ShaderModule                                    ps;
+    std::vector<vk::VertexInputBindingDescription>      vertex_bindings;
+    std::vector<vk::VertexInputAttributeDescription>    vertex_attributes;
+    vk::PrimitiveTopology                               topology = vk::PrimitiveTopology::eTriangleList;
+    vk::PolygonMode                                     polygon_mode = vk::PolygonMode::eFill;
+    vk::CullModeFlags                                   cull_mode = vk::CullModeFlagBits::eNone;
+    vk::FrontFace                                       front_face = vk::FrontFace::eCounterClockwise;
+    bool                                                depth_test = false;
+    bool                                                depth_write = false;
+    vk::CompareOp                                       depth_compare = vk::CompareOp::eLessOrEqual;
+    // one for each color attachment of the subpass
+    std::vector<vk::PipelineColorBlendAttachmentState>  blend;
+    vk::PipelineLayout                                  layout;
+    vk::RenderPass                                      render_pass;
+    uint32_t                                            subpass = 0;
+};
+
+constexpr vk::Format get_vk_vertex_format(const VertexFormat format) {
+    switch (format) {
+    case VertexFormat::Float2:      return vk::Format::eR32G32Sfloat;
+    case VertexFormat::Float3:      return vk::Format::eR32G32B32Sfloat;
+    case VertexFormat::Float4:      return vk::Format::eR32G32B32A32Sfloat;
+    case VertexFormat::UNorm8x4:    return vk::Format::eR8G8B8A8Unorm;
+    case VertexFormat::SNorm8x4:    return vk::Format::eR8G8B8A8Snorm;
+    case VertexFormat::UNorm16x2:   return vk::Format::eR16G16Unorm;
+    case VertexFormat::SNorm16x2:   return vk::Format::eR16G16Snorm;
+    case VertexFormat::UNorm16x4:   return vk::Format::eR16G16B16A16Unorm;
+    case VertexFormat::SNorm16x4:   return vk::Format::eR16G16B16A16Snorm;
+    case VertexFormat::Half2:       return vk::Format::eR16G16Sfloat;
+    case VertexFormat::Half4:       return vk::Format::eR16G16B16A16Sfloat;
+    }
+    return vk::Format::eUndefined;
+}
+
+/*
+ * Add a vertex stream to the pipeline, its binding and attributes are generated from the layout of the vertex.
+ */
+template<class V>
+void add_vertex_stream(VulkanPipelineDesc& desc, const uint32_t binding, const vk::VertexInputRate rate = vk::VertexInputRate::eVertex) {
+    static const auto attributes = make_vertex_elements<V, vk::VertexInputAttributeDescription>([](const VertexAttribute& attribute) {
+        return vk::VertexInputAttributeDescription(get_vertex_location(attribute.semantic), 0, get_vk_vertex_format(attribute.format), attribute.offset);
+    });
+
+    desc.vertex_bindings.push_back(vk::VertexInputBindingDescription(binding, get_vertex_stride<V>(), rate));
+    for (auto attribute : attributes)
+        desc.vertex_attributes.push_back(attribute.setBinding(binding));
+}
+
+/*
+ * Deduplication of pipelines and everything they are built from.
+ * Each request is canonicalized and hashed, identical requests return the same object, so that thousands of materials only
+ * pay for their unique states. Render passes, shader modules, descriptor set layouts and pipeline layouts come from the
+ * registry too, it owns all of them, which makes their handles canonical in the keys of the objects built on top of them.
+ *
+ * Looking up existing states is lock-free. Pipelines are compiled in the background, a request returns right away and the
+ * pipeline is ready some time later.
+ */
+class VulkanPipelineRegistry {
+public:
+    /*
+     * The compiler has to outlive the registry.
+     */
+    void initialize(const vk::Device& device, PipelineCompiler& compiler);
+
+    /*
+     * The cache pipelines are compiled with, it has to be set before any pipeline is requested.
+     */
+    void set_pipeline_cache(const vk::PipelineCache& cache) { m_pipeline_cache = cache; }
+
+    /*
+     * Destroy everything created by the registry, the compiler has to be idle and GPU can't be using any of them.
+     */
+    void shutdown();
+
+    /*
+     * A shader module of the SPIR-V code.
+     */
+    vk::ShaderModule get_shader_module(const uint32_t* code, const size_t size);
+
+    /*
+     * A render pass of the description. Render passes only differing in load and store operations or layouts are
+     * compatible, pipelines are shared between them.
+     */
+    vk::RenderPass get_render_pass(const vk::RenderPassCreateInfo& info);
+
+    /*
+     * A descriptor set layout of the bindings, the order of the bindings doesn't matter.
+     */
+    vk::DescriptorSetLayout get_descriptor_set_layout(const vk::DescriptorSetLayoutCreateInfo& info);
+
+    /*
+     * A pipeline layout, the descriptor set layouts have to come from the registry.
+     */
+    vk::PipelineLayout get_pipeline_layout(const vk::PipelineLayoutCreateInfo& info);
+
+    /*
+     * A graphics pipeline, the shader modules, the layout and the render pass have to come from the registry. The name has to be
+     * a string literal, it is only used by the first request of the state. A request never fails, a pipeline failing to
+     * compile ends up as failed instead.
+     */
+    std::shared_ptr<VulkanPipeline> get_graphics_pipeline(const VulkanPipelineDesc& desc, const char* name);
+
+    /*
+     * A compute pipeline, it is requested and compiled the same way as graphics pipelines. The entry of the shader is 'main'.
+     */
+    std::shared_ptr<VulkanPipeline> get_compute_pipeline(const vk::ShaderModule& cs, const vk::PipelineLayout& layout, const char* name);
+
+    /*
+     * Counters of the pipeline requests.
+     */
+    StateCacheStats get_pipeline_stats() const { return m_pipelines.get_stats(); }
+
+private:
+    // A render pass along with what makes two render passes compatible.
+    struct RenderPass {
+        vk::RenderPass  render_pass;
+        StateKey        compatibility;
+    };
+
+    vk::Device                                      m_device;
+    vk::PipelineCache                               m_pipeline_cache;
+    PipelineCompiler*                               m_compiler = nullptr;
+
+    StateCache<vk::ShaderModule>                    m_shader_modules;
+    StateCache<RenderPass>                          m_render_passes;
+    // compatibility of each render pass, looked up by its handle
+    StateCache<StateKey>                            m_render_pass_compatibility;
+    StateCache<vk::DescriptorSetLayout>             m_descriptor_set_layouts;
+    StateCache<vk::PipelineLayout>                  m_pipeline_layouts;
+    StateCache<std::shared_ptr<VulkanPipeline>>     m_pipelines;
+};
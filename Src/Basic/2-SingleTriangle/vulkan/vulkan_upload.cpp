@@ -0,0 +1,194 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#include <string.h>
+#include "vulkan_upload.h"
+
+bool VulkanUploader::initialize(const vk::Device& device, VulkanMemoryAllocator& allocator, const uint32_t transfer_queue_family, const vk::Queue& transfer_queue,
+                                const uint32_t graphics_queue_family, std::mutex& queue_mutex) {
+    m_device = device;
+    m_allocator = &allocator;
+    m_queue = transfer_queue;
+    m_queue_families[0] = transfer_queue_family;
+    m_queue_families[1] = graphics_queue_family;
+    m_queue_mutex = &queue_mutex;
+
+    // command buffers are recorded once and freed as soon as the batch is done
+    auto const cmd_pool_info = vk::CommandPoolCreateInfo()
+        .setQueueFamilyIndex(transfer_queue_family)
+        .setFlags(vk::CommandPoolCreateFlagBits::eTransient);
+    auto result = m_device.createCommandPool(&cmd_pool_info, nullptr, &m_cmd_pool);
+    return result == vk::Result::eSuccess;
+}
+
+void VulkanUploader::shutdown() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    if (m_recording) {
+        m_recording->cmd.end();
+        free_batch(*m_recording);
+        m_recording = nullptr;
+    }
+
+    for (auto& batch : m_in_flight) {
+        m_device.waitForFences(1, &batch->fence, VK_TRUE, UINT64_MAX);
+        free_batch(*batch);
+    }
+    m_in_flight.clear();
+
+    if (m_cmd_pool)
+        m_device.destroyCommandPool(m_cmd_pool, nullptr);
+    m_cmd_pool = vk::CommandPool();
+}
+
+vk::BufferCreateInfo& VulkanUploader::share_with_graphics(vk::BufferCreateInfo& info) const {
+    if (m_queue_families[0] == m_queue_families[1])
+        return info.setSharingMode(vk::SharingMode::eExclusive).setQueueFamilyIndexCount(0);
+
+    return info.setSharingMode(vk::SharingMode::eConcurrent)
+               .setQueueFamilyIndexCount(2)
+               .setPQueueFamilyIndices(m_queue_families);
+}
+
+bool VulkanUploader::begin_batch() {
+    auto batch = std::make_unique<Batch>();
+
+    auto const cmd_info = vk::CommandBufferAllocateInfo()
+        .setCommandPool(m_cmd_pool)
+        .setLevel(vk::CommandBufferLevel::ePrimary)
+        .setCommandBufferCount(1);
+    auto result = m_device.allocateCommandBuffers(&cmd_info, &batch->cmd);
+    if (result != vk::Result::eSuccess)
+        return false;
+
+    auto const fence_info = vk::FenceCreateInfo();
+    auto const semaphore_info = vk::SemaphoreCreateInfo();
+    if (m_device.createFence(&fence_info, nullptr, &batch->fence) != vk::Result::eSuccess ||
+        m_device.createSemaphore(&semaphore_info, nullptr, &batch->semaphore) != vk::Result::eSuccess) {
+        free_batch(*batch);
+        return false;
+    }
+
+    auto const begin_info = vk::CommandBufferBeginInfo().setFlags(vk::CommandBufferUsageFlagBits::eOneTimeSubmit);
+    result = batch->cmd.begin(&begin_info);
+    if (result != vk::Result::eSuccess) {
+        free_batch(*batch);
+        return false;
+    }
+
+    m_recording = std::move(batch);
+    return true;
+}
+
+void VulkanUploader::free_batch(Batch& batch) {
+    for (auto& staging : batch.staging)
+        m_allocator->destroy_buffer(staging.first, staging.second);
+    batch.staging.clear();
+
+    if (batch.cmd)
+        m_device.freeCommandBuffers(m_cmd_pool, { batch.cmd });
+    if (batch.fence)
+        m_device.destroyFence(batch.fence, nullptr);
+    if (batch.semaphore)
+        m_device.destroySemaphore(batch.semaphore, nullptr);
+}
+
+bool VulkanUploader::upload_buffer(const vk::Buffer& dst, const vk::DeviceSize offset, const void* data, const vk::DeviceSize size) {
+    // Writing the staging buffer doesn't need the lock, only the batch does.
+    auto const buf_info = vk::BufferCreateInfo()
+        .setUsage(vk::BufferUsageFlagBits::eTransferSrc)
+        .setSharingMode(vk::SharingMode::eExclusive)
+        .setSize(size);
+
+    vk::Buffer staging;
+    VulkanAllocation allocation;
+    if (!m_allocator->create_buffer(buf_info, vk::MemoryPropertyFlagBits::eHostVisible | vk::MemoryPropertyFlagBits::eHostCoherent, staging, allocation))
+        return false;
+    memcpy(allocation.mapped, data, (size_t)size);
+
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_recording && !begin_batch()) {
+        m_allocator->destroy_buffer(staging, allocation);
+        return false;
+    }
+
+    auto const region = vk::BufferCopy().setSrcOffset(0).setDstOffset(offset).setSize(size);
+    m_recording->cmd.copyBuffer(staging, dst, 1, &region);
+    m_recording->staging.push_back(std::make_pair(staging, allocation));
+    return true;
+}
+
+unsigned long long VulkanUploader::submit() {
+    std::lock_guard<std::mutex> lock(m_mutex);
+    if (!m_recording)
+        return 0;
+
+    auto batch = std::move(m_recording);
+    batch->cmd.end();
+
+    // The semaphore makes the copies visible to the graphics queue, there is no ownership to transfer since the destination
+    // buffers are either shared concurrently or owned by the same queue family.
+    auto const submit_info = vk::SubmitInfo()
+        .setCommandBufferCount(1)
+        .setPCommandBuffers(&batch->cmd)
+        .setSignalSemaphoreCount(1)
+        .setPSignalSemaphores(&batch->semaphore);
+
+    vk::Result result;
+    {
+        std::lock_guard<std::mutex> queue_lock(*m_queue_mutex);
+        result = m_queue.submit(1, &submit_info, batch->fence);
+    }
+    if (result != vk::Result::eSuccess) {
+        free_batch(*batch);
+        return 0;
+    }
+
+    batch->ticket = m_next_ticket++;
+    const auto ticket = batch->ticket;
+    m_in_flight.push_back(std::move(batch));
+    return ticket;
+}
+
+bool VulkanUploader::is_complete(const unsigned long long ticket) const {
+    return ticket <= m_completed_ticket.load(std::memory_order_acquire);
+}
+
+void VulkanUploader::take_wait_semaphores(const unsigned long long graphics_serial, std::vector<vk::Semaphore>& semaphores) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // A binary semaphore can only be waited once, later submissions are ordered after this one on the graphics queue anyway.
+    for (auto& batch : m_in_flight) {
+        if (batch->graphics_serial)
+            continue;
+        batch->graphics_serial = graphics_serial;
+        semaphores.push_back(batch->semaphore);
+    }
+}
+
+void VulkanUploader::poll(const unsigned long long completed_graphics_serial) {
+    std::lock_guard<std::mutex> lock(m_mutex);
+
+    // batches are done in order on the transfer queue
+    for (auto& batch : m_in_flight) {
+        if (batch->ticket <= m_completed_ticket.load(std::memory_order_relaxed))
+            continue;
+        if (m_device.getFenceStatus(batch->fence) != vk::Result::eSuccess)
+            break;
+        m_completed_ticket.store(batch->ticket, std::memory_order_release);
+    }
+
+    // The semaphore of a batch can't be destroyed until the graphics submission waiting for it is done as well.
+    while (!m_in_flight.empty()) {
+        auto& batch = m_in_flight.front();
+        if (batch->ticket > m_completed_ticket.load(std::memory_order_relaxed))
+            break;
+        if (batch->graphics_serial == 0 || batch->graphics_serial > completed_graphics_serial)
+            break;
+
+        free_batch(*batch);
+        m_in_flight.pop_front();
+    }
+}
@@ -0,0 +1,105 @@
+//
+//  This file is a part of Jiayin's Graphics Samples.
+//  Copyright(c) 2020 - 2020 by Jiayin Cao - All rights reserved.
+//
+
+#pragma once
+
+#include <deque>
+#include <mutex>
+#include <atomic>
+#include <vector>
+#include <memory>
+#include "vulkan_include.h"
+#include "vulkan_memory.h"
+
+/*
+ * Streaming uploads into device local memory.
+ * Data is copied into host visible staging buffers first, the copies into the destination buffers are recorded into a
+ * batch, which is submitted to a transfer queue. Nothing blocks on CPU, each batch signals a fence for recycling its staging
+ * buffers and a semaphore, which the next graphics submission waits for before touching the uploaded data.
+ *
+ * The transfer queue is a dedicated one if the device has it. Otherwise it shares the queue family with graphics, or even the
+ * queue itself, in which case submissions are serialized through the queue mutex.
+ */
+class VulkanUploader {
+public:
+    /*
+     * Create the command pool of the transfer queue. The queue mutex has to be locked by anyone submitting to the same queue.
+     */
+    bool initialize(const vk::Device& device, VulkanMemoryAllocator& allocator, const uint32_t transfer_queue_family, const vk::Queue& transfer_queue,
+                    const uint32_t graphics_queue_family, std::mutex& queue_mutex);
+
+    /*
+     * Wait for all uploads and free everything, it is only safe when graphics queue is idle too.
+     */
+    void shutdown();
+
+    /*
+     * Make a buffer accessible from both the transfer queue and the graphics queue if they are from different families, so that
+     * there is no need to transfer the ownership of the buffer after uploading.
+     */
+    vk::BufferCreateInfo& share_with_graphics(vk::BufferCreateInfo& info) const;
+
+    /*
+     * Copy the data into a staging buffer and record the copy into the destination buffer, which needs 'eTransferDst' usage.
+     * Nothing is submitted until 'submit' is called.
+     */
+    bool upload_buffer(const vk::Buffer& dst, const vk::DeviceSize offset, const void* data, const vk::DeviceSize size);
+
+    /*
+     * Submit all uploads recorded so far, the returned ticket can be checked with 'is_complete'. 0 means there was nothing
+     * to submit.
+     */
+    unsigned long long submit();
+
+    /*
+     * Whether the uploads of the ticket are already done on the transfer queue.
+     */
+    bool is_complete(const unsigned long long ticket) const;
+
+    /*
+     * Semaphores of the submitted uploads that no graphics submission waits for yet, the graphics submission with the serial
+     * has to wait for them.
+     */
+    void take_wait_semaphores(const unsigned long long graphics_serial, std::vector<vk::Semaphore>& semaphores);
+
+    /*
+     * Recycle the batches that are done on both queues, it never waits.
+     */
+    void poll(const unsigned long long completed_graphics_serial);
+
+private:
+    // Everything of a submission to the transfer queue.
+    struct Batch {
+        unsigned long long                                  ticket = 0;
+        vk::CommandBuffer                                   cmd;
+        vk::Fence                                           fence;
+        vk::Semaphore                                       semaphore;
+        // staging buffers can't be freed until the copies are done
+        std::vector<std::pair<vk::Buffer, VulkanAllocation>> staging;
+        // serial of the graphics submission waiting for the semaphore, 0 means none yet
+        unsigned long long                                  graphics_serial = 0;
+    };
+
+    bool begin_batch();
+    void free_batch(Batch& batch);
+
+    vk::Device                              m_device;
+    VulkanMemoryAllocator*                  m_allocator = nullptr;
+    vk::Queue                               m_queue;
+    vk::CommandPool                         m_cmd_pool;
+    uint32_t                                m_queue_families[2] = { 0, 0 };
+    std::mutex*                             m_queue_mutex = nullptr;
+
+    // the batch recording uploads, it is submitted as a whole
+    std::unique_ptr<Batch>                  m_recording;
+    // batches submitted to the transfer queue, in order of submission
+    std::deque<std::unique_ptr<Batch>>      m_in_flight;
+    unsigned long long                      m_next_ticket = 1;
+    // every ticket up to this one is done on the transfer queue
+    std::atomic<unsigned long long>         m_completed_ticket{ 0 };
+
+    // uploads could come from loading threads
+    std::mutex                              m_mutex;
+};